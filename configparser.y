@@ -111,6 +111,13 @@ struct component {
 %token VAR_IPV6_EDNS_SIZE
 %token VAR_STATISTICS
 %token VAR_XFRD_RELOAD_TIMEOUT
+%token VAR_RELOAD_COW_STATS
+%token VAR_RELOAD_INCREMENTAL
+%token VAR_ZONE_SHARDS
+%token VAR_NSEC3_PRECOMPILE_PROCESSES
+%token VAR_NSEC3_HASH_CACHE
+%token VAR_NSEC3_PROOF_CACHE_SIZE
+%token VAR_XFR_CHECK_PROCESSES
 %token VAR_LOG_TIME_ASCII
 %token VAR_LOG_TIME_ISO
 %token VAR_ROUND_ROBIN
@@ -120,12 +127,14 @@ struct component {
 %token VAR_RELOAD_CONFIG
 %token VAR_ZONEFILES_CHECK
 %token VAR_ZONEFILES_WRITE
+%token VAR_ZONEFILES_SNAPSHOT
 %token VAR_RRL_SIZE
 %token VAR_RRL_RATELIMIT
 %token VAR_RRL_SLIP
 %token VAR_RRL_IPV4_PREFIX_LENGTH
 %token VAR_RRL_IPV6_PREFIX_LENGTH
 %token VAR_RRL_WHITELIST_RATELIMIT
+%token VAR_RRL_SHARED
 %token VAR_TLS_SERVICE_KEY
 %token VAR_TLS_SERVICE_PEM
 %token VAR_TLS_SERVICE_OCSP
@@ -141,10 +150,15 @@ struct component {
 %token VAR_DROP_UPDATES
 %token VAR_XFRD_TCP_MAX
 %token VAR_XFRD_TCP_PIPELINE
+%token VAR_XFRD_XFR_BUFFER_SIZE
+%token VAR_XFRD_UDP_PER_PRIMARY
+%token VAR_XFRD_TCP_IDLE_TIMEOUT
+%token VAR_XFRD_TCP_POOL_SIZE
 %token VAR_METRICS_ENABLE
 %token VAR_METRICS_INTERFACE
 %token VAR_METRICS_PORT
 %token VAR_METRICS_PATH
+%token VAR_METRICS_CACHE_TIME
 
 /* dnstap */
 %token VAR_DNSTAP
@@ -162,6 +176,12 @@ struct component {
 %token VAR_DNSTAP_VERSION
 %token VAR_DNSTAP_LOG_AUTH_QUERY_MESSAGES
 %token VAR_DNSTAP_LOG_AUTH_RESPONSE_MESSAGES
+%token VAR_DNSTAP_SAMPLE_RATE
+%token VAR_DNSTAP_LOG_ZONES
+%token VAR_DNSTAP_LOG_QTYPES
+%token VAR_DNSTAP_LOG_RCODES
+%token VAR_DNSTAP_LOG_CLIENTS
+%token VAR_DNSTAP_LOG_TRANSPORTS
 
 /* remote-control */
 %token VAR_REMOTE_CONTROL
@@ -210,11 +230,14 @@ struct component {
 %token VAR_MIN_EXPIRE_TIME
 %token VAR_MULTI_PRIMARY_CHECK
 %token VAR_SIZE_LIMIT_XFR
+%token VAR_RELOAD_MAX_STALENESS
 %token VAR_ZONESTATS
 %token VAR_INCLUDE_PATTERN
 %token VAR_STORE_IXFR
 %token VAR_IXFR_SIZE
 %token VAR_IXFR_NUMBER
+%token VAR_IXFR_COMPRESS
+%token VAR_IXFR_CONDENSE
 %token VAR_CREATE_IXFR
 %token VAR_CATALOG
 %token VAR_CATALOG_MEMBER_PATTERN
@@ -428,6 +451,30 @@ server_option:
     { cfg_parser->opt->xfrdir = region_strdup(cfg_parser->opt->region, $2); }
   | VAR_XFRD_RELOAD_TIMEOUT number
     { cfg_parser->opt->xfrd_reload_timeout = (int)$2; }
+  | VAR_RELOAD_COW_STATS boolean
+    { cfg_parser->opt->reload_cow_stats = $2; }
+  | VAR_RELOAD_INCREMENTAL number
+    { cfg_parser->opt->reload_incremental = (size_t)$2; }
+  | VAR_ZONE_SHARDS number
+    { cfg_parser->opt->zone_shards = (int)$2; }
+  | VAR_NSEC3_PRECOMPILE_PROCESSES number
+    {
+      if($2 < 1)
+        yyerror("expected a number greater than zero");
+      else
+        cfg_parser->opt->nsec3_precompile_processes = (int)$2;
+    }
+  | VAR_NSEC3_HASH_CACHE boolean
+    { cfg_parser->opt->nsec3_hash_cache = $2; }
+  | VAR_NSEC3_PROOF_CACHE_SIZE number
+    { cfg_parser->opt->nsec3_proof_cache_size = (size_t)$2; }
+  | VAR_XFR_CHECK_PROCESSES number
+    {
+      if($2 < 1)
+        yyerror("expected a number greater than zero");
+      else
+        cfg_parser->opt->xfr_check_processes = (int)$2;
+    }
   | VAR_VERBOSITY number
     { cfg_parser->opt->verbosity = (int)$2; }
   | VAR_RRL_SIZE number
@@ -476,6 +523,12 @@ server_option:
     {
 #ifdef RATELIMIT
       cfg_parser->opt->rrl_whitelist_ratelimit = (size_t)$2;
+#endif
+    }
+  | VAR_RRL_SHARED boolean
+    {
+#ifdef RATELIMIT
+      cfg_parser->opt->rrl_shared = $2;
 #endif
     }
   | VAR_RELOAD_CONFIG boolean
@@ -484,6 +537,8 @@ server_option:
     { cfg_parser->opt->zonefiles_check = $2; }
   | VAR_ZONEFILES_WRITE number
     { cfg_parser->opt->zonefiles_write = (int)$2; }
+  | VAR_ZONEFILES_SNAPSHOT boolean
+    { cfg_parser->opt->zonefiles_snapshot = $2; }
   | VAR_LOG_TIME_ASCII boolean
     {
       cfg_parser->opt->log_time_ascii = $2;
@@ -592,6 +647,19 @@ server_option:
     { cfg_parser->opt->xfrd_tcp_max = (int)$2; }
   | VAR_XFRD_TCP_PIPELINE number
     { cfg_parser->opt->xfrd_tcp_pipeline = (int)$2; }
+  | VAR_XFRD_XFR_BUFFER_SIZE number
+    { cfg_parser->opt->xfrd_xfr_buffer_size = (int)$2; }
+  | VAR_XFRD_UDP_PER_PRIMARY number
+    {
+      if($2 == 0)
+        yyerror("expected a number greater than zero");
+      else
+        cfg_parser->opt->xfrd_udp_per_primary = (int)$2;
+    }
+  | VAR_XFRD_TCP_IDLE_TIMEOUT number
+    { cfg_parser->opt->xfrd_tcp_idle_timeout = (int)$2; }
+  | VAR_XFRD_TCP_POOL_SIZE number
+    { cfg_parser->opt->xfrd_tcp_pool_size = (int)$2; }
   | VAR_CPU_AFFINITY cpus
     {
       cfg_parser->opt->cpu_affinity = $2;
@@ -686,6 +754,12 @@ server_option:
     {
 #ifdef USE_METRICS
       cfg_parser->opt->metrics_path = region_strdup(cfg_parser->opt->region, $2);
+#endif /* USE_METRICS */
+    }
+  | VAR_METRICS_CACHE_TIME number
+    {
+#ifdef USE_METRICS
+      cfg_parser->opt->metrics_cache_time = (int)$2;
 #endif /* USE_METRICS */
     }
   ;
@@ -810,6 +884,18 @@ dnstap_option:
     { cfg_parser->opt->dnstap_log_auth_query_messages = $2; }
   | VAR_DNSTAP_LOG_AUTH_RESPONSE_MESSAGES boolean
     { cfg_parser->opt->dnstap_log_auth_response_messages = $2; }
+  | VAR_DNSTAP_SAMPLE_RATE number
+    { cfg_parser->opt->dnstap_sample_rate = (int)$2; }
+  | VAR_DNSTAP_LOG_ZONES STRING
+    { cfg_parser->opt->dnstap_log_zones = region_strdup(cfg_parser->opt->region, $2); }
+  | VAR_DNSTAP_LOG_QTYPES STRING
+    { cfg_parser->opt->dnstap_log_qtypes = region_strdup(cfg_parser->opt->region, $2); }
+  | VAR_DNSTAP_LOG_RCODES STRING
+    { cfg_parser->opt->dnstap_log_rcodes = region_strdup(cfg_parser->opt->region, $2); }
+  | VAR_DNSTAP_LOG_CLIENTS STRING
+    { cfg_parser->opt->dnstap_log_clients = region_strdup(cfg_parser->opt->region, $2); }
+  | VAR_DNSTAP_LOG_TRANSPORTS STRING
+    { cfg_parser->opt->dnstap_log_transports = region_strdup(cfg_parser->opt->region, $2); }
   ;
 
 remote_control:
@@ -1063,6 +1149,8 @@ pattern_or_zone_option:
         yyerror("expected a number greater than zero");
       }
     }
+  | VAR_RELOAD_MAX_STALENESS number
+    { cfg_parser->pattern->reload_max_staleness = (uint32_t)$2; }
   | VAR_MULTI_PRIMARY_CHECK boolean
     { cfg_parser->pattern->multi_primary_check = (int)$2; }
   | VAR_INCLUDE_PATTERN STRING
@@ -1190,6 +1278,16 @@ pattern_or_zone_option:
       cfg_parser->pattern->ixfr_number = $2;
       cfg_parser->pattern->ixfr_number_is_default = 0;
     }
+  | VAR_IXFR_COMPRESS boolean
+    {
+      cfg_parser->pattern->ixfr_compress = $2;
+      cfg_parser->pattern->ixfr_compress_is_default = 0;
+    }
+  | VAR_IXFR_CONDENSE boolean
+    {
+      cfg_parser->pattern->ixfr_condense = $2;
+      cfg_parser->pattern->ixfr_condense_is_default = 0;
+    }
   | VAR_CREATE_IXFR boolean
     {
       cfg_parser->pattern->create_ixfr = $2;
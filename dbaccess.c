@@ -17,6 +17,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif /* HAVE_MMAP */
 
 #include "dns.h"
 #include "namedb.h"
@@ -30,6 +33,7 @@
 #include "nsd.h"
 #include "ixfr.h"
 #include "ixfrcreate.h"
+#include "lookup3.h"
 
 void
 namedb_close(struct namedb* db)
@@ -48,6 +52,32 @@ namedb_free_ixfr(struct namedb* db)
 	}
 }
 
+void
+namedb_ixfr_condense(struct namedb* db)
+{
+	struct radnode* n;
+	for(n=radix_first(db->zonetree); n; n=radix_next(n))
+		zone_ixfr_make_condensed((zone_type*)n->elem);
+}
+
+void
+namedb_ixfr_sizes(struct namedb* db, uint64_t* mem, uint64_t* disk,
+	uint64_t* condensed)
+{
+	struct radnode* n;
+	*mem = 0;
+	*disk = 0;
+	*condensed = 0;
+	for(n=radix_first(db->zonetree); n; n=radix_next(n)) {
+		struct zone_ixfr* ixfr = ((zone_type*)n->elem)->ixfr;
+		if(!ixfr)
+			continue;
+		*mem += ixfr->total_size;
+		*disk += ixfr->file_size;
+		*condensed += ixfr->condensed_size;
+	}
+}
+
 /** create a zone */
 zone_type*
 namedb_zone_create(namedb_type* db, const dname_type* dname,
@@ -119,6 +149,27 @@ namedb_zone_free_filenames(namedb_type *db, zone_type* zone)
 	}
 }
 
+size_t
+namedb_use_zone_shard(namedb_type* db, zone_type* zone)
+{
+	const dname_type* apex;
+	size_t shard;
+	if(db->shards == 0)
+		return 0;
+	apex = domain_dname(zone->apex);
+	shard = 1 + hashlittle(dname_name(apex), apex->name_size, 0)
+		% db->shards;
+	return region_use_arena(db->region, shard);
+}
+
+void
+namedb_use_shard(namedb_type* db, size_t shard)
+{
+	if(db->shards == 0)
+		return;
+	(void)region_use_arena(db->region, shard);
+}
+
 void
 namedb_zone_delete(namedb_type* db, zone_type* zone)
 {
@@ -177,8 +228,6 @@ namedb_open (struct nsd_options* opt)
 	 */
 	region_type* db_region;
 
-	(void)opt;
-
 #ifdef USE_MMAP_ALLOC
 	db_region = region_create_custom(mmap_alloc, mmap_free, MMAP_ALLOC_CHUNK_SIZE,
 		MMAP_ALLOC_LARGE_OBJECT_SIZE, MMAP_ALLOC_INITIAL_CLEANUP_SIZE, 1);
@@ -188,6 +237,15 @@ namedb_open (struct nsd_options* opt)
 #endif /* !USE_MMAP_ALLOC */
 	db = (namedb_type *) region_alloc(db_region, sizeof(struct namedb));
 	db->region = db_region;
+	db->shards = 0;
+	db->nsec3_precompile_processes = (opt?opt->nsec3_precompile_processes:1);
+	db->nsec3_hash_cache = (opt?opt->nsec3_hash_cache:0);
+	if(opt && opt->zone_shards > 0) {
+		/* arena 0 is for the data that is not in a zone shard */
+		if(region_set_arenas(db_region, opt->zone_shards + 1))
+			db->shards = opt->zone_shards;
+		else	log_msg(LOG_ERR, "could not allocate zone shards");
+	}
 	db->domains = domain_table_create(db->region);
 	db->zonetree = radix_tree_create(db->region);
 	db->diff_skip = 0;
@@ -225,6 +283,202 @@ file_get_mtime(const char* file, struct timespec* mtime, int* nonexist)
 	return 1;
 }
 
+/** read an RRset from the snapshot and add it to the domain */
+static int
+read_snapshot_rrset(namedb_type* db, zone_type* zone, domain_type* domain,
+	buffer_type* packet)
+{
+	const nsd_type_descriptor_type *descriptor;
+	rrset_type* rrset;
+	uint16_t type, klass, rr_count, i;
+	if(!buffer_available(packet, 6))
+		return 0;
+	type = buffer_read_u16(packet);
+	klass = buffer_read_u16(packet);
+	rr_count = buffer_read_u16(packet);
+	if(rr_count == 0 || domain_find_rrset(domain, zone, type))
+		return 0;
+	rrset = region_alloc(db->region, sizeof(*rrset)
+#ifdef PACKED_STRUCTS
+		+ sizeof(rr_type*) * rr_count /* Add space for RRs. */
+#endif
+		);
+	rrset->zone = zone;
+	rrset->rr_count = 0;
+#ifndef PACKED_STRUCTS
+	rrset->rrs = region_alloc_array(db->region, rr_count,
+		sizeof(rr_type*));
+#endif
+	descriptor = nsd_type_descriptor(type);
+	for(i=0; i<rr_count; i++) {
+		buffer_type rdata;
+		uint32_t ttl;
+		uint16_t rdlength;
+		rr_type* rr;
+		if(!buffer_available(packet, 6))
+			break;
+		ttl = buffer_read_u32(packet);
+		rdlength = buffer_read_u16(packet);
+		if(!buffer_available(packet, rdlength))
+			break;
+		buffer_create_from(&rdata, buffer_current(packet), rdlength);
+		buffer_skip(packet, rdlength);
+		if(descriptor->read_rdata(db->domains, rdlength, &rdata,
+			&rr) < 0)
+			break;
+		rr->owner = domain;
+		rr->type = type;
+		rr->klass = klass;
+		rr->ttl = ttl;
+		rrset->rrs[rrset->rr_count++] = rr;
+	}
+	/* added to the domain also when short, so that the caller can
+	 * wipe the zone contents on failure */
+	if(rrset->rr_count == 0) {
+#ifndef PACKED_STRUCTS
+		region_recycle(db->region, rrset->rrs,
+			sizeof(rr_type*) * rr_count);
+#endif
+		region_recycle(db->region, rrset, sizeof(*rrset)
+#ifdef PACKED_STRUCTS
+			+ sizeof(rr_type*) * rr_count
+#endif
+			);
+		return 0;
+	}
+	domain_add_rrset(domain, rrset);
+	if(domain == zone->apex)
+		apex_rrset_checks(db, rrset, domain);
+	return rrset->rr_count == rr_count;
+}
+
+/** read the snapshot body, the domains with their RRsets, into the zone */
+static int
+read_snapshot_body(namedb_type* db, zone_type* zone, uint8_t* data,
+	size_t len)
+{
+	buffer_type packet;
+	buffer_create_from(&packet, data, len);
+	while(buffer_remaining(&packet) > 0) {
+		struct dname_buffer owner;
+		uint8_t name[MAXDOMAINLEN+1];
+		domain_type* domain;
+		uint16_t rrsets, i;
+		uint8_t namelen = buffer_read_u8(&packet);
+		if(!buffer_available(&packet, (size_t)namelen+2) ||
+			buf_dname_length(buffer_current(&packet), namelen)
+			!= namelen)
+			return 0;
+		buffer_read(&packet, name, namelen);
+		if(!dname_make_buffered(&owner, name, 1) ||
+			!dname_is_subdomain(&owner.dname,
+			domain_dname(zone->apex)))
+			return 0;
+		domain = domain_table_insert(db->domains, &owner.dname);
+		rrsets = buffer_read_u16(&packet);
+		for(i=0; i<rrsets; i++) {
+			if(!read_snapshot_rrset(db, zone, domain, &packet))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+int
+namedb_read_zone_snapshot(namedb_type* db, zone_type* zone,
+	const char* zfile)
+{
+	char snapfile[4096];
+	uint8_t hdr[ZONE_SNAPSHOT_HEADER_SIZE];
+	uint8_t* data;
+	uint64_t bodysize;
+	uint32_t nsec = 0, rrcount, crc;
+	struct stat zs, ss;
+	int fd, ret;
+	snprintf(snapfile, sizeof(snapfile), "%s%s", zfile,
+		ZONE_SNAPSHOT_SUFFIX);
+	if(stat(zfile, &zs) != 0 || stat(snapfile, &ss) != 0)
+		return 0;
+#ifdef HAVE_STRUCT_STAT_ST_MTIMENSEC
+	nsec = (uint32_t)zs.st_mtimensec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+	nsec = (uint32_t)zs.st_mtim.tv_nsec;
+#endif
+	if((fd = open(snapfile, O_RDONLY)) == -1) {
+		log_msg(LOG_ERR, "cannot open %s: %s", snapfile,
+			strerror(errno));
+		return 0;
+	}
+	if(read(fd, hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr) ||
+		read_uint32(hdr) != ZONE_SNAPSHOT_MAGIC ||
+		read_uint32(hdr+4) != ZONE_SNAPSHOT_VERSION) {
+		log_msg(LOG_WARNING, "zone %s snapshot %s has a bad header, "
+			"reading zonefile", zone->opts->name, snapfile);
+		close(fd);
+		return 0;
+	}
+	bodysize = read_uint64(hdr+32);
+	if(read_uint64(hdr+8) != (uint64_t)zs.st_mtime ||
+		read_uint32(hdr+16) != nsec ||
+		read_uint64(hdr+20) != (uint64_t)zs.st_size ||
+		bodysize != (uint64_t)ss.st_size - sizeof(hdr)) {
+		VERBOSITY(3, (LOG_INFO, "zone %s snapshot %s is stale, "
+			"reading zonefile", zone->opts->name, snapfile));
+		close(fd);
+		return 0;
+	}
+	rrcount = read_uint32(hdr+28);
+	if(bodysize == 0) {
+		close(fd);
+		return 0;
+	}
+#ifdef HAVE_MMAP
+	data = mmap(NULL, (size_t)ss.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		log_msg(LOG_ERR, "mmap %s: %s", snapfile, strerror(errno));
+		return 0;
+	}
+#else
+	data = xalloc((size_t)ss.st_size);
+	memcpy(data, hdr, sizeof(hdr));
+	if(read(fd, data+sizeof(hdr), (size_t)bodysize) != (ssize_t)bodysize) {
+		log_msg(LOG_ERR, "read %s: %s", snapfile, strerror(errno));
+		close(fd);
+		free(data);
+		return 0;
+	}
+	close(fd);
+#endif /* HAVE_MMAP */
+	crc = ~compute_crc(0xffffffff, data+sizeof(hdr), (size_t)bodysize);
+	if(crc != read_uint32(hdr+40)) {
+		log_msg(LOG_WARNING, "zone %s snapshot %s has a bad checksum, "
+			"reading zonefile", zone->opts->name, snapfile);
+		ret = 0;
+	} else {
+		ret = read_snapshot_body(db, zone, data+sizeof(hdr),
+			(size_t)bodysize);
+		if(ret && (!zone->soa_rrset || zone->soa_rrset->rr_count == 0))
+			ret = 0;
+		if(!ret)
+			log_msg(LOG_WARNING, "zone %s snapshot %s is malformed, "
+				"reading zonefile", zone->opts->name,
+				snapfile);
+	}
+#ifdef HAVE_MMAP
+	munmap(data, (size_t)ss.st_size);
+#else
+	free(data);
+#endif
+	if(!ret) {
+		delete_zone_rrs(db, zone);
+		return 0;
+	}
+	VERBOSITY(2, (LOG_INFO, "zone %s read from snapshot %s, %u RRs",
+		zone->opts->name, snapfile, (unsigned)rrcount));
+	return 1;
+}
+
 void
 namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
 	udb_ptr* last_task)
@@ -235,6 +489,7 @@ namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
 	const char* fname;
 	struct ixfr_create* ixfrcr = NULL;
 	int ixfr_create_already_done = 0;
+	size_t shard;
 	if(!nsd->db || !zone || !zone->opts || !zone->opts->pattern->zonefile)
 		return;
 	mtime.tv_sec = 0;
@@ -305,6 +560,7 @@ namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
 		}
 	}
 
+	shard = namedb_use_zone_shard(nsd->db, zone);
 	namedb_zone_free_filenames(nsd->db, zone);
 	zone->filename = region_strdup(nsd->db->region, fname);
 
@@ -314,9 +570,15 @@ namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
 	zone->nsec3_param = NULL;
 #endif
 	delete_zone_rrs(nsd->db, zone);
-	VERBOSITY(5, (LOG_INFO, "zone %s zonec_read(%s)",
-		zone->opts->name, fname));
-	errors = zonec_read(nsd->db, nsd->db->domains, zone->opts->name, fname, zone);
+	if(nsd->options && nsd->options->zonefiles_snapshot &&
+		namedb_read_zone_snapshot(nsd->db, zone, fname)) {
+		errors = 0;
+	} else {
+		VERBOSITY(5, (LOG_INFO, "zone %s zonec_read(%s)",
+			zone->opts->name, fname));
+		errors = zonec_read(nsd->db, nsd->db->domains,
+			zone->opts->name, fname, zone);
+	}
 	if(errors > 0) {
 		log_msg(LOG_ERR, "zone %s file %s read with %u errors",
 			zone->opts->name, fname, errors);
@@ -362,6 +624,7 @@ namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
 #ifdef NSEC3
 	prehash_zone_complete(nsd->db, zone);
 #endif
+	namedb_use_shard(nsd->db, shard);
 }
 
 void namedb_check_zonefile(struct nsd* nsd, udb_base* taskudb,
@@ -386,4 +649,7 @@ void namedb_check_zonefiles(struct nsd* nsd, struct nsd_options* opt,
 		namedb_check_zonefile(nsd, taskudb, last_task, zo);
 		if(nsd->signal_hint_shutdown) break;
 	}
+#ifdef NSEC3
+	nsec3_hash_pool_stop();
+#endif
 }
@@ -22,6 +22,8 @@
 #include "options.h"
 #include "nsd.h"
 #include "ixfr.h"
+#include "rdata.h"
+#include "nsec3.h"
 
 /* pathname directory separator character */
 #define PATHSEP '/'
@@ -119,6 +121,144 @@ write_to_zonefile(zone_type* zone, const char* filename, const char* logs)
 	return 1;
 }
 
+/** write the RRsets of the zone at the domain to the snapshot */
+static int
+write_snapshot_domain(FILE* out, zone_type* zone, domain_type* domain,
+	uint32_t* crc, uint64_t* bodysize, uint32_t* rrcount)
+{
+	uint8_t buf[MAX_RDLENGTH+6];
+	const dname_type* dname = domain_dname(domain);
+	rrset_type* rrset;
+	uint16_t rrsets = 0;
+	uint8_t len;
+	for(rrset = domain->rrsets; rrset; rrset = rrset->next) {
+		if(rrset->zone == zone)
+			rrsets++;
+	}
+	if(rrsets == 0)
+		return 1;
+	len = (uint8_t)dname->name_size;
+	write_uint16(buf, rrsets);
+	if(!write_data_crc(out, &len, 1, crc) ||
+		!write_data_crc(out, dname_name(dname), len, crc) ||
+		!write_data_crc(out, buf, 2, crc))
+		return 0;
+	*bodysize += 1 + len + 2;
+	for(rrset = domain->rrsets; rrset; rrset = rrset->next) {
+		uint16_t i;
+		if(rrset->zone != zone)
+			continue;
+		write_uint16(buf, rrset_rrtype(rrset));
+		write_uint16(buf+2, rrset_rrclass(rrset));
+		write_uint16(buf+4, rrset->rr_count);
+		if(!write_data_crc(out, buf, 6, crc))
+			return 0;
+		*bodysize += 6;
+		for(i=0; i<rrset->rr_count; i++) {
+			rr_type* rr = rrset->rrs[i];
+			int32_t rdlen = rr_calculate_uncompressed_rdata_length(rr);
+			if(rdlen < 0 || rdlen + 6 > (int32_t)sizeof(buf)) {
+				log_msg(LOG_ERR, "zone %s snapshot: bad rdata "
+					"for %s %s", zone->opts->name,
+					domain_to_string(domain),
+					rrtype_to_string(rr->type));
+				return 0;
+			}
+			write_uint32(buf, rr->ttl);
+			write_uint16(buf+4, (uint16_t)rdlen);
+			rr_write_uncompressed_rdata(rr, buf+6, rdlen);
+			if(!write_data_crc(out, buf, 6+rdlen, crc))
+				return 0;
+			*bodysize += 6 + rdlen;
+			(*rrcount)++;
+		}
+	}
+	return 1;
+}
+
+/** write the snapshot header, with the zonefile stat and body summary */
+static int
+write_snapshot_header(FILE* out, struct stat* zs, uint32_t rrcount,
+	uint64_t bodysize, uint32_t crc)
+{
+	uint8_t hdr[ZONE_SNAPSHOT_HEADER_SIZE];
+	uint32_t nsec = 0;
+#ifdef HAVE_STRUCT_STAT_ST_MTIMENSEC
+	nsec = (uint32_t)zs->st_mtimensec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+	nsec = (uint32_t)zs->st_mtim.tv_nsec;
+#endif
+	write_uint32(hdr, ZONE_SNAPSHOT_MAGIC);
+	write_uint32(hdr+4, ZONE_SNAPSHOT_VERSION);
+	write_uint64(hdr+8, (uint64_t)zs->st_mtime);
+	write_uint32(hdr+16, nsec);
+	write_uint64(hdr+20, (uint64_t)zs->st_size);
+	write_uint32(hdr+28, rrcount);
+	write_uint64(hdr+32, bodysize);
+	write_uint32(hdr+40, crc);
+	return write_data(out, hdr, sizeof(hdr));
+}
+
+int
+namedb_write_zone_snapshot(zone_type* zone, const char* zfile)
+{
+	char snapfile[4096], tmpfile[sizeof(snapfile)+1];
+	domain_type* domain;
+	struct stat zs;
+	uint64_t bodysize = 0;
+	uint32_t rrcount = 0, crc = 0xffffffff;
+	FILE* out;
+	if(stat(zfile, &zs) != 0) {
+		log_msg(LOG_ERR, "cannot stat %s: %s", zfile, strerror(errno));
+		return 0;
+	}
+	snprintf(snapfile, sizeof(snapfile), "%s%s", zfile,
+		ZONE_SNAPSHOT_SUFFIX);
+	snprintf(tmpfile, sizeof(tmpfile), "%s~", snapfile);
+	out = fopen(tmpfile, "w");
+	if(!out) {
+		log_msg(LOG_ERR, "cannot write zone %s snapshot %s: %s",
+			zone->opts->name, tmpfile, strerror(errno));
+		return 0;
+	}
+	/* the header is written again when the crc is known */
+	if(!write_snapshot_header(out, &zs, 0, 0, 0))
+		goto fail;
+	/* go through entire tree below the zone apex (incl subzones) */
+	for(domain = zone->apex; domain &&
+		domain_is_subdomain(domain, zone->apex);
+		domain = domain_next(domain)) {
+		if(!write_snapshot_domain(out, zone, domain, &crc, &bodysize,
+			&rrcount))
+			goto fail;
+	}
+	crc = ~crc;
+	if(fseeko(out, 0, SEEK_SET) == -1 ||
+		!write_snapshot_header(out, &zs, rrcount, bodysize, crc))
+		goto fail;
+	if(fclose(out) != 0) {
+		log_msg(LOG_ERR, "cannot write zone %s snapshot %s: fclose: %s",
+			zone->opts->name, tmpfile, strerror(errno));
+		(void)unlink(tmpfile);
+		return 0;
+	}
+	if(rename(tmpfile, snapfile) == -1) {
+		log_msg(LOG_ERR, "rename(%s to %s) failed: %s",
+			tmpfile, snapfile, strerror(errno));
+		(void)unlink(tmpfile);
+		return 0;
+	}
+	VERBOSITY(3, (LOG_INFO, "zone %s snapshot written to %s, %u RRs",
+		zone->opts->name, snapfile, (unsigned)rrcount));
+	return 1;
+fail:
+	log_msg(LOG_ERR, "could not write zone %s snapshot %s",
+		zone->opts->name, tmpfile);
+	fclose(out);
+	(void)unlink(tmpfile);
+	return 0;
+}
+
 /** create directories above this file, .../dir/dir/dir/file */
 int
 create_dirs(const char* path)
@@ -234,6 +374,12 @@ namedb_write_zonefile(struct nsd* nsd, struct zone_options* zopt)
 			region_recycle(nsd->db->region, zone->logstr,
 				strlen(zone->logstr)+1);
 		zone->logstr = NULL;
+		if(nsd->options && nsd->options->zonefiles_snapshot)
+			(void)namedb_write_zone_snapshot(zone, zfile);
+#ifdef NSEC3
+		if(nsd->options && nsd->options->nsec3_hash_cache)
+			nsec3_hash_cache_write(zone, zfile);
+#endif
 		if(zone_is_ixfr_enabled(zone) && zone->ixfr)
 			ixfr_write_to_file(zone, zfile);
 	}
@@ -14,6 +14,10 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <inttypes.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif /* HAVE_MMAP */
 #include "difffile.h"
 #include "xfrd-disk.h"
 #include "util.h"
@@ -55,12 +59,58 @@ write_str(FILE *out, const char* str)
 	return write_data(out, str, len);
 }
 
+void
+diff_xfrfile_close(struct diff_xfrfile* xf)
+{
+	if(xf->df)
+		fclose(xf->df);
+	free(xf->buf);
+	xf->df = NULL;
+	xf->buf = NULL;
+}
+
+uint64_t
+diff_xfrfile_size(struct diff_xfrfile* xf)
+{
+	long pos;
+	if(!xf->df || (pos = ftell(xf->df)) == -1)
+		return 0;
+	return (uint64_t)pos;
+}
+
+/* open the diff file for the first packet and keep it open, with a write
+ * buffer of xfrd-xfr-buffer-size bytes */
+static FILE*
+diff_xfrfile_open(struct nsd* nsd, uint64_t filenumber,
+	struct diff_xfrfile* xf)
+{
+	size_t bufsize = (size_t)nsd->options->xfrd_xfr_buffer_size;
+	diff_xfrfile_close(xf);
+	if(!(xf->df = xfrd_open_xfrfile(nsd, filenumber, "w+")))
+		return NULL;
+	if(bufsize > BUFSIZ) {
+		xf->buf = xalloc(bufsize);
+		if(setvbuf(xf->df, xf->buf, _IOFBF, bufsize) != 0) {
+			free(xf->buf);
+			xf->buf = NULL;
+		}
+	} else if(bufsize == 0) {
+		setvbuf(xf->df, NULL, _IONBF, 0);
+	}
+	return xf->df;
+}
+
 void
 diff_write_packet(const char* zone, const char* pat, uint32_t old_serial,
 	uint32_t new_serial, uint32_t seq_nr, uint8_t* data, size_t len,
-	struct nsd* nsd, uint64_t filenumber)
+	struct nsd* nsd, uint64_t filenumber, struct diff_xfrfile* xf)
 {
-	FILE* df = xfrd_open_xfrfile(nsd, filenumber, seq_nr?"a":"w");
+	FILE* df;
+	if(xf && seq_nr == 0)
+		df = diff_xfrfile_open(nsd, filenumber, xf);
+	else if(xf && xf->df)
+		df = xf->df;
+	else	df = xfrd_open_xfrfile(nsd, filenumber, seq_nr?"a":"w");
 	if(!df) {
 		log_msg(LOG_ERR, "could not open transfer %s file %lld: %s",
 			zone, (long long)filenumber, strerror(errno));
@@ -87,7 +137,9 @@ diff_write_packet(const char* zone, const char* pat, uint32_t old_serial,
 			!write_str(df, pat)) {
 			log_msg(LOG_ERR, "could not write transfer %s file %lld: %s",
 				zone, (long long)filenumber, strerror(errno));
-			fclose(df);
+			if(xf && xf->df == df)
+				diff_xfrfile_close(xf);
+			else	fclose(df);
 			return;
 		}
 	}
@@ -100,13 +152,14 @@ diff_write_packet(const char* zone, const char* pat, uint32_t old_serial,
 		log_msg(LOG_ERR, "could not write transfer %s file %lld: %s",
 			zone, (long long)filenumber, strerror(errno));
 	}
-	fclose(df);
+	if(!xf || xf->df != df)
+		fclose(df);
 }
 
 void
 diff_write_commit(const char* zone, uint32_t old_serial, uint32_t new_serial,
 	uint32_t num_parts, uint8_t commit, const char* log_str,
-	struct nsd* nsd, uint64_t filenumber)
+	struct nsd* nsd, uint64_t filenumber, struct diff_xfrfile* xf)
 {
 	struct timeval tv;
 	FILE* df;
@@ -121,11 +174,30 @@ diff_write_commit(const char* zone, uint32_t old_serial, uint32_t new_serial,
 	 * also write old_serial and new_serial, so that a bad file mixup
 	 * will result in unusable serial numbers. */
 
-	df = xfrd_open_xfrfile(nsd, filenumber, "r+");
-	if(!df) {
-		log_msg(LOG_ERR, "could not open transfer %s file %lld: %s",
-			zone, (long long)filenumber, strerror(errno));
-		return;
+	if(xf && xf->df) {
+		/* the file is open at the end, append the log_str first,
+		 * the write buffer is flushed when it seeks to the start */
+		df = xf->df;
+		if(!write_str(df, log_str)) {
+			log_msg(LOG_ERR, "could not write transfer %s file %lld: %s",
+				zone, (long long)filenumber, strerror(errno));
+			diff_xfrfile_close(xf);
+			return;
+		}
+		if(fseek(df, 0, SEEK_SET) == -1) {
+			log_msg(LOG_ERR, "could not fseek transfer %s file %lld: %s",
+				zone, (long long)filenumber, strerror(errno));
+			diff_xfrfile_close(xf);
+			return;
+		}
+	} else {
+		xf = NULL;
+		df = xfrd_open_xfrfile(nsd, filenumber, "r+");
+		if(!df) {
+			log_msg(LOG_ERR, "could not open transfer %s file %lld: %s",
+				zone, (long long)filenumber, strerror(errno));
+			return;
+		}
 	}
 	if(!write_32(df, DIFF_PART_XFRF) ||
 		!write_8(df, commit) /* committed */ ||
@@ -137,7 +209,17 @@ diff_write_commit(const char* zone, uint32_t old_serial, uint32_t new_serial,
 	{
 		log_msg(LOG_ERR, "could not write transfer %s file %lld: %s",
 			zone, (long long)filenumber, strerror(errno));
-		fclose(df);
+		if(xf)
+			diff_xfrfile_close(xf);
+		else	fclose(df);
+		return;
+	}
+	if(xf) {
+		if(fflush(df) != 0) {
+			log_msg(LOG_ERR, "could not write transfer %s file %lld: %s",
+				zone, (long long)filenumber, strerror(errno));
+		}
+		diff_xfrfile_close(xf);
 		return;
 	}
 
@@ -1198,9 +1280,22 @@ delete_zone_rrs(namedb_type* db, zone_type* zone)
 	assert(zone->is_secure == 0);
 }
 
+/* read a 32bit value of the diff file from the mapped file, or the file */
+static int
+diff_map_read_32(FILE* in, buffer_type* map, uint32_t* result)
+{
+	if(!map)
+		return diff_read_32(in, result);
+	if(!buffer_available(map, sizeof(*result)))
+		return 0;
+	/* the diff file has the values in network order */
+	*result = buffer_read_u32(map);
+	return 1;
+}
+
 /* return value 0: syntaxerror,badIXFR, 1:OK, 2:done_and_skip_it */
 static int
-apply_ixfr(nsd_type* nsd, FILE *in, uint32_t serialno,
+apply_ixfr(nsd_type* nsd, FILE *in, buffer_type* map, uint32_t serialno,
 	uint32_t seq_nr, uint32_t seq_total,
 	int* is_axfr, int* delete_mode, int* rr_count,
 	struct zone* zone, uint64_t* bytes,
@@ -1209,6 +1304,7 @@ apply_ixfr(nsd_type* nsd, FILE *in, uint32_t serialno,
 	uint32_t msglen, checklen, pkttype;
 	int qcount, ancount;
 	buffer_type* packet;
+	buffer_type mapped_packet;
 	region_type* region;
 	struct collect_rrs collect_rrs;
 
@@ -1218,12 +1314,12 @@ apply_ixfr(nsd_type* nsd, FILE *in, uint32_t serialno,
 	 * something internal or a bad disk or something. */
 
 	/* read ixfr packet RRs and apply to in memory db */
-	if(!diff_read_32(in, &pkttype) || pkttype != DIFF_PART_XXFR) {
+	if(!diff_map_read_32(in, map, &pkttype) || pkttype != DIFF_PART_XXFR) {
 		log_msg(LOG_ERR, "could not read type or wrong type");
 		return 0;
 	}
 
-	if(!diff_read_32(in, &msglen)) {
+	if(!diff_map_read_32(in, map, &msglen)) {
 		log_msg(LOG_ERR, "could not read len");
 		return 0;
 	}
@@ -1238,23 +1334,35 @@ apply_ixfr(nsd_type* nsd, FILE *in, uint32_t serialno,
 		log_msg(LOG_ERR, "out of memory");
 		return 0;
 	}
-	packet = buffer_create(region, QIOBUFSZ);
 	if(msglen > QIOBUFSZ) {
 		log_msg(LOG_ERR, "msg too long");
 		region_destroy(region);
 		return 0;
 	}
-	buffer_clear(packet);
-	if(fread(buffer_begin(packet), msglen, 1, in) != 1) {
-		log_msg(LOG_ERR, "short fread: %s", strerror(errno));
-		region_destroy(region);
-		return 0;
+	if(map) {
+		/* parse the packet in place in the mapped file */
+		if(!buffer_available(map, msglen)) {
+			log_msg(LOG_ERR, "short diff file");
+			region_destroy(region);
+			return 0;
+		}
+		packet = &mapped_packet;
+		buffer_create_from(packet, buffer_current(map), msglen);
+		buffer_skip(map, msglen);
+	} else {
+		packet = buffer_create(region, QIOBUFSZ);
+		buffer_clear(packet);
+		if(fread(buffer_begin(packet), msglen, 1, in) != 1) {
+			log_msg(LOG_ERR, "short fread: %s", strerror(errno));
+			region_destroy(region);
+			return 0;
+		}
+		buffer_set_limit(packet, msglen);
 	}
-	buffer_set_limit(packet, msglen);
 
 	/* see if check on data fails: checks that we are not reading
 	 * random garbage */
-	if(!diff_read_32(in, &checklen) || checklen != msglen) {
+	if(!diff_map_read_32(in, map, &checklen) || checklen != msglen) {
 		log_msg(LOG_ERR, "transfer part has incorrect checkvalue");
 		return 0;
 	}
@@ -1515,6 +1623,51 @@ check_for_bad_serial(namedb_type* db, const char* zone_str, uint32_t old_serial)
 	return 0;
 }
 
+/*
+ * Map the diff file in memory, so that the parts after the current
+ * position are parsed in place, and not read into a buffer one by one.
+ * Returns NULL if that is not possible, the file is read then.
+ */
+static buffer_type*
+diff_map_parts(FILE* in, buffer_type* map)
+{
+#ifdef HAVE_MMAP
+	struct stat st;
+	long offset;
+	void* base;
+	if((offset = ftell(in)) == -1 || fstat(fileno(in), &st) == -1 ||
+		(off_t)offset >= st.st_size)
+		return NULL;
+	base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+		fileno(in), 0);
+	if(base == MAP_FAILED) {
+		VERBOSITY(3, (LOG_INFO, "could not mmap diff file: %s",
+			strerror(errno)));
+		return NULL;
+	}
+	buffer_create_from(map, base, (size_t)st.st_size);
+	buffer_set_position(map, (size_t)offset);
+	return map;
+#else
+	(void)in; (void)map;
+	return NULL;
+#endif /* HAVE_MMAP */
+}
+
+/* unmap the diff file, and continue to read the file after the parts */
+static void
+diff_unmap_parts(FILE* in, buffer_type* map)
+{
+#ifdef HAVE_MMAP
+	if(fseek(in, (long)buffer_position(map), SEEK_SET) == -1)
+		log_msg(LOG_ERR, "could not fseek diff file: %s",
+			strerror(errno));
+	munmap(buffer_begin(map), buffer_capacity(map));
+#else
+	(void)in; (void)map;
+#endif /* HAVE_MMAP */
+}
+
 int
 apply_ixfr_for_zone(nsd_type* nsd, zone_type* zone, FILE* in,
 	struct nsd_options* ATTR_UNUSED(opt), udb_base* taskudb, uint32_t xfrfilenr)
@@ -1595,20 +1748,24 @@ apply_ixfr_for_zone(nsd_type* nsd, zone_type* zone, FILE* in,
 	{
 		int is_axfr=0, delete_mode=0, rr_count=0, softfail=0;
 		struct ixfr_store* ixfr_store = NULL, ixfr_store_mem;
+		buffer_type mapbuf, *map;
 
 		DEBUG(DEBUG_XFRD,1, (LOG_INFO, "processing xfr: %s", zone_buf));
 		if(zone_is_ixfr_enabled(zone))
 			ixfr_store = ixfr_store_start(zone, &ixfr_store_mem);
+		map = diff_map_parts(in, &mapbuf);
 		/* read and apply all of the parts */
 		for(i=0; i<num_parts; i++) {
 			int ret;
 			DEBUG(DEBUG_XFRD,2, (LOG_INFO, "processing xfr: apply part %d", (int)i));
-			ret = apply_ixfr(nsd, in, new_serial,
+			ret = apply_ixfr(nsd, in, map, new_serial,
 				i, num_parts, &is_axfr, &delete_mode,
 				&rr_count, zone,
 				&num_bytes, &softfail, ixfr_store);
 			if(ret == 0) {
 				log_msg(LOG_ERR, "bad ixfr packet part %d in diff file for %s", (int)i, zone_buf);
+				if(map)
+					diff_unmap_parts(in, map);
 				diff_update_commit(
 					zone_buf, DIFF_CORRUPT, nsd, xfrfilenr);
 				/* the udb is still dirty, it is bad */
@@ -1617,6 +1774,8 @@ apply_ixfr_for_zone(nsd_type* nsd, zone_type* zone, FILE* in,
 				break;
 			}
 		}
+		if(map)
+			diff_unmap_parts(in, map);
 		/* read the final log_str: but do not fail on it */
 		if(!diff_read_str(in, log_buf, sizeof(log_buf))) {
 			log_msg(LOG_ERR, "could not read log for transfer %s",
@@ -2162,6 +2321,7 @@ task_process_del_zone(struct nsd* nsd, struct task_list_d* task)
 {
 	zone_type* zone;
 	struct zone_options* zopt;
+	size_t shard;
 	DEBUG(DEBUG_IPC,1, (LOG_INFO, "delzone task %s", dname_to_string(
 		task->zname, NULL)));
 	zone = namedb_find_zone(nsd->db, task->zname);
@@ -2173,7 +2333,10 @@ task_process_del_zone(struct nsd* nsd, struct task_list_d* task)
 	nsec3_clear_precompile(nsd->db, zone);
 	zone->nsec3_param = NULL;
 #endif
+	/* recycle the zone contents in the zone shard */
+	shard = namedb_use_zone_shard(nsd->db, zone);
 	delete_zone_rrs(nsd->db, zone);
+	namedb_use_shard(nsd->db, shard);
 
 	/* remove from zonetree, apex, soa */
 	zopt = zone->opts;
@@ -2265,53 +2428,229 @@ task_process_zonestat_inc(struct nsd* nsd, udb_base* udb, udb_ptr *last_task,
 }
 #endif
 
-void
-task_process_apply_xfr(struct nsd* nsd, udb_base* udb, udb_ptr* task)
+/* check a part of the xfr file, as apply_ixfr reads it, the rdata is
+ * read into the domains of the check. return 0 on a bad part. */
+static int
+check_ixfr_part(FILE* in, buffer_type* map, domain_table_type* domains,
+	uint32_t seq_nr)
+{
+	uint32_t msglen, checklen, pkttype;
+	int qcount, ancount, i;
+	buffer_type* packet;
+	buffer_type mapped_packet;
+
+	if(!diff_map_read_32(in, map, &pkttype) || pkttype != DIFF_PART_XXFR ||
+		!diff_map_read_32(in, map, &msglen) ||
+		msglen < QHEADERSZ || msglen > QIOBUFSZ) {
+		log_msg(LOG_ERR, "xfr check: part %d has a bad header",
+			(int)seq_nr);
+		return 0;
+	}
+	if(map) {
+		if(!buffer_available(map, msglen)) {
+			log_msg(LOG_ERR, "xfr check: short diff file");
+			return 0;
+		}
+		packet = &mapped_packet;
+		buffer_create_from(packet, buffer_current(map), msglen);
+		buffer_skip(map, msglen);
+	} else {
+		packet = buffer_create(domains->region, msglen);
+		if(fread(buffer_begin(packet), msglen, 1, in) != 1) {
+			log_msg(LOG_ERR, "xfr check: short fread: %s",
+				strerror(errno));
+			return 0;
+		}
+		buffer_set_limit(packet, msglen);
+	}
+	if(!diff_map_read_32(in, map, &checklen) || checklen != msglen) {
+		log_msg(LOG_ERR, "xfr check: part %d has incorrect "
+			"checkvalue", (int)seq_nr);
+		return 0;
+	}
+
+	qcount = QDCOUNT(packet);
+	ancount = ANCOUNT(packet);
+	buffer_skip(packet, QHEADERSZ);
+	if(qcount > 64 || ancount > 65530) {
+		log_msg(LOG_ERR, "xfr check: RR count impossibly high");
+		return 0;
+	}
+	for(i=0; i < qcount; ++i) {
+		if(!packet_skip_rr(packet, 1)) {
+			log_msg(LOG_ERR, "xfr check: bad RR in question section");
+			return 0;
+		}
+	}
+	for(i=0; i < ancount; ++i) {
+		const dname_type* owner;
+		uint16_t type, klass, rrlen;
+		size_t end;
+		rr_type* rr;
+		int32_t code;
+
+		owner = dname_make_from_packet(domains->region, packet, 1, 1);
+		if(!owner || !buffer_available(packet, 10)) {
+			log_msg(LOG_ERR, "xfr check: bad RR %d in part %d", i,
+				(int)seq_nr);
+			return 0;
+		}
+		type = buffer_read_u16(packet);
+		klass = buffer_read_u16(packet);
+		buffer_skip(packet, 4); /* ttl */
+		rrlen = buffer_read_u16(packet);
+		if(!buffer_available(packet, rrlen) || klass != CLASS_IN) {
+			log_msg(LOG_ERR, "xfr check: bad RR %s in part %d",
+				dname_to_string(owner, NULL), (int)seq_nr);
+			return 0;
+		}
+		end = buffer_position(packet) + rrlen;
+		if(type == TYPE_TSIG || type == TYPE_OPT) {
+			buffer_set_position(packet, end);
+			continue;
+		}
+		code = nsd_type_descriptor(type)->read_rdata(domains, rrlen,
+			packet, &rr);
+		if(code < 0) {
+			log_msg(LOG_ERR, "xfr check: could not read rdata for "
+				"%s %s %s", dname_to_string(owner, NULL),
+				rrtype_to_string(type),
+				read_rdata_fail_str(code));
+			return 0;
+		}
+		buffer_set_position(packet, end);
+	}
+	return 1;
+}
+
+int
+check_xfrfile(struct nsd* nsd, uint64_t filenumber)
+{
+	char zone_buf[3072];
+	char patname_buf[2048];
+	uint32_t type, num_parts, old_serial, new_serial, time_1, i;
+	uint64_t time_0;
+	uint8_t committed;
+	buffer_type mapbuf, *map;
+	region_type* region;
+	domain_table_type* domains;
+	FILE* in;
+	int ret = 1;
+
+	in = xfrd_open_xfrfile(nsd, filenumber, "r");
+	if(!in)
+		return 1; /* the apply reports it */
+	if(!diff_read_32(in, &type) || type != DIFF_PART_XFRF ||
+		!diff_read_8(in, &committed) ||
+		!diff_read_32(in, &num_parts) ||
+		!diff_read_64(in, &time_0) ||
+		!diff_read_32(in, &time_1) ||
+		!diff_read_32(in, &old_serial) ||
+		!diff_read_32(in, &new_serial) ||
+		!diff_read_64(in, &time_0) ||
+		!diff_read_32(in, &time_1) ||
+		!diff_read_str(in, zone_buf, sizeof(zone_buf)) ||
+		!diff_read_str(in, patname_buf, sizeof(patname_buf)) ||
+		committed == DIFF_NOT_COMMITTED ||
+		committed == DIFF_CORRUPT ||
+		committed == DIFF_INCONSISTENT) {
+		/* the apply fails on it without a change to the zone, and
+		 * reports it */
+		fclose(in);
+		return 1;
+	}
+	region = region_create(xalloc, free);
+	domains = domain_table_create(region);
+	map = diff_map_parts(in, &mapbuf);
+	for(i=0; i<num_parts; i++) {
+		if(!check_ixfr_part(in, map, domains, i)) {
+			log_msg(LOG_ERR, "xfr check: diff file for %s serial "
+				"%u is bad", zone_buf, (unsigned)new_serial);
+			ret = 0;
+			break;
+		}
+	}
+	if(map)
+		diff_unmap_parts(in, map);
+	region_destroy(region);
+	fclose(in);
+	return ret;
+}
+
+int
+apply_xfrfile(struct nsd* nsd, const dname_type* zname, uint64_t filenumber,
+	udb_base* taskudb)
 {
-	/* we have to use an udb_ptr task here, because the apply_xfr procedure
-	 * appends soa_info which may remap and change the pointer. */
 	zone_type* zone;
 	FILE* df;
-	DEBUG(DEBUG_IPC,1, (LOG_INFO, "applyxfr task %s", dname_to_string(
-		TASKLIST(task)->zname, NULL)));
-	zone = namedb_find_zone(nsd->db, TASKLIST(task)->zname);
+	size_t shard;
+	int ret;
+	zone = namedb_find_zone(nsd->db, zname);
 	if(!zone) {
 		/* assume the zone has been deleted and a zone transfer was
 		 * still waiting to be processed */
-		udb_ptr_free_space(task, udb, TASKLIST(task)->size);
-		return;
+		return 1;
 	}
 
 	/* apply the XFR */
-	/* oldserial, newserial, yesno is filenumber */
-	df = xfrd_open_xfrfile(nsd, TASKLIST(task)->yesno, "r");
+	df = xfrd_open_xfrfile(nsd, filenumber, "r");
 	if(!df) {
 		/* could not open file to update */
 		/* soainfo_gone will be communicated from server_reload, unless
 		   preceding updates have been applied */
 		zone->is_skipped = 1;
-		udb_ptr_free_space(task, udb, TASKLIST(task)->size);
-		return;
+		return 0;
 	}
-	/* read and apply zone transfer */
-	switch(apply_ixfr_for_zone(nsd, zone, df, nsd->options, udb,
-				TASKLIST(task)->yesno)) {
-	case 1: /* Success */
-		break;
-
-	case 0: /* Failure */
+	/* read and apply zone transfer, in the memory of the zone shard */
+	shard = namedb_use_zone_shard(nsd->db, zone);
+	ret = apply_ixfr_for_zone(nsd, zone, df, nsd->options, taskudb,
+		filenumber);
+	namedb_use_shard(nsd->db, shard);
+	if(ret == 0) {
 		/* soainfo_gone will be communicated from server_reload, unless
 		   preceding updates have been applied  */
 		zone->is_skipped = 1;
-		break;
+	}
+	fclose(df);
+	return ret;
+}
 
-	case -1:/* Fatal */
-		exit(1);
-		break;
+int
+task_process_apply_xfr(struct nsd* nsd, udb_base* udb, udb_ptr* task)
+{
+	/* we have to use an udb_ptr task here, because the apply_xfr procedure
+	 * appends soa_info which may remap and change the pointer. */
+	int ret;
+	struct timespec start, end;
+	DEBUG(DEBUG_IPC,1, (LOG_INFO, "applyxfr task %s", dname_to_string(
+		TASKLIST(task)->zname, NULL)));
 
-	default:break;
+	/* oldserial, newserial, yesno is filenumber */
+	get_time(&start);
+	ret = apply_xfrfile(nsd, TASKLIST(task)->zname, TASKLIST(task)->yesno,
+		udb);
+	if(ret == 1 && verbosity >= 2) {
+		get_time(&end);
+		timespec_subtract(&end, &start);
+		VERBOSITY(2, (LOG_INFO, "zone %s serial %u applied in "
+			"%lld.%6.6d seconds", dname_to_string(
+			TASKLIST(task)->zname, NULL),
+			(unsigned)TASKLIST(task)->newserial,
+			(long long)end.tv_sec, (int)(end.tv_nsec/1000)));
 	}
-	fclose(df);
+	udb_ptr_free_space(task, udb, TASKLIST(task)->size);
+	/* Fatal, the zone is partly updated, the caller handles it */
+	return (ret == -1)?0:1;
+}
+
+void
+task_process_skip_xfr(struct nsd* nsd, udb_base* udb, udb_ptr* task)
+{
+	zone_type* zone = namedb_find_zone(nsd->db, TASKLIST(task)->zname);
+	/* soainfo_gone will be communicated from server_reload, unless
+	   preceding updates have been applied */
+	if(zone)
+		zone->is_skipped = 1;
 	udb_ptr_free_space(task, udb, TASKLIST(task)->size);
 }
 
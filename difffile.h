@@ -27,19 +27,39 @@ struct collect_rrs;
 #define DIFF_INCONSISTENT (1u<<2) /* IXFR cannot be applied */
 #define DIFF_VERIFIED (1u<<3) /* XFR already verified */
 
+/*
+ * A diff file that is kept open while the transfer is received. It has
+ * a large write buffer, so that a small transfer is written out when it
+ * is committed, and not for every packet.
+ */
+struct diff_xfrfile {
+	/* the open file, or NULL */
+	FILE* df;
+	/* the write buffer of the file */
+	char* buf;
+};
+
 /* write an xfr packet data to the diff file, type=IXFR.
-   The diff file is created if necessary, with initial header(notcommitted). */
+   The diff file is created if necessary, with initial header(notcommitted).
+   If xf is not NULL, the file is kept open in it for the next packets. */
 void diff_write_packet(const char* zone, const char* pat, uint32_t old_serial,
 	uint32_t new_serial, uint32_t seq_nr, uint8_t* data, size_t len,
-	struct nsd* nsd, uint64_t filenumber);
+	struct nsd* nsd, uint64_t filenumber, struct diff_xfrfile* xf);
 
 /*
  * Overwrite header of diff file with committed vale and other data.
- * append log string.
+ * append log string. If xf is not NULL, its open file is used and closed.
  */
 void diff_write_commit(const char* zone, uint32_t old_serial,
 	uint32_t new_serial, uint32_t num_parts, uint8_t commit,
-	const char* log_msg, struct nsd* nsd, uint64_t filenumber);
+	const char* log_msg, struct nsd* nsd, uint64_t filenumber,
+	struct diff_xfrfile* xf);
+
+/* close the diff file that is kept open, and free its write buffer */
+void diff_xfrfile_close(struct diff_xfrfile* xf);
+
+/* the size of the diff file that is kept open, that is written so far */
+uint64_t diff_xfrfile_size(struct diff_xfrfile* xf);
 
 /*
  * Overwrite committed value of diff file with discarded to ensure diff
@@ -73,6 +93,13 @@ int add_RR(namedb_type* db, const dname_type* dname,
 /* apply the xfr file identified by xfrfilenr to zone */
 int apply_ixfr_for_zone(struct nsd* nsd, zone_type* zone, FILE* in,
         struct nsd_options* opt, udb_base* taskudb, uint32_t xfrfilenr);
+/* apply the xfr file filenumber to the zone by name, returns as
+ * apply_ixfr_for_zone, and 1 if the zone does not exist */
+int apply_xfrfile(struct nsd* nsd, const dname_type* zname,
+	uint64_t filenumber, udb_base* taskudb);
+/* check that the records in the xfr file can be read, without the zone
+ * data, returns false if applying it would fail part way */
+int check_xfrfile(struct nsd* nsd, uint64_t filenumber);
 
 enum soainfo_hint {
 	soainfo_ok,
@@ -155,7 +182,11 @@ void task_new_cookies(udb_base* udb, udb_ptr* last, int answer_cookie,
 		size_t cookie_count, void* cookie_secrets);
 int task_new_apply_xfr(udb_base* udb, udb_ptr* last, const dname_type* zone,
 	uint32_t old_serial, uint32_t new_serial, uint64_t filenumber);
-void task_process_apply_xfr(struct nsd* nsd, udb_base* udb, udb_ptr *task);
+/* apply the xfr task, returns false on a fatal error, the zone has
+ * then been partly updated */
+int task_process_apply_xfr(struct nsd* nsd, udb_base* udb, udb_ptr *task);
+/* do not apply the xfr task, its xfr file failed check_xfrfile */
+void task_process_skip_xfr(struct nsd* nsd, udb_base* udb, udb_ptr *task);
 void task_process_in_reload(struct nsd* nsd, udb_base* udb, udb_ptr *last_task,
 	udb_ptr* task);
 void task_process_expire(namedb_type* db, struct task_list_d* task);
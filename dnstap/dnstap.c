@@ -63,47 +63,144 @@
 #endif
 
 #define DNSTAP_CONTENT_TYPE		"protobuf:dnstap.Dnstap"
-#define DNSTAP_INITIAL_BUF_SIZE		256
+/* frames that the collector can queue for the I/O thread, a power of 2 */
+#define DNSTAP_INPUT_QUEUE_SIZE		4096
+/* frames that the I/O thread writes at once */
+#define DNSTAP_OUTPUT_QUEUE_SIZE	128
 
 struct dt_msg {
 	void		*buf;
 	size_t		len_buf;
+	void		*free_data;
 	Dnstap__Dnstap	d;
 	Dnstap__Message	m;
 };
 
-static int
-dt_pack(const Dnstap__Dnstap *d, void **buf, size_t *sz)
+#ifdef HAVE_ATOMIC_BUILTINS
+/* The frames are packed one after the other into blocks of memory. The
+ * I/O thread gives the frames back when they are written, and the block
+ * is freed, or kept for reuse, when all of its frames are written. */
+#define DNSTAP_ARENA_SIZE		(64*1024)
+
+struct dt_arena {
+	/* frames that are not written yet, plus one while the block is the
+	 * one that the frames are packed into */
+	int		refs;
+	/* size of the data, and the bytes used */
+	size_t		size;
+	size_t		used;
+	struct dt_env	*env;
+	uint8_t		*data;
+};
+
+/* drop a reference to the block, called by the I/O thread for the frames */
+static void
+dt_arena_release(struct dt_arena *a)
 {
-	ProtobufCBufferSimple sbuf;
-
-	memset(&sbuf, 0, sizeof(sbuf));
-	sbuf.base.append = protobuf_c_buffer_simple_append;
-	sbuf.len = 0;
-	sbuf.alloced = DNSTAP_INITIAL_BUF_SIZE;
-	sbuf.data = malloc(sbuf.alloced);
-	if (sbuf.data == NULL)
-		return 0;
-	sbuf.must_free_data = 1;
+	struct dt_arena *none = NULL;
+	if (__atomic_sub_fetch(&a->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	/* keep one block of the usual size for reuse */
+	if (a->size != DNSTAP_ARENA_SIZE ||
+	    !__atomic_compare_exchange_n(&a->env->spare_arena, &none, a, 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		free(a);
+}
 
-	*sz = dnstap__dnstap__pack_to_buffer(d, (ProtobufCBuffer *) &sbuf);
-	if (sbuf.data == NULL)
-		return 0;
-	*buf = sbuf.data;
+/* the I/O thread is done with the frame */
+static void
+dt_arena_free_frame(void *ATTR_UNUSED(buf), void *free_data)
+{
+	struct dt_arena *a = (struct dt_arena *) free_data;
+	__atomic_sub_fetch(&a->env->queued, 1, __ATOMIC_RELAXED);
+	dt_arena_release(a);
+}
 
+/* get a block for frames, with space for at least len bytes */
+static struct dt_arena *
+dt_arena_get(struct dt_env *env, size_t len)
+{
+	struct dt_arena *a = NULL;
+	size_t size = DNSTAP_ARENA_SIZE;
+	if (len <= size)
+		a = __atomic_exchange_n(&env->spare_arena, NULL,
+			__ATOMIC_ACQ_REL);
+	else	size = len;
+	if (a == NULL) {
+		a = malloc(sizeof(*a) + size);
+		if (a == NULL)
+			return NULL;
+		a->size = size;
+		a->env = env;
+		a->data = (uint8_t *) (a + 1);
+	}
+	a->refs = 1;
+	a->used = 0;
+	return a;
+}
+#endif /* HAVE_ATOMIC_BUILTINS */
+
+static int
+dt_pack(struct dt_env *env, const Dnstap__Dnstap *d, void **buf, size_t *sz,
+	void **free_data)
+{
+	size_t len = dnstap__dnstap__get_packed_size(d);
+#ifdef HAVE_ATOMIC_BUILTINS
+	struct dt_arena *a = env->arena;
+
+	if (a == NULL || a->size - a->used < len) {
+		/* the frames in the full block keep it until written */
+		env->arena = NULL;
+		if (a != NULL)
+			dt_arena_release(a);
+		if ((a = dt_arena_get(env, len)) == NULL)
+			return 0;
+		env->arena = a;
+	}
+	*buf = a->data + a->used;
+	*sz = dnstap__dnstap__pack(d, *buf);
+	a->used += *sz;
+	__atomic_add_fetch(&a->refs, 1, __ATOMIC_RELAXED);
+	*free_data = a;
+#else
+	(void)env;
+	*buf = malloc(len);
+	if (*buf == NULL)
+		return 0;
+	*sz = dnstap__dnstap__pack(d, *buf);
+	*free_data = NULL;
+#endif /* HAVE_ATOMIC_BUILTINS */
 	return 1;
 }
 
 static void
-dt_send(const struct dt_env *env, void *buf, size_t len_buf)
+dt_send(struct dt_env *env, void *buf, size_t len_buf, void *free_data)
 {
 	fstrm_res res;
 	if (!buf)
 		return;
+#ifdef HAVE_ATOMIC_BUILTINS
+	/* count it before the I/O thread can give it back */
+	__atomic_add_fetch(&env->queued, 1, __ATOMIC_RELAXED);
+	res = fstrm_iothr_submit(env->iothr, env->ioq, buf, len_buf,
+				 dt_arena_free_frame, free_data);
+	if (res != fstrm_res_success) {
+		__atomic_sub_fetch(&env->queued, 1, __ATOMIC_RELAXED);
+		dt_arena_release((struct dt_arena *) free_data);
+		env->dropped++;
+		return;
+	}
+#else
+	(void)free_data;
 	res = fstrm_iothr_submit(env->iothr, env->ioq, buf, len_buf,
 				 fstrm_free_wrapper, NULL);
-	if (res != fstrm_res_success)
+	if (res != fstrm_res_success) {
 		free(buf);
+		env->dropped++;
+		return;
+	}
+#endif /* HAVE_ATOMIC_BUILTINS */
+	env->frames++;
 }
 
 static void
@@ -130,6 +227,9 @@ dt_msg_init(const struct dt_env *env,
 }
 
 #ifdef HAVE_SSL
+/* the size of a TLS record */
+#define DNSTAP_TLS_WRITE_SIZE		16384
+
 /** TLS writer object for fstrm. */
 struct dt_tls_writer {
 	/* ip address */
@@ -144,6 +244,8 @@ struct dt_tls_writer {
 	SSL* ssl;
 	/* the server name to authenticate */
 	char* tls_server_name;
+	/* the frames of a write are gathered here, for fewer TLS records */
+	uint8_t wbuf[DNSTAP_TLS_WRITE_SIZE];
 };
 
 void log_crypto_err(const char* str); /* in server.c */
@@ -475,20 +577,45 @@ dt_tls_writer_read(void* obj, void* buf, size_t nbytes)
 	return fstrm_res_success;
 }
 
-/* The fstrm writer write callback for TLS */
+/* write data with SSL_write, return false on failure */
+static int
+dt_tls_write(struct dt_tls_writer* dtw, const void* buf, size_t len)
+{
+	if(len == 0)
+		return 1;
+	if(SSL_write(dtw->ssl, buf, (int)len) <= 0) {
+		log_crypto_err("dnstap: could not SSL_write");
+		return 0;
+	}
+	return 1;
+}
+
+/* The fstrm writer write callback for TLS, the I/O thread passes a batch
+ * of frames, that are written with as few SSL_write calls as fit */
 static fstrm_res
 dt_tls_writer_write(void* obj, const struct iovec* iov, int iovcnt)
 {
 	struct dt_tls_writer* dtw = (struct dt_tls_writer*)obj;
+	size_t used = 0;
 	int i;
 	if(!dtw->connected)
 		return fstrm_res_failure;
 	for(i=0; i<iovcnt; i++) {
-		if(SSL_write(dtw->ssl, iov[i].iov_base, (int)(iov[i].iov_len)) <= 0) {
-			log_crypto_err("dnstap: could not SSL_write");
-			return fstrm_res_failure;
+		if(used + iov[i].iov_len > sizeof(dtw->wbuf)) {
+			if(!dt_tls_write(dtw, dtw->wbuf, used))
+				return fstrm_res_failure;
+			used = 0;
+		}
+		if(iov[i].iov_len > sizeof(dtw->wbuf)) {
+			if(!dt_tls_write(dtw, iov[i].iov_base, iov[i].iov_len))
+				return fstrm_res_failure;
+			continue;
 		}
+		memcpy(dtw->wbuf+used, iov[i].iov_base, iov[i].iov_len);
+		used += iov[i].iov_len;
 	}
+	if(!dt_tls_write(dtw, dtw->wbuf, used))
+		return fstrm_res_failure;
 	return fstrm_res_success;
 }
 
@@ -607,6 +734,15 @@ dt_create(const char *socket_path, char* ip, unsigned num_workers,
 
 	fopt = fstrm_iothr_options_init();
 	fstrm_iothr_options_set_num_input_queues(fopt, num_workers);
+	/* the collector submits the messages from the workers in batches,
+	 * and the I/O thread writes up to the output queue size of frames
+	 * with one writev */
+	if (fstrm_iothr_options_set_input_queue_size(fopt,
+		DNSTAP_INPUT_QUEUE_SIZE) != fstrm_res_success)
+		log_msg(LOG_WARNING, "dnstap: could not set input queue size");
+	if (fstrm_iothr_options_set_output_queue_size(fopt,
+		DNSTAP_OUTPUT_QUEUE_SIZE) != fstrm_res_success)
+		log_msg(LOG_WARNING, "dnstap: could not set output queue size");
 	env->iothr = fstrm_iothr_init(fopt, &fw);
 	if (env->iothr == NULL) {
 		log_msg(LOG_ERR, "dt_create: fstrm_iothr_init() failed");
@@ -702,6 +838,12 @@ dt_delete(struct dt_env *env)
 		return;
 	VERBOSITY(1, (LOG_INFO, "closing dnstap socket"));
 	fstrm_iothr_destroy(&env->iothr);
+#ifdef HAVE_ATOMIC_BUILTINS
+	/* the I/O thread has given back all the frames */
+	if (env->arena)
+		dt_arena_release(env->arena);
+	free(env->spare_arena);
+#endif
 	free(env->identity);
 	free(env->version);
 	free(env);
@@ -864,8 +1006,8 @@ dt_msg_send_auth_query(struct dt_env *env,
 			&dm.m.query_port, &dm.m.has_query_port);
 
 
-	if (dt_pack(&dm.d, &dm.buf, &dm.len_buf))
-		dt_send(env, dm.buf, dm.len_buf);
+	if (dt_pack(env, &dm.d, &dm.buf, &dm.len_buf, &dm.free_data))
+		dt_send(env, dm.buf, dm.len_buf, dm.free_data);
 }
 
 void
@@ -909,8 +1051,8 @@ dt_msg_send_auth_response(struct dt_env *env,
 			&dm.m.query_address, &dm.m.has_query_address,
 			&dm.m.query_port, &dm.m.has_query_port);
 
-	if (dt_pack(&dm.d, &dm.buf, &dm.len_buf))
-		dt_send(env, dm.buf, dm.len_buf);
+	if (dt_pack(env, &dm.d, &dm.buf, &dm.len_buf, &dm.free_data))
+		dt_send(env, dm.buf, dm.len_buf, dm.free_data);
 }
 
 #endif /* USE_DNSTAP */
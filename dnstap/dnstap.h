@@ -43,6 +43,7 @@ struct nsd_options;
 struct fstrm_io;
 struct fstrm_queue;
 struct dt_tls_writer;
+struct dt_arena;
 
 struct dt_env {
 	/** dnstap I/O thread */
@@ -70,6 +71,18 @@ struct dt_env {
 
 	/** tls writer object, or NULL */
 	struct dt_tls_writer* tls_writer;
+
+	/** frames that were given to the I/O thread */
+	uint64_t frames;
+	/** frames that were dropped because the I/O thread queue was full */
+	uint64_t dropped;
+	/** frames given to the I/O thread that are not written yet */
+	uint64_t queued;
+
+	/** the block of memory that the frames are packed into, and a
+	 * block that the I/O thread gave back for reuse */
+	struct dt_arena* arena;
+	struct dt_arena* spare_arena;
 };
 
 /**
@@ -11,8 +11,18 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <signal.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS   MAP_ANON
+#endif
+#endif /* HAVE_MMAP */
 #ifndef USE_MINI_EVENT
 #  ifdef HAVE_EVENT_H
 #    include <event.h>
@@ -36,6 +46,269 @@
 
 #include "udb.h"
 #include "rrl.h"
+#include "query.h"
+
+#if defined(HAVE_MMAP) && defined(HAVE_ATOMIC_BUILTINS)
+/* The workers put the messages in a ring in shared memory, and the
+ * socketpair is only used to wake up the collector when it waits for data.
+ * Every ring has one worker that writes it, the old and new workers during
+ * a reload use different rings, like they use different socketpairs. The
+ * workers of the reload after that use the ring again, and a worker takes
+ * the ring only when the pid that writes it has released it on quit, or
+ * has exited. Until then it sends the messages over the socketpair. */
+#define DT_USE_RING 1
+#endif
+
+/* messages that are read from a socketpair before the next worker */
+#define DT_INPUT_BATCH 64
+
+#ifdef DT_USE_RING
+/* size of the data in the ring from a worker to the collector */
+#define DT_RING_SIZE (256*1024)
+/* the messages in the ring start at 4 byte boundaries */
+#define DT_RING_ALIGN(x) (((x)+3)&~((size_t)3))
+/* in place of the length of a message, the rest of the ring is unused and
+ * the next message is at the start of the ring */
+#define DT_RING_WRAP 0xffffffff
+
+/* the ring of messages from a worker. The head and tail count the bytes
+ * that have been written and consumed, and are on different cache lines. */
+struct dt_ring {
+	/* written by the worker */
+	volatile uint64_t head;
+	/* the pid of the worker that writes the ring, 0 if none */
+	volatile pid_t writer;
+	uint8_t pad1[52];
+	/* written by the collector */
+	volatile uint64_t tail;
+	/* set by the collector when it waits for a wakeup, the worker
+	 * clears it when it sends the wakeup */
+	volatile uint32_t waiting;
+	uint8_t pad2[52];
+	/* the messages, every one is the u32 length and the content that
+	 * dt_submit_content reads */
+	uint8_t data[DT_RING_SIZE];
+};
+
+static void dt_ring_release(struct nsd* nsd);
+#endif /* DT_USE_RING */
+
+/* a client netblock for the dnstap filter */
+struct dt_filter_addr {
+	int family;
+	int prefix;
+	uint8_t addr[16];
+};
+
+/* the sample rate and the filters that choose the queries that are logged,
+ * a query that matches a filter is logged regardless of the sample rate */
+struct dt_filter {
+	/* log 1 in sample queries, 0 none */
+	uint32_t sample;
+	/* count of the queries for the sample rate, in the worker */
+	uint32_t count;
+	/* bitmask of the transports, 1<<STAT_UDP, TCP, TLS */
+	int transports;
+	/* the client netblocks */
+	struct dt_filter_addr* clients;
+	size_t num_clients;
+	/* the zone names */
+	const struct dname** zones;
+	size_t num_zones;
+	/* the qtypes */
+	uint16_t* qtypes;
+	size_t num_qtypes;
+	/* bitmask of the rcodes */
+	uint32_t rcodes;
+	/* if the zones, qtypes or rcodes filters are used, they need the
+	 * answer */
+	int answer;
+};
+
+/* the rcode names for the dnstap-log-rcodes filter */
+static lookup_table_type dt_rcode_names[] = {
+	{ RCODE_OK, "NOERROR" },
+	{ RCODE_FORMAT, "FORMERR" },
+	{ RCODE_SERVFAIL, "SERVFAIL" },
+	{ RCODE_NXDOMAIN, "NXDOMAIN" },
+	{ RCODE_IMPL, "NOTIMP" },
+	{ RCODE_REFUSE, "REFUSED" },
+	{ RCODE_YXDOMAIN, "YXDOMAIN" },
+	{ RCODE_YXRRSET, "YXRRSET" },
+	{ RCODE_NXRRSET, "NXRRSET" },
+	{ RCODE_NOTAUTH, "NOTAUTH" },
+	{ RCODE_NOTZONE, "NOTZONE" },
+	{ 0, NULL }
+};
+
+/* count the space separated words in the string */
+static size_t dt_filter_count(const char* str)
+{
+	size_t n = 0;
+	const char* p = str;
+	while(p && *p) {
+		while(*p == ' ' || *p == '\t')
+			p++;
+		if(!*p)
+			break;
+		n++;
+		while(*p && *p != ' ' && *p != '\t')
+			p++;
+	}
+	return n;
+}
+
+/* get the next space separated word from the string, NULL at the end */
+static char* dt_filter_word(char** p)
+{
+	char* w;
+	while(**p == ' ' || **p == '\t')
+		(*p)++;
+	if(!**p)
+		return NULL;
+	w = *p;
+	while(**p && **p != ' ' && **p != '\t')
+		(*p)++;
+	if(**p)
+		*(*p)++ = 0;
+	return w;
+}
+
+/* parse a client address with optional prefix length, 0 on failure */
+static int dt_filter_parse_addr(char* str, struct dt_filter_addr* a)
+{
+	char* s = strchr(str, '/');
+	int max;
+	if(s)
+		*s++ = 0;
+	memset(a, 0, sizeof(*a));
+	if(inet_pton(AF_INET, str, a->addr) == 1) {
+		a->family = AF_INET;
+		max = 32;
+#ifdef INET6
+	} else if(inet_pton(AF_INET6, str, a->addr) == 1) {
+		a->family = AF_INET6;
+		max = 128;
+#endif
+	} else {
+		return 0;
+	}
+	a->prefix = max;
+	if(s) {
+		char* end;
+		long l = strtol(s, &end, 10);
+		if(*s == 0 || *end != 0 || l < 0 || l > max)
+			return 0;
+		a->prefix = (int)l;
+	}
+	return 1;
+}
+
+/* create the sample rate and filters from the options */
+static struct dt_filter* dt_filter_create(struct region* region,
+	struct nsd_options* opt)
+{
+	struct dt_filter* f = (struct dt_filter*)region_alloc_zero(region,
+		sizeof(*f));
+	char* w, *p;
+	size_t n;
+
+	f->sample = (opt->dnstap_sample_rate < 0 ? 1 :
+		(uint32_t)opt->dnstap_sample_rate);
+	if(opt->dnstap_log_transports) {
+		p = region_strdup(region, opt->dnstap_log_transports);
+		while((w = dt_filter_word(&p)) != NULL) {
+			if(strcasecmp(w, "udp") == 0)
+				f->transports |= (1<<STAT_UDP);
+			else if(strcasecmp(w, "tcp") == 0)
+				f->transports |= (1<<STAT_TCP);
+			else if(strcasecmp(w, "tls") == 0)
+				f->transports |= (1<<STAT_TLS);
+			else	log_msg(LOG_ERR, "dnstap-log-transports: unknown "
+					"transport %s, expected udp, tcp or tls", w);
+		}
+	}
+	if((n = dt_filter_count(opt->dnstap_log_clients)) > 0) {
+		f->clients = (struct dt_filter_addr*)region_alloc_array(region,
+			n, sizeof(*f->clients));
+		p = region_strdup(region, opt->dnstap_log_clients);
+		while((w = dt_filter_word(&p)) != NULL) {
+			if(!dt_filter_parse_addr(w, &f->clients[f->num_clients]))
+				log_msg(LOG_ERR, "dnstap-log-clients: cannot "
+					"parse %s", w);
+			else	f->num_clients++;
+		}
+	}
+	if((n = dt_filter_count(opt->dnstap_log_zones)) > 0) {
+		f->zones = (const struct dname**)region_alloc_array(region,
+			n, sizeof(*f->zones));
+		p = region_strdup(region, opt->dnstap_log_zones);
+		while((w = dt_filter_word(&p)) != NULL) {
+			const struct dname* d = dname_parse(region, w);
+			if(!d)
+				log_msg(LOG_ERR, "dnstap-log-zones: cannot "
+					"parse %s", w);
+			else	f->zones[f->num_zones++] = d;
+		}
+	}
+	if((n = dt_filter_count(opt->dnstap_log_qtypes)) > 0) {
+		f->qtypes = (uint16_t*)region_alloc_array(region, n,
+			sizeof(*f->qtypes));
+		p = region_strdup(region, opt->dnstap_log_qtypes);
+		while((w = dt_filter_word(&p)) != NULL) {
+			uint16_t t = rrtype_from_string(w);
+			if(t == 0)
+				log_msg(LOG_ERR, "dnstap-log-qtypes: unknown "
+					"type %s", w);
+			else	f->qtypes[f->num_qtypes++] = t;
+		}
+	}
+	if(opt->dnstap_log_rcodes) {
+		p = region_strdup(region, opt->dnstap_log_rcodes);
+		while((w = dt_filter_word(&p)) != NULL) {
+			lookup_table_type* lt = lookup_by_name(dt_rcode_names, w);
+			if(lt)
+				f->rcodes |= (1<<lt->id);
+			else if(isdigit((unsigned char)*w) && atoi(w) < 16)
+				f->rcodes |= (1<<atoi(w));
+			else	log_msg(LOG_ERR, "dnstap-log-rcodes: unknown "
+					"rcode %s", w);
+		}
+	}
+	f->answer = (f->num_zones != 0 || f->num_qtypes != 0 ||
+		f->rcodes != 0);
+	return f;
+}
+
+/* see if the client address is in one of the netblocks of the filter */
+static int dt_filter_client(struct dt_filter* f, struct query* q)
+{
+	size_t i;
+	for(i=0; i<f->num_clients; i++) {
+		if(addr_in_netblock(&q->client_addr, f->clients[i].family,
+			f->clients[i].addr, f->clients[i].prefix))
+			return 1;
+	}
+	return 0;
+}
+
+/* see if the answered query matches the zones, qtypes or rcodes filter */
+static int dt_filter_answer(struct dt_filter* f, struct query* q)
+{
+	size_t i;
+	if(f->rcodes & (1<<RCODE(q->packet)))
+		return 1;
+	for(i=0; i<f->num_qtypes; i++)
+		if(f->qtypes[i] == q->qtype)
+			return 1;
+	if(q->zone && q->zone->apex) {
+		for(i=0; i<f->num_zones; i++)
+			if(dname_compare(domain_dname(q->zone->apex),
+				f->zones[i]) == 0)
+				return 1;
+	}
+	return 0;
+}
 
 struct dt_collector* dt_collector_create(struct nsd* nsd)
 {
@@ -110,12 +383,38 @@ struct dt_collector* dt_collector_create(struct nsd* nsd)
 	dt_col->cmd_socket_dt = sv[0];
 	dt_col->cmd_socket_nsd = sv[1];
 
+	dt_col->filter = dt_filter_create(dt_col->region, nsd->options);
+	if(dt_col->filter->answer &&
+		nsd->options->dnstap_log_auth_query_messages)
+		dt_col->query_buffer = buffer_create(dt_col->region,
+			TCP_MAX_MESSAGE_LEN);
+
+#ifdef DT_USE_RING
+	/* the rings are shared with the workers that are forked later */
+	dt_col->rings = (struct dt_ring*)mmap(NULL,
+		sizeof(struct dt_ring)*dt_col->count, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(dt_col->rings == MAP_FAILED) {
+		log_msg(LOG_ERR, "dnstap_collector: mmap failed: %s, sending "
+			"the messages over the socketpairs", strerror(errno));
+		dt_col->rings = NULL;
+	} else {
+		/* the collector waits for the first message */
+		for(i=0; i<dt_col->count; i++)
+			dt_col->rings[i].waiting = 1;
+	}
+#endif
 	return dt_col;
 }
 
 void dt_collector_destroy(struct dt_collector* dt_col, struct nsd* nsd)
 {
 	if(!dt_col) return;
+#ifdef DT_USE_RING
+	/* in the worker, the worker of a later reload can take its ring */
+	if(dt_col->ring_writer != 0)
+		dt_ring_release(nsd);
+#endif
 	free(nsd->dt_collector_fd_recv);
 	nsd->dt_collector_fd_recv = NULL;
 	if (nsd->dt_collector_fd_send < nsd->dt_collector_fd_swap)
@@ -124,6 +423,10 @@ void dt_collector_destroy(struct dt_collector* dt_col, struct nsd* nsd)
 		free(nsd->dt_collector_fd_swap);
 	nsd->dt_collector_fd_send = NULL;
 	nsd->dt_collector_fd_swap = NULL;
+#ifdef DT_USE_RING
+	if(dt_col->rings)
+		munmap(dt_col->rings, sizeof(struct dt_ring)*dt_col->count);
+#endif
 	region_destroy(dt_col->region);
 	free(dt_col);
 }
@@ -253,30 +556,184 @@ dt_submit_content(struct dt_env* dt_env, struct buffer* buf)
 	}
 }
 
+/* put the counters of the output in the statistics of the collector */
+static void dt_collector_stats(struct dt_collector* dt_col)
+{
+#ifdef BIND8_STATS
+	struct dt_env* dt_env = dt_col->dt_env;
+	if(!dt_col->st || !dt_env)
+		return;
+	dt_col->st->dnstapframes = dt_env->frames;
+	dt_col->st->dnstapdrop = dt_env->dropped;
+#ifdef HAVE_ATOMIC_BUILTINS
+	dt_col->st->dnstapqueue = __atomic_load_n(&dt_env->queued,
+		__ATOMIC_RELAXED);
+#endif
+#else
+	(void)dt_col;
+#endif
+}
+
+#ifdef DT_USE_RING
+/* read the wakeup datagrams from the worker, and the messages of a worker
+ * that waits for the ring, -1 on error */
+static int dt_read_wakeups(struct dt_collector_input* dt_input, int fd)
+{
+	struct buffer* buf = dt_input->buffer;
+	ssize_t r;
+	for(;;) {
+		r = recv(fd, buffer_begin(buf), buffer_capacity(buf),
+			MSG_DONTWAIT);
+		if(r == -1) {
+			if(errno == EAGAIN || errno == EINTR)
+				return 0;
+			log_msg(LOG_ERR, "dnstap collector: receive failed: %s",
+				strerror(errno));
+			return -1;
+		}
+		if(r == 0) {
+			log_msg(LOG_ERR, "dnstap collector: remote closed connection");
+			return -1;
+		}
+		if(r <= 4)
+			continue; /* a wakeup */
+		if(buffer_read_u32_at(buf, 0) != (size_t)(r - 4)) {
+			log_msg(LOG_ERR, "dnstap collector: out of sync "
+				"(msglen: %u)", (unsigned int)
+				buffer_read_u32_at(buf, 0));
+			continue;
+		}
+		if(dt_input->dt_collector->dt_env) {
+			buffer_set_limit(buf, r);
+			dt_submit_content(dt_input->dt_collector->dt_env, buf);
+		}
+		buffer_clear(buf);
+	}
+}
+
+/* submit the messages in the ring of the worker to dnstap, at most a ring
+ * full, so that the other workers get a turn. Returns true if there is
+ * more data, false if the worker wakes up the collector for the next. */
+static int dt_ring_drain(struct dt_collector_input* dt_input)
+{
+	struct dt_ring* ring = dt_input->ring;
+	struct dt_env* dt_env = dt_input->dt_collector->dt_env;
+	uint64_t tail = ring->tail, stop = tail + DT_RING_SIZE, head;
+	struct buffer buf;
+	size_t pos;
+	uint32_t msglen;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	while(tail != head && tail < stop) {
+		pos = tail % DT_RING_SIZE;
+		msglen = read_uint32(ring->data + pos);
+		if(msglen == DT_RING_WRAP) {
+			tail += DT_RING_SIZE - pos;
+			continue;
+		}
+		if((size_t)msglen + 4 > DT_RING_SIZE - pos ||
+			(uint64_t)msglen + 4 > head - tail) {
+			log_msg(LOG_ERR, "dnstap collector: ring out of sync "
+				"(msglen: %u)", (unsigned int)msglen);
+			tail = head;
+			break;
+		}
+		if(dt_env) {
+			buffer_create_from(&buf, ring->data + pos, msglen + 4);
+			dt_submit_content(dt_env, &buf);
+		}
+		tail += DT_RING_ALIGN((size_t)msglen + 4);
+		/* give the space back to the worker */
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+		if(tail == head)
+			head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	}
+	__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+	if(tail != head)
+		return 1;
+	/* wait for a wakeup, unless data came in before the worker could
+	 * see that the collector waits */
+	__atomic_store_n(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail)
+		return 0;
+	/* if the worker took the flag, it sends a wakeup */
+	return __atomic_exchange_n(&ring->waiting, 0, __ATOMIC_SEQ_CST) != 0;
+}
+
+/* make the collector continue with the rings after the other events */
+static void dt_schedule_drain(struct dt_collector* dt_col)
+{
+	struct timeval tv;
+	if(dt_col->drain_pending)
+		return;
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	if(event_add(dt_col->drain_event, &tv) != 0) {
+		log_msg(LOG_ERR, "dnstap collector: event_add failed");
+		return;
+	}
+	dt_col->drain_pending = 1;
+}
+
+/* continue with the rings that had more data after their turn */
+static void dt_handle_drain(int ATTR_UNUSED(fd), short ATTR_UNUSED(event),
+	void* arg)
+{
+	struct dt_collector* dt_col = (struct dt_collector*)arg;
+	int i, more = 0;
+	dt_col->drain_pending = 0;
+	for(i=0; i<dt_col->count; i++) {
+		if(dt_col->inputs[i].ring && dt_ring_drain(&dt_col->inputs[i]))
+			more = 1;
+	}
+	if(more)
+		dt_schedule_drain(dt_col);
+	dt_collector_stats(dt_col);
+}
+#endif /* DT_USE_RING */
+
 /* handle input from worker for dnstap */
 void
 dt_handle_input(int fd, short event, void* arg)
 {
 	struct dt_collector_input* dt_input = (struct dt_collector_input*)arg;
+	int i;
 	if((event&EV_READ) != 0) {
-		/* receive */
-		int r = recv_into_buffer(fd, dt_input->buffer);
-		if(r == 0)
-			return;
-		else if(r < 0) {
-			event_base_loopexit(dt_input->dt_collector->event_base, NULL);
+#ifdef DT_USE_RING
+		if(dt_input->ring) {
+			/* the worker woke us up, the data is in the ring */
+			if(dt_read_wakeups(dt_input, fd) < 0) {
+				event_base_loopexit(dt_input->dt_collector->event_base, NULL);
+				return;
+			}
+			if(dt_ring_drain(dt_input))
+				dt_schedule_drain(dt_input->dt_collector);
+			dt_collector_stats(dt_input->dt_collector);
 			return;
 		}
-		/* once data is complete, send it to dnstap */
-		VERBOSITY(4, (LOG_INFO, "dnstap collector: received msg len %d",
-			(int)buffer_remaining(dt_input->buffer)));
-		if(dt_input->dt_collector->dt_env) {
-			dt_submit_content(dt_input->dt_collector->dt_env,
-				dt_input->buffer);
+#endif
+		/* receive a batch of messages, the other workers get a turn
+		 * after it */
+		for(i=0; i<DT_INPUT_BATCH; i++) {
+			int r = recv_into_buffer(fd, dt_input->buffer);
+			if(r == 0)
+				break;
+			else if(r < 0) {
+				event_base_loopexit(dt_input->dt_collector->event_base, NULL);
+				return;
+			}
+			/* once data is complete, send it to dnstap */
+			VERBOSITY(4, (LOG_INFO, "dnstap collector: received msg len %d",
+				(int)buffer_remaining(dt_input->buffer)));
+			if(dt_input->dt_collector->dt_env) {
+				dt_submit_content(dt_input->dt_collector->dt_env,
+					dt_input->buffer);
+			}
+
+			/* clear buffer for next message */
+			buffer_clear(dt_input->buffer);
 		}
-		
-		/* clear buffer for next message */
-		buffer_clear(dt_input->buffer);
+		dt_collector_stats(dt_input->dt_collector);
 	}
 }
 
@@ -317,10 +774,15 @@ static void dt_collector_cleanup(struct dt_collector* dt_col, struct nsd* nsd)
 	for(i=0; i<dt_col->count; i++) {
 		event_del(dt_col->inputs[i].event);
 	}
+#ifdef DT_USE_RING
+	if(dt_col->drain_pending)
+		event_del(dt_col->drain_event);
+#endif
 	dt_collector_close(dt_col, nsd);
 	event_base_free(dt_col->event_base);
 #ifdef MEMCLEAN
 	free(dt_col->cmd_event);
+	free(dt_col->drain_event);
 	if(dt_col->inputs) {
 		for(i=0; i<dt_col->count; i++) {
 			free(dt_col->inputs[i].event);
@@ -353,12 +815,26 @@ static void dt_attach_events(struct dt_collector* dt_col, struct nsd* nsd)
 		log_msg(LOG_ERR, "dnstap collector: event_base_set failed");
 	if(event_add(dt_col->cmd_event, NULL) != 0)
 		log_msg(LOG_ERR, "dnstap collector: event_add failed");
+
+#ifdef DT_USE_RING
+	/* the drain handler is added when a ring has more data */
+	dt_col->drain_event = (struct event*)xalloc_zero(
+		sizeof(*dt_col->drain_event));
+	event_set(dt_col->drain_event, -1, EV_TIMEOUT, dt_handle_drain,
+		dt_col);
+	if(event_base_set(dt_col->event_base, dt_col->drain_event) != 0)
+		log_msg(LOG_ERR, "dnstap collector: event_base_set failed");
+#endif
 	
 	/* add worker input handlers */
 	dt_col->inputs = xalloc_array_zero(dt_col->count,
 		sizeof(*dt_col->inputs));
 	for(i=0; i<dt_col->count; i++) {
 		dt_col->inputs[i].dt_collector = dt_col;
+#ifdef DT_USE_RING
+		if(dt_col->rings)
+			dt_col->inputs[i].ring = &dt_col->rings[i];
+#endif
 		dt_col->inputs[i].event = (struct event*)xalloc_zero(
 			sizeof(struct event));
 		event_set(dt_col->inputs[i].event,
@@ -390,6 +866,11 @@ static void dt_collector_run(struct dt_collector* dt_col, struct nsd* nsd)
 	/* init dnstap */
 	VERBOSITY(1, (LOG_INFO, "dnstap collector started"));
 	dt_init_dnstap(dt_col, nsd);
+#ifdef BIND8_STATS
+	/* the block after the ones of the server processes */
+	if(nsd->stat_map)
+		dt_col->st = &nsd->stat_map[nsd->child_count*2];
+#endif
 	dt_attach_events(dt_col, nsd);
 
 	/* run */
@@ -539,6 +1020,158 @@ static int attempt_to_send(int s, uint8_t* data, size_t len)
 	return -1;
 }
 
+#ifdef DT_USE_RING
+/* the ring that this worker writes, the rings are in the order of the
+ * socketpairs, and the workers of a reload use the other half of them */
+static struct dt_ring* dt_worker_ring(struct nsd* nsd)
+{
+	int* fd_send = nsd->dt_collector_fd_send < nsd->dt_collector_fd_swap
+		? nsd->dt_collector_fd_send : nsd->dt_collector_fd_swap;
+	return &nsd->dt_collector->rings[(nsd->dt_collector_fd_send - fd_send)
+		+ nsd->this_child->child_num];
+}
+
+/* see if this worker writes its ring. It takes the ring when no worker
+ * writes it, or the worker that did has exited. */
+static int dt_ring_take(struct nsd* nsd, struct dt_ring* ring)
+{
+	pid_t writer;
+	if(nsd->dt_collector->ring_writer != 0)
+		return 1;
+	writer = __atomic_load_n(&ring->writer, __ATOMIC_ACQUIRE);
+	if(writer != 0 && !(kill(writer, 0) == -1 && errno == ESRCH))
+		return 0;
+	if(!__atomic_compare_exchange_n(&ring->writer, &writer, getpid(), 0,
+		__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		return 0;
+	nsd->dt_collector->ring_writer = getpid();
+	return 1;
+}
+
+/* release the ring of this worker, so that the worker of a later reload
+ * can take it */
+static void dt_ring_release(struct nsd* nsd)
+{
+	pid_t writer = nsd->dt_collector->ring_writer;
+	if(writer == 0)
+		return;
+	nsd->dt_collector->ring_writer = 0;
+	(void)__atomic_compare_exchange_n(&dt_worker_ring(nsd)->writer,
+		&writer, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/* put the message in the ring of this worker, and wake up the collector
+ * if it waits for data. If the ring is full, the message is dropped.
+ * Returns false if a worker of the reload before still writes the ring. */
+static int
+dt_ring_submit(struct nsd* nsd, uint8_t is_response,
+#ifdef INET6
+	struct sockaddr_storage* local_addr,
+	struct sockaddr_storage* addr,
+#else
+	struct sockaddr_in* local_addr,
+	struct sockaddr_in* addr,
+#endif
+	socklen_t addrlen, int is_tcp, struct buffer* packet,
+	struct zone* zone)
+{
+	struct dt_ring* ring = dt_worker_ring(nsd);
+	int* fd = &nsd->dt_collector_fd_send[nsd->this_child->child_num];
+	uint64_t head, tail;
+	size_t pos, skip = 0;
+	/* the largest that prep_send_data can make of it */
+	size_t need = DT_RING_ALIGN(4+1+4+2*(size_t)addrlen+1+4+
+		buffer_remaining(packet)+4+MAXDOMAINLEN);
+	struct buffer buf;
+
+	if(!dt_ring_take(nsd, ring))
+		return 0;
+	head = ring->head;
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	pos = head % DT_RING_SIZE;
+	if(DT_RING_SIZE - pos < need) {
+		/* does not fit at the end, continue at the start */
+		skip = DT_RING_SIZE - pos;
+		pos = 0;
+	}
+	if(need > DT_RING_SIZE || DT_RING_SIZE - (head - tail) < skip + need) {
+		/* the collector is behind, drop the message */
+#ifdef BIND8_STATS
+		STATUP(nsd, dnstapdrop);
+#endif
+		return 1;
+	}
+	buffer_create_from(&buf, ring->data + pos, need);
+	if(!prep_send_data(&buf, is_response, local_addr, addr, addrlen,
+		is_tcp, packet, zone))
+		return 1;
+	if(skip)
+		write_uint32(ring->data + head % DT_RING_SIZE, DT_RING_WRAP);
+	__atomic_store_n(&ring->head, head + skip +
+		DT_RING_ALIGN(buffer_remaining(&buf)), __ATOMIC_SEQ_CST);
+
+	if(__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST) &&
+		__atomic_exchange_n(&ring->waiting, 0, __ATOMIC_SEQ_CST)) {
+		if(attempt_to_send(*fd, (uint8_t*)"", 1)) {
+			/* Something went wrong sending to the socket. Don't
+			 * send to this socket again. */
+			close(*fd);
+			*fd = -1;
+		}
+	}
+	return 1;
+}
+#endif /* DT_USE_RING */
+
+int dt_collector_log_query(struct nsd* nsd, struct query* q, int transport)
+{
+	struct dt_filter* f;
+	q->dt_log = DT_LOG_NO;
+	if(!nsd->dt_collector) return 0;
+	f = nsd->dt_collector->filter;
+	if(f->sample != 0 && ++f->count >= f->sample) {
+		f->count = 0;
+		q->dt_log = DT_LOG_YES;
+	} else if((f->transports & (1<<transport)) ||
+		(f->num_clients != 0 && dt_filter_client(f, q))) {
+		q->dt_log = DT_LOG_YES;
+	} else if(f->answer) {
+		/* keep the query until the answer shows if it is logged */
+		q->dt_log = DT_LOG_ANSWER;
+		if(nsd->dt_collector->query_buffer) {
+			buffer_clear(nsd->dt_collector->query_buffer);
+			buffer_write(nsd->dt_collector->query_buffer,
+				buffer_begin(q->packet),
+				buffer_remaining(q->packet));
+			buffer_flip(nsd->dt_collector->query_buffer);
+		}
+		return 0;
+	}
+	return (q->dt_log == DT_LOG_YES);
+}
+
+int dt_collector_log_response(struct nsd* nsd,
+#ifdef INET6
+	struct sockaddr_storage* local_addr,
+#else
+	struct sockaddr_in* local_addr,
+#endif
+	struct query* q)
+{
+	if(q->dt_log == DT_LOG_ANSWER && nsd->dt_collector) {
+		if(!dt_filter_answer(nsd->dt_collector->filter, q)) {
+			q->dt_log = DT_LOG_NO;
+			return 0;
+		}
+		q->dt_log = DT_LOG_YES;
+		if(nsd->dt_collector->query_buffer)
+			dt_collector_submit_auth_query(nsd, local_addr,
+				&q->client_addr, q->client_addrlen, q->tcp,
+				nsd->dt_collector->query_buffer);
+	}
+	return (q->dt_log == DT_LOG_YES);
+}
+
 void dt_collector_submit_auth_query(struct nsd* nsd,
 #ifdef INET6
 	struct sockaddr_storage* local_addr,
@@ -553,6 +1186,11 @@ void dt_collector_submit_auth_query(struct nsd* nsd,
 	if(!nsd->options->dnstap_log_auth_query_messages) return;
 	if(nsd->dt_collector_fd_send[nsd->this_child->child_num] == -1) return;
 	VERBOSITY(4, (LOG_INFO, "dnstap submit auth query"));
+#ifdef DT_USE_RING
+	if(nsd->dt_collector->rings && dt_ring_submit(nsd, 0, local_addr,
+		addr, addrlen, is_tcp, packet, NULL))
+		return;
+#endif
 
 	/* marshal data into send buffer */
 	if(!prep_send_data(nsd->dt_collector->send_buffer, 0, local_addr, addr, addrlen,
@@ -585,6 +1223,11 @@ void dt_collector_submit_auth_response(struct nsd* nsd,
 	if(!nsd->options->dnstap_log_auth_response_messages) return;
 	if(nsd->dt_collector_fd_send[nsd->this_child->child_num] == -1) return;
 	VERBOSITY(4, (LOG_INFO, "dnstap submit auth response"));
+#ifdef DT_USE_RING
+	if(nsd->dt_collector->rings && dt_ring_submit(nsd, 1, local_addr,
+		addr, addrlen, is_tcp, packet, zone))
+		return;
+#endif
 
 	/* marshal data into send buffer */
 	if(!prep_send_data(nsd->dt_collector->send_buffer, 1, local_addr, addr, addrlen,
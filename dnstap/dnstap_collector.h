@@ -17,6 +17,15 @@ struct dt_collector_input;
 struct zone;
 struct buffer;
 struct region;
+struct dt_ring;
+struct dt_filter;
+struct query;
+
+/* the dnstap choice for a query, in q->dt_log */
+#define DT_LOG_NO 0
+#define DT_LOG_YES 1
+/* chosen when the query has been answered */
+#define DT_LOG_ANSWER 2
 
 /* information for the dnstap collector process. It collects information
  * for dnstap from the worker processes.  And writes them to the dnstap
@@ -43,6 +52,23 @@ struct dt_collector {
 	struct region* region;
 	/* buffer for sending data to the collector */
 	struct buffer* send_buffer;
+	/* the rings in shared memory from the workers, count of them, NULL
+	 * if the datagrams on the socketpairs carry the data */
+	struct dt_ring* rings;
+	/* in the worker, its pid once it writes its ring, 0 before that */
+	pid_t ring_writer;
+	/* in the collector process, event to continue with rings that
+	 * have more data after their turn */
+	struct event* drain_event;
+	/* if the drain_event is added */
+	int drain_pending;
+	/* the sample rate and filters of the queries that are logged */
+	struct dt_filter* filter;
+	/* in the worker, copy of the query that waits for the answer to
+	 * see if it is logged, NULL if no filter needs the answer */
+	struct buffer* query_buffer;
+	/* in the collector process, its block in the statistics, or NULL */
+	struct nsdst* st;
 };
 
 /* information per worker to get input from that worker. */
@@ -53,6 +79,9 @@ struct dt_collector_input {
 	struct event* event;
 	/* buffer to store the datagrams while they are read in */
 	struct buffer* buffer;
+	/* the ring with data from that worker, or NULL, the socketpair
+	 * then only wakes up the collector */
+	struct dt_ring* ring;
 };
 
 /* create dt_collector process structure and dt_env */
@@ -64,9 +93,26 @@ void dt_collector_close(struct dt_collector* dt_col, struct nsd* nsd);
 /* start the collector process */
 void dt_collector_start(struct dt_collector* dt_col, struct nsd* nsd);
 
+/* choose if the query is logged in the worker, with the sample rate and the
+ * client and transport filters, before it is processed. Returns true if the
+ * query is submitted. If the zones, qtypes or rcodes filters have to see the
+ * answer, the query is kept and the choice is made by
+ * dt_collector_log_response. transport is STAT_UDP, STAT_TCP or STAT_TLS. */
+int dt_collector_log_query(struct nsd* nsd, struct query* q, int transport);
+
+/* choose if the response is logged, returns true if it is submitted. A
+ * query that waited for the answer is submitted first if it is logged. */
+int dt_collector_log_response(struct nsd* nsd,
+#ifdef INET6
+	struct sockaddr_storage* local_addr,
+#else
+	struct sockaddr_in* local_addr,
+#endif
+	struct query* q);
+
 /* submit auth query from worker.  It attempts to send it to the collector,
- * if the nonblocking fails, then it silently skips it.  So it does not block
- * on the log.
+ * if the nonblocking fails, or the ring is full, then it skips it.  So it
+ * does not block on the log.
  */
 void dt_collector_submit_auth_query(struct nsd* nsd,
 #ifdef INET6
@@ -79,8 +125,8 @@ void dt_collector_submit_auth_query(struct nsd* nsd,
 	socklen_t addrlen, int is_tcp, struct buffer* packet);
 
 /* submit auth response from worker.  It attempts to send it to the collector,
- * if the nonblocking fails, then it silently skips it.  So it does not block
- * on the log.
+ * if the nonblocking fails, or the ring is full, then it skips it.  So it
+ * does not block on the log.
  */
 void dt_collector_submit_auth_response(struct nsd* nsd,
 #ifdef INET6
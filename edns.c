@@ -267,12 +267,16 @@ void cookie_verify(query_type *q, struct nsd* nsd, uint32_t *now_p) {
 
 	now_uint32 = *now_p ? *now_p : (*now_p = (uint32_t)time(NULL));
 
+	/* reject on the timestamp before the hash is computed */
 	if(compare_1982(now_uint32, cookie_time) > 0) {
 		/* ignore cookies > 1 hour in past */
-		if (subtract_1982(cookie_time, now_uint32) > 3600)
+		if (subtract_1982(cookie_time, now_uint32) > 3600) {
+			STATUP(nsd, cookieinvalid);
 			return;
+		}
 	} else if (subtract_1982(now_uint32, cookie_time) > 300) {
 		/* ignore cookies > 5 minutes in future */
+		STATUP(nsd, cookieinvalid);
 		return;
 	}
 
@@ -298,8 +302,11 @@ void cookie_verify(query_type *q, struct nsd* nsd, uint32_t *now_p) {
 		if (subtract_1982(cookie_time, now_uint32) < 1800) {
 			q->edns.cookie_status = COOKIE_VALID_REUSE;
 			memcpy(q->edns.cookie + 16, hash, 8);
-		} else
+			STATUP(nsd, cookiereuse);
+		} else {
 			q->edns.cookie_status = COOKIE_VALID;
+			STATUP(nsd, cookievalid);
+		}
 		return;
 	}
 	for(i = 1;
@@ -309,9 +316,11 @@ void cookie_verify(query_type *q, struct nsd* nsd, uint32_t *now_p) {
 		        nsd->cookie_secrets[i].cookie_secret, hash, 8);
 		if(CRYPTO_memcmp(hash2verify, hash, 8) == 0 ) {
 			q->edns.cookie_status = COOKIE_VALID;
+			STATUP(nsd, cookievalid);
 			return;
 		}
 	}
+	STATUP(nsd, cookieinvalid);
 }
 
 void cookie_create(query_type *q, struct nsd* nsd, uint32_t *now_p)
@@ -84,6 +84,9 @@ child_handle_parent_command(int fd, short event, void* arg)
 	case NSD_QUIT:
 		ipc_child_quit(data->nsd);
 		break;
+	case NSD_APPLY_XFR:
+		server_child_apply_xfrs(data->nsd, fd);
+		break;
 	case NSD_QUIT_CHILD:
 		/* close our listening sockets and ack */
 		server_close_all_sockets(data->nsd->udp, data->nsd->ifs);
@@ -242,9 +245,21 @@ stats_add(struct nsdst* total, struct nsdst* s)
 	total->raxfr += s->raxfr;
 	total->nona += s->nona;
 	total->rixfr += s->rixfr;
+	total->cookievalid += s->cookievalid;
+	total->cookiereuse += s->cookiereuse;
+	total->cookieinvalid += s->cookieinvalid;
+	total->ratelimited += s->ratelimited;
+	total->rrlretry += s->rrlretry;
+	total->rrlevict += s->rrlevict;
+	total->dnstapdrop += s->dnstapdrop;
+	total->dnstapframes += s->dnstapframes;
+	total->dnstapqueue += s->dnstapqueue;
 
 	total->db_disk = s->db_disk;
 	total->db_mem = s->db_mem;
+	total->ixfr_mem = s->ixfr_mem;
+	total->ixfr_disk = s->ixfr_disk;
+	total->ixfr_condensed = s->ixfr_condensed;
 }
 
 /** subtract stats from total */
@@ -276,6 +291,54 @@ stats_subtract(struct nsdst* total, struct nsdst* s)
 	total->raxfr -= s->raxfr;
 	total->nona -= s->nona;
 	total->rixfr -= s->rixfr;
+	total->cookievalid -= s->cookievalid;
+	total->cookiereuse -= s->cookiereuse;
+	total->cookieinvalid -= s->cookieinvalid;
+	total->ratelimited -= s->ratelimited;
+	total->rrlretry -= s->rrlretry;
+	total->rrlevict -= s->rrlevict;
+	total->dnstapdrop -= s->dnstapdrop;
+	total->dnstapframes -= s->dnstapframes;
+}
+
+/** add answer stats to total */
+void
+resp_stats_add(struct nsdst_resp* total, struct nsdst_resp* s)
+{
+	unsigned i;
+	for(i=0; i<STAT_TRANSPORTS; i++) {
+		unsigned j;
+		for(j=0; j<sizeof(total->qtype_tp[i])/sizeof(stc_type); j++)
+			total->qtype_tp[i][j] += s->qtype_tp[i][j];
+		for(j=0; j<sizeof(total->rcode_tp[i])/sizeof(stc_type); j++)
+			total->rcode_tp[i][j] += s->rcode_tp[i][j];
+	}
+	for(i=0; i<sizeof(total->latency)/sizeof(stc_type); i++)
+		total->latency[i] += s->latency[i];
+	total->latency_sum += s->latency_sum;
+	for(i=0; i<sizeof(total->respsize)/sizeof(stc_type); i++)
+		total->respsize[i] += s->respsize[i];
+	total->respsize_sum += s->respsize_sum;
+}
+
+/** subtract answer stats from total */
+void
+resp_stats_subtract(struct nsdst_resp* total, struct nsdst_resp* s)
+{
+	unsigned i;
+	for(i=0; i<STAT_TRANSPORTS; i++) {
+		unsigned j;
+		for(j=0; j<sizeof(total->qtype_tp[i])/sizeof(stc_type); j++)
+			total->qtype_tp[i][j] -= s->qtype_tp[i][j];
+		for(j=0; j<sizeof(total->rcode_tp[i])/sizeof(stc_type); j++)
+			total->rcode_tp[i][j] -= s->rcode_tp[i][j];
+	}
+	for(i=0; i<sizeof(total->latency)/sizeof(stc_type); i++)
+		total->latency[i] -= s->latency[i];
+	total->latency_sum -= s->latency_sum;
+	for(i=0; i<sizeof(total->respsize)/sizeof(stc_type); i++)
+		total->respsize[i] -= s->respsize[i];
+	total->respsize_sum -= s->respsize_sum;
 }
 #endif /* BIND8_STATS */
 
@@ -429,6 +492,7 @@ xfrd_send_reload_req(xfrd_state_type* xfrd)
 	if(!xfrd->reload_cmd_first_sent)
 		xfrd->reload_cmd_first_sent = xfrd_time();
 	xfrd->reload_cmd_last_sent = xfrd_time();
+	xfrd_reload_sent(xfrd);
 	xfrd->need_to_send_reload = 0;
 	xfrd->can_send_reload = 0;
 }
@@ -562,6 +626,7 @@ xfrd_handle_ipc_read(struct event* handler, xfrd_state_type* xfrd)
 			sizeof(pid_t), -1) != sizeof(pid_t)) {
 			log_msg(LOG_ERR, "xfrd cannot get reload_pid");
 		}
+		xfrd_reload_done(xfrd);
 		/* read the not-mytask for the results and soainfo */
 		xfrd_process_task_result(xfrd,
 			xfrd->nsd->task[1-xfrd->nsd->mytask]);
@@ -17,6 +17,7 @@ struct nsd_child;
 struct xfrd_tcp;
 struct xfrd_state;
 struct nsdst;
+struct nsdst_resp;
 struct event;
 
 /*
@@ -84,6 +85,10 @@ void parent_check_all_children_exited(struct nsd* nsd);
 void stats_add(struct nsdst* total, struct nsdst* s);
 /** subtract stats from total */
 void stats_subtract(struct nsdst* total, struct nsdst* s);
+/** add answer stats to total */
+void resp_stats_add(struct nsdst_resp* total, struct nsdst_resp* s);
+/** subtract answer stats from total */
+void resp_stats_subtract(struct nsdst_resp* total, struct nsdst_resp* s);
 
 /** set event to listen to given mode, no timeout, must be added already */
 void ipc_xfrd_set_listening(struct xfrd_state* xfrd, short mode);
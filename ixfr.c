@@ -40,6 +40,11 @@
 /* initial space in rrs data for storing records */
 #define IXFR_STORE_INITIAL_SIZE 4096
 
+/* bits in the hash table that finds matches for the ixfr compression */
+#define IXFR_Z_HASHBITS 12
+/* the minimum length of a match in the ixfr compression */
+#define IXFR_Z_MINMATCH 4
+
 /* store compression for one name */
 struct rrcompress_entry {
 	/* rbtree node, key is this struct */
@@ -681,6 +686,46 @@ static size_t count_rr_length(const uint8_t* data, size_t data_len,
 	return i-current;
 }
 
+/* get the del and add RRs of the data, if it is compressed they are
+ * uncompressed into *buf, that the caller frees. return 0 on failure. */
+static int ixfr_data_get_rrs(struct ixfr_data* data, uint8_t** del,
+	uint8_t** add, uint8_t** buf)
+{
+	*buf = NULL;
+	if(!data->zdata) {
+		*del = data->del;
+		*add = data->add;
+		return 1;
+	}
+	*buf = xalloc(data->del_len + data->add_len);
+	if(!ixfr_decompress(data->zdata, data->zdata_len, *buf,
+		data->del_len + data->add_len)) {
+		free(*buf);
+		*buf = NULL;
+		return 0;
+	}
+	*del = *buf;
+	*add = *buf + data->del_len;
+	return 1;
+}
+
+/* set the ixfr data that the query processes, with its RRs */
+static int ixfr_query_set_data(struct query* query, struct ixfr_data* data)
+{
+	free(query->ixfr_rrs);
+	query->ixfr_rrs = NULL;
+	query->ixfr_data = data;
+	if(!ixfr_data_get_rrs(data, &query->ixfr_del, &query->ixfr_add,
+		&query->ixfr_rrs)) {
+		log_msg(LOG_ERR, "ixfr_out: could not uncompress IXFR data "
+			"of zone %s from serial %u",
+			domain_to_string(query->zone->apex),
+			(unsigned)data->oldserial);
+		return 0;
+	}
+	return 1;
+}
+
 /* Copy RRs into packet until packet full, return number RRs added */
 static uint16_t ixfr_copy_rrs_into_packet(struct query* query,
 	struct pktcompression* pcomp)
@@ -745,10 +790,10 @@ static uint16_t ixfr_copy_rrs_into_packet(struct query* query,
 
 	/* Add del data, with deleted RRs and a SOA */
 	while(query->ixfr_count_del < query->ixfr_data->del_len) {
-		size_t rrlen = count_rr_length(query->ixfr_data->del,
+		size_t rrlen = count_rr_length(query->ixfr_del,
 			query->ixfr_data->del_len, query->ixfr_count_del);
 		if(rrlen && ixfr_write_rr_pkt(query, query->packet, pcomp,
-			query->ixfr_data->del + query->ixfr_count_del,
+			query->ixfr_del + query->ixfr_count_del,
 			rrlen, total_added)) {
 			query->ixfr_count_del += rrlen;
 			total_added++;
@@ -762,7 +807,7 @@ static uint16_t ixfr_copy_rrs_into_packet(struct query* query,
 				char apexstr[MAXDOMAINLEN * 5];
 				char* ownerstr = "";
 				if(rrlen)
-					ownerstr = wiredname2str(query->ixfr_data->del + query->ixfr_count_del);
+					ownerstr = wiredname2str(query->ixfr_del + query->ixfr_count_del);
 				domain_to_string_buf(query->zone->apex, apexstr);
 				VERBOSITY(2, (LOG_ERR, "ixfr_out: RR at %s in zone %s too large for any DNS message "
 					"(wire encoding exceeds %d bytes), aborting IXFR transfer",
@@ -776,10 +821,10 @@ static uint16_t ixfr_copy_rrs_into_packet(struct query* query,
 
 	/* Add add data, with added RRs and a SOA */
 	while(query->ixfr_count_add < query->ixfr_data->add_len) {
-		size_t rrlen = count_rr_length(query->ixfr_data->add,
+		size_t rrlen = count_rr_length(query->ixfr_add,
 			query->ixfr_data->add_len, query->ixfr_count_add);
 		if(rrlen && ixfr_write_rr_pkt(query, query->packet, pcomp,
-			query->ixfr_data->add + query->ixfr_count_add,
+			query->ixfr_add + query->ixfr_count_add,
 			rrlen, total_added)) {
 			query->ixfr_count_add += rrlen;
 			total_added++;
@@ -793,7 +838,7 @@ static uint16_t ixfr_copy_rrs_into_packet(struct query* query,
 				char apexstr[MAXDOMAINLEN * 5];
 				char* ownerstr = "";
 				if(rrlen)
-					ownerstr = wiredname2str(query->ixfr_data->add + query->ixfr_count_add);
+					ownerstr = wiredname2str(query->ixfr_add + query->ixfr_count_add);
 				domain_to_string_buf(query->zone->apex, apexstr);
 				VERBOSITY(2, (LOG_ERR, "ixfr_out: RR at %s in zone %s too large for any DNS message "
 					"(wire encoding exceeds %d bytes), aborting IXFR transfer",
@@ -807,6 +852,163 @@ static uint16_t ixfr_copy_rrs_into_packet(struct query* query,
 	return total_added;
 }
 
+/* an RR in the deleted or added set of a condensed IXFR */
+struct ixfr_condense_rr {
+	/* rbtree node, key is this struct */
+	struct rbnode node;
+	/* the RR in uncompressed wireformat */
+	uint8_t* rr;
+	/* length of the RR */
+	size_t len;
+};
+
+/* compare two RRs for the condensed IXFR, the owner name is compared
+ * case insensitive. Returns -1, 0, or 1. */
+static int ixfr_condense_cmp(const void* a, const void* b)
+{
+	struct ixfr_condense_rr* x = (struct ixfr_condense_rr*)a;
+	struct ixfr_condense_rr* y = (struct ixfr_condense_rr*)b;
+	size_t i = 0, n;
+	/* the owner names, the label lengths are compared as well */
+	while(x->rr[i] != 0 && x->rr[i] == y->rr[i]) {
+		size_t lablen = x->rr[i++], j;
+		for(j=0; j<lablen; j++, i++) {
+			uint8_t cx = (uint8_t)tolower((unsigned char)x->rr[i]);
+			uint8_t cy = (uint8_t)tolower((unsigned char)y->rr[i]);
+			if(cx != cy)
+				return cx < cy ? -1 : 1;
+		}
+	}
+	if(x->rr[i] != y->rr[i])
+		return x->rr[i] < y->rr[i] ? -1 : 1;
+	/* the type, class, ttl and rdata */
+	i++;
+	n = (x->len < y->len ? x->len : y->len) - i;
+	if(n > 0) {
+		int c = memcmp(x->rr+i, y->rr+i, n);
+		if(c != 0)
+			return c < 0 ? -1 : 1;
+	}
+	if(x->len != y->len)
+		return x->len < y->len ? -1 : 1;
+	return 0;
+}
+
+/* Remove the RRs from the other set, or add them to this set, for the
+ * condensed IXFR. An RR that is deleted after it was added, or added
+ * after it was deleted, is not in the condensed IXFR.
+ * Returns 0 on failure. */
+static int ixfr_condense_rrs(struct region* region, struct rbtree* set,
+	struct rbtree* other, uint8_t* rrs, size_t len)
+{
+	size_t pos = 0;
+	while(pos < len) {
+		struct ixfr_condense_rr key, *rr;
+		size_t rrlen = count_rr_length(rrs, len, pos);
+		if(rrlen == 0)
+			return 0;
+		key.rr = rrs+pos;
+		key.len = rrlen;
+		key.node.key = &key;
+		if(rbtree_delete(other, &key) == NULL) {
+			rr = (struct ixfr_condense_rr*)region_alloc(region,
+				sizeof(*rr));
+			rr->rr = region_alloc_init(region, rrs+pos, rrlen);
+			rr->len = rrlen;
+			rr->node.key = rr;
+			(void)rbtree_insert(set, &rr->node);
+		}
+		pos += rrlen;
+	}
+	return 1;
+}
+
+/* Put the RRs in the set after each other, and the SOA record after it.
+ * Returns the allocated RRs. */
+static uint8_t* ixfr_condense_put(struct rbtree* set, uint8_t* soa,
+	size_t soa_len, size_t* len)
+{
+	struct ixfr_condense_rr* rr;
+	uint8_t* rrs;
+	size_t pos = 0;
+	*len = soa_len;
+	RBTREE_FOR(rr, struct ixfr_condense_rr*, set) {
+		*len += rr->len;
+	}
+	rrs = xalloc(*len);
+	RBTREE_FOR(rr, struct ixfr_condense_rr*, set) {
+		memmove(rrs+pos, rr->rr, rr->len);
+		pos += rr->len;
+	}
+	memmove(rrs+pos, soa, soa_len);
+	return rrs;
+}
+
+/* Make the condensed IXFR from the data to the newest version, it
+ * deletes and adds the RRs of the versions in one. Returns NULL on
+ * failure. */
+struct ixfr_data* ixfr_data_condense(struct zone_ixfr* ixfr,
+	struct ixfr_data* first)
+{
+	struct region* region = region_create(xalloc, free);
+	struct rbtree* delset = rbtree_create(region, &ixfr_condense_cmp);
+	struct rbtree* addset = rbtree_create(region, &ixfr_condense_cmp);
+	struct ixfr_data* data = first, *last = NULL, *c;
+	size_t count = 0;
+	while(data) {
+		uint8_t* del, *add, *buf;
+		int ok;
+		if(count++ > ixfr->data->count + 12 ||
+			data->del_len < data->newsoa_len ||
+			data->add_len < data->newsoa_len ||
+			!ixfr_data_get_rrs(data, &del, &add, &buf)) {
+			region_destroy(region);
+			return NULL;
+		}
+		/* the del and add RRs end with the SOA record of the
+		 * version, that is not part of the condensed sets */
+		ok = ixfr_condense_rrs(region, delset, addset, del,
+			data->del_len - data->newsoa_len) &&
+			ixfr_condense_rrs(region, addset, delset, add,
+			data->add_len - data->newsoa_len);
+		free(buf);
+		if(!ok) {
+			region_destroy(region);
+			return NULL;
+		}
+		last = data;
+		data = ixfr_data_next(ixfr, data);
+	}
+	if(!last) {
+		region_destroy(region);
+		return NULL;
+	}
+	c = xalloc_zero(sizeof(*c));
+	c->oldserial = first->oldserial;
+	c->newserial = last->newserial;
+	c->oldsoa = xalloc(first->oldsoa_len);
+	memmove(c->oldsoa, first->oldsoa, first->oldsoa_len);
+	c->oldsoa_len = first->oldsoa_len;
+	c->newsoa = xalloc(last->newsoa_len);
+	memmove(c->newsoa, last->newsoa, last->newsoa_len);
+	c->newsoa_len = last->newsoa_len;
+	c->del = ixfr_condense_put(delset, last->newsoa, last->newsoa_len,
+		&c->del_len);
+	c->add = ixfr_condense_put(addset, last->newsoa, last->newsoa_len,
+		&c->add_len);
+	region_destroy(region);
+	return c;
+}
+
+/* get the condensed IXFR from the data to the newest version. It is
+ * made at the reload, NULL if there is none. */
+static struct ixfr_data* ixfr_data_condensed(struct zone* zone,
+	struct ixfr_data* first)
+{
+	return (struct ixfr_data*)rbtree_search(zone->ixfr->condensed,
+		&first->oldserial);
+}
+
 query_state_type query_ixfr(struct nsd *nsd, struct query *query)
 {
 	uint16_t total_added = 0;
@@ -916,10 +1118,24 @@ query_state_type query_ixfr(struct nsd *nsd, struct query *query)
 		}
 
 		query->zone = zone;
-		query->ixfr_data = ixfr_data;
-		query->ixfr_is_done = 0;
 		/* set up to copy the last version's SOA as first SOA */
 		query->ixfr_end_data = ixfr_data_last(zone->ixfr);
+		if(zone->opts->pattern->ixfr_condense &&
+			ixfr_data != query->ixfr_end_data) {
+			/* send the versions as one, if that fails send
+			 * the versions one after the other */
+			struct ixfr_data* c = ixfr_data_condensed(zone,
+				ixfr_data);
+			if(c) {
+				ixfr_data = c;
+				query->ixfr_end_data = c;
+			}
+		}
+		if(!ixfr_query_set_data(query, ixfr_data)) {
+			RCODE_SET(query->packet, RCODE_SERVFAIL);
+			return QUERY_PROCESSED;
+		}
+		query->ixfr_is_done = 0;
 		query->ixfr_count_newsoa = 0;
 		query->ixfr_count_oldsoa = 0;
 		query->ixfr_count_del = 0;
@@ -946,12 +1162,18 @@ query_state_type query_ixfr(struct nsd *nsd, struct query *query)
 
 	while(!query->ixfr_is_done &&
 		query->ixfr_count_add >= query->ixfr_data->add_len) {
-		struct ixfr_data* next = ixfr_data_next(query->zone->ixfr,
-			query->ixfr_data);
+		/* the end data is the last, also if it is condensed */
+		struct ixfr_data* next = (query->ixfr_data ==
+			query->ixfr_end_data ? NULL :
+			ixfr_data_next(query->zone->ixfr, query->ixfr_data));
 		/* finished the ixfr_data */
 		if(next) {
 			/* move to the next IXFR */
-			query->ixfr_data = next;
+			if(!ixfr_query_set_data(query, next)) {
+				RCODE_SET(query->packet, RCODE_SERVFAIL);
+				query->ixfr_is_done = 1;
+				break;
+			}
 			/* we need to skip the SOA records, set len to done*/
 			/* the newsoa count is already done, at end_data len */
 			query->ixfr_count_oldsoa = next->oldsoa_len;
@@ -1009,16 +1231,165 @@ static void ixfr_data_free(struct ixfr_data* data)
 	free(data->oldsoa);
 	free(data->del);
 	free(data->add);
+	free(data->zdata);
 	free(data->log_str);
 	free(data);
 }
 
 size_t ixfr_data_size(struct ixfr_data* data)
 {
+	if(data->zdata)
+		return sizeof(struct ixfr_data) + data->newsoa_len +
+			data->oldsoa_len + data->zdata_len;
 	return sizeof(struct ixfr_data) + data->newsoa_len + data->oldsoa_len
 		+ data->del_len + data->add_len;
 }
 
+size_t ixfr_compress_bound(size_t len)
+{
+	return len + len/255 + 16;
+}
+
+/* write the extra bytes of a length in the compressed data */
+static size_t ixfr_z_putlen(uint8_t* out, size_t op, size_t len)
+{
+	while(len >= 255) {
+		out[op++] = 255;
+		len -= 255;
+	}
+	out[op++] = (uint8_t)len;
+	return op;
+}
+
+/* read the extra bytes of a length in the compressed data */
+static int ixfr_z_getlen(const uint8_t* in, size_t inlen, size_t* ip,
+	size_t* len)
+{
+	uint8_t b;
+	do {
+		if(*ip >= inlen)
+			return 0;
+		b = in[(*ip)++];
+		*len += b;
+	} while(b == 255);
+	return 1;
+}
+
+/* write a sequence of literals and a match of mlen, if mlen is not 0, at
+ * offset back. The token has the literal length in the upper four bits
+ * and the match length in the lower four bits. */
+static size_t ixfr_z_sequence(uint8_t* out, size_t op, const uint8_t* lit,
+	size_t litlen, size_t offset, size_t mlen)
+{
+	size_t token = op++;
+	out[token] = (uint8_t)((litlen<15?litlen:15)<<4);
+	if(litlen >= 15)
+		op = ixfr_z_putlen(out, op, litlen-15);
+	memcpy(out+op, lit, litlen);
+	op += litlen;
+	if(mlen == 0)
+		return op;
+	out[op++] = (uint8_t)(offset&0xff);
+	out[op++] = (uint8_t)(offset>>8);
+	mlen -= IXFR_Z_MINMATCH;
+	out[token] |= (uint8_t)(mlen<15?mlen:15);
+	if(mlen >= 15)
+		op = ixfr_z_putlen(out, op, mlen-15);
+	return op;
+}
+
+size_t ixfr_compress(const uint8_t* in, size_t len, uint8_t* out)
+{
+	/* the position plus one of the last occurrence of a hash */
+	uint32_t table[1<<IXFR_Z_HASHBITS];
+	size_t ip = 0, anchor = 0, op = 0;
+	memset(table, 0, sizeof(table));
+	while(ip + IXFR_Z_MINMATCH <= len) {
+		uint32_t seq, h;
+		size_t ref;
+		memcpy(&seq, in+ip, sizeof(seq));
+		h = (seq*2654435761U) >> (32-IXFR_Z_HASHBITS);
+		ref = table[h];
+		table[h] = (uint32_t)(ip+1);
+		if(ref != 0 && ip-(ref-1) <= 65535 &&
+			memcmp(in+ref-1, in+ip, IXFR_Z_MINMATCH) == 0) {
+			size_t mlen = IXFR_Z_MINMATCH;
+			while(ip+mlen < len && in[ref-1+mlen] == in[ip+mlen])
+				mlen++;
+			op = ixfr_z_sequence(out, op, in+anchor, ip-anchor,
+				ip-(ref-1), mlen);
+			ip += mlen;
+			anchor = ip;
+		} else {
+			ip++;
+		}
+	}
+	/* the last sequence has only literals */
+	return ixfr_z_sequence(out, op, in+anchor, len-anchor, 0, 0);
+}
+
+int ixfr_decompress(const uint8_t* in, size_t inlen, uint8_t* out,
+	size_t outlen)
+{
+	size_t ip = 0, op = 0;
+	while(ip < inlen) {
+		uint8_t token = in[ip++];
+		size_t litlen = token>>4, mlen = token&0x0f, offset;
+		if(litlen == 15 && !ixfr_z_getlen(in, inlen, &ip, &litlen))
+			return 0;
+		if(litlen > inlen-ip || litlen > outlen-op)
+			return 0;
+		memcpy(out+op, in+ip, litlen);
+		ip += litlen;
+		op += litlen;
+		if(ip == inlen)
+			break; /* the last sequence */
+		if(ip+2 > inlen)
+			return 0;
+		offset = in[ip] | (in[ip+1]<<8);
+		ip += 2;
+		if(mlen == 15 && !ixfr_z_getlen(in, inlen, &ip, &mlen))
+			return 0;
+		mlen += IXFR_Z_MINMATCH;
+		if(offset == 0 || offset > op || mlen > outlen-op)
+			return 0;
+		/* the match can overlap the output, copy bytewise */
+		while(mlen--) {
+			out[op] = out[op-offset];
+			op++;
+		}
+	}
+	return op == outlen;
+}
+
+/* compress the del and add RRs of the data, for ixfr-compress */
+static void ixfr_data_compress(struct ixfr_data* data)
+{
+	size_t len = data->del_len + data->add_len, zlen;
+	uint8_t* buf, *z;
+	if(data->zdata || len == 0)
+		return;
+	buf = xalloc(len);
+	if(data->del_len)
+		memcpy(buf, data->del, data->del_len);
+	if(data->add_len)
+		memcpy(buf+data->del_len, data->add, data->add_len);
+	z = xalloc(ixfr_compress_bound(len));
+	zlen = ixfr_compress(buf, len, z);
+	free(buf);
+	if(zlen >= len) {
+		/* it does not get smaller */
+		free(z);
+		return;
+	}
+	data->zdata = xrealloc(z, zlen);
+	data->zdata_len = zlen;
+	free(data->del);
+	free(data->add);
+	data->del = NULL;
+	data->add = NULL;
+}
+
 struct ixfr_store* ixfr_store_start(struct zone* zone,
 	struct ixfr_store* ixfr_store_mem)
 {
@@ -1135,6 +1506,8 @@ void ixfr_store_finish(struct ixfr_store* ixfr_store, struct nsd* nsd,
 
 	if(log_buf && !ixfr_store->data->log_str)
 		ixfr_store->data->log_str = strdup(log_buf);
+	if(ixfr_store->zone->opts->pattern->ixfr_compress)
+		ixfr_data_compress(ixfr_store->data);
 
 	/* store the data in the zone */
 	if(!ixfr_store->zone->ixfr)
@@ -1557,6 +1930,7 @@ struct zone_ixfr* zone_ixfr_create(struct nsd* nsd)
 {
 	struct zone_ixfr* ixfr = xalloc_zero(sizeof(struct zone_ixfr));
 	ixfr->data = rbtree_create(nsd->region, &ixfrcompare);
+	ixfr->condensed = rbtree_create(nsd->region, &ixfrcompare);
 	return ixfr;
 }
 
@@ -1570,17 +1944,70 @@ static void ixfr_tree_del(struct rbnode* node)
 	ixfr_data_free((struct ixfr_data*)node);
 }
 
+/* clear the cache of condensed IXFRs, when the versions change */
+static void zone_ixfr_clear_condensed(struct zone_ixfr* ixfr)
+{
+	if(!ixfr || !ixfr->condensed)
+		return;
+	ixfr_tree_del(ixfr->condensed->root);
+	ixfr->condensed->root = RBTREE_NULL;
+	ixfr->condensed->count = 0;
+	ixfr->condensed_size = 0;
+	ixfr->condensed_made = 0;
+}
+
+void zone_ixfr_make_condensed(struct zone* zone)
+{
+	struct zone_ixfr* ixfr = zone->ixfr;
+	struct ixfr_data* data;
+	size_t prevcount = 0;
+	if(!ixfr || ixfr->condensed_made)
+		return;
+	if(!zone->opts->pattern->ixfr_condense) {
+		zone_ixfr_clear_condensed(ixfr);
+		return;
+	}
+	ixfr->condensed_made = 1;
+	/* the newest version is sent as it is. The condensed IXFRs from
+	 * the newer versions are smaller, and are made first. */
+	data = ixfr_data_last(ixfr);
+	while((data = ixfr_data_prev(ixfr, data, &prevcount)) != NULL) {
+		struct ixfr_data* c = ixfr_data_condense(ixfr, data);
+		if(!c)
+			return;
+		if(zone->opts->pattern->ixfr_compress)
+			ixfr_data_compress(c);
+		if(zone->opts->pattern->ixfr_size != 0 &&
+			ixfr->condensed_size + ixfr_data_size(c) >
+			zone->opts->pattern->ixfr_size) {
+			VERBOSITY(2, (LOG_INFO, "zone %s: condensed IXFR "
+				"from serial %u does not fit in ixfr-size",
+				zone->opts->name, (unsigned)c->oldserial));
+			ixfr_data_free(c);
+			return;
+		}
+		c->node.key = &c->oldserial;
+		(void)rbtree_insert(ixfr->condensed, &c->node);
+		ixfr->condensed_size += ixfr_data_size(c);
+		VERBOSITY(2, (LOG_INFO, "zone %s: condensed IXFR from serial "
+			"%u to %u", zone->opts->name, (unsigned)c->oldserial,
+			(unsigned)c->newserial));
+	}
+}
+
 /* clear the ixfr data elements */
 static void zone_ixfr_clear(struct zone_ixfr* ixfr)
 {
 	if(!ixfr)
 		return;
+	zone_ixfr_clear_condensed(ixfr);
 	if(ixfr->data) {
 		ixfr_tree_del(ixfr->data->root);
 		ixfr->data->root = RBTREE_NULL;
 		ixfr->data->count = 0;
 	}
 	ixfr->total_size = 0;
+	ixfr->file_size = 0;
 	ixfr->oldest_serial = 0;
 	ixfr->newest_serial = 0;
 }
@@ -1593,6 +2020,10 @@ void zone_ixfr_free(struct zone_ixfr* ixfr)
 		ixfr_tree_del(ixfr->data->root);
 		ixfr->data = NULL;
 	}
+	if(ixfr->condensed) {
+		ixfr_tree_del(ixfr->condensed->root);
+		ixfr->condensed = NULL;
+	}
 	free(ixfr);
 }
 
@@ -1670,14 +2101,17 @@ void zone_ixfr_make_space(struct zone_ixfr* ixfr, struct zone* zone,
 
 void zone_ixfr_remove(struct zone_ixfr* ixfr, struct ixfr_data* data)
 {
+	zone_ixfr_clear_condensed(ixfr);
 	rbtree_delete(ixfr->data, data->node.key);
 	ixfr->total_size -= ixfr_data_size(data);
+	ixfr->file_size -= data->file_size;
 	ixfr_data_free(data);
 }
 
 void zone_ixfr_add(struct zone_ixfr* ixfr, struct ixfr_data* data, int isnew,
 	const char* zname)
 {
+	zone_ixfr_clear_condensed(ixfr);
 	memset(&data->node, 0, sizeof(data->node));
 	data->node.key = &data->oldserial;
 	if(rbtree_insert(ixfr->data, &data->node) == NULL) {
@@ -1699,6 +2133,7 @@ void zone_ixfr_add(struct zone_ixfr* ixfr, struct ixfr_data* data, int isnew,
 		ixfr->oldest_serial = data->oldserial;
 	}
 	ixfr->total_size += ixfr_data_size(data);
+	ixfr->file_size += data->file_size;
 }
 
 struct ixfr_data* zone_ixfr_find_serial(struct zone_ixfr* ixfr,
@@ -1880,6 +2315,8 @@ static void ixfr_delete_rest_files(struct zone* zone, struct ixfr_data* from,
 			(void)ixfr_unlink_it_ctmp(zone->opts->name, zfile,
 				data->file_num, 0, temp);
 			data->file_num = 0;
+			zone->ixfr->file_size -= data->file_size;
+			data->file_size = 0;
 		}
 		data = ixfr_data_prev(zone->ixfr, data, &prevcount);
 	}
@@ -2023,7 +2460,11 @@ static int ixfr_write_file_header(struct zone* zone, struct ixfr_data* data,
 		return 0;
 	if(!fprintf(out, "; to_serial %u\n", (unsigned)data->newserial))
 		return 0;
-	if(!fprintf(out, "; data_size %u\n", (unsigned)ixfr_data_size(data)))
+	/* the size of the uncompressed data, also if it is kept compressed
+	 * in memory, the file has the same contents either way */
+	if(!fprintf(out, "; data_size %u\n", (unsigned)(
+		sizeof(struct ixfr_data) + data->newsoa_len +
+		data->oldsoa_len + data->del_len + data->add_len)))
 		return 0;
 	if(data->log_str) {
 		if(!fprintf(out, "; %s\n", data->log_str))
@@ -2159,34 +2600,30 @@ static int ixfr_write_file_data(struct zone* zone, struct ixfr_data* data,
 {
 	struct region* temp, *rrtemp;
 	buffer_type* rr_buffer;
+	uint8_t* del, *add, *buf;
+	if(!ixfr_data_get_rrs(data, &del, &add, &buf)) {
+		log_msg(LOG_ERR, "could not uncompress IXFR data of zone %s "
+			"for file %s", zone->opts->name, fname);
+		return 0;
+	}
 	temp = region_create(xalloc, free);
 	rrtemp = region_create(xalloc, free);
 	rr_buffer = buffer_create(rrtemp, MAX_RDLENGTH);
 
 	if(!ixfr_write_rrs(zone, out, fname, data->newsoa, data->newsoa_len,
+		temp, rr_buffer) ||
+		!ixfr_write_rrs(zone, out, fname, data->oldsoa,
+		data->oldsoa_len, temp, rr_buffer) ||
+		!ixfr_write_rrs(zone, out, fname, del, data->del_len,
+		temp, rr_buffer) ||
+		!ixfr_write_rrs(zone, out, fname, add, data->add_len,
 		temp, rr_buffer)) {
+		free(buf);
 		region_destroy(temp);
 		region_destroy(rrtemp);
 		return 0;
 	}
-	if(!ixfr_write_rrs(zone, out, fname, data->oldsoa, data->oldsoa_len,
-		temp, rr_buffer)) {
-		region_destroy(temp);
-		region_destroy(rrtemp);
-		return 0;
-	}
-	if(!ixfr_write_rrs(zone, out, fname, data->del, data->del_len,
-		temp, rr_buffer)) {
-		region_destroy(temp);
-		region_destroy(rrtemp);
-		return 0;
-	}
-	if(!ixfr_write_rrs(zone, out, fname, data->add, data->add_len,
-		temp, rr_buffer)) {
-		region_destroy(temp);
-		region_destroy(rrtemp);
-		return 0;
-	}
+	free(buf);
 	region_destroy(temp);
 	region_destroy(rrtemp);
 	return 1;
@@ -2218,6 +2655,7 @@ int ixfr_write_file(struct zone* zone, struct ixfr_data* data,
 		return 0;
 	}
 
+	data->file_size = (size_t)ftell(out);
 	fclose(out);
 	data->file_num = file_num;
 	return 1;
@@ -2236,6 +2674,8 @@ static void ixfr_write_files(struct zone* zone, const char* zfile)
 	data = ixfr_data_last(zone->ixfr);
 	num=1;
 	while(data && data->file_num == 0) {
+		zone->ixfr->file_size -= data->file_size;
+		data->file_size = 0;
 		if(!ixfr_write_file(zone, data, zfile, num)) {
 			/* There could be more files that are sitting on the
 			 * disk, remove them, they are not used without
@@ -2251,6 +2691,7 @@ static void ixfr_write_files(struct zone* zone, const char* zfile)
 			ixfr_delete_rest_files(zone, data, zfile, 0);
 			return;
 		}
+		zone->ixfr->file_size += data->file_size;
 		num++;
 		data = ixfr_data_prev(zone->ixfr, data, &prevcount);
 	}
@@ -2651,7 +3092,8 @@ static void ixfr_data_log(
 
 /* read ixfr data from file */
 static int ixfr_data_read(struct nsd* nsd, struct zone* zone,
-	const char* ixfrfile, uint32_t* dest_serial, int file_num)
+	const char* ixfrfile, uint32_t* dest_serial, int file_num,
+	size_t file_size)
 {
 	struct ixfr_data_state state = { 0 };
 	size_t ixfr_data_sz;
@@ -2672,6 +3114,7 @@ static int ixfr_data_read(struct nsd* nsd, struct zone* zone,
 	state.zone = zone;
 	state.data = xalloc_zero(sizeof(*state.data));
 	state.data->file_num = file_num;
+	state.data->file_size = file_size;
 
 	state.dest_serial = dest_serial;
 	/* the temp region is cleared after every RR */
@@ -2723,6 +3166,8 @@ static int ixfr_data_read(struct nsd* nsd, struct zone* zone,
 
 	region_destroy(state.tempregion);
 	region_destroy(state.stayregion);
+	if(zone->opts->pattern->ixfr_compress)
+		ixfr_data_compress(state.data);
 
 	if(!zone->ixfr)
 		zone->ixfr = zone_ixfr_create(nsd);
@@ -2752,9 +3197,13 @@ static int ixfr_read_one_more_file(struct nsd* nsd, struct zone* zone,
 	int file_num = num_files+1;
 	make_ixfr_name(ixfrfile, sizeof(ixfrfile), zfile, file_num);
 	/* if the file does not exist, all transfers have been read */
-	if (stat(ixfrfile, &statbuf) != 0 && errno == ENOENT)
-		return 0;
-	return ixfr_data_read(nsd, zone, ixfrfile, dest_serial, file_num);
+	if (stat(ixfrfile, &statbuf) != 0) {
+		if(errno == ENOENT)
+			return 0;
+		statbuf.st_size = 0;
+	}
+	return ixfr_data_read(nsd, zone, ixfrfile, dest_serial, file_num,
+		(size_t)statbuf.st_size);
 }
 
 void ixfr_read_from_file(struct nsd* nsd, struct zone* zone, const char* zfile)
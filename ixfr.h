@@ -29,9 +29,20 @@ struct zone_ixfr {
 	 * by old_serial, so the looked up and next are the versions needed.
 	 * Tree of ixfr data for versions */
 	struct rbtree* data;
+	/* With ixfr-condense, the condensed IXFRs, that go from a version
+	 * to the newest version at once. Items are of type ixfr_data, the
+	 * key is old_serial. They are cleared when the versions change,
+	 * and made again by zone_ixfr_make_condensed. */
+	struct rbtree* condensed;
+	/* size of the condensed IXFRs in memory, in bytes */
+	size_t condensed_size;
+	/* if the condensed IXFRs are made for the current versions */
+	int condensed_made;
 	/* total size stored at this time, in bytes,
 	 * sum of sizes of the ixfr data elements */
 	size_t total_size;
+	/* total size of the ixfr files on disk of the data elements */
+	size_t file_size;
 	/* the oldest serial number in the tree, searchable by old_serial */
 	uint32_t oldest_serial;
 	/* the newest serial number in the tree, that is searchable in the
@@ -82,11 +93,19 @@ struct ixfr_data {
 	uint8_t* add;
 	/* byte length of the uncompressed wireformat RRs in add */
 	size_t add_len;
+	/* with ixfr-compress, the del and add RRs after each other,
+	 * compressed. Then del and add are NULL, and del_len and add_len
+	 * are the uncompressed lengths. NULL if not compressed. */
+	uint8_t* zdata;
+	/* byte length of the compressed data in zdata */
+	size_t zdata_len;
 	/* log string (if not NULL) about where data is from */
 	char* log_str;
 	/* the number of the ixfr.<num> file on disk. If 0, there is no
 	 * file. If 1, it is file ixfr<nothingafterit>. */
 	int file_num;
+	/* the size of the ixfr file on disk, 0 if not known */
+	size_t file_size;
 };
 
 /* process queries in IXFR state */
@@ -218,13 +237,44 @@ void zone_ixfr_remove(struct zone_ixfr* ixfr, struct ixfr_data* data);
 void zone_ixfr_add(struct zone_ixfr* ixfr, struct ixfr_data* data, int isnew,
 	const char* zname);
 
+/* make the condensed IXFRs of the zone, with ixfr-condense, if the
+ * versions have changed. They are made until they do not fit in the
+ * ixfr-size of the zone. */
+void zone_ixfr_make_condensed(struct zone* zone);
+
+/* Make the condensed IXFR from the data to the newest version, it deletes
+ * and adds the RRs of the versions in one. Returns NULL on failure, or
+ * the ixfr_data, that the caller frees. */
+struct ixfr_data* ixfr_data_condense(struct zone_ixfr* ixfr,
+	struct ixfr_data* first);
+
 /* find serial number in ixfr list, or NULL if not found */
 struct ixfr_data* zone_ixfr_find_serial(struct zone_ixfr* ixfr,
 	uint32_t qserial);
 
-/* size of the ixfr data */
+/* size of the ixfr data, that is stored in memory */
 size_t ixfr_data_size(struct ixfr_data* data);
 
+/* the maximum length of the compressed output for len bytes of input */
+size_t ixfr_compress_bound(size_t len);
+
+/*
+ * Compress data for the IXFR storage, with an LZ77 method.
+ * in: the input and its length.
+ * out: destination, ixfr_compress_bound(len) bytes in size.
+ * return the compressed length.
+ */
+size_t ixfr_compress(const uint8_t* in, size_t len, uint8_t* out);
+
+/*
+ * Decompress data compressed with ixfr_compress.
+ * in: the compressed data and its length.
+ * out: destination, and its length that is the uncompressed length.
+ * return 0 if the data is malformed or does not fill out exactly.
+ */
+int ixfr_decompress(const uint8_t* in, size_t inlen, uint8_t* out,
+	size_t outlen);
+
 /* write ixfr contents to file for the zone */
 void ixfr_write_to_file(struct zone* zone, const char* zfile);
 
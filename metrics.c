@@ -18,6 +18,8 @@
 #include <errno.h>
 #include <event2/event.h>
 #include <event2/http.h>
+#include <event2/buffer.h>
+#include <event2/keyvalq_struct.h>
 #include <ctype.h>
 #include <inttypes.h>
 
@@ -26,6 +28,7 @@
 #include "options.h"
 #include "remote.h"
 #include "metrics.h"
+#include "xfrd-notify.h"
 
 /** if you want zero to be inhibited in stats output.
  * it omits zeroes for types that have no acronym and unused-rcodes */
@@ -53,6 +56,14 @@ struct daemon_metrics {
 	struct timeval stats_time, boot_time;
 	/** libevent http server */
 	struct evhttp *http_server;
+	/** the rendered metrics page, that the requests are served from */
+	struct evbuffer *cache;
+	/** if the cached page is current, the refresh timer keeps it so */
+	int cache_valid;
+	/** timer that renders the page again every metrics-cache-time */
+	struct event *refresh_timer;
+	/** the number of refresh periods without a request */
+	int idle;
 };
 
 static void
@@ -99,6 +110,15 @@ void daemon_metrics_close(struct daemon_metrics* metrics)
 		evhttp_free(metrics->http_server);
 		metrics->http_server = NULL;
 	}
+	if (metrics->refresh_timer) {
+		event_free(metrics->refresh_timer);
+		metrics->refresh_timer = NULL;
+	}
+	if (metrics->cache) {
+		evbuffer_free(metrics->cache);
+		metrics->cache = NULL;
+	}
+	metrics->cache_valid = 0;
 }
 
 void daemon_metrics_delete(struct daemon_metrics* metrics)
@@ -312,6 +332,146 @@ daemon_metrics_attach(struct daemon_metrics* metrics, struct xfrd_state* xfrd)
 	}
 }
 
+#ifdef BIND8_STATS
+/* See if the line of metrics text is selected by the name= and exclude=
+ * query parameters, they match the start of the metric name. */
+static int
+metrics_line_selected(const char *line, size_t len, struct evkeyvalq *params)
+{
+	struct evkeyval *kv;
+	size_t n = 0;
+	int has_name = 0, name_match = 0;
+
+	/* the name is after '# HELP ' or '# TYPE ', or starts the line */
+	if (len >= 7 && (strncmp(line, "# HELP ", 7) == 0 ||
+		strncmp(line, "# TYPE ", 7) == 0)) {
+		line += 7;
+		len -= 7;
+	}
+	while (n < len && line[n] != ' ' && line[n] != '{')
+		n++;
+	for (kv = params->tqh_first; kv; kv = kv->next.tqe_next) {
+		size_t vlen = strlen(kv->value);
+		int match = (vlen <= n && strncmp(line, kv->value, vlen) == 0);
+		if (strcmp(kv->key, "exclude") == 0) {
+			if (match)
+				return 0;
+		} else if (strcmp(kv->key, "name") == 0) {
+			has_name = 1;
+			if (match)
+				name_match = 1;
+		}
+	}
+	return !has_name || name_match;
+}
+
+/* Copy the metrics page to the reply, with the lines that the query
+ * parameters of the request select. */
+static void
+metrics_filter(struct evhttp_request *req, struct evbuffer *page,
+	struct evbuffer *reply)
+{
+	struct evkeyvalq params;
+	const char *query = evhttp_uri_get_query(evhttp_request_get_evhttp_uri(
+		req));
+	size_t len = evbuffer_get_length(page), pos = 0;
+	const char *text = (const char *)evbuffer_pullup(page, -1);
+
+	if (!query || !query[0]) {
+		evbuffer_add(reply, text, len);
+		return;
+	}
+	/* this initializes params, also when it fails */
+	if (evhttp_parse_query_str(query, &params) != 0) {
+		evhttp_clear_headers(&params);
+		evbuffer_add(reply, text, len);
+		return;
+	}
+	while (pos < len) {
+		const char *eol = memchr(text+pos, '\n', len-pos);
+		size_t linelen = (eol ? (size_t)(eol-(text+pos))+1 : len-pos);
+		if (metrics_line_selected(text+pos, linelen, &params))
+			evbuffer_add(reply, text+pos, linelen);
+		pos += linelen;
+	}
+	evhttp_clear_headers(&params);
+}
+
+/* Render the metrics page into the cache. */
+static void
+metrics_render(struct daemon_metrics *metrics)
+{
+	if (metrics->cache) {
+		evbuffer_drain(metrics->cache,
+			evbuffer_get_length(metrics->cache));
+	} else if (!(metrics->cache = evbuffer_new())) {
+		log_msg(LOG_ERR, "failed to allocate metrics cache buffer");
+		return;
+	}
+	process_stats(NULL, metrics->cache, metrics->xfrd, 1);
+	metrics->cache_valid = 1;
+}
+
+/* Start the timer that renders the page again after metrics-cache-time. */
+static void
+metrics_refresh_add(struct daemon_metrics *metrics)
+{
+	struct timeval tv;
+	tv.tv_sec = metrics->xfrd->nsd->options->metrics_cache_time;
+	tv.tv_usec = 0;
+	if (event_add(metrics->refresh_timer, &tv) != 0)
+		log_msg(LOG_ERR, "metrics: cannot add refresh timer");
+}
+
+/* The page is rendered on this timer while it is being scraped, so that
+ * the scrapes are served from the cache, also when the scrape interval is
+ * the same as the refresh time. After two periods without a request it
+ * stops, and the next request renders the page. */
+static void
+metrics_refresh_timer(int ATTR_UNUSED(fd), short ATTR_UNUSED(event),
+	void *arg)
+{
+	struct daemon_metrics *metrics = (struct daemon_metrics *)arg;
+	if (++metrics->idle > 2) {
+		metrics->cache_valid = 0;
+		return;
+	}
+	metrics_render(metrics);
+	metrics_refresh_add(metrics);
+}
+
+void
+daemon_metrics_invalidate(struct daemon_metrics *metrics)
+{
+	if (metrics)
+		metrics->cache_valid = 0;
+}
+
+/* Make sure the cached page is current for the request. */
+static void
+metrics_request_page(struct daemon_metrics *metrics)
+{
+	metrics->idle = 0;
+	if (metrics->xfrd->nsd->options->metrics_cache_time <= 0) {
+		metrics_render(metrics);
+		return;
+	}
+	if (metrics->cache_valid) {
+		VERBOSITY(4, (LOG_INFO, "metrics served from cache"));
+		return;
+	}
+	metrics_render(metrics);
+	if (!metrics->refresh_timer && !(metrics->refresh_timer = event_new(
+		metrics->xfrd->event_base, -1, 0, metrics_refresh_timer,
+		metrics))) {
+		log_msg(LOG_ERR, "metrics: out of memory in event_new");
+		metrics->cache_valid = 0;
+		return;
+	}
+	metrics_refresh_add(metrics);
+}
+#endif /* BIND8_STATS */
+
 /* Callback for handling the active http request to the specific URI */
 static void
 metrics_http_callback(struct evhttp_request *req, void *p)
@@ -337,7 +497,13 @@ metrics_http_callback(struct evhttp_request *req, void *p)
 	evhttp_add_header(evhttp_request_get_output_headers(req),
 	                  "Content-Type", "text/plain; version=0.0.4");
 #ifdef BIND8_STATS
-	process_stats(NULL, reply, metrics->xfrd, 1);
+	metrics_request_page(metrics);
+	if (!metrics->cache) {
+		evhttp_send_error(req, HTTP_INTERNAL, 0);
+		evbuffer_free(reply);
+		return;
+	}
+	metrics_filter(req, metrics->cache, reply);
 	evhttp_send_reply(req, HTTP_OK, NULL, reply);
 	VERBOSITY(3, (LOG_INFO, "metrics operation completed, response sent"));
 #else
@@ -350,7 +516,7 @@ metrics_http_callback(struct evhttp_request *req, void *p)
 }
 
 #ifdef BIND8_STATS
-#define METRIC_MAX_LABELS 2
+#define METRIC_MAX_LABELS 3
 
 struct metrics_metric {
 	const char *prefix;
@@ -390,8 +556,9 @@ metric_pop_label(struct metrics_metric *metric) {
 	metric->label_count--;
 }
 
+/** Print the name and the labels of a metric, without the value. */
 static void
-metric_print(struct metrics_metric *metric, struct evbuffer *buf, uint64_t value) {
+metric_print_name(struct metrics_metric *metric, struct evbuffer *buf) {
 	evbuffer_add_printf(buf, "%s%s", metric->prefix, metric->name);
 	for (size_t i = 0; i < metric->label_count; i++) {
 		evbuffer_add_printf(buf, "%c%s=\"%s\"",
@@ -400,21 +567,23 @@ metric_print(struct metrics_metric *metric, struct evbuffer *buf, uint64_t value
 			metric->label_values[i]);
 	}
 	if (metric->label_count > 0) {
-		evbuffer_add_printf(buf, "} %" PRIu64 "\n", value);
-	} else {
-		evbuffer_add_printf(buf, " %" PRIu64 "\n", value);
+		evbuffer_add_printf(buf, "}");
 	}
 }
 
+static void
+metric_print(struct metrics_metric *metric, struct evbuffer *buf, uint64_t value) {
+	metric_print_name(metric, buf);
+	evbuffer_add_printf(buf, " %" PRIu64 "\n", value);
+}
+
 /** Print a metric value of `integral + decimals_micro * 1e-6`. */
 static void
 metric_print_micros(struct metrics_metric *metric, struct evbuffer *buf,
 	unsigned long integral, unsigned long decimals_micro)
 {
-	assert(metric->label_count == 0
-		&& "metric_print_micros is not implemented for metrics with labels");
-	evbuffer_add_printf(buf, "%s%s %lu.%6.6lu\n",
-		metric->prefix, metric->name, integral, decimals_micro);
+	metric_print_name(metric, buf);
+	evbuffer_add_printf(buf, " %lu.%6.6lu\n", integral, decimals_micro);
 }
 
 static void
@@ -430,6 +599,36 @@ metric_print_help(struct metrics_metric *metric, struct evbuffer *buf, const cha
 		metric->prefix, metric->name, metric->type);
 }
 
+/** Print a histogram from the counts per bucket, le has the upper bounds of
+ * the buckets, with "+Inf" for the last one. If sum_micros is set, the sum
+ * is in microseconds and printed in seconds. */
+static void
+metric_print_histogram(struct metrics_metric *metric, struct evbuffer *buf,
+	const char *name, const char *help, stc_type *counts, size_t num,
+	const char **le, unsigned long sum, int sum_micros)
+{
+	char n[64];
+	uint64_t total = 0;
+	size_t i;
+
+	metric_set_name_and_type(metric, name, "histogram");
+	metric_print_help(metric, buf, help);
+	snprintf(n, sizeof(n), "%s_bucket", name);
+	metric->name = n;
+	for(i=0; i<num; i++) {
+		total += counts[i];
+		metric_push_label(metric, "le", le[i]);
+		metric_print_pop(metric, buf, total);
+	}
+	snprintf(n, sizeof(n), "%s_sum", name);
+	if(sum_micros)
+		metric_print_micros(metric, buf, sum/1000000, sum%1000000);
+	else	metric_print(metric, buf, (uint64_t)sum);
+	snprintf(n, sizeof(n), "%s_count", name);
+	metric_print(metric, buf, total);
+	metric->name = name;
+}
+
 static void
 print_stat_block(struct evbuffer *buf, struct nsdst* st, struct metrics_metric *metric) {
 	size_t i;
@@ -500,6 +699,16 @@ print_stat_block(struct evbuffer *buf, struct nsdst* st, struct metrics_metric *
 	metric_print_help(metric, buf, "Total number of queries received with EDNS OPT where EDNS parsing failed.");
 	metric_print(metric, buf, (uint64_t)st->ednserr);
 
+	/* nsd_queries_with_cookie_total */
+	metric_set_name_and_type(metric, "queries_with_cookie_total", "counter");
+	metric_print_help(metric, buf, "Total number of queries received with a server cookie, by the result of the verification.");
+	metric_push_label(metric, "status", "valid");
+	metric_print_pop(metric, buf, (uint64_t)st->cookievalid);
+	metric_push_label(metric, "status", "reused");
+	metric_print_pop(metric, buf, (uint64_t)st->cookiereuse);
+	metric_push_label(metric, "status", "invalid");
+	metric_print_pop(metric, buf, (uint64_t)st->cookieinvalid);
+
 	/* nsd_connections_total */
 	metric_set_name_and_type(metric, "connections_total", "counter");
 	metric_print_help(metric, buf, "Total number of connections.");
@@ -525,6 +734,36 @@ print_stat_block(struct evbuffer *buf, struct nsdst* st, struct metrics_metric *
 	metric_print_help(metric, buf, "Total number of dropped queries.");
 	metric_print(metric, buf, (uint64_t)st->dropped);
 
+	/* nsd_queries_ratelimited_total */
+	metric_set_name_and_type(metric, "queries_ratelimited_total", "counter");
+	metric_print_help(metric, buf, "Total number of queries that hit the ratelimit.");
+	metric_print(metric, buf, (uint64_t)st->ratelimited);
+
+	/* nsd_ratelimit_retries_total */
+	metric_set_name_and_type(metric, "ratelimit_retries_total", "counter");
+	metric_print_help(metric, buf, "Total number of retried updates of the shared ratelimit table.");
+	metric_print(metric, buf, (uint64_t)st->rrlretry);
+
+	/* nsd_ratelimit_evictions_total */
+	metric_set_name_and_type(metric, "ratelimit_evictions_total", "counter");
+	metric_print_help(metric, buf, "Total number of ratelimit buckets taken over from another source.");
+	metric_print(metric, buf, (uint64_t)st->rrlevict);
+
+	/* nsd_dnstap_dropped_total */
+	metric_set_name_and_type(metric, "dnstap_dropped_total", "counter");
+	metric_print_help(metric, buf, "Total number of dnstap messages dropped because the collector was behind.");
+	metric_print(metric, buf, (uint64_t)st->dnstapdrop);
+
+	/* nsd_dnstap_frames_total */
+	metric_set_name_and_type(metric, "dnstap_frames_total", "counter");
+	metric_print_help(metric, buf, "Total number of dnstap frames given to the output by the collector.");
+	metric_print(metric, buf, (uint64_t)st->dnstapframes);
+
+	/* nsd_dnstap_queue_frames */
+	metric_set_name_and_type(metric, "dnstap_queue_frames", "gauge");
+	metric_print_help(metric, buf, "Number of dnstap frames in the output queue of the collector that are not written yet.");
+	metric_print(metric, buf, (uint64_t)st->dnstapqueue);
+
 	/* nsd_queries_rx_failed_total */
 	metric_set_name_and_type(metric, "queries_rx_failed_total", "counter");
 	metric_print_help(metric, buf, "Total number of queries where receive failed.");
@@ -546,6 +785,182 @@ print_stat_block(struct evbuffer *buf, struct nsdst* st, struct metrics_metric *
 	metric_print(metric, buf, (uint64_t)st->truncated);
 }
 
+/* print the answer statistics, these are not kept per zone */
+static void
+print_resp_block(struct evbuffer *buf, struct nsdst_resp* rs,
+	struct metrics_metric *metric)
+{
+	size_t i, tp;
+	const char* rcstr[] = {"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN",
+		"NOTIMP", "REFUSED", "YXDOMAIN", "YXRRSET", "NXRRSET", "NOTAUTH",
+		"NOTZONE", "RCODE11", "RCODE12", "RCODE13", "RCODE14", "RCODE15",
+		"BADVERS"
+	};
+	const char* tpstr[] = {"udp", "tcp", "tls"};
+	char lat_le[STAT_LATENCY_BUCKETS][24], size_le[STAT_RESPSIZE_BUCKETS][24];
+	const char* lat_lep[STAT_LATENCY_BUCKETS];
+	const char* size_lep[STAT_RESPSIZE_BUCKETS];
+
+	/* nsd_answers_by_type_total */
+	metric_set_name_and_type(metric, "answers_by_type_total", "counter");
+	metric_print_help(metric, buf, "Total number of answers by transport and query type.");
+	for(tp=0; tp<STAT_TRANSPORTS; tp++) {
+		metric_push_label(metric, "transport", tpstr[tp]);
+		for(i=0; i<= 255; i++) {
+			if(metrics_inhibit_zero && rs->qtype_tp[tp][i] == 0 &&
+				strncmp(rrtype_to_string(i), "TYPE", 4) == 0)
+				continue;
+			metric_push_label(metric, "type", rrtype_to_string(i));
+			metric_print_pop(metric, buf, (uint64_t)rs->qtype_tp[tp][i]);
+		}
+		metric_pop_label(metric);
+	}
+
+	/* nsd_answers_by_rcode_total */
+	metric_set_name_and_type(metric, "answers_by_rcode_total", "counter");
+	metric_print_help(metric, buf, "Total number of answers by transport and rcode.");
+	for(tp=0; tp<STAT_TRANSPORTS; tp++) {
+		metric_push_label(metric, "transport", tpstr[tp]);
+		for(i=0; i<17; i++) {
+			if(metrics_inhibit_zero && rs->rcode_tp[tp][i] == 0 &&
+				i > RCODE_YXDOMAIN) /*NSD does not use larger*/
+				continue;
+			metric_push_label(metric, "rcode", rcstr[i]);
+			metric_print_pop(metric, buf, (uint64_t)rs->rcode_tp[tp][i]);
+		}
+		metric_pop_label(metric);
+	}
+
+	/* nsd_response_latency_seconds, bucket i has the answers that took
+	 * less than 2^i microseconds, at most 2^i - 1, like the sizes */
+	for(i=0; i<STAT_LATENCY_BUCKETS-1; i++) {
+		snprintf(lat_le[i], sizeof(lat_le[i]), "%lu.%6.6lu",
+			(((unsigned long)1<<i)-1)/1000000,
+			(((unsigned long)1<<i)-1)%1000000);
+		lat_lep[i] = lat_le[i];
+	}
+	lat_lep[STAT_LATENCY_BUCKETS-1] = "+Inf";
+	metric_print_histogram(metric, buf, "response_latency_seconds",
+		"Time from receiving the query to sending the answer.",
+		rs->latency, STAT_LATENCY_BUCKETS, lat_lep,
+		(unsigned long)rs->latency_sum, 1);
+
+	/* nsd_response_size_bytes */
+	for(i=0; i<STAT_RESPSIZE_BUCKETS-1; i++) {
+		snprintf(size_le[i], sizeof(size_le[i]), "%lu",
+			((unsigned long)1<<(i+STAT_RESPSIZE_SHIFT))-1);
+		size_lep[i] = size_le[i];
+	}
+	size_lep[STAT_RESPSIZE_BUCKETS-1] = "+Inf";
+	metric_print_histogram(metric, buf, "response_size_bytes",
+		"Size of the answers.",
+		rs->respsize, STAT_RESPSIZE_BUCKETS, size_lep,
+		(unsigned long)rs->respsize_sum, 0);
+}
+
+/* print the counters of the server processes, per server process */
+static void
+print_child_stats(struct evbuffer *buf, struct xfrd_state *xfrd,
+	struct nsdst *stats, struct metrics_metric *metric)
+{
+	const struct {
+		const char *name, *help;
+		size_t off, off6;
+	} ctr[] = {
+		{ "server_queries_udp_total", "Number of UDP queries received "
+		  "by the server process.", offsetof(struct nsdst, qudp),
+		  offsetof(struct nsdst, qudp6) },
+		{ "server_connections_tcp_total", "Number of TCP connections "
+		  "accepted by the server process.",
+		  offsetof(struct nsdst, ctcp), offsetof(struct nsdst, ctcp6) },
+		{ "server_connections_tls_total", "Number of TLS connections "
+		  "accepted by the server process.",
+		  offsetof(struct nsdst, ctls), offsetof(struct nsdst, ctls6) },
+		{ "server_dropped_total", "Number of queries dropped by the "
+		  "server process.", offsetof(struct nsdst, dropped), 0 },
+		{ "server_truncated_total", "Number of truncated answers of "
+		  "the server process.", offsetof(struct nsdst, truncated), 0 },
+		{ "server_ratelimited_total", "Number of queries ratelimited "
+		  "by the server process.", offsetof(struct nsdst, ratelimited),
+		  0 },
+		{ "server_rx_failed_total", "Number of queries where receive "
+		  "failed in the server process.", offsetof(struct nsdst, rxerr),
+		  0 },
+		{ "server_tx_failed_total", "Number of answers where transmit "
+		  "failed in the server process.", offsetof(struct nsdst, txerr),
+		  0 }
+	};
+	char server_str[16];
+	size_t i, c;
+
+	for(c=0; c<sizeof(ctr)/sizeof(ctr[0]); c++) {
+		metric_set_name_and_type(metric, ctr[c].name, "counter");
+		metric_print_help(metric, buf, ctr[c].help);
+		for(i=0; i<xfrd->nsd->child_count; i++) {
+			uint64_t v = *(stc_type*)((char*)&stats[i]+ctr[c].off);
+			if(ctr[c].off6)
+				v += *(stc_type*)((char*)&stats[i]+ctr[c].off6);
+			snprintf(server_str, sizeof(server_str), "%d", (int)i);
+			metric_push_label(metric, "server", server_str);
+			metric_print_pop(metric, buf, v);
+		}
+	}
+}
+
+/* print the serial of the zones, and the state of the secondary zones */
+static void
+print_zone_series(struct evbuffer *buf, struct xfrd_state *xfrd)
+{
+	struct metrics_metric metric;
+	struct notify_zone *nz;
+	struct xfrd_zone *xz;
+	char name[MAXDOMAINLEN*5];
+	metric_init_with_prefix(&metric, "nsd_zone_");
+
+	metric_set_name_and_type(&metric, "serial", "gauge");
+	metric_print_help(&metric, buf, "Serial of the zone that is served.");
+	RBTREE_FOR(nz, struct notify_zone*, xfrd->notify_zones) {
+		uint32_t serial;
+		if((xz = (struct xfrd_zone*)rbtree_search(xfrd->zones,
+			nz->apex))) {
+			if(!xz->soa_nsd_acquired)
+				continue; /* not served yet */
+			serial = xz->soa_nsd.serial;
+		} else if(nz->current_soa && nz->current_soa->serial != 0) {
+			serial = nz->current_soa->serial;
+		} else	continue; /* not loaded */
+		strlcpy(name, nz->apex_str, sizeof(name));
+		metrics_make_label_value_valid(name);
+		metric_push_label(&metric, "zone", name);
+		metric_print_pop(&metric, buf, (uint64_t)ntohl(serial));
+	}
+
+	metric_set_name_and_type(&metric, "expired", "gauge");
+	metric_print_help(&metric, buf, "If the secondary zone has expired.");
+	RBTREE_FOR(xz, struct xfrd_zone*, xfrd->zones) {
+		strlcpy(name, xz->apex_str, sizeof(name));
+		metrics_make_label_value_valid(name);
+		metric_push_label(&metric, "zone", name);
+		metric_print_pop(&metric, buf,
+			(uint64_t)(xz->state == xfrd_zone_expired));
+	}
+
+	metric_set_name_and_type(&metric, "last_refresh_timestamp_seconds",
+		"gauge");
+	metric_print_help(&metric, buf, "Time that the contents of the "
+		"secondary zone were last transferred or confirmed by a "
+		"primary.");
+	RBTREE_FOR(xz, struct xfrd_zone*, xfrd->zones) {
+		if(!xz->soa_disk_acquired)
+			continue;
+		strlcpy(name, xz->apex_str, sizeof(name));
+		metrics_make_label_value_valid(name);
+		metric_push_label(&metric, "zone", name);
+		metric_print_pop(&metric, buf,
+			(uint64_t)xz->soa_disk_acquired);
+	}
+}
+
 #ifdef USE_ZONE_STATS
 
 void
@@ -579,12 +994,19 @@ metrics_zonestat_print_one(struct evbuffer *buf, char *name,
 void
 metrics_print_stats(struct evbuffer *buf, xfrd_state_type *xfrd,
                     struct timeval *now, int clear, struct nsdst *st,
+                    struct nsdst *childstats, struct nsdst_resp *rs,
                     struct nsdst **zonestats, struct timeval *rc_stats_time)
 {
 	size_t i;
 	struct timeval elapsed, uptime;
 	struct metrics_metric metric;
 	char server_str[16] = {0};
+	char stale_le[XFRD_STALENESS_BUCKETS][24];
+	const char* stale_lep[XFRD_STALENESS_BUCKETS];
+	stc_type stale[XFRD_STALENESS_BUCKETS];
+	char lag_le[XFRD_REFRESH_LAG_BUCKETS][24];
+	const char* lag_lep[XFRD_REFRESH_LAG_BUCKETS];
+	stc_type lag[XFRD_REFRESH_LAG_BUCKETS];
 
 	metric_init_with_prefix(&metric, "nsd_");
 
@@ -599,6 +1021,8 @@ metrics_print_stats(struct evbuffer *buf, xfrd_state_type *xfrd,
 	}
 
 	print_stat_block(buf, st, &metric);
+	print_resp_block(buf, rs, &metric);
+	print_child_stats(buf, xfrd, childstats, &metric);
 
 	/* uptime (in seconds) */
 	timeval_subtract(&uptime, now, &xfrd->nsd->metrics->boot_time);
@@ -631,6 +1055,18 @@ metrics_print_stats(struct evbuffer *buf, xfrd_state_type *xfrd,
 	metric_print_help(&metric, buf, "Size of DNS database in memory.");
 	metric_print(&metric, buf, st->db_mem);
 
+	metric_set_name_and_type(&metric, "size_ixfr_in_mem_bytes", "gauge");
+	metric_print_help(&metric, buf, "Size of the stored IXFR versions in memory.");
+	metric_print(&metric, buf, st->ixfr_mem);
+
+	metric_set_name_and_type(&metric, "size_ixfr_on_disk_bytes", "gauge");
+	metric_print_help(&metric, buf, "Size of the ixfr files of the stored IXFR versions on disk.");
+	metric_print(&metric, buf, st->ixfr_disk);
+
+	metric_set_name_and_type(&metric, "size_ixfr_condensed_in_mem_bytes", "gauge");
+	metric_print_help(&metric, buf, "Size of the condensed IXFRs in memory.");
+	metric_print(&metric, buf, st->ixfr_condensed);
+
 	metric_set_name_and_type(&metric, "size_xfrd_in_mem_bytes", "gauge");
 	metric_print_help(&metric, buf, "Size of zone transfers and notifies in xfrd process, excluding TSIG data.");
 	metric_print(&metric, buf, region_get_mem(xfrd->region));
@@ -653,6 +1089,66 @@ metrics_print_stats(struct evbuffer *buf, xfrd_state_type *xfrd,
 	metric_print_help(&metric, buf, "Number of secondary zones served.");
 	metric_print(&metric, buf, (uint64_t)xfrd->zones->count);
 
+	metric_set_name_and_type(&metric, "reloads_total", "counter");
+	metric_print_help(&metric, buf, "Number of reloads.");
+	metric_print(&metric, buf, xfrd->reload_count);
+
+	metric_set_name_and_type(&metric, "reload_duration_seconds", "gauge");
+	metric_print_help(&metric, buf, "Moving average of the duration of "
+		"the reloads that apply zone transfers.");
+	metric_print_micros(&metric, buf,
+		(unsigned long)xfrd->reload_duration_avg/1000,
+		(unsigned long)(xfrd->reload_duration_avg%1000)*1000);
+
+	/* nsd_xfr_staleness_seconds */
+	for(i=0; i<XFRD_STALENESS_BUCKETS-1; i++) {
+		snprintf(stale_le[i], sizeof(stale_le[i]), "%lu.%3.3lu",
+			((unsigned long)1<<i)/1000,
+			((unsigned long)1<<i)%1000);
+		stale_lep[i] = stale_le[i];
+		stale[i] = (stc_type)xfrd->staleness[i];
+	}
+	stale_lep[XFRD_STALENESS_BUCKETS-1] = "+Inf";
+	stale[XFRD_STALENESS_BUCKETS-1] =
+		(stc_type)xfrd->staleness[XFRD_STALENESS_BUCKETS-1];
+	metric_print_histogram(&metric, buf, "xfr_staleness_seconds",
+		"Time from receiving a zone transfer to serving it.",
+		stale, XFRD_STALENESS_BUCKETS, stale_lep,
+		(unsigned long)xfrd->staleness_sum*1000, 1);
+
+	/* nsd_refresh_lag_seconds */
+	for(i=0; i<XFRD_REFRESH_LAG_BUCKETS-1; i++) {
+		snprintf(lag_le[i], sizeof(lag_le[i]), "%lu",
+			(unsigned long)1<<i);
+		lag_lep[i] = lag_le[i];
+		lag[i] = (stc_type)xfrd->refresh_lag[i];
+	}
+	lag_lep[XFRD_REFRESH_LAG_BUCKETS-1] = "+Inf";
+	lag[XFRD_REFRESH_LAG_BUCKETS-1] =
+		(stc_type)xfrd->refresh_lag[XFRD_REFRESH_LAG_BUCKETS-1];
+	metric_print_histogram(&metric, buf, "refresh_lag_seconds",
+		"Time from a zone refresh or retry that is due to sending "
+		"its query.", lag, XFRD_REFRESH_LAG_BUCKETS, lag_lep,
+		(unsigned long)xfrd->refresh_lag_sum, 0);
+
+	metric_set_name_and_type(&metric, "xfrd_tcp_opened_total", "counter");
+	metric_print_help(&metric, buf, "Number of TCP connections that xfrd "
+		"opened to primaries.");
+	metric_print(&metric, buf, xfrd->tcp_opened);
+
+	metric_set_name_and_type(&metric, "xfrd_tcp_reused_total", "counter");
+	metric_print_help(&metric, buf, "Number of transfers that used an "
+		"idle TCP connection to the primary that was kept open.");
+	metric_print(&metric, buf, xfrd->tcp_reused);
+
+	metric_set_name_and_type(&metric, "xfrd_tls_handshakes_avoided_total",
+		"counter");
+	metric_print_help(&metric, buf, "Number of transfers that used an "
+		"idle XFR-over-TLS connection, without a TLS handshake.");
+	metric_print(&metric, buf, xfrd->tls_reused);
+
+	print_zone_series(buf, xfrd);
+
 #ifdef USE_ZONE_STATS
 	zonestat_print(NULL, buf, xfrd, clear, zonestats); /*per-zone statistics*/
 #else
@@ -17,6 +17,7 @@ struct evbuffer;
 
 #ifdef BIND8_STATS
 struct nsdst;
+struct nsdst_resp;
 #endif /* BIND8_STATS */
 
 /* the metrics daemon needs little backlog */
@@ -68,24 +69,32 @@ void daemon_metrics_attach(struct daemon_metrics* m, struct xfrd_state* xfrd);
  * @param now: current time
  * @param clear: whether to reset the stats time
  * @param st: the stats
+ * @param childstats: the stats per server process
+ * @param rs: the answer stats
  * @param zonestats: the zonestats
  * @param rc_stats_time: pointer to the remote-control stats_time member
  *   to correctly print the elapsed time since last stats reset
  */
 void metrics_print_stats(struct evbuffer *buf, struct xfrd_state *xfrd,
                          struct timeval *now, int clear, struct nsdst *st,
+                         struct nsdst *childstats, struct nsdst_resp *rs,
                          struct nsdst **zonestats,
                          struct timeval *rc_stats_time);
 
-#ifdef USE_ZONE_STATS
+/**
+ * Drop the rendered metrics page, because the stats have been reset.
+ * The next request renders it again.
+ * @param m: metrics state, or NULL.
+ */
+void daemon_metrics_invalidate(struct daemon_metrics* m);
 
 /**
  * Replace characters disallowed in Prometheus label values with '_'.
  *
  * According to [1], label values can be any UTF-8 characters, but backslash,
  * double-quote, and line feed must be escaped. We could escape them but that
- * changes the length of the string, and in practice for zonestats names you
- * don't need these characters anyway so we just replace them.
+ * changes the length of the string, and in practice for zone and zonestats
+ * names you don't need these characters anyway so we just replace them.
  * [1]: https://prometheus.io/docs/instrumenting/exposition_formats/#comments-help-text-and-type-information>
  *
  * @param value: the label value to edit.
@@ -107,6 +116,8 @@ static inline int metrics_make_label_value_valid(char* value) {
 	return made_changes;
 }
 
+#ifdef USE_ZONE_STATS
+
 /**
  * Print zonestat metrics for a single zonestats object
  * @param buf: the HTTP buffer to write to
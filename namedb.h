@@ -360,6 +360,13 @@ struct namedb
 	/* if diff_skip=1, diff_pos contains the nsd.diff place to continue */
 	uint8_t		  diff_skip;
 	off_t		  diff_pos;
+	/* number of shards (region arenas) the zones are divided over,
+	 * 0 if the zones are not sharded */
+	size_t		  shards;
+	/* number of processes that compute NSEC3 hashes for a precompile */
+	int		  nsec3_precompile_processes;
+	/* if NSEC3 hashes are cached in a file next to the zonefile */
+	int		  nsec3_hash_cache;
 };
 
 /* Find the zone for the specified dname in DB. */
@@ -385,6 +392,12 @@ struct namedb *namedb_open(struct nsd_options* opt);
 void namedb_close(struct namedb* db);
 /* free ixfr data stored for zones */
 void namedb_free_ixfr(struct namedb* db);
+/* make the condensed IXFRs of the zones that have changed versions */
+void namedb_ixfr_condense(struct namedb* db);
+/* the bytes of the stored IXFR versions in memory, of their files, and
+ * of the condensed IXFRs in memory */
+void namedb_ixfr_sizes(struct namedb* db, uint64_t* mem, uint64_t* disk,
+	uint64_t* condensed);
 void namedb_check_zonefiles(struct nsd* nsd, struct nsd_options* opt,
 	struct udb_base* taskudb, struct udb_ptr* last_task);
 void namedb_check_zonefile(struct nsd* nsd, struct udb_base* taskudb,
@@ -401,10 +414,38 @@ namedb_find_or_create_zone(namedb_type *db, const dname_type *dname,
   return zone ? zone : namedb_zone_create(db, dname, zopt); }
 void namedb_zone_free_filenames(namedb_type* db, zone_type* zone);
 void namedb_zone_delete(namedb_type* db, zone_type* zone);
+/* allocate from the shard of the zone in the namedb region, from now on.
+ * returns the shard that was in use, to pass to namedb_use_shard after. */
+size_t namedb_use_zone_shard(namedb_type* db, zone_type* zone);
+/* allocate from the given shard, 0 is the common part of the namedb. */
+void namedb_use_shard(namedb_type* db, size_t shard);
 void namedb_write_zonefile(struct nsd* nsd, struct zone_options* zopt);
 void namedb_write_zonefiles(struct nsd* nsd, struct nsd_options* options);
 int create_dirs(const char* path);
 int file_get_mtime(const char* file, struct timespec* mtime, int* nonexist);
+
+/*
+ * Zone snapshot file, written next to the zonefile with zonefiles-snapshot.
+ * It has a header, with the modification time and size of the zonefile it
+ * was made for, and a CRC over the body. The body has per domain the owner
+ * name and the RRsets of the zone at that name, the rdata in uncompressed
+ * wireformat. All numbers are in network byte order.
+ *	header: magic(4) version(4) mtime_sec(8) mtime_nsec(4) filesize(8)
+ *		rrcount(4) bodysize(8) crc(4)
+ *	domain: namelen(1) name rrsetcount(2)
+ *	rrset: type(2) class(2) rrcount(2)
+ *	rr: ttl(4) rdlength(2) rdata
+ */
+#define ZONE_SNAPSHOT_SUFFIX ".snap"
+#define ZONE_SNAPSHOT_MAGIC 0x4e534453 /* "NSDS" */
+#define ZONE_SNAPSHOT_VERSION 1
+#define ZONE_SNAPSHOT_HEADER_SIZE 44
+/* write the snapshot for the zone, made for zonefile zfile */
+int namedb_write_zone_snapshot(zone_type* zone, const char* zfile);
+/* read the zone contents from its snapshot, if it is current for zfile.
+ * returns false if it cannot be used, zone contents are then empty. */
+int namedb_read_zone_snapshot(namedb_type* db, zone_type* zone,
+	const char* zfile);
 void allocate_domain_nsec3(domain_table_type *table, domain_type *result);
 
 static inline uint16_t
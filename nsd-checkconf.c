@@ -351,6 +351,7 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		ZONE_GET_INT(min_retry_time, o, zone->pattern);
 		ZONE_GET_INT(min_expire_time, o, zone->pattern);
 		ZONE_GET_INT(size_limit_xfr, o, zone->pattern);
+		ZONE_GET_INT(reload_max_staleness, o, zone->pattern);
 #ifdef RATELIMIT
 		ZONE_GET_RRL(rrl_whitelist, o, zone->pattern);
 #endif
@@ -358,6 +359,8 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		ZONE_GET_BIN(store_ixfr, o, zone->pattern);
 		ZONE_GET_INT(ixfr_size, o, zone->pattern);
 		ZONE_GET_INT(ixfr_number, o, zone->pattern);
+		ZONE_GET_BIN(ixfr_compress, o, zone->pattern);
+		ZONE_GET_BIN(ixfr_condense, o, zone->pattern);
 		ZONE_GET_BIN(create_ixfr, o, zone->pattern);
 		printf("Zone option not handled: %s %s\n", z, o);
 		exit(1);
@@ -388,6 +391,7 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		ZONE_GET_INT(min_retry_time, o, p);
 		ZONE_GET_INT(min_expire_time, o, p);
 		ZONE_GET_INT(size_limit_xfr, o, p);
+		ZONE_GET_INT(reload_max_staleness, o, p);
 #ifdef RATELIMIT
 		ZONE_GET_RRL(rrl_whitelist, o, p);
 #endif
@@ -395,6 +399,8 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		ZONE_GET_BIN(store_ixfr, o, p);
 		ZONE_GET_INT(ixfr_size, o, p);
 		ZONE_GET_INT(ixfr_number, o, p);
+		ZONE_GET_BIN(ixfr_compress, o, p);
+		ZONE_GET_BIN(ixfr_condense, o, p);
 		ZONE_GET_BIN(create_ixfr, o, p);
 		printf("Pattern option not handled: %s %s\n", pat, o);
 		exit(1);
@@ -452,10 +458,21 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		SERV_GET_INT(outgoing_tcp_mss, o);
 		SERV_GET_INT(xfrd_tcp_max, o);
 		SERV_GET_INT(xfrd_tcp_pipeline, o);
+		SERV_GET_INT(xfrd_xfr_buffer_size, o);
+		SERV_GET_INT(xfrd_udp_per_primary, o);
+		SERV_GET_INT(xfrd_tcp_idle_timeout, o);
+		SERV_GET_INT(xfrd_tcp_pool_size, o);
 		SERV_GET_INT(ipv4_edns_size, o);
 		SERV_GET_INT(ipv6_edns_size, o);
 		SERV_GET_INT(statistics, o);
 		SERV_GET_INT(xfrd_reload_timeout, o);
+		SERV_GET_BIN(reload_cow_stats, o);
+		SERV_GET_INT(reload_incremental, o);
+		SERV_GET_INT(zone_shards, o);
+		SERV_GET_INT(nsec3_precompile_processes, o);
+		SERV_GET_BIN(nsec3_hash_cache, o);
+		SERV_GET_INT(nsec3_proof_cache_size, o);
+		SERV_GET_INT(xfr_check_processes, o);
 		SERV_GET_INT(verbosity, o);
 		SERV_GET_INT(send_buffer_size, o);
 		SERV_GET_INT(receive_buffer_size, o);
@@ -466,12 +483,14 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		SERV_GET_INT(rrl_ipv4_prefix_length, o);
 		SERV_GET_INT(rrl_ipv6_prefix_length, o);
 		SERV_GET_INT(rrl_whitelist_ratelimit, o);
+		SERV_GET_BIN(rrl_shared, o);
 #endif
 #ifdef USE_METRICS
 		SERV_GET_BIN(metrics_enable, o);
 		SERV_GET_IP(metrics_interface, metrics_interface, o);
 		SERV_GET_INT(metrics_port, o);
 		SERV_GET_STR(metrics_path, o);
+		SERV_GET_INT(metrics_cache_time, o);
 #endif /* USE_METRICS */
 #ifdef USE_DNSTAP
 		SERV_GET_BIN(dnstap_enable, o);
@@ -488,8 +507,15 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		SERV_GET_STR(dnstap_version, o);
 		SERV_GET_BIN(dnstap_log_auth_query_messages, o);
 		SERV_GET_BIN(dnstap_log_auth_response_messages, o);
+		SERV_GET_INT(dnstap_sample_rate, o);
+		SERV_GET_STR(dnstap_log_zones, o);
+		SERV_GET_STR(dnstap_log_qtypes, o);
+		SERV_GET_STR(dnstap_log_rcodes, o);
+		SERV_GET_STR(dnstap_log_clients, o);
+		SERV_GET_STR(dnstap_log_transports, o);
 #endif
 		SERV_GET_INT(zonefiles_write, o);
+		SERV_GET_BIN(zonefiles_snapshot, o);
 		/* remote control */
 		SERV_GET_BIN(control_enable, o);
 		SERV_GET_IP(control_interface, control_interface, o);
@@ -560,12 +586,19 @@ static void print_zone_content_elems(pattern_options_type* pat)
 	if(pat->size_limit_xfr != 0)
 		printf("\tsize-limit-xfr: %llu\n",
 			(long long unsigned)pat->size_limit_xfr);
+	if(pat->reload_max_staleness != 0)
+		printf("\treload-max-staleness: %u\n",
+			(unsigned)pat->reload_max_staleness);
 	if(!pat->store_ixfr_is_default)
 		printf("\tstore-ixfr: %s\n", pat->store_ixfr?"yes":"no");
 	if(!pat->ixfr_number_is_default)
 		printf("\tixfr-number: %u\n", (unsigned)pat->ixfr_number);
 	if(!pat->ixfr_size_is_default)
 		printf("\tixfr-size: %u\n", (unsigned)pat->ixfr_size);
+	if(!pat->ixfr_compress_is_default)
+		printf("\tixfr-compress: %s\n", pat->ixfr_compress?"yes":"no");
+	if(!pat->ixfr_condense_is_default)
+		printf("\tixfr-condense: %s\n", pat->ixfr_condense?"yes":"no");
 	if(!pat->create_ixfr_is_default)
 		printf("\tcreate-ixfr: %s\n", pat->create_ixfr?"yes":"no");
 	if(pat->verify_zone != VERIFY_ZONE_INHERIT) {
@@ -667,6 +700,10 @@ config_test_print_server(nsd_options_type* opt)
 	printf("\toutgoing-tcp-mss: %d\n", opt->outgoing_tcp_mss);
 	printf("\txfrd-tcp-max: %d\n", opt->xfrd_tcp_max);
 	printf("\txfrd-tcp-pipeline: %d\n", opt->xfrd_tcp_pipeline);
+	printf("\txfrd-xfr-buffer-size: %d\n", opt->xfrd_xfr_buffer_size);
+	printf("\txfrd-udp-per-primary: %d\n", opt->xfrd_udp_per_primary);
+	printf("\txfrd-tcp-idle-timeout: %d\n", opt->xfrd_tcp_idle_timeout);
+	printf("\txfrd-tcp-pool-size: %d\n", opt->xfrd_tcp_pool_size);
 	printf("\tipv4-edns-size: %d\n", (int) opt->ipv4_edns_size);
 	printf("\tipv6-edns-size: %d\n", (int) opt->ipv6_edns_size);
 	print_string_var("pidfile:", opt->pidfile);
@@ -679,6 +716,13 @@ config_test_print_server(nsd_options_type* opt)
 	print_string_var("zonelistfile:", opt->zonelistfile);
 	print_string_var("xfrdir:", opt->xfrdir);
 	printf("\txfrd-reload-timeout: %d\n", opt->xfrd_reload_timeout);
+	printf("\treload-cow-stats: %s\n", opt->reload_cow_stats?"yes":"no");
+	printf("\treload-incremental: %d\n", (int)opt->reload_incremental);
+	printf("\tzone-shards: %d\n", opt->zone_shards);
+	printf("\tnsec3-precompile-processes: %d\n", opt->nsec3_precompile_processes);
+	printf("\tnsec3-hash-cache: %s\n", opt->nsec3_hash_cache?"yes":"no");
+	printf("\tnsec3-proof-cache-size: %d\n", (int)opt->nsec3_proof_cache_size);
+	printf("\txfr-check-processes: %d\n", opt->xfr_check_processes);
 	printf("\tlog-time-ascii: %s\n", opt->log_time_ascii?"yes":"no");
 	printf("\tlog-time-iso: %s\n", opt->log_time_iso?"yes":"no");
 	printf("\tround-robin: %s\n", opt->round_robin?"yes":"no");
@@ -715,10 +759,12 @@ config_test_print_server(nsd_options_type* opt)
 	printf("\trrl-ipv4-prefix-length: %d\n", (int)opt->rrl_ipv4_prefix_length);
 	printf("\trrl-ipv6-prefix-length: %d\n", (int)opt->rrl_ipv6_prefix_length);
 	printf("\trrl-whitelist-ratelimit: %d\n", (int)opt->rrl_whitelist_ratelimit);
+	printf("\trrl-shared: %s\n", opt->rrl_shared?"yes":"no");
 #endif
 	printf("\treload-config: %s\n", opt->reload_config?"yes":"no");
 	printf("\tzonefiles-check: %s\n", opt->zonefiles_check?"yes":"no");
 	printf("\tzonefiles-write: %d\n", opt->zonefiles_write);
+	printf("\tzonefiles-snapshot: %s\n", opt->zonefiles_snapshot?"yes":"no");
 	print_string_var("tls-service-key:", opt->tls_service_key);
 	print_string_var("tls-service-pem:", opt->tls_service_pem);
 	print_string_var("tls-service-ocsp:", opt->tls_service_ocsp);
@@ -746,6 +792,7 @@ config_test_print_server(nsd_options_type* opt)
 		print_string_var("metrics-interface:", ip->address);
 	printf("\tmetrics-port: %d\n", opt->metrics_port);
 	print_string_var("metrics-path:", opt->metrics_path);
+	printf("\tmetrics-cache-time: %d\n", opt->metrics_cache_time);
 #endif /* USE_METRICS */
 
 #ifdef USE_DNSTAP
@@ -764,6 +811,12 @@ config_test_print_server(nsd_options_type* opt)
 	print_string_var("dnstap-version:", opt->dnstap_version);
 	printf("\tdnstap-log-auth-query-messages: %s\n", opt->dnstap_log_auth_query_messages?"yes":"no");
 	printf("\tdnstap-log-auth-response-messages: %s\n", opt->dnstap_log_auth_response_messages?"yes":"no");
+	printf("\tdnstap-sample-rate: %d\n", opt->dnstap_sample_rate);
+	print_string_var("dnstap-log-zones:", opt->dnstap_log_zones);
+	print_string_var("dnstap-log-qtypes:", opt->dnstap_log_qtypes);
+	print_string_var("dnstap-log-rcodes:", opt->dnstap_log_rcodes);
+	print_string_var("dnstap-log-clients:", opt->dnstap_log_clients);
+	print_string_var("dnstap-log-transports:", opt->dnstap_log_transports);
 #endif
 
 	printf("\nremote-control:\n");
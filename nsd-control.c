@@ -129,6 +129,11 @@ usage()
 	printf("  force_transfer [<zone>]	update secondary zones with AXFR, no serial check\n");
 	printf("  zonestatus [<zone>]		print state, serial, activity\n");
 	printf("  serverpid			get pid of server process\n");
+	printf("  rrl_top [<number>]		list sources with highest ratelimit rates\n");
+	printf("  trace_start <N> [name <name>] [client <ip>[/<prefix>]]\n");
+	printf("				trace 1 in N queries, that match the name and client\n");
+	printf("  trace_stop			stop tracing queries\n");
+	printf("  trace_show [<number>]		print the stage timings of traced queries\n");
 	printf("  verbosity <number>		change logging detail\n");
 	printf("  print_tsig [<key_name>]	print tsig with <name> the secret and algo\n");
 	printf("  update_tsig <name> <secret>	change existing tsig with <name> to a new <secret>\n");
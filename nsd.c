@@ -55,6 +55,10 @@
 #include "xfrd-disk.h"
 #include "ipc.h"
 #include "util.h"
+#include "qtrace.h"
+#ifdef RATELIMIT
+#include "rrl.h"
+#endif
 #ifdef USE_METRICS
 #include "metrics.h"
 #endif /* USE_METRICS */
@@ -1719,6 +1723,18 @@ main(int argc, char *argv[])
 #ifdef BIND8_STATS
 	server_stat_alloc(&nsd);
 #endif /* BIND8_STATS */
+#ifdef RATELIMIT
+	/* before xfrd is forked, so that it can read them for rrl_top */
+	rrl_mmap_init(nsd.child_count, nsd.options->rrl_size,
+		nsd.options->rrl_ratelimit,
+		nsd.options->rrl_whitelist_ratelimit,
+		nsd.options->rrl_slip,
+		nsd.options->rrl_ipv4_prefix_length,
+		nsd.options->rrl_ipv6_prefix_length,
+		nsd.options->rrl_shared);
+#endif /* RATELIMIT */
+	/* the query trace rings, also read by xfrd for trace_show */
+	qtrace_mmap_init(nsd.child_count);
 	if(nsd.server_kind == NSD_SERVER_MAIN) {
 		server_prepare_xfrd(&nsd);
 		/* xfrd forks this before reading database, so it does not get
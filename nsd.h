@@ -74,6 +74,12 @@ struct dt_collector;
  * the command to xfrd so it will not reload from xfrd yet.
  */
 #define NSD_RELOAD_FAILED 14
+/*
+ * APPLY_XFR is sent to the server processes when the main process has
+ * applied zone transfers with reload-incremental. The transfers follow it,
+ * the server processes apply them too and send APPLY_XFR back.
+ */
+#define NSD_APPLY_XFR 15
 
 #define NSD_SERVER_MAIN 0x0U
 #define NSD_SERVER_UDP  0x1U
@@ -97,10 +103,12 @@ typedef	unsigned long stc_type;
 				nsd->st.stc[LASTELEM(nsd->st->stc)]++ */
 
 #define	STATUP2(nsd, stc, i) nsd->st->stc[(i) <= (LASTELEM(nsd->st->stc) - 1) ? i : LASTELEM(nsd->st->stc)]++
+#define	STATADD(nsd, stc, v) nsd->st->stc += (v)
 #else	/* BIND8_STATS */
 
 #define	STATUP(nsd, stc) /* Nothing */
 #define	STATUP2(nsd, stc, i) /* Nothing */
+#define	STATADD(nsd, stc, v) /* Nothing */
 
 #endif /* BIND8_STATS */
 
@@ -114,12 +122,36 @@ typedef	unsigned long stc_type;
 	(zone && zone->zonestatid < nsd->zonestatsizenow) ? \
 		(nsd->zonestatnow[zone->zonestatid].stc[(i) <= (LASTELEM(nsd->zonestatnow[zone->zonestatid].stc) - 1) ? i : LASTELEM(nsd->zonestatnow[zone->zonestatid].stc)]++ ) \
 		: 0)
+#define ZTATADD(nsd, zone, stc, v) ( \
+	(zone && zone->zonestatid < nsd->zonestatsizenow) ? \
+		(nsd->zonestatnow[zone->zonestatid].stc += (v)) \
+		: 0)
 #else /* USE_ZONE_STATS */
 #define	ZTATUP(nsd, zone, stc) /* Nothing */
 #define	ZTATUP2(nsd, zone, stc, i) /* Nothing */
+#define	ZTATADD(nsd, zone, stc, v) /* Nothing */
 #endif /* USE_ZONE_STATS */
 
+/* Transports for the per transport counters and the query trace */
+#define STAT_UDP 0
+#define STAT_TCP 1
+#define STAT_TLS 2
+#define STAT_TRANSPORTS 3
+
 #ifdef	BIND8_STATS
+/* Buckets of the latency histogram, bucket i counts the responses that took
+ * less than 2^i microseconds from receive to send (and at least
+ * 2^(i-1)), the last bucket counts the remainder. */
+#define STAT_LATENCY_BUCKETS 20
+/* Buckets of the response size histogram, bucket i counts the responses
+ * smaller than 2^(i+STAT_RESPSIZE_SHIFT) bytes (and at least half that),
+ * the last bucket ends at the maximum message size. */
+#define STAT_RESPSIZE_SHIFT 5
+#define STAT_RESPSIZE_BUCKETS 12
+/* The size of a cache line, the stat blocks of the server children are
+ * kept apart by this much so they do not share cache lines. */
+#define STAT_CACHE_LINE 64
+
 /* Data structure to keep track of statistics */
 struct nsdst {
 	time_t	boot;
@@ -133,7 +165,41 @@ struct nsdst {
 	/* Dropped, truncated, queries for nonconfigured zone, tx errors */
 	stc_type dropped, truncated, wrongzone, txerr, rxerr;
 	stc_type edns, ednserr, raxfr, nona, rixfr;
+	/* Server cookies that are valid, valid and reused in the answer,
+	 * and invalid */
+	stc_type cookievalid, cookiereuse, cookieinvalid;
+	/* Ratelimited queries, retried updates of the shared ratelimit table,
+	 * ratelimit buckets taken over from another source */
+	stc_type ratelimited, rrlretry, rrlevict;
+	/* Dnstap messages dropped because the ring to the collector, or the
+	 * output queue of the collector, was full */
+	stc_type dnstapdrop;
+	/* Dnstap frames given to the output by the collector, and the frames
+	 * in its output queue that are not written yet */
+	stc_type dnstapframes, dnstapqueue;
 	uint64_t db_disk, db_mem;
+	/* The IXFR versions stored in memory, their ixfr files on disk,
+	 * and the condensed IXFRs in memory, in bytes */
+	uint64_t ixfr_mem, ixfr_disk, ixfr_condensed;
+	/* The server children write their own block in the shared stat
+	 * map, without atomics, this keeps the counters of neighbouring
+	 * children off each others cache lines. */
+	uint8_t pad[STAT_CACHE_LINE];
+};
+
+/* Statistics of the answers, kept per server process next to struct nsdst
+ * but not per zone, the zone statistics would be many times larger with
+ * these arrays in them. */
+struct nsdst_resp {
+	/* Qtypes and rcodes of the answered queries per transport */
+	stc_type qtype_tp[STAT_TRANSPORTS][257];
+	stc_type rcode_tp[STAT_TRANSPORTS][17];
+	/* Histogram of the time from receive to send, and the sum of the
+	 * times in microseconds */
+	stc_type latency[STAT_LATENCY_BUCKETS], latency_sum;
+	/* Histogram of the response sizes, and the sum of the sizes */
+	stc_type respsize[STAT_RESPSIZE_BUCKETS], respsize_sum;
+	uint8_t pad[STAT_CACHE_LINE];
 };
 #endif /* BIND8_STATS */
 
@@ -355,6 +421,10 @@ struct	nsd
 	struct nsdst* stat_map;
 	/* statistics array of size child_count, twice */
 	struct nsdst* stats_per_child[2];
+	/* answer statistics, in the stat file after the stat_map, with
+	 * the same layout, and the block of this server process */
+	struct nsdst_resp* resp_map;
+	struct nsdst_resp* resp;
 	/* current stats_per_child array that is in use for the child set */
 	int stat_current;
 	/* start value for per process statistics printout, to clear it */
@@ -433,6 +503,8 @@ const char* nsd_event_vs(void);
 const char* nsd_event_method(void);
 struct event_base* nsd_child_event_base(void);
 void service_remaining_tcp(struct nsd* nsd);
+/* apply the transfers sent by main with NSD_APPLY_XFR, in a server process */
+void server_child_apply_xfrs(struct nsd* nsd, int fd);
 /* extra domain numbers for temporary domains */
 #define EXTRA_DOMAIN_NUMBERS 1024
 #define SLOW_ACCEPT_TIMEOUT 2 /* in seconds */
@@ -10,6 +10,15 @@
 #ifdef NSEC3
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 #include "nsec3.h"
 #include "iterated_hash.h"
@@ -17,6 +26,8 @@
 #include "nsd.h"
 #include "answer.h"
 #include "options.h"
+#include "rdata.h"
+#include "lookup3.h"
 
 #define NSEC3_RDATA_BITMAP 5
 
@@ -843,6 +854,631 @@ nsec3_superzone_precompile_for_apex(struct namedb* db, const dname_type* apex)
 	region_destroy(tmpregion);
 }
 
+/* hashes of a domain that the zone precompile needs, see prehash_list */
+struct nsec3_prehash {
+	domain_type* domain;
+	uint8_t flags;
+	uint8_t hash[NSEC3_HASH_LEN];
+	uint8_t wc[NSEC3_HASH_LEN];
+	uint8_t ds[NSEC3_HASH_LEN];
+};
+#define PREHASH_HASH 0x01 /* hash of the name */
+#define PREHASH_WC 0x02 /* hash of the wildcard child of the name */
+#define PREHASH_DS 0x04 /* hash of the name in the parent zone, for DS */
+
+/* list of prehash entries, for the domains of the zone in domain order */
+struct nsec3_prehash_list {
+	struct nsec3_prehash* list;
+	size_t num;
+};
+
+/* the needed hashes of the domain in the zone, 0 if none */
+static uint8_t
+prehash_flags(domain_type* walk, zone_type* zone)
+{
+	uint8_t flags = 0;
+	if(nsec3_condition_hash(walk, zone)) {
+		flags |= PREHASH_HASH;
+		if(domain_dname(walk)->name_size + 2 <= MAXDOMAINLEN)
+			flags |= PREHASH_WC;
+	}
+	if(nsec3_condition_dshash(walk, zone))
+		flags |= PREHASH_DS;
+	return flags;
+}
+
+/* create the list of domains to hash for the zone, in domain order.
+ * Returns false on failure. */
+static int
+prehash_list_create(struct nsec3_prehash_list* pl, zone_type* zone)
+{
+	domain_type* walk;
+	size_t i = 0;
+	memset(pl, 0, sizeof(*pl));
+	for(walk=zone->apex; walk && domain_is_subdomain(walk, zone->apex);
+		walk = domain_next(walk)) {
+		if(prehash_flags(walk, zone))
+			pl->num++;
+	}
+	pl->list = (struct nsec3_prehash*)malloc(pl->num == 0 ? 1 :
+		pl->num*sizeof(struct nsec3_prehash));
+	if(!pl->list) {
+		log_msg(LOG_ERR, "nsec3: out of memory");
+		return 0;
+	}
+	for(walk=zone->apex; walk && domain_is_subdomain(walk, zone->apex);
+		walk = domain_next(walk)) {
+		uint8_t flags = prehash_flags(walk, zone);
+		if(!flags)
+			continue;
+		pl->list[i].domain = walk;
+		pl->list[i].flags = flags;
+		i++;
+	}
+	return 1;
+}
+
+static void
+prehash_list_delete(struct nsec3_prehash_list* pl)
+{
+	free(pl->list);
+	pl->list = NULL;
+}
+
+/* compute the hashes for the entries start, start+step, ... */
+static void
+prehash_compute(zone_type* zone, struct nsec3_prehash_list* pl,
+	size_t start, size_t step)
+{
+	region_type* tmpregion = region_create(xalloc, free);
+	size_t i;
+	for(i=start; i<pl->num; i+=step) {
+		struct nsec3_prehash* p = &pl->list[i];
+		const dname_type* dname = domain_dname(p->domain);
+		if((p->flags & PREHASH_HASH))
+			nsec3_hash_and_store(zone, dname, p->hash);
+		if((p->flags & PREHASH_WC)) {
+			const dname_type* wcard = dname_parse(tmpregion, "*");
+			wcard = dname_concatenate(tmpregion, wcard, dname);
+			nsec3_hash_and_store(zone, wcard, p->wc);
+			region_free_all(tmpregion);
+		}
+		if((p->flags & PREHASH_DS))
+			nsec3_hash_and_store(zone, dname, p->ds);
+	}
+	region_destroy(tmpregion);
+}
+
+#if defined(HAVE_MMAP) && defined(HAVE_FORK)
+/* the number of names in a batch for the hash processes */
+#define NSEC3_POOL_BATCH 4096
+
+/* a name to hash, in the batch */
+struct nsec3_pool_item {
+	uint8_t namelen;
+	uint8_t name[MAXDOMAINLEN];
+	uint8_t hash[NSEC3_HASH_LEN];
+};
+
+/* a batch of names to hash with the NSEC3 parameters of the zone */
+struct nsec3_pool_batch {
+	int iterations;
+	int saltlen;
+	uint8_t salt[256];
+	size_t num;
+	struct nsec3_pool_item items[NSEC3_POOL_BATCH];
+};
+
+/* the hash processes. They are forked for the first zone that needs
+ * them, and the next zones that are loaded use them too, until
+ * nsec3_hash_pool_stop. The names are passed in the batch, in memory
+ * that is shared with them, because they are forked before those zones
+ * are read. */
+static struct nsec3_hash_pool {
+	/* the process that forked them */
+	pid_t owner;
+	/* number of shares of a batch, the owner computes share 0 */
+	size_t num;
+	/* the processes for shares 1 .. num-1, 0 if not there */
+	pid_t* pids;
+	/* socket to start the batch and for the reply, -1 if failed */
+	int* fds;
+	struct nsec3_pool_batch* batch;
+} hash_pool;
+
+/* hash the names in the batch, start, start+step, ... */
+static void
+nsec3_pool_hash(struct nsec3_pool_batch* b, size_t start, size_t step)
+{
+	size_t i;
+	for(i=start; i<b->num; i+=step) {
+		iterated_hash(b->items[i].hash, b->salt, b->saltlen,
+			b->items[i].name, b->items[i].namelen, b->iterations);
+	}
+}
+
+/* read a byte from the socket, false on failure or when closed */
+static int
+nsec3_pool_read(int fd, uint8_t* c)
+{
+	ssize_t r;
+	while((r = read(fd, c, 1)) == -1 && errno == EINTR)
+		;
+	return r == 1;
+}
+
+/* the hash process, computes its share of a batch when it is started,
+ * and exits when the socket is closed */
+static void
+nsec3_pool_worker(int fd, size_t k, size_t step)
+{
+	uint8_t c;
+	while(nsec3_pool_read(fd, &c)) {
+		nsec3_pool_hash(hash_pool.batch, k, step);
+		if(!write_socket(fd, &c, 1))
+			break;
+	}
+	_exit(0);
+}
+
+/* start the pool with procs shares, returns false if it cannot be used */
+static int
+nsec3_hash_pool_start(size_t procs)
+{
+	size_t k, j;
+	void* p;
+	if(hash_pool.num == procs && hash_pool.owner == getpid())
+		return 1;
+	nsec3_hash_pool_stop();
+	p = mmap(NULL, sizeof(struct nsec3_pool_batch), PROT_READ |
+		PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED) {
+		log_msg(LOG_ERR, "nsec3: mmap failed: %s", strerror(errno));
+		return 0;
+	}
+	hash_pool.batch = (struct nsec3_pool_batch*)p;
+	hash_pool.owner = getpid();
+	hash_pool.num = procs;
+	hash_pool.pids = (pid_t*)xalloc_array_zero(procs, sizeof(pid_t));
+	hash_pool.fds = (int*)xalloc_array_zero(procs, sizeof(int));
+	hash_pool.fds[0] = -1;
+	for(k=1; k<procs; k++) {
+		int sv[2];
+		hash_pool.fds[k] = -1;
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+			log_msg(LOG_ERR, "nsec3: socketpair failed: %s",
+				strerror(errno));
+			continue;
+		}
+		hash_pool.pids[k] = fork();
+		if(hash_pool.pids[k] == 0) {
+			/* the sockets of the other processes are not for
+			 * this one, they must see the close of the owner */
+			close(sv[0]);
+			for(j=1; j<k; j++) {
+				if(hash_pool.fds[j] != -1)
+					close(hash_pool.fds[j]);
+			}
+			nsec3_pool_worker(sv[1], k, procs);
+		} else if(hash_pool.pids[k] == -1) {
+			log_msg(LOG_ERR, "nsec3: fork failed: %s",
+				strerror(errno));
+			hash_pool.pids[k] = 0;
+			close(sv[0]);
+			close(sv[1]);
+			continue;
+		}
+		close(sv[1]);
+		hash_pool.fds[k] = sv[0];
+	}
+	return 1;
+}
+
+/* hash the batch with the processes of the pool and this process, the
+ * shares of processes that failed are computed here */
+static void
+nsec3_hash_pool_run(void)
+{
+	uint8_t c = 0;
+	size_t k;
+	for(k=1; k<hash_pool.num; k++) {
+		if(hash_pool.fds[k] != -1 &&
+			!write_socket(hash_pool.fds[k], &c, 1)) {
+			close(hash_pool.fds[k]);
+			hash_pool.fds[k] = -1;
+		}
+	}
+	nsec3_pool_hash(hash_pool.batch, 0, hash_pool.num);
+	for(k=1; k<hash_pool.num; k++) {
+		if(hash_pool.fds[k] != -1 &&
+			!nsec3_pool_read(hash_pool.fds[k], &c)) {
+			log_msg(LOG_ERR, "nsec3: hash process %d failed",
+				(int)hash_pool.pids[k]);
+			close(hash_pool.fds[k]);
+			hash_pool.fds[k] = -1;
+		}
+		if(hash_pool.fds[k] == -1)
+			nsec3_pool_hash(hash_pool.batch, k, hash_pool.num);
+	}
+}
+
+/* the hash of the part of the prehash entry, NULL if it does not have
+ * it. part 0 is the name, 1 the wildcard below it, 2 the DS name. */
+static uint8_t*
+prehash_part(struct nsec3_prehash* p, int part)
+{
+	if(part == 0)
+		return (p->flags & PREHASH_HASH) ? p->hash : NULL;
+	if(part == 1)
+		return (p->flags & PREHASH_WC) ? p->wc : NULL;
+	return (p->flags & PREHASH_DS) ? p->ds : NULL;
+}
+
+/* compute the hashes of the list in batches, with the pool */
+static void
+prehash_compute_pool(zone_type* zone, struct nsec3_prehash_list* pl)
+{
+	struct nsec3_pool_batch* b = hash_pool.batch;
+	const unsigned char* salt = NULL;
+	int saltlen = 0, iter = 0, part = 0, bpart;
+	size_t i = 0, bi, n;
+	detect_nsec3_params(zone->nsec3_param, &salt, &saltlen, &iter);
+	b->iterations = iter;
+	b->saltlen = saltlen;
+	if(saltlen > 0)
+		memcpy(b->salt, salt, (size_t)saltlen);
+	while(i < pl->num) {
+		/* fill the batch, from entry i and part */
+		bi = i;
+		bpart = part;
+		for(n=0; i < pl->num && n < NSEC3_POOL_BATCH; ) {
+			struct nsec3_prehash* p = &pl->list[i];
+			if(prehash_part(p, part)) {
+				const dname_type* d = domain_dname(p->domain);
+				struct nsec3_pool_item* it = &b->items[n++];
+				size_t wc = 0;
+				if(part == 1) {
+					/* the wildcard label in front */
+					it->name[0] = 1;
+					it->name[1] = '*';
+					wc = 2;
+				}
+				memcpy(it->name+wc, dname_name(d), d->name_size);
+				it->namelen = (uint8_t)(d->name_size + wc);
+			}
+			if(++part == 3) {
+				part = 0;
+				i++;
+			}
+		}
+		b->num = n;
+		nsec3_hash_pool_run();
+		/* copy the hashes to the entries, in the same order */
+		for(n=0; n < b->num; ) {
+			uint8_t* h = prehash_part(&pl->list[bi], bpart);
+			if(h)
+				memcpy(h, b->items[n++].hash, NSEC3_HASH_LEN);
+			if(++bpart == 3) {
+				bpart = 0;
+				bi++;
+			}
+		}
+	}
+}
+#endif /* HAVE_MMAP && HAVE_FORK */
+
+void
+nsec3_hash_pool_stop(void)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_FORK)
+	size_t k;
+	if(hash_pool.num == 0)
+		return;
+	for(k=1; k<hash_pool.num; k++) {
+		if(hash_pool.fds[k] != -1)
+			close(hash_pool.fds[k]);
+		/* a pool that is inherited over fork has the processes of
+		 * the parent, they exit when the parent closes them */
+		if(hash_pool.pids[k] != 0 && hash_pool.owner == getpid()) {
+			while(waitpid(hash_pool.pids[k], NULL, 0) == -1 &&
+				errno == EINTR)
+				; /* wait for it */
+		}
+	}
+	free(hash_pool.pids);
+	free(hash_pool.fds);
+	(void)munmap(hash_pool.batch, sizeof(struct nsec3_pool_batch));
+	memset(&hash_pool, 0, sizeof(hash_pool));
+#endif /* HAVE_MMAP && HAVE_FORK */
+}
+
+/* compute the hashes of the list, with the pool of hash processes if
+ * procs is more than one, and in this process */
+static void
+prehash_compute_all(zone_type* zone, struct nsec3_prehash_list* pl,
+	size_t procs)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_FORK)
+	if(procs > 1 && nsec3_hash_pool_start(procs)) {
+		prehash_compute_pool(zone, pl);
+		return;
+	}
+#endif /* HAVE_MMAP && HAVE_FORK */
+	prehash_compute(zone, pl, 0, 1);
+}
+
+/* the nsec3 hash cache file name for the zonefile */
+static void
+prehash_cache_name(char* buf, size_t len, const char* zfile)
+{
+	snprintf(buf, len, "%s%s", zfile, NSEC3_HASH_CACHE_SUFFIX);
+}
+
+/* the parameters the cache is for: serial, iterations, salt.
+ * returns false if there are none. */
+static int
+prehash_cache_params(zone_type* zone, uint32_t* serial, int* iter,
+	const unsigned char** salt, int* saltlen)
+{
+	if(!zone->nsec3_param || !zone->soa_rrset ||
+		zone->soa_rrset->rr_count == 0 ||
+		!retrieve_soa_rdata_serial(zone->soa_rrset->rrs[0], serial))
+		return 0;
+	*salt = NULL;
+	*saltlen = 0;
+	*iter = 0;
+	detect_nsec3_params(zone->nsec3_param, salt, saltlen, iter);
+	return 1;
+}
+
+/* write the hashes of the list to the cache file for the zonefile */
+static void
+prehash_cache_write(zone_type* zone, struct nsec3_prehash_list* pl,
+	const char* zfile)
+{
+	char fname[4096], tmpname[4200];
+	uint8_t buf[16];
+	const unsigned char* salt;
+	int iter, saltlen;
+	uint32_t serial, crc = 0xffffffff;
+	size_t i;
+	FILE* out;
+	if(!prehash_cache_params(zone, &serial, &iter, &salt, &saltlen))
+		return;
+	prehash_cache_name(fname, sizeof(fname), zfile);
+	snprintf(tmpname, sizeof(tmpname), "%s~", fname);
+	out = fopen(tmpname, "w");
+	if(!out) {
+		log_msg(LOG_ERR, "cannot write nsec3 hash cache %s: %s",
+			tmpname, strerror(errno));
+		return;
+	}
+	write_uint32(buf, NSEC3_HASH_CACHE_MAGIC);
+	write_uint32(buf+4, serial);
+	write_uint16(buf+8, (uint16_t)iter);
+	buf[10] = (uint8_t)saltlen;
+	if(!write_data_crc(out, buf, 11, &crc) ||
+		!write_data_crc(out, salt, (size_t)saltlen, &crc))
+		goto fail;
+	write_uint32(buf, (uint32_t)pl->num);
+	if(!write_data_crc(out, buf, 4, &crc))
+		goto fail;
+	for(i=0; i<pl->num; i++) {
+		struct nsec3_prehash* p = &pl->list[i];
+		const dname_type* dname = domain_dname(p->domain);
+		buf[0] = p->flags;
+		buf[1] = dname->name_size;
+		if(!write_data_crc(out, buf, 2, &crc) ||
+			!write_data_crc(out, dname_name(dname),
+			dname->name_size, &crc) ||
+			((p->flags & PREHASH_HASH) &&
+			!write_data_crc(out, p->hash, NSEC3_HASH_LEN, &crc)) ||
+			((p->flags & PREHASH_WC) &&
+			!write_data_crc(out, p->wc, NSEC3_HASH_LEN, &crc)) ||
+			((p->flags & PREHASH_DS) &&
+			!write_data_crc(out, p->ds, NSEC3_HASH_LEN, &crc)))
+			goto fail;
+	}
+	write_uint32(buf, ~crc);
+	if(!write_data(out, buf, 4))
+		goto fail;
+	if(fclose(out) != 0) {
+		log_msg(LOG_ERR, "cannot write nsec3 hash cache %s: %s",
+			tmpname, strerror(errno));
+		(void)unlink(tmpname);
+		return;
+	}
+	if(rename(tmpname, fname) == -1) {
+		log_msg(LOG_ERR, "rename(%s to %s) failed: %s", tmpname,
+			fname, strerror(errno));
+		(void)unlink(tmpname);
+		return;
+	}
+	VERBOSITY(3, (LOG_INFO, "zone %s nsec3 hashes written to %s",
+		zone->opts->name, fname));
+	return;
+fail:
+	/* write_data has logged the error */
+	fclose(out);
+	(void)unlink(tmpname);
+}
+
+/* read the hashes of the list from the cache file for the zonefile.
+ * Returns false if the cache is not there, or is not for this zone
+ * contents and NSEC3 parameters. */
+static int
+prehash_cache_read(zone_type* zone, struct nsec3_prehash_list* pl,
+	const char* zfile)
+{
+	char fname[4096];
+	const unsigned char* salt;
+	int iter, saltlen;
+	uint32_t serial;
+	uint8_t* data = NULL, *p, *end;
+	long len;
+	size_t i;
+	FILE* in;
+	if(!prehash_cache_params(zone, &serial, &iter, &salt, &saltlen))
+		return 0;
+	prehash_cache_name(fname, sizeof(fname), zfile);
+	in = fopen(fname, "r");
+	if(!in)
+		return 0;
+	if(fseek(in, 0, SEEK_END) != 0 || (len = ftell(in)) < 19 ||
+		fseek(in, 0, SEEK_SET) != 0 ||
+		!(data = (uint8_t*)malloc((size_t)len)) ||
+		fread(data, 1, (size_t)len, in) != (size_t)len) {
+		free(data);
+		fclose(in);
+		return 0;
+	}
+	fclose(in);
+	p = data;
+	end = data + len - 4;
+	if(~compute_crc(0xffffffff, data, (size_t)len - 4) !=
+		read_uint32(end) ||
+		read_uint32(p) != NSEC3_HASH_CACHE_MAGIC ||
+		read_uint32(p+4) != serial ||
+		read_uint16(p+8) != (uint16_t)iter ||
+		p[10] != (uint8_t)saltlen ||
+		end - (p+11) < saltlen + 4 ||
+		memcmp(p+11, salt, (size_t)saltlen) != 0 ||
+		read_uint32(p+11+saltlen) != pl->num) {
+		VERBOSITY(3, (LOG_INFO, "nsec3 hash cache %s is not for zone "
+			"%s contents", fname, zone->opts->name));
+		free(data);
+		return 0;
+	}
+	p += 11 + saltlen + 4;
+	for(i=0; i<pl->num; i++) {
+		struct nsec3_prehash* h = &pl->list[i];
+		const dname_type* dname = domain_dname(h->domain);
+		if(end - p < 2 || p[0] != h->flags ||
+			p[1] != dname->name_size ||
+			end - (p+2) < dname->name_size ||
+			memcmp(p+2, dname_name(dname), dname->name_size) != 0)
+			break;
+		p += 2 + dname->name_size;
+		if((h->flags & PREHASH_HASH)) {
+			if(end - p < NSEC3_HASH_LEN) break;
+			memcpy(h->hash, p, NSEC3_HASH_LEN);
+			p += NSEC3_HASH_LEN;
+		}
+		if((h->flags & PREHASH_WC)) {
+			if(end - p < NSEC3_HASH_LEN) break;
+			memcpy(h->wc, p, NSEC3_HASH_LEN);
+			p += NSEC3_HASH_LEN;
+		}
+		if((h->flags & PREHASH_DS)) {
+			if(end - p < NSEC3_HASH_LEN) break;
+			memcpy(h->ds, p, NSEC3_HASH_LEN);
+			p += NSEC3_HASH_LEN;
+		}
+	}
+	free(data);
+	if(i != pl->num || p != end) {
+		VERBOSITY(3, (LOG_INFO, "nsec3 hash cache %s is not for zone "
+			"%s contents", fname, zone->opts->name));
+		return 0;
+	}
+	return 1;
+}
+
+void
+nsec3_hash_cache_write(struct zone* zone, const char* zfile)
+{
+	struct nsec3_prehash_list pl;
+	size_t i;
+	if(!zone->nsec3_param)
+		return;
+	if(!prehash_list_create(&pl, zone))
+		return;
+	/* copy the hashes from the precompile */
+	for(i=0; i<pl.num; i++) {
+		struct nsec3_prehash* p = &pl.list[i];
+		struct nsec3_domain_data* n = p->domain->nsec3;
+		if(!n || ((p->flags & (PREHASH_HASH|PREHASH_WC)) &&
+			!n->hash_wc) ||
+			((p->flags & PREHASH_DS) && !n->ds_parent_hash)) {
+			/* not precompiled */
+			prehash_list_delete(&pl);
+			return;
+		}
+		if((p->flags & PREHASH_HASH))
+			memcpy(p->hash, n->hash_wc->hash.hash, NSEC3_HASH_LEN);
+		if((p->flags & PREHASH_WC))
+			memcpy(p->wc, n->hash_wc->wc.hash, NSEC3_HASH_LEN);
+		if((p->flags & PREHASH_DS))
+			memcpy(p->ds, n->ds_parent_hash->hash, NSEC3_HASH_LEN);
+	}
+	prehash_cache_write(zone, &pl, zfile);
+	prehash_list_delete(&pl);
+}
+
+/* store the hashes of the list in the domains, so that the precompile
+ * does not have to compute them */
+static void
+prehash_list_store(namedb_type* db, struct nsec3_prehash_list* pl)
+{
+	size_t i;
+	for(i=0; i<pl->num; i++) {
+		struct nsec3_prehash* p = &pl->list[i];
+		domain_type* domain = p->domain;
+		allocate_domain_nsec3(db->domains, domain);
+		if((p->flags & PREHASH_HASH) && !domain->nsec3->hash_wc) {
+			domain->nsec3->hash_wc = (nsec3_hash_wc_node_type *)
+				region_alloc(db->region,
+				sizeof(nsec3_hash_wc_node_type));
+			domain->nsec3->hash_wc->hash.node.key = NULL;
+			domain->nsec3->hash_wc->wc.node.key = NULL;
+			memcpy(domain->nsec3->hash_wc->hash.hash, p->hash,
+				NSEC3_HASH_LEN);
+			if((p->flags & PREHASH_WC))
+				memcpy(domain->nsec3->hash_wc->wc.hash, p->wc,
+					NSEC3_HASH_LEN);
+		}
+		if((p->flags & PREHASH_DS) && !domain->nsec3->ds_parent_hash) {
+			domain->nsec3->ds_parent_hash = (nsec3_hash_node_type *)
+				region_alloc(db->region,
+				sizeof(nsec3_hash_node_type));
+			domain->nsec3->ds_parent_hash->node.key = NULL;
+			memcpy(domain->nsec3->ds_parent_hash->hash, p->ds,
+				NSEC3_HASH_LEN);
+		}
+	}
+}
+
+/* compute, or read from the cache, the hashes for the precompile of the
+ * zone, in advance. The hashes are then not computed one at a time by
+ * the precompile. */
+static void
+prehash_zone_hashes(namedb_type* db, zone_type* zone)
+{
+	struct nsec3_prehash_list pl;
+	size_t procs = (db->nsec3_precompile_processes > 1 ?
+		(size_t)db->nsec3_precompile_processes : 1);
+	int cache = db->nsec3_hash_cache && zone->filename;
+	if(procs == 1 && !cache)
+		return; /* the precompile hashes them */
+	if(!prehash_list_create(&pl, zone))
+		return;
+	if(pl.num < NSEC3_PRECOMPILE_PARALLEL_MIN)
+		procs = 1;
+	if(!cache || !prehash_cache_read(zone, &pl, zone->filename)) {
+		VERBOSITY(3, (LOG_INFO, "zone %s nsec3 hash %u names with %u "
+			"processes", zone->opts->name, (unsigned)pl.num,
+			(unsigned)procs));
+		prehash_compute_all(zone, &pl, procs);
+		if(cache)
+			prehash_cache_write(zone, &pl, zone->filename);
+	} else {
+		VERBOSITY(2, (LOG_INFO, "zone %s nsec3 hashes read from cache",
+			zone->opts->name));
+	}
+	prehash_list_store(db, &pl);
+	prehash_list_delete(&pl);
+}
+
 void
 nsec3_precompile_newparam(namedb_type* db, zone_type* zone)
 {
@@ -859,6 +1495,8 @@ nsec3_precompile_newparam(namedb_type* db, zone_type* zone)
 			nsec3_precompile_nsec3rr(db, walk, zone);
 		}
 	}
+	/* hashes computed in parallel or read from the cache */
+	prehash_zone_hashes(db, zone);
 	/* hash and precompile zone */
 	for(walk=zone->apex; walk && domain_is_subdomain(walk, zone->apex);
 		walk = domain_next(walk)) {
@@ -1118,7 +1756,108 @@ nsec3_add_rrset(struct query* query, struct answer* answer,
 	}
 }
 
-/* this routine does hashing at query-time. slow. */
+/*
+ * Cache of the proofs that the name one label below the closest encloser
+ * does not exist, per zone and closest encloser. The namedb of a server
+ * process does not change, so the pointers are the key. In a random
+ * subdomain flood every query has another name below the same closest
+ * encloser, the hash of that name has to be computed, but it often falls
+ * in the span of the NSEC3 that covered the previous one, and then the
+ * NSEC3 tree is not searched. The proof that the closest encloser exists,
+ * and the wildcard proof, are precompiled in the closest encloser. The
+ * last name and its hash are kept too, for a name that is asked again.
+ * Every server process has its own, it is set up when the server process
+ * starts.
+ */
+struct nsec3_proof_entry {
+	/* zone of the proof, NULL if the entry is empty */
+	struct zone* zone;
+	/* the closest encloser */
+	struct domain* encloser;
+	/* the NSEC3 that covers the hashes from the NSEC3 lo, inclusive, to
+	 * the NSEC3 hi. lo NULL is before the first, hi NULL after the last
+	 * NSEC3 in the chain. cover NULL if there is no span. */
+	struct domain* cover, *lo, *hi;
+	/* the last name that was proven and its hash */
+	uint8_t hash[NSEC3_HASH_LEN];
+	uint8_t namelen;
+	uint8_t name[MAXDOMAINLEN];
+};
+static struct nsec3_proof_entry* nsec3_proof_cache = NULL;
+static size_t nsec3_proof_cache_size = 0;
+
+void
+nsec3_proof_cache_init(size_t size)
+{
+	free(nsec3_proof_cache);
+	nsec3_proof_cache = NULL;
+	nsec3_proof_cache_size = 0;
+	if(size == 0)
+		return;
+	nsec3_proof_cache = (struct nsec3_proof_entry*)xalloc_array_zero(
+		size, sizeof(struct nsec3_proof_entry));
+	nsec3_proof_cache_size = size;
+}
+
+/* the cache entry for the closest encloser in the zone, NULL if no cache */
+static struct nsec3_proof_entry*
+nsec3_proof_cache_entry(struct zone* zone, struct domain* encloser)
+{
+	uint32_t h;
+	if(!nsec3_proof_cache)
+		return NULL;
+	h = hashlittle(&encloser, sizeof(encloser), (uint32_t)(size_t)zone);
+	return &nsec3_proof_cache[h % nsec3_proof_cache_size];
+}
+
+/* compare the NSEC3 owner label with the owner of the NSEC3 domain, as
+ * the nsec3 tree does */
+static int
+nsec3_label_cmp(const uint8_t* label, struct domain* nsec3)
+{
+	return memcmp(label, dname_name(domain_dname(nsec3)),
+		NSEC3_OWNER_LABEL_LEN + 1);
+}
+
+/* find the NSEC3 that covers the hash, with the span in the cache entry
+ * of the closest encloser, the span is updated if it is not there.
+ * returns true if the find is exact. */
+static int
+nsec3_proof_find_cover(struct zone* zone, struct nsec3_proof_entry* e,
+	uint8_t* hash, struct domain** cover)
+{
+	uint8_t label[NSEC3_OWNER_LABEL_LEN+8];
+	rbnode_type* next;
+	int exact;
+	if(!e)
+		return nsec3_find_cover(zone, hash, NSEC3_HASH_LEN, cover);
+	label[0] = NSEC3_OWNER_LABEL_LEN;
+	b32_ntop(hash, NSEC3_HASH_LEN, (char*)label+1, sizeof(label)-1);
+	if(e->cover && (!e->lo || nsec3_label_cmp(label, e->lo) >= 0) &&
+		(!e->hi || nsec3_label_cmp(label, e->hi) < 0)) {
+		*cover = e->cover;
+		return e->lo && nsec3_label_cmp(label, e->lo) == 0;
+	}
+	exact = nsec3_find_cover(zone, hash, NSEC3_HASH_LEN, cover);
+	e->cover = NULL;
+	if(!*cover || !(*cover)->nsec3 ||
+		(*cover)->nsec3->nsec3_node.key == NULL)
+		return exact;
+	if(*cover == zone->nsec3_last && nsec3_label_cmp(label, *cover) < 0) {
+		/* before the first NSEC3, covered by the last */
+		next = rbtree_first(zone->nsec3tree);
+		e->lo = NULL;
+	} else {
+		next = rbtree_next(&(*cover)->nsec3->nsec3_node);
+		e->lo = *cover;
+	}
+	e->hi = (next == RBTREE_NULL ? NULL : (struct domain*)next->key);
+	e->cover = *cover;
+	return exact;
+}
+
+/* this routine does hashing at query-time, the span of the NSEC3 that
+ * covers it is in the proof cache. */
 static void
 nsec3_add_nonexist_proof(struct query* query, struct answer* answer,
         struct domain* encloser, const dname_type* qname)
@@ -1126,14 +1865,36 @@ nsec3_add_nonexist_proof(struct query* query, struct answer* answer,
 	uint8_t hash[NSEC3_HASH_LEN];
 	const dname_type* to_prove;
 	domain_type* cover=0;
+	struct nsec3_proof_entry* e;
+	int exact;
 	assert(encloser);
 	/* if query=a.b.c.d encloser=c.d. then proof needed for b.c.d. */
 	/* if query=a.b.c.d encloser=*.c.d. then proof needed for b.c.d. */
 	to_prove = dname_partial_copy(query->region, qname,
 		dname_label_match_count(qname, domain_dname(encloser))+1);
 	/* generate proof that one label below closest encloser does not exist */
-	nsec3_hash_and_store(query->zone, to_prove, hash);
-	if(nsec3_find_cover(query->zone, hash, sizeof(hash), &cover))
+	e = nsec3_proof_cache_entry(query->zone, encloser);
+	if(e && (e->zone != query->zone || e->encloser != encloser)) {
+		e->zone = query->zone;
+		e->encloser = encloser;
+		e->cover = NULL;
+		e->namelen = 0;
+	}
+	if(e && e->namelen == to_prove->name_size &&
+		memcmp(e->name, dname_name(to_prove), to_prove->name_size)
+		== 0) {
+		memmove(hash, e->hash, NSEC3_HASH_LEN);
+	} else {
+		nsec3_hash_and_store(query->zone, to_prove, hash);
+		if(e) {
+			memmove(e->hash, hash, NSEC3_HASH_LEN);
+			e->namelen = to_prove->name_size;
+			memmove(e->name, dname_name(to_prove),
+				to_prove->name_size);
+		}
+	}
+	exact = nsec3_proof_find_cover(query->zone, e, hash, &cover);
+	if(exact)
 	{
 		/* exact match, hash collision */
 		domain_type* walk;
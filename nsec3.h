@@ -20,6 +20,20 @@ struct query;
 struct answer;
 struct rr;
 
+/*
+ * NSEC3 hash cache file, written next to the zonefile with nsec3-hash-cache.
+ * It has the hashes of the zone precompile, for the zone serial and NSEC3
+ * parameters in the header, per domain in domain order. The domain name is
+ * stored to check it. All numbers are in network byte order.
+ *	header: magic(4) serial(4) iterations(2) saltlen(1) salt count(4)
+ *	domain: flags(1) namelen(1) name [hash(20)] [wchash(20)] [dshash(20)]
+ *	trailer: crc(4)
+ */
+#define NSEC3_HASH_CACHE_SUFFIX ".nsec3hash"
+#define NSEC3_HASH_CACHE_MAGIC 0x4e534843 /* "NSHC" */
+/* the number of hashes needed before they are computed in parallel */
+#define NSEC3_PRECOMPILE_PARALLEL_MIN 1000
+
 /*
  * calculate prehash information for zone.
  */
@@ -28,6 +42,11 @@ void prehash_zone(struct namedb* db, struct zone* zone);
  * calculate prehash for zone, assumes no partial precompile or prehashlist
  */
 void prehash_zone_complete(struct namedb* db, struct zone* zone);
+/*
+ * stop the processes that hash in parallel for nsec3-precompile-processes.
+ * They are kept for the next zone, call this when the zones are loaded.
+ */
+void nsec3_hash_pool_stop(void);
 
 /*
  * finds nsec3 that covers the given domain hash.
@@ -36,6 +55,12 @@ void prehash_zone_complete(struct namedb* db, struct zone* zone);
 int nsec3_find_cover(struct zone* zone, uint8_t* hash, size_t hashlen,
 	struct domain** result);
 
+/*
+ * set up the cache of nonexistence proofs with size entries, for this
+ * server process. Removes the previous contents. size 0 turns it off.
+ */
+void nsec3_proof_cache_init(size_t size);
+
 /*
  * _answer_ Routines used to add the correct nsec3 record to a query answer.
  * cnames etc may have been followed, hence original name.
@@ -104,6 +129,9 @@ void nsec3_precompile_nsec3rr(struct namedb* db, struct domain* domain,
 	struct zone* zone);
 /* precompile entire zone, assumes all is null at start */
 void nsec3_precompile_newparam(struct namedb* db, struct zone* zone);
+/* write the NSEC3 hashes of the precompiled zone to the hash cache file
+ * next to the zonefile, so a later precompile can read them */
+void nsec3_hash_cache_write(struct zone* zone, const char* zfile);
 /* clear super zone of apex, for names subdomain of apex. */
 void nsec3_superzone_clear_for_apex(struct namedb* db,
 	const struct dname* apex);
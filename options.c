@@ -104,6 +104,10 @@ nsd_options_create(region_type* region)
 	opt->reuseport = 0;
 	opt->xfrd_tcp_max = 128;
 	opt->xfrd_tcp_pipeline = 128;
+	opt->xfrd_xfr_buffer_size = 65536;
+	opt->xfrd_udp_per_primary = 16;
+	opt->xfrd_tcp_idle_timeout = 10;
+	opt->xfrd_tcp_pool_size = 2;
 	opt->statistics = 0;
 	opt->chroot = 0;
 	opt->username = USER;
@@ -116,6 +120,7 @@ nsd_options_create(region_type* region)
 	opt->rrl_slip = RRL_SLIP;
 	opt->rrl_ipv4_prefix_length = RRL_IPV4_PREFIX_LENGTH;
 	opt->rrl_ipv6_prefix_length = RRL_IPV6_PREFIX_LENGTH;
+	opt->rrl_shared = 0;
 #  ifdef RATELIMIT_DEFAULT_OFF
 	opt->rrl_ratelimit = 0;
 	opt->rrl_whitelist_ratelimit = 0;
@@ -139,11 +144,25 @@ nsd_options_create(region_type* region)
 	opt->dnstap_version = NULL;
 	opt->dnstap_log_auth_query_messages = 0;
 	opt->dnstap_log_auth_response_messages = 0;
+	opt->dnstap_sample_rate = 1;
+	opt->dnstap_log_zones = NULL;
+	opt->dnstap_log_qtypes = NULL;
+	opt->dnstap_log_rcodes = NULL;
+	opt->dnstap_log_clients = NULL;
+	opt->dnstap_log_transports = NULL;
 #endif
 	opt->reload_config = 0;
 	opt->zonefiles_check = 1;
 	opt->zonefiles_write = ZONEFILES_WRITE_INTERVAL;
+	opt->zonefiles_snapshot = 0;
 	opt->xfrd_reload_timeout = 1;
+	opt->reload_cow_stats = 0;
+	opt->reload_incremental = 0;
+	opt->zone_shards = 0;
+	opt->nsec3_precompile_processes = 1;
+	opt->nsec3_hash_cache = 0;
+	opt->nsec3_proof_cache_size = 1024;
+	opt->xfr_check_processes = 1;
 	opt->tls_service_key = NULL;
 	opt->tls_service_ocsp = NULL;
 	opt->tls_service_pem = NULL;
@@ -177,6 +196,7 @@ nsd_options_create(region_type* region)
 	opt->metrics_interface = NULL;
 	opt->metrics_port = NSD_METRICS_PORT;
 	opt->metrics_path = "/metrics";
+	opt->metrics_cache_time = 0;
 #endif /* USE_METRICS */
 
 	opt->verify_enable = 0;
@@ -1124,6 +1144,7 @@ pattern_options_create(region_type* region)
 	p->allow_notify = 0;
 	p->request_xfr = 0;
 	p->size_limit_xfr = 0;
+	p->reload_max_staleness = 0;
 	p->notify = 0;
 	p->provide_xfr = 0;
 	p->allow_query = 0;
@@ -1154,6 +1175,10 @@ pattern_options_create(region_type* region)
 	p->ixfr_size_is_default = 1;
 	p->ixfr_number = IXFR_NUMBER_DEFAULT;
 	p->ixfr_number_is_default = 1;
+	p->ixfr_compress = 0;
+	p->ixfr_compress_is_default = 1;
+	p->ixfr_condense = 0;
+	p->ixfr_condense_is_default = 1;
 	p->create_ixfr = 0;
 	p->create_ixfr_is_default = 1;
 	p->verify_zone = VERIFY_ZONE_INHERIT;
@@ -1360,6 +1385,10 @@ copy_pat_fixed(region_type* region, struct pattern_options* orig,
 	orig->ixfr_size_is_default = p->ixfr_size_is_default;
 	orig->ixfr_number = p->ixfr_number;
 	orig->ixfr_number_is_default = p->ixfr_number_is_default;
+	orig->ixfr_compress = p->ixfr_compress;
+	orig->ixfr_compress_is_default = p->ixfr_compress_is_default;
+	orig->ixfr_condense = p->ixfr_condense;
+	orig->ixfr_condense_is_default = p->ixfr_condense_is_default;
 	orig->create_ixfr = p->create_ixfr;
 	orig->create_ixfr_is_default = p->create_ixfr_is_default;
 	orig->verify_zone = p->verify_zone;
@@ -1493,12 +1522,17 @@ pattern_options_equal(struct pattern_options* p, struct pattern_options* q)
 #endif
 	if(!booleq(p->multi_primary_check,q->multi_primary_check)) return 0;
 	if(p->size_limit_xfr != q->size_limit_xfr) return 0;
+	if(p->reload_max_staleness != q->reload_max_staleness) return 0;
 	if(!booleq(p->store_ixfr,q->store_ixfr)) return 0;
 	if(!booleq(p->store_ixfr_is_default,q->store_ixfr_is_default)) return 0;
 	if(p->ixfr_size != q->ixfr_size) return 0;
 	if(!booleq(p->ixfr_size_is_default,q->ixfr_size_is_default)) return 0;
 	if(p->ixfr_number != q->ixfr_number) return 0;
 	if(!booleq(p->ixfr_number_is_default,q->ixfr_number_is_default)) return 0;
+	if(!booleq(p->ixfr_compress,q->ixfr_compress)) return 0;
+	if(!booleq(p->ixfr_compress_is_default,q->ixfr_compress_is_default)) return 0;
+	if(!booleq(p->ixfr_condense,q->ixfr_condense)) return 0;
+	if(!booleq(p->ixfr_condense_is_default,q->ixfr_condense_is_default)) return 0;
 	if(!booleq(p->create_ixfr,q->create_ixfr)) return 0;
 	if(!booleq(p->create_ixfr_is_default,q->create_ixfr_is_default)) return 0;
 	if(p->verify_zone != q->verify_zone) return 0;
@@ -1717,6 +1751,7 @@ pattern_options_marshal(struct buffer* b, struct pattern_options* p)
 	marshal_u8(b, p->notify_retry_is_default);
 	marshal_u8(b, p->implicit);
 	marshal_u64(b, p->size_limit_xfr);
+	marshal_u32(b, p->reload_max_staleness);
 	marshal_acl_list(b, p->allow_notify);
 	marshal_acl_list(b, p->request_xfr);
 	marshal_acl_list(b, p->notify);
@@ -1740,6 +1775,10 @@ pattern_options_marshal(struct buffer* b, struct pattern_options* p)
 	marshal_u8(b, p->ixfr_size_is_default);
 	marshal_u32(b, p->ixfr_number);
 	marshal_u8(b, p->ixfr_number_is_default);
+	marshal_u8(b, p->ixfr_compress);
+	marshal_u8(b, p->ixfr_compress_is_default);
+	marshal_u8(b, p->ixfr_condense);
+	marshal_u8(b, p->ixfr_condense_is_default);
 	marshal_u8(b, p->create_ixfr);
 	marshal_u8(b, p->create_ixfr_is_default);
 	marshal_u8(b, p->verify_zone);
@@ -1771,6 +1810,7 @@ pattern_options_unmarshal(region_type* r, struct buffer* b)
 	p->notify_retry_is_default = unmarshal_u8(b);
 	p->implicit = unmarshal_u8(b);
 	p->size_limit_xfr = unmarshal_u64(b);
+	p->reload_max_staleness = unmarshal_u32(b);
 	p->allow_notify = unmarshal_acl_list(r, b);
 	p->request_xfr = unmarshal_acl_list(r, b);
 	p->notify = unmarshal_acl_list(r, b);
@@ -1794,6 +1834,10 @@ pattern_options_unmarshal(region_type* r, struct buffer* b)
 	p->ixfr_size_is_default = unmarshal_u8(b);
 	p->ixfr_number = unmarshal_u32(b);
 	p->ixfr_number_is_default = unmarshal_u8(b);
+	p->ixfr_compress = unmarshal_u8(b);
+	p->ixfr_compress_is_default = unmarshal_u8(b);
+	p->ixfr_condense = unmarshal_u8(b);
+	p->ixfr_condense_is_default = unmarshal_u8(b);
 	p->create_ixfr = unmarshal_u8(b);
 	p->create_ixfr_is_default = unmarshal_u8(b);
 	p->verify_zone = unmarshal_u8(b);
@@ -2917,11 +2961,21 @@ config_apply_pattern(struct pattern_options *dest, const char* name)
 		dest->ixfr_number = pat->ixfr_number;
 		dest->ixfr_number_is_default = 0;
 	}
+	if(!pat->ixfr_compress_is_default) {
+		dest->ixfr_compress = pat->ixfr_compress;
+		dest->ixfr_compress_is_default = 0;
+	}
+	if(!pat->ixfr_condense_is_default) {
+		dest->ixfr_condense = pat->ixfr_condense;
+		dest->ixfr_condense_is_default = 0;
+	}
 	if(!pat->create_ixfr_is_default) {
 		dest->create_ixfr = pat->create_ixfr;
 		dest->create_ixfr_is_default = 0;
 	}
 	dest->size_limit_xfr = pat->size_limit_xfr;
+	if(pat->reload_max_staleness)
+		dest->reload_max_staleness = pat->reload_max_staleness;
 #ifdef RATELIMIT
 	dest->rrl_whitelist |= pat->rrl_whitelist;
 #endif
@@ -117,9 +117,26 @@ struct nsd_options {
 	const char* zonelistfile;
 	const char* nsid;
 	int xfrd_reload_timeout;
+	/* log the memory copied-on-write by the reload process */
+	int reload_cow_stats;
+	/* max bytes of transfers that are applied without a reload process,
+	 * 0 is off */
+	size_t reload_incremental;
+	/* number of memory shards to divide the zones over, 0 is off */
+	int zone_shards;
+	/* number of processes to compute NSEC3 hashes with */
+	int nsec3_precompile_processes;
+	/* cache NSEC3 hashes in a file next to the zonefile */
+	int nsec3_hash_cache;
+	/* entries in the per process cache of NSEC3 next closer proofs */
+	size_t nsec3_proof_cache_size;
+	/* number of processes to check the transfers of a reload with */
+	int xfr_check_processes;
 	int reload_config;
 	int zonefiles_check;
 	int zonefiles_write;
+	/* write and use a binary snapshot next to written zonefiles */
+	int zonefiles_snapshot;
 	int log_time_ascii;
 	int log_time_iso;
 	int round_robin;
@@ -130,6 +147,14 @@ struct nsd_options {
 	int xfrd_tcp_max;
 	/* max number of simultaneous requests on xfrd tcp socket */
 	int xfrd_tcp_pipeline;
+	/* write buffer for a zone transfer that is received, in bytes */
+	int xfrd_xfr_buffer_size;
+	/* max number of simultaneous xfrd udp probes to one primary */
+	int xfrd_udp_per_primary;
+	/* seconds that an idle xfrd tcp connection to a primary stays open */
+	int xfrd_tcp_idle_timeout;
+	/* max number of idle xfrd tcp connections kept open to one primary */
+	int xfrd_tcp_pool_size;
 
 	/* private key file for TLS */
 	char* tls_service_key;
@@ -188,6 +213,8 @@ struct nsd_options {
 	int metrics_port;
 	/** HTTP path for the metrics endpoint */
 	char* metrics_path;
+	/** seconds that the rendered metrics are served from cache */
+	int metrics_cache_time;
 #endif /* USE_METRICS */
 
 #ifdef RATELIMIT
@@ -202,6 +229,8 @@ struct nsd_options {
 	size_t rrl_ipv6_prefix_length;
 	/** max qps for whitelisted queries, 0 is nolimit */
 	size_t rrl_whitelist_ratelimit;
+	/** one table shared by all server processes */
+	int rrl_shared;
 #endif
 	/** if dnstap is enabled */
 	int dnstap_enable;
@@ -231,6 +260,17 @@ struct nsd_options {
 	int dnstap_log_auth_query_messages;
 	/** true to log dnstap AUTH_RESPONSE message events */
 	int dnstap_log_auth_response_messages;
+	/** log 1 in this many queries with dnstap, 0 only the ones that
+	 * match the dnstap-log filters */
+	int dnstap_sample_rate;
+	/** queries that match one of these lists are logged regardless of
+	 * the sample rate, space separated zone names, qtypes, rcodes,
+	 * client addresses with prefix and transports */
+	char* dnstap_log_zones;
+	char* dnstap_log_qtypes;
+	char* dnstap_log_rcodes;
+	char* dnstap_log_clients;
+	char* dnstap_log_transports;
 
 	/** do answer with server cookie when request contained cookie option */
 	int answer_cookie;
@@ -336,6 +376,9 @@ struct pattern_options {
 	 */
 	uint8_t min_expire_time_expr;
 	uint64_t size_limit_xfr;
+	/* seconds from a transfer to serving it that the reload
+	 * scheduler aims for, 0 if not set */
+	uint32_t reload_max_staleness;
 	uint8_t multi_primary_check;
 	uint8_t store_ixfr;
 	uint8_t store_ixfr_is_default;
@@ -343,6 +386,10 @@ struct pattern_options {
 	uint8_t ixfr_size_is_default;
 	uint32_t ixfr_number;
 	uint8_t ixfr_number_is_default;
+	uint8_t ixfr_compress;
+	uint8_t ixfr_compress_is_default;
+	uint8_t ixfr_condense;
+	uint8_t ixfr_condense_is_default;
 	uint8_t create_ixfr;
 	uint8_t create_ixfr_is_default;
 	uint8_t verify_zone;
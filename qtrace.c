@@ -0,0 +1,364 @@
+/*
+ * qtrace.c -- sampling tracer for the time spent on queries.
+ *
+ * Copyright (c) 2026, NLnet Labs. All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+
+/*
+ * The server processes store traced queries in a ring per process, in
+ * shared memory that is created by the main process, so that xfrd can
+ * read them for nsd-control. Every ring has one writer, the entries have
+ * a sequence number that the reader checks before and after it copies
+ * them, so entries that were overwritten during the copy are skipped.
+ * During a reload the old and new server process briefly write the same
+ * ring, that can spoil an entry, which is also skipped.
+ *
+ * The control block with the sample rate and the filters is written by
+ * xfrd and read by the server processes without locks, while it changes
+ * a query may be traced by the old or the new settings.
+ */
+#include "config.h"
+#include <ctype.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS   MAP_ANON
+#endif
+#endif /* HAVE_MMAP */
+#include "qtrace.h"
+#include "query.h"
+#include "util.h"
+
+#ifdef HAVE_ATOMIC_BUILTINS
+#define QTRACE_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+#define QTRACE_FENCE() /* nothing */
+#endif
+
+/** the control block, at the start of the shared memory */
+struct qtrace_ctrl {
+	/* trace 1 in sample queries, 0 is off. First member, it is
+	 * checked by QTRACE_ACTIVE. */
+	uint32_t sample;
+	/* the name filter, in lowercase wireformat, 0 length if none */
+	uint8_t qnamelen;
+	uint8_t qname[MAXDOMAINLEN];
+	/* the client filter, family 0 if none */
+	uint8_t family;
+	uint8_t prefix;
+	uint8_t addr[16];
+};
+
+/** the ring of traced queries of a server process */
+struct qtrace_ring {
+	/* the number of entries that have been written */
+	volatile uint64_t next;
+	struct qtrace_entry entry[QTRACE_RING_SIZE];
+};
+
+struct qtrace_ctrl* qtrace_ctrl = NULL;
+/* the rings follow the control block in the shared memory */
+static struct qtrace_ring* qtrace_rings = NULL;
+static size_t qtrace_rings_num = 0;
+/* the ring of this server process */
+static struct qtrace_ring* qtrace_ring = NULL;
+/* count of queries for the sample rate */
+static uint32_t qtrace_count = 0;
+
+static size_t
+qtrace_mmap_size(size_t numch)
+{
+	return sizeof(struct qtrace_ctrl) + sizeof(uint64_t) /* align */ +
+		numch*sizeof(struct qtrace_ring);
+}
+
+void
+qtrace_mmap_init(int numch)
+{
+#ifdef HAVE_MMAP
+	void* map;
+	size_t sz = qtrace_mmap_size((size_t)numch);
+	map = mmap(NULL, sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS,
+		-1, 0);
+	if(map == MAP_FAILED) {
+		log_msg(LOG_ERR, "qtrace: mmap failed: %s", strerror(errno));
+		return;
+	}
+	memset(map, 0, sz);
+	qtrace_ctrl = (struct qtrace_ctrl*)map;
+	qtrace_rings = (struct qtrace_ring*)((uint8_t*)map +
+		(sizeof(struct qtrace_ctrl)+sizeof(uint64_t)-1)/sizeof(uint64_t)
+		*sizeof(uint64_t));
+	qtrace_rings_num = (size_t)numch;
+#else
+	(void)numch;
+#endif
+}
+
+void
+qtrace_mmap_deinit(void)
+{
+#ifdef HAVE_MMAP
+	if(qtrace_ctrl)
+		munmap(qtrace_ctrl, qtrace_mmap_size(qtrace_rings_num));
+#endif
+	qtrace_ctrl = NULL;
+	qtrace_rings = NULL;
+	qtrace_rings_num = 0;
+	qtrace_ring = NULL;
+}
+
+void
+qtrace_init(int child)
+{
+	if(!qtrace_rings || child < 0 || (size_t)child >= qtrace_rings_num) {
+		qtrace_ring = NULL;
+		return;
+	}
+	qtrace_ring = &qtrace_rings[child];
+	qtrace_count = 0;
+}
+
+void
+qtrace_start(uint32_t sample, const struct dname* qname, int family,
+	const uint8_t* addr, int prefix)
+{
+	size_t i;
+	if(!qtrace_ctrl)
+		return;
+	/* stop while the filters change */
+	qtrace_ctrl->sample = 0;
+	QTRACE_FENCE();
+	qtrace_ctrl->qnamelen = 0;
+	if(qname) {
+		memcpy(qtrace_ctrl->qname, dname_name(qname),
+			qname->name_size);
+		for(i=0; i<qname->name_size; i++)
+			qtrace_ctrl->qname[i] = DNAME_NORMALIZE(
+				qtrace_ctrl->qname[i]);
+		qtrace_ctrl->qnamelen = qname->name_size;
+	}
+	qtrace_ctrl->family = (uint8_t)family;
+	qtrace_ctrl->prefix = (uint8_t)prefix;
+	memset(qtrace_ctrl->addr, 0, sizeof(qtrace_ctrl->addr));
+	if(family == AF_INET)
+		memcpy(qtrace_ctrl->addr, addr, 4);
+#ifdef INET6
+	else if(family == AF_INET6)
+		memcpy(qtrace_ctrl->addr, addr, 16);
+#endif
+	QTRACE_FENCE();
+	qtrace_ctrl->sample = (sample==0?1:sample);
+}
+
+void
+qtrace_stop(void)
+{
+	if(qtrace_ctrl)
+		qtrace_ctrl->sample = 0;
+}
+
+void
+qtrace_clock(struct timespec* t)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	if(clock_gettime(CLOCK_MONOTONIC, t) == 0)
+		return;
+#endif
+	get_time(t);
+}
+
+const char*
+qtrace_stage_str(int stage)
+{
+	static const char* str[] = {"recv", "pp2", "process", "lookup_zone",
+		"encode", "optional", "send"};
+	if(stage < 0 || stage >= qtrace_stages)
+		return "unknown";
+	return str[stage];
+}
+
+/* see if the query name is the filter name or below it */
+static int
+qtrace_qname_match(struct query* q)
+{
+	const uint8_t* n;
+	size_t len, pos = 0, i, flen = qtrace_ctrl->qnamelen;
+	if(!q->qname)
+		return 0;
+	n = dname_name(q->qname);
+	len = q->qname->name_size;
+	while(pos < len && len-pos > flen)
+		pos += n[pos]+1;
+	if(len-pos != flen)
+		return 0;
+	for(i=0; i<flen; i++)
+		if(DNAME_NORMALIZE(n[pos+i]) != qtrace_ctrl->qname[i])
+			return 0;
+	return 1;
+}
+
+/* apply the sample rate, returns true if the query is traced */
+static int
+qtrace_sample(void)
+{
+	uint32_t sample = qtrace_ctrl->sample;
+	if(sample == 0)
+		return 0;
+	if(++qtrace_count >= sample) {
+		qtrace_count = 0;
+		return 1;
+	}
+	return 0;
+}
+
+void
+qtrace_begin(struct query* q, struct timespec* recv)
+{
+	q->trace.on = 0;
+	if(!qtrace_ring)
+		return;
+	if(qtrace_ctrl->family != 0 && !addr_in_netblock(&q->client_addr,
+		qtrace_ctrl->family, qtrace_ctrl->addr, qtrace_ctrl->prefix))
+		return;
+	if(qtrace_ctrl->qnamelen == 0 && !qtrace_sample())
+		return;
+	q->trace.on = 1;
+	q->trace.start = *recv;
+	memset(q->trace.ns, 0, sizeof(q->trace.ns));
+	if(q->is_proxied)
+		qtrace_stamp(&q->trace, qtrace_pp2);
+}
+
+void
+qtrace_process_done(struct query* q)
+{
+	if(qtrace_ctrl->qnamelen == 0)
+		return;
+	if(!qtrace_qname_match(q) || !qtrace_sample())
+		q->trace.on = 0;
+}
+
+void
+qtrace_stamp(struct qtrace_query* trace, int stage)
+{
+	struct timespec now;
+	int64_t ns;
+	qtrace_clock(&now);
+	ns = ((int64_t)now.tv_sec - (int64_t)trace->start.tv_sec)*1000000000
+		+ ((int64_t)now.tv_nsec - (int64_t)trace->start.tv_nsec);
+	if(ns <= 0)
+		ns = 1; /* 0 is not reached */
+	else if(ns > 0xffffffff)
+		ns = 0xffffffff;
+	trace->ns[stage] = (uint32_t)ns;
+}
+
+void
+qtrace_finish(struct query* q, int transport, size_t size)
+{
+	struct qtrace_entry* e;
+	struct timeval tv;
+	uint64_t idx;
+	int af = ((struct sockaddr*)&q->client_addr)->sa_family;
+	q->trace.on = 0;
+	if(!qtrace_ring)
+		return;
+	qtrace_stamp(&q->trace, qtrace_send);
+	if(gettimeofday(&tv, NULL) == -1)
+		memset(&tv, 0, sizeof(tv));
+
+	idx = qtrace_ring->next;
+	e = &qtrace_ring->entry[idx%QTRACE_RING_SIZE];
+	e->seq = 0;
+	QTRACE_FENCE();
+	e->sec = (int64_t)tv.tv_sec;
+	e->usec = (uint32_t)tv.tv_usec;
+	memcpy(e->ns, q->trace.ns, sizeof(e->ns));
+	e->qtype = q->qtype;
+	e->size = (uint16_t)size;
+	e->rcode = (uint8_t)RCODE(q->packet);
+	e->transport = (uint8_t)transport;
+	e->family = (uint8_t)af;
+	memset(e->addr, 0, sizeof(e->addr));
+	if(af == AF_INET)
+		memcpy(e->addr, &((struct sockaddr_in*)&q->client_addr)
+			->sin_addr, 4);
+#ifdef INET6
+	else if(af == AF_INET6)
+		memcpy(e->addr, &((struct sockaddr_in6*)&q->client_addr)
+			->sin6_addr, 16);
+#endif
+	if(q->qname) {
+		e->qnamelen = q->qname->name_size;
+		memcpy(e->qname, dname_name(q->qname), e->qnamelen);
+	} else {
+		e->qnamelen = 0;
+	}
+	QTRACE_FENCE();
+	e->seq = idx+1;
+	qtrace_ring->next = idx+1;
+}
+
+/* insert the entry in the list, that is sorted by time and keeps the
+ * most recent num entries */
+static void
+qtrace_list_add(struct qtrace_entry* list, int* server, size_t* count,
+	size_t num, struct qtrace_entry* e, int s)
+{
+	size_t i = *count;
+	if(*count == num) {
+		/* full, drop the oldest if this one is newer */
+		if(e->sec < list[0].sec || (e->sec == list[0].sec &&
+			e->usec <= list[0].usec))
+			return;
+		memmove(&list[0], &list[1], (num-1)*sizeof(*list));
+		memmove(&server[0], &server[1], (num-1)*sizeof(*server));
+		i = num-1;
+	} else {
+		(*count)++;
+	}
+	while(i > 0 && (list[i-1].sec > e->sec || (list[i-1].sec == e->sec
+		&& list[i-1].usec > e->usec))) {
+		list[i] = list[i-1];
+		server[i] = server[i-1];
+		i--;
+	}
+	list[i] = *e;
+	server[i] = s;
+}
+
+size_t
+qtrace_list(struct qtrace_entry* list, int* server, size_t num)
+{
+	size_t count = 0, r;
+	uint64_t next, idx;
+	struct qtrace_entry e;
+	if(!qtrace_rings || num == 0)
+		return 0;
+	for(r=0; r<qtrace_rings_num; r++) {
+		struct qtrace_ring* ring = &qtrace_rings[r];
+		next = ring->next;
+		idx = (next > QTRACE_RING_SIZE ? next-QTRACE_RING_SIZE : 0);
+		for(; idx < next; idx++) {
+			struct qtrace_entry* p =
+				&ring->entry[idx%QTRACE_RING_SIZE];
+			uint64_t seq = p->seq;
+			QTRACE_FENCE();
+			if(seq != idx+1)
+				continue;
+			memcpy(&e, p, sizeof(e));
+			QTRACE_FENCE();
+			if(p->seq != seq)
+				continue; /* overwritten while copied */
+			qtrace_list_add(list, server, &count, num, &e, (int)r);
+		}
+	}
+	return count;
+}
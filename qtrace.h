@@ -0,0 +1,153 @@
+/*
+ * qtrace.h -- sampling tracer for the time spent on queries.
+ *
+ * Copyright (c) 2026, NLnet Labs. All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+
+#ifndef QTRACE_H
+#define QTRACE_H
+#include "dns.h"
+
+struct query;
+struct dname;
+
+/** the stages of a query that get a timestamp */
+enum qtrace_stage {
+	/* the query was received */
+	qtrace_recv = 0,
+	/* the PROXYv2 header was parsed */
+	qtrace_pp2,
+	/* query_process started */
+	qtrace_process,
+	/* answer_lookup_zone started */
+	qtrace_lookup_zone,
+	/* encode_answer started */
+	qtrace_encode,
+	/* query_add_optional started */
+	qtrace_optional,
+	/* the answer was sent */
+	qtrace_send,
+	/* the number of stages */
+	qtrace_stages
+};
+
+/** number of traced queries that are kept per server process */
+#define QTRACE_RING_SIZE 256
+
+/**
+ * The trace of a query that is being answered, part of the query.
+ */
+struct qtrace_query {
+	/* if the query is traced */
+	int on;
+	/* the time the query was received */
+	struct timespec start;
+	/* nanoseconds since the receive that the stage was reached, 0 if
+	 * it was not reached */
+	uint32_t ns[qtrace_stages];
+};
+
+/**
+ * A traced query, in the ring of a server process.
+ */
+struct qtrace_entry {
+	/* the number of the entry plus one, 0 while it is written */
+	volatile uint64_t seq;
+	/* wallclock time that the answer was sent */
+	int64_t sec;
+	uint32_t usec;
+	/* nanoseconds since the receive for the stages */
+	uint32_t ns[qtrace_stages];
+	uint16_t qtype;
+	uint16_t size;
+	uint8_t rcode;
+	/* STAT_UDP, STAT_TCP or STAT_TLS */
+	uint8_t transport;
+	/* AF_INET or AF_INET6, and the client address */
+	uint8_t family;
+	uint8_t addr[16];
+	/* the query name in wireformat */
+	uint8_t qnamelen;
+	uint8_t qname[MAXDOMAINLEN];
+};
+
+/** the control block, in shared memory, set from nsd-control */
+extern struct qtrace_ctrl* qtrace_ctrl;
+/** if queries are traced at the moment, checked on the hot path */
+#define QTRACE_ACTIVE() (qtrace_ctrl && *(volatile uint32_t*)qtrace_ctrl)
+/** timestamp a stage for a query, if it is traced */
+#define QTRACE_STAMP(q, stage) do { if((q)->trace.on) \
+	qtrace_stamp(&(q)->trace, stage); } while(0)
+
+/**
+ * Create the shared memory for the trace rings of numch server processes,
+ * in the main process, before the fork of xfrd and the servers.
+ */
+void qtrace_mmap_init(int numch);
+
+/** delete the shared memory of the trace rings */
+void qtrace_mmap_deinit(void);
+
+/** set the ring of this server process */
+void qtrace_init(int child);
+
+/**
+ * Start tracing 1 in sample queries (of the ones that match the filters).
+ * @param sample: trace 1 in this many queries, 1 is every query.
+ * @param qname: if not NULL the query name must be this name or below it.
+ * @param family: if not 0, AF_INET or AF_INET6 of the client filter.
+ * @param addr: the client address of the filter.
+ * @param prefix: the prefix length of the client filter.
+ */
+void qtrace_start(uint32_t sample, const struct dname* qname, int family,
+	const uint8_t* addr, int prefix);
+
+/** stop tracing queries */
+void qtrace_stop(void);
+
+/**
+ * Get the traced queries from the rings of the server processes, sorted
+ * from old to new.
+ * @param list: array to store the most recent entries in.
+ * @param server: array with the server number of the entries.
+ * @param num: size of the arrays.
+ * @return the number of entries stored in list.
+ */
+size_t qtrace_list(struct qtrace_entry* list, int* server, size_t num);
+
+/** get the time for the trace, monotonic if possible */
+void qtrace_clock(struct timespec* t);
+
+/** the name of a stage, for printout */
+const char* qtrace_stage_str(int stage);
+
+/**
+ * Decide if a received query is traced, with the client filter and, if
+ * there is no name filter, the sample rate. Call when QTRACE_ACTIVE().
+ * @param q: the query, with the client address.
+ * @param recv: time the query was received.
+ */
+void qtrace_begin(struct query* q, struct timespec* recv);
+
+/**
+ * For a traced query, check the name filter after the query has been
+ * processed, and apply the sample rate if there is a name filter.
+ */
+void qtrace_process_done(struct query* q);
+
+/** timestamp the stage of a traced query */
+void qtrace_stamp(struct qtrace_query* trace, int stage);
+
+/**
+ * Finish a traced query after the answer was sent, and store it in the
+ * ring of the server process.
+ * @param q: the query with the answer.
+ * @param transport: STAT_UDP, STAT_TCP or STAT_TLS.
+ * @param size: the size of the answer.
+ */
+void qtrace_finish(struct query* q, int transport, size_t size);
+
+#endif /* QTRACE_H */
@@ -180,6 +180,7 @@ static void
 query_cleanup(void *data)
 {
 	query_type *query = (query_type *) data;
+	free(query->ixfr_rrs);
 	region_destroy(query->region);
 }
 
@@ -259,6 +260,7 @@ query_reset(query_type *q, size_t maxlen, int is_tcp)
 	q->tsig_update_it = 1;
 	q->tsig_sign_it = 1;
 	q->tcp = is_tcp;
+	q->trace.on = 0;
 	q->qname = NULL;
 	q->qtype = 0;
 	q->qclass = 0;
@@ -282,6 +284,8 @@ query_reset(query_type *q, size_t maxlen, int is_tcp)
 	q->ixfr_count_oldsoa = 0;
 	q->ixfr_count_del = 0;
 	q->ixfr_count_add = 0;
+	free(q->ixfr_rrs);
+	q->ixfr_rrs = NULL;
 
 #ifdef RATELIMIT
 	q->wildcard_domain = NULL;
@@ -1580,6 +1584,7 @@ answer_query(struct nsd *nsd, struct query *q)
 
 	exact = namedb_lookup(nsd->db, q->qname, &closest_match, &closest_encloser);
 
+	QTRACE_STAMP(q, qtrace_lookup_zone);
 	answer_lookup_zone(nsd, q, &answer, 0, exact, closest_match,
 		closest_encloser, q->qname);
 	ZTATUP2(nsd, q->zone, opcode, q->opcode);
@@ -1588,6 +1593,7 @@ answer_query(struct nsd *nsd, struct query *q)
 
 	offset = dname_label_offsets(q->qname)[domain_dname(closest_encloser)->label_count - 1] + QHEADERSZ;
 	query_add_compression_domain(q, closest_encloser, offset);
+	QTRACE_STAMP(q, qtrace_encode);
 	encode_answer(q, &answer);
 	query_clear_compression_tables(q);
 }
@@ -1629,6 +1635,8 @@ query_process(query_type *q, nsd_type *nsd, uint32_t *now_p)
 	query_state_type query_state;
 	uint16_t arcount;
 
+	QTRACE_STAMP(q, qtrace_process);
+
 	/* Sanity checks */
 	if (buffer_limit(q->packet) < QHEADERSZ) {
 		/* packet too small to contain DNS header.
@@ -1813,6 +1821,7 @@ void
 query_add_optional(query_type *q, nsd_type *nsd, uint32_t *now_p)
 {
 	struct edns_data *edns = &nsd->edns_ipv4;
+	QTRACE_STAMP(q, qtrace_optional);
 #if defined(INET6)
 	if (q->client_addr.ss_family == AF_INET6) {
 		edns = &nsd->edns_ipv6;
@@ -17,6 +17,7 @@
 #include "nsd.h"
 #include "packet.h"
 #include "tsig.h"
+#include "qtrace.h"
 struct ixfr_data;
 
 enum query_state {
@@ -156,11 +157,23 @@ struct query {
 	size_t ixfr_count_add;
 	/* position for the end of SOA record, for UDP truncation */
 	size_t ixfr_pos_of_newsoa;
+	/* the del and add RRs of the ixfr data that is processed */
+	uint8_t* ixfr_del, *ixfr_add;
+	/* if the ixfr data is compressed, the allocation with its
+	 * uncompressed del and add RRs, or NULL */
+	uint8_t* ixfr_rrs;
 
 #ifdef RATELIMIT
 	/* if we encountered a wildcard, its domain */
 	domain_type *wildcard_domain;
 #endif
+
+	/* the timestamps of the stages, if the query is traced */
+	struct qtrace_query trace;
+#ifdef USE_DNSTAP
+	/* if the query is logged with dnstap, DT_LOG_NO, YES or ANSWER */
+	int dt_log;
+#endif
 };
 
 
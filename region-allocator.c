@@ -52,6 +52,23 @@ struct large_elem {
 	struct large_elem* prev;
 };
 
+/*
+ * An arena has its own chunk to allocate from and its own recycle bin.
+ * The arena that is in use is stored in the data, allocated and
+ * recycle_bin members of the region, the others are stored here.
+ */
+struct region_arena {
+	char* data;
+	size_t allocated;
+	struct recycle_elem** recycle_bin;
+};
+
+/* a chunk of an arena, to find the arena of a block that is recycled */
+struct region_arena_chunk {
+	char* start;
+	size_t arena;
+};
+
 struct region
 {
 	size_t        total_allocated;
@@ -82,6 +99,17 @@ struct region
 	struct recycle_elem** recycle_bin;
 	/* amount of memory in recycle storage */
 	size_t		recycle_size;
+
+	/* if not NULL, the arenas of the region, arena_count of them */
+	struct region_arena* arenas;
+	size_t		arena_count;
+	/* the arena that is in use */
+	size_t		arena_current;
+	/* the chunks allocated since the arenas were made, sorted by
+	 * address, arena_chunk_count of them in room for arena_chunk_max */
+	struct region_arena_chunk* arena_chunks;
+	size_t		arena_chunk_count;
+	size_t		arena_chunk_max;
 };
 
 
@@ -101,6 +129,12 @@ alloc_region_base(void *(*allocator)(size_t size),
 	result->recycle_bin = NULL;
 	result->recycle_size = 0;
 	result->large_list = NULL;
+	result->arenas = NULL;
+	result->arena_count = 0;
+	result->arena_current = 0;
+	result->arena_chunks = NULL;
+	result->arena_chunk_count = 0;
+	result->arena_chunk_max = 0;
 
 	result->allocated = 0;
 	result->data = NULL;
@@ -144,6 +178,36 @@ region_create(void *(*allocator)(size_t size),
 }
 
 
+/* create an empty recycle bin for the region */
+static struct recycle_elem**
+recycle_bin_create(region_type* region)
+{
+	struct recycle_elem** bin = region->allocator(
+		sizeof(struct recycle_elem*) * region->large_object_size);
+	if(!bin)
+		return NULL;
+	memset(bin, 0, sizeof(struct recycle_elem*) *
+		region->large_object_size);
+	return bin;
+}
+
+/* delete a recycle bin, the recycled blocks stay in the chunks */
+static void
+recycle_bin_delete(region_type* region, struct recycle_elem** bin)
+{
+	if(bin)
+		region->deallocator(bin);
+}
+
+/* empty a recycle bin */
+static void
+recycle_bin_clear(region_type* region, struct recycle_elem** bin)
+{
+	if(bin)
+		memset(bin, 0, sizeof(struct recycle_elem*) *
+			region->large_object_size);
+}
+
 region_type *region_create_custom(void *(*allocator)(size_t),
 				  void (*deallocator)(void *),
 				  size_t chunk_size,
@@ -168,14 +232,11 @@ region_type *region_create_custom(void *(*allocator)(size_t),
 		result->initial_data = result->data;
 	}
 	if(recycle) {
-		result->recycle_bin = allocator(sizeof(struct recycle_elem*)
-			* result->large_object_size);
+		result->recycle_bin = recycle_bin_create(result);
 		if(!result->recycle_bin) {
 			region_destroy(result);
 			return NULL;
 		}
-		memset(result->recycle_bin, 0, sizeof(struct recycle_elem*)
-			* result->large_object_size);
 	}
 	return result;
 }
@@ -193,8 +254,18 @@ region_destroy(region_type *region)
 	region_free_all(region);
 	deallocator(region->cleanups);
 	deallocator(region->initial_data);
-	if(region->recycle_bin)
-		deallocator(region->recycle_bin);
+	if(region->arenas) {
+		/* arena 0 is in use after region_free_all, and its
+		 * recycle bin is deleted below */
+		size_t a;
+		for(a=1; a<region->arena_count; a++)
+			recycle_bin_delete(region,
+				region->arenas[a].recycle_bin);
+		deallocator(region->arenas);
+		if(region->arena_chunks)
+			deallocator(region->arena_chunks);
+	}
+	recycle_bin_delete(region, region->recycle_bin);
 	if(region->large_list) {
 		struct large_elem* p = region->large_list, *np;
 		while(p) {
@@ -248,6 +319,78 @@ region_remove_cleanup(region_type *region, void (*action)(void *), void *data)
 	}
 }
 
+/* the position in the sorted arena chunks after the last chunk that starts
+ * at or before ptr */
+static size_t
+arena_chunk_search(region_type* region, char* ptr)
+{
+	size_t lo = 0, hi = region->arena_chunk_count, mid;
+	while(lo < hi) {
+		mid = lo + (hi-lo)/2;
+		if(region->arena_chunks[mid].start <= ptr)
+			lo = mid+1;
+		else	hi = mid;
+	}
+	return lo;
+}
+
+/* note the new chunk of the arena in use, returns false on alloc failure */
+static int
+arena_chunk_add(region_type* region, char* chunk)
+{
+	size_t pos;
+	if(region->arena_chunk_count == region->arena_chunk_max) {
+		size_t newmax = (region->arena_chunk_max?
+			region->arena_chunk_max*2:64);
+		struct region_arena_chunk* c = region->allocator(
+			newmax*sizeof(*c));
+		if(!c)
+			return 0;
+		if(region->arena_chunks) {
+			memcpy(c, region->arena_chunks,
+				region->arena_chunk_count*sizeof(*c));
+			region->deallocator(region->arena_chunks);
+		}
+		region->arena_chunks = c;
+		region->arena_chunk_max = newmax;
+	}
+	/* the chunks mostly come at higher addresses, at the end */
+	pos = arena_chunk_search(region, chunk);
+	memmove(&region->arena_chunks[pos+1], &region->arena_chunks[pos],
+		(region->arena_chunk_count-pos)*sizeof(*region->arena_chunks));
+	region->arena_chunks[pos].start = chunk;
+	region->arena_chunks[pos].arena = region->arena_current;
+	region->arena_chunk_count++;
+	return 1;
+}
+
+/* remove the chunk that was just added */
+static void
+arena_chunk_del(region_type* region, char* chunk)
+{
+	size_t pos = arena_chunk_search(region, chunk);
+	assert(pos > 0 && region->arena_chunks[pos-1].start == chunk);
+	memmove(&region->arena_chunks[pos-1], &region->arena_chunks[pos],
+		(region->arena_chunk_count-pos)*sizeof(*region->arena_chunks));
+	region->arena_chunk_count--;
+}
+
+/* the recycle bin of the arena that the block was allocated from */
+static struct recycle_elem**
+arena_recycle_bin(region_type* region, void* block)
+{
+	size_t pos, arena = 0;
+	if(!region->arenas)
+		return region->recycle_bin;
+	pos = arena_chunk_search(region, (char*)block);
+	if(pos > 0 && (char*)block < region->arena_chunks[pos-1].start +
+		region->chunk_size)
+		arena = region->arena_chunks[pos-1].arena;
+	if(arena == region->arena_current)
+		return region->recycle_bin;
+	return region->arenas[arena].recycle_bin;
+}
+
 void *
 region_alloc(region_type *region, size_t size)
 {
@@ -306,7 +449,16 @@ region_alloc(region_type *region, size_t size)
 		++region->chunk_count;
 		region->unused_space += region->chunk_size - region->allocated;
 
+		if(region->arenas && !arena_chunk_add(region, chunk)) {
+			region->deallocator(chunk);
+			region->chunk_count--;
+			region->unused_space -=
+                                region->chunk_size - region->allocated;
+			return NULL;
+		}
 		if(!region_add_cleanup(region, region->deallocator, chunk)) {
+			if(region->arenas)
+				arena_chunk_del(region, chunk);
 			region->deallocator(chunk);
 			region->chunk_count--;
 			region->unused_space -=
@@ -393,9 +545,20 @@ region_free_all(region_type *region)
 		region->cleanups[i].action(region->cleanups[i].data);
 	}
 
+	if(region->arenas) {
+		/* the chunks of the arenas are freed by the cleanups */
+		size_t a;
+		region->arena_chunk_count = 0;
+		(void)region_use_arena(region, 0);
+		for(a=1; a<region->arena_count; a++) {
+			region->arenas[a].data = NULL;
+			region->arenas[a].allocated = region->chunk_size;
+			recycle_bin_clear(region,
+				region->arenas[a].recycle_bin);
+		}
+	}
 	if(region->recycle_bin) {
-		memset(region->recycle_bin, 0, sizeof(struct recycle_elem*)
-			* region->large_object_size);
+		recycle_bin_clear(region, region->recycle_bin);
 		region->recycle_size = 0;
 	}
 
@@ -461,6 +624,7 @@ region_recycle(region_type *region, void *block, size_t size)
 	aligned_size = REGION_ALIGN_UP(size, ALIGNMENT);
 
 	if(aligned_size < region->large_object_size) {
+		struct recycle_elem** bin = arena_recycle_bin(region, block);
 		struct recycle_elem* elem = (struct recycle_elem*)block;
 		/* we rely on the fact that ALIGNMENT is void* so the next will fit */
 		assert(aligned_size >= sizeof(struct recycle_elem));
@@ -468,7 +632,7 @@ region_recycle(region_type *region, void *block, size_t size)
 #ifdef CHECK_DOUBLE_FREE
 		if(CHECK_DOUBLE_FREE) {
 			/* make sure the same ptr is not freed twice. */
-			struct recycle_elem *p = region->recycle_bin[aligned_size];
+			struct recycle_elem *p = bin[aligned_size];
 			while(p) {
 				assert(p != elem);
 				p = p->next;
@@ -476,8 +640,8 @@ region_recycle(region_type *region, void *block, size_t size)
 		}
 #endif
 
-		elem->next = region->recycle_bin[aligned_size];
-		region->recycle_bin[aligned_size] = elem;
+		elem->next = bin[aligned_size];
+		bin[aligned_size] = elem;
 		region->recycle_size += aligned_size;
 		region->unused_space -= aligned_size - size;
 		return;
@@ -498,6 +662,57 @@ region_recycle(region_type *region, void *block, size_t size)
 	}
 }
 
+int
+region_set_arenas(region_type* region, size_t count)
+{
+	size_t a;
+	if(region->arenas || count < 2)
+		return 1;
+	region->arenas = region->allocator(sizeof(struct region_arena)*count);
+	if(!region->arenas)
+		return 0;
+	memset(region->arenas, 0, sizeof(struct region_arena)*count);
+	for(a=1; a<count; a++) {
+		/* the first allocation gets a new chunk for the arena */
+		region->arenas[a].data = NULL;
+		region->arenas[a].allocated = region->chunk_size;
+		if(region->recycle_bin) {
+			region->arenas[a].recycle_bin =
+				recycle_bin_create(region);
+			if(!region->arenas[a].recycle_bin) {
+				while(--a > 0)
+					recycle_bin_delete(region,
+						region->arenas[a].recycle_bin);
+				region->deallocator(region->arenas);
+				region->arenas = NULL;
+				return 0;
+			}
+		}
+	}
+	region->arena_count = count;
+	region->arena_current = 0;
+	return 1;
+}
+
+size_t
+region_use_arena(region_type* region, size_t arena)
+{
+	size_t prev = region->arena_current;
+	struct region_arena* a;
+	if(!region->arenas || arena == prev || arena >= region->arena_count)
+		return prev;
+	a = &region->arenas[prev];
+	a->data = region->data;
+	a->allocated = region->allocated;
+	a->recycle_bin = region->recycle_bin;
+	a = &region->arenas[arena];
+	region->data = a->data;
+	region->allocated = a->allocated;
+	region->recycle_bin = a->recycle_bin;
+	region->arena_current = arena;
+	return prev;
+}
+
 void
 region_dump_stats(region_type *region, FILE *out)
 {
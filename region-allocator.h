@@ -140,6 +140,23 @@ void region_str_replace(region_type* region, char **to_replace,
  */
 void region_recycle(region_type *region, void *block, size_t size);
 
+/*
+ * Divide the region into COUNT arenas. Every arena allocates from its own
+ * chunks and has its own recycle bin, so that the memory allocated while
+ * an arena is in use is kept together, away from that of other arenas.
+ * Memory can be recycled while any arena is in use, it goes back to the
+ * arena of the chunk it is in. Arena 0 is used by default, and holds the
+ * chunks from before the arenas. Returns false on allocation failure.
+ */
+int region_set_arenas(region_type* region, size_t count);
+
+/*
+ * Allocate from arena number ARENA of the region, from now on.
+ * Returns the arena that was in use, to switch back to.
+ * Does nothing if the region has no such arena.
+ */
+size_t region_use_arena(region_type* region, size_t arena);
+
 /*
  * Print some REGION statistics to OUT.
  */
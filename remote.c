@@ -82,6 +82,11 @@
 #include "ipc.h"
 #include "remote.h"
 #include "rdata.h"
+#ifdef RATELIMIT
+#include "rrl.h"
+#endif
+#include "qtrace.h"
+
 
 #ifdef USE_METRICS
 #include "metrics.h"
@@ -2249,6 +2254,177 @@ do_serverpid(RES* ssl, xfrd_state_type* xfrd)
 	(void)ssl_printf(ssl, "%u\n", (unsigned)xfrd->reload_pid);
 }
 
+#ifdef RATELIMIT
+/** do the rrl_top command: print the sources with the highest rates */
+static void
+do_rrl_top(RES* ssl, xfrd_state_type* xfrd, char* arg)
+{
+	struct rrl_top* top;
+	size_t num = 10, count, i;
+	uint32_t lm = (uint32_t)xfrd->nsd->options->rrl_ratelimit*2;
+	char server[16];
+	if(*arg != '\0') {
+		int n = atoi(arg);
+		if(n <= 0 || n > 10000) {
+			(void)ssl_printf(ssl, "error expected a number from 1 "
+				"to 10000: %s\n", arg);
+			return;
+		}
+		num = (size_t)n;
+	}
+	top = (struct rrl_top*)xalloc_array_zero(num, sizeof(*top));
+	count = rrl_top_list(top, num, (int32_t)time(NULL));
+	for(i=0; i<count; i++) {
+		if(top[i].server == -1)
+			snprintf(server, sizeof(server), "all");
+		else	snprintf(server, sizeof(server), "%d", top[i].server);
+		if(!ssl_printf(ssl, "%s %s qps=%u server=%s %s\n",
+			rrlsource2str(top[i].source, top[i].flags&rrl_ip6),
+			rrltype2str(top[i].flags), (unsigned)top[i].rate/2,
+			server, (lm != 0 && top[i].rate >= lm)?"blocked":"ok"))
+			break;
+	}
+	free(top);
+}
+#endif /* RATELIMIT */
+
+/** do the trace_start command: trace 1 in N queries that match filters */
+static void
+do_trace_start(RES* ssl, xfrd_state_type* ATTR_UNUSED(xfrd), char* arg)
+{
+	region_type* region = region_create(xalloc, free);
+	const dname_type* qname = NULL;
+	uint8_t addr[16];
+	int family = 0, prefix = 0, n;
+	char* p = arg, *tok, *val;
+	memset(addr, 0, sizeof(addr));
+	n = atoi(p);
+	if(n <= 0) {
+		(void)ssl_printf(ssl, "error expected a sample rate, 1 or "
+			"more: %s\n", arg);
+		region_destroy(region);
+		return;
+	}
+	while(*p && !isspace((unsigned char)*p))
+		p++;
+	while(*(p = skipwhite(p))) {
+		tok = p;
+		while(*p && !isspace((unsigned char)*p))
+			p++;
+		if(*p) *p++ = 0;
+		val = skipwhite(p);
+		p = val;
+		while(*p && !isspace((unsigned char)*p))
+			p++;
+		if(*p) *p++ = 0;
+		if(strcmp(tok, "name") == 0 && *val) {
+			if(!(qname = dname_parse(region, val))) {
+				(void)ssl_printf(ssl, "error cannot parse "
+					"name: %s\n", val);
+				region_destroy(region);
+				return;
+			}
+		} else if(strcmp(tok, "client") == 0 && *val) {
+			char* s = strchr(val, '/');
+			if(s) *s++ = 0;
+			if(inet_pton(AF_INET, val, addr) == 1) {
+				family = AF_INET;
+				prefix = 32;
+#ifdef INET6
+			} else if(inet_pton(AF_INET6, val, addr) == 1) {
+				family = AF_INET6;
+				prefix = 128;
+#endif
+			} else {
+				(void)ssl_printf(ssl, "error cannot parse "
+					"client address: %s\n", val);
+				region_destroy(region);
+				return;
+			}
+			if(s) {
+				int pl = atoi(s);
+				if(pl < 0 || pl > prefix) {
+					(void)ssl_printf(ssl, "error bad prefix "
+						"length: %s\n", s);
+					region_destroy(region);
+					return;
+				}
+				prefix = pl;
+			}
+		} else {
+			(void)ssl_printf(ssl, "error expected name <name> or "
+				"client <addr>[/<prefix>]: %s\n", tok);
+			region_destroy(region);
+			return;
+		}
+	}
+	qtrace_start((uint32_t)n, qname, family, addr, prefix);
+	region_destroy(region);
+	send_ok(ssl);
+}
+
+/** do the trace_stop command */
+static void
+do_trace_stop(RES* ssl, xfrd_state_type* ATTR_UNUSED(xfrd))
+{
+	qtrace_stop();
+	send_ok(ssl);
+}
+
+/** do the trace_show command: print the recently traced queries */
+static void
+do_trace_show(RES* ssl, xfrd_state_type* ATTR_UNUSED(xfrd), char* arg)
+{
+	const char* rcstr[] = {"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN",
+	    "NOTIMP", "REFUSED", "YXDOMAIN", "YXRRSET", "NXRRSET", "NOTAUTH",
+	    "NOTZONE", "RCODE11", "RCODE12", "RCODE13", "RCODE14", "RCODE15"
+	};
+	const char* tpstr[] = {"udp", "tcp", "tls"};
+	struct qtrace_entry* list;
+	int* server;
+	size_t num = 20, count, i;
+	int s;
+	char client[64], stages[256];
+	if(*arg != '\0') {
+		int n = atoi(arg);
+		if(n <= 0 || n > 10000) {
+			(void)ssl_printf(ssl, "error expected a number from 1 "
+				"to 10000: %s\n", arg);
+			return;
+		}
+		num = (size_t)n;
+	}
+	list = (struct qtrace_entry*)xalloc_array_zero(num, sizeof(*list));
+	server = (int*)xalloc_array_zero(num, sizeof(*server));
+	count = qtrace_list(list, server, num);
+	for(i=0; i<count; i++) {
+		struct qtrace_entry* e = &list[i];
+		size_t len = 0;
+		if(!inet_ntop(e->family, e->addr, client, sizeof(client)))
+			snprintf(client, sizeof(client), "unknown");
+		stages[0] = 0;
+		for(s=0; s<qtrace_stages; s++) {
+			if(e->ns[s] == 0 && s != qtrace_recv)
+				snprintf(stages+len, sizeof(stages)-len,
+					" %s=-", qtrace_stage_str(s));
+			else	snprintf(stages+len, sizeof(stages)-len,
+					" %s=%u.%3.3u", qtrace_stage_str(s),
+					(unsigned)(e->ns[s]/1000),
+					(unsigned)(e->ns[s]%1000));
+			len = strlen(stages);
+		}
+		if(!ssl_printf(ssl, "%lld.%6.6u server=%d %s %s %s %s %s "
+			"size=%u%s\n", (long long)e->sec, (unsigned)e->usec,
+			server[i], client, tpstr[e->transport%3],
+			(e->qnamelen?wiredname2str(e->qname):"."),
+			rrtype_to_string(e->qtype), rcstr[e->rcode&0xf],
+			(unsigned)e->size, stages))
+			break;
+	}
+	free(list);
+	free(server);
+}
+
 /** do the print_tsig command: printout tsig info */
 static void
 do_print_tsig(RES* ssl, xfrd_state_type* xfrd, char* arg)
@@ -2788,6 +2964,16 @@ execute_cmd(struct daemon_remote* rc, RES* ssl, char* cmd)
 		do_repattern(ssl, rc->xfrd);
 	} else if(cmdcmp(p, "serverpid", 9)) {
 		do_serverpid(ssl, rc->xfrd);
+#ifdef RATELIMIT
+	} else if(cmdcmp(p, "rrl_top", 7)) {
+		do_rrl_top(ssl, rc->xfrd, skipwhite(p+7));
+#endif
+	} else if(cmdcmp(p, "trace_start", 11)) {
+		do_trace_start(ssl, rc->xfrd, skipwhite(p+11));
+	} else if(cmdcmp(p, "trace_stop", 10)) {
+		do_trace_stop(ssl, rc->xfrd);
+	} else if(cmdcmp(p, "trace_show", 10)) {
+		do_trace_show(ssl, rc->xfrd, skipwhite(p+10));
 	} else if(cmdcmp(p, "print_tsig", 10)) {
 		do_print_tsig(ssl, rc->xfrd, skipwhite(p+10));
 	} else if(cmdcmp(p, "update_tsig", 11)) {
@@ -3081,6 +3267,17 @@ print_stat_block(RES* ssl, char* n, char* d, struct nsdst* st)
 		(unsigned long)st->ednserr))
 		return;
 
+	/* server cookies */
+	if(!ssl_printf(ssl, "%s%snum.cookie.valid=%lu\n", n, d,
+		(unsigned long)st->cookievalid))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.cookie.reused=%lu\n", n, d,
+		(unsigned long)st->cookiereuse))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.cookie.invalid=%lu\n", n, d,
+		(unsigned long)st->cookieinvalid))
+		return;
+
 	/* qudp */
 	if(!ssl_printf(ssl, "%s%snum.udp=%lu\n", n, d, (unsigned long)st->qudp))
 		return;
@@ -3130,6 +3327,85 @@ print_stat_block(RES* ssl, char* n, char* d, struct nsdst* st)
 	if(!ssl_printf(ssl, "%s%snum.dropped=%lu\n", n, d,
 		(unsigned long)st->dropped))
 		return;
+
+	/* ratelimited, and retries of the shared ratelimit table */
+	if(!ssl_printf(ssl, "%s%snum.ratelimited=%lu\n", n, d,
+		(unsigned long)st->ratelimited))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.ratelimit_retry=%lu\n", n, d,
+		(unsigned long)st->rrlretry))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.ratelimit_evict=%lu\n", n, d,
+		(unsigned long)st->rrlevict))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.dnstap_dropped=%lu\n", n, d,
+		(unsigned long)st->dnstapdrop))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.dnstap_frames=%lu\n", n, d,
+		(unsigned long)st->dnstapframes))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.dnstap_queue=%lu\n", n, d,
+		(unsigned long)st->dnstapqueue))
+		return;
+}
+
+/* print the answer statistics */
+static void
+print_resp_block(RES* ssl, struct nsdst_resp* rs)
+{
+	const char* rcstr[] = {"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN",
+	    "NOTIMP", "REFUSED", "YXDOMAIN", "YXRRSET", "NXRRSET", "NOTAUTH",
+	    "NOTZONE", "RCODE11", "RCODE12", "RCODE13", "RCODE14", "RCODE15",
+	    "BADVERS"
+	};
+	const char* tpstr[] = {"udp", "tcp", "tls"};
+	size_t i, tp;
+
+	/* qtype and rcode per transport */
+	for(tp=0; tp<STAT_TRANSPORTS; tp++) {
+		for(i=0; i<= 255; i++) {
+			if(inhibit_zero && rs->qtype_tp[tp][i] == 0 &&
+				strncmp(rrtype_to_string(i), "TYPE", 4) == 0)
+				continue;
+			if(!ssl_printf(ssl, "num.%s.type.%s=%lu\n",
+				tpstr[tp], rrtype_to_string(i),
+				(unsigned long)rs->qtype_tp[tp][i]))
+				return;
+		}
+		for(i=0; i<17; i++) {
+			if(inhibit_zero && rs->rcode_tp[tp][i] == 0 &&
+				i > RCODE_YXDOMAIN) /* NSD does not use larger */
+				continue;
+			if(!ssl_printf(ssl, "num.%s.rcode.%s=%lu\n",
+				tpstr[tp], rcstr[i],
+				(unsigned long)rs->rcode_tp[tp][i]))
+				return;
+		}
+	}
+
+	/* latency histogram, in microseconds */
+	for(i=0; i<STAT_LATENCY_BUCKETS-1; i++) {
+		if(!ssl_printf(ssl, "num.latency.usec.%lu=%lu\n",
+			(unsigned long)1<<i, (unsigned long)rs->latency[i]))
+			return;
+	}
+	if(!ssl_printf(ssl, "num.latency.usec.inf=%lu\n",
+		(unsigned long)rs->latency[STAT_LATENCY_BUCKETS-1]))
+		return;
+	if(!ssl_printf(ssl, "num.latency.sum=%lu\n",
+		(unsigned long)rs->latency_sum))
+		return;
+
+	/* response size histogram, in bytes */
+	for(i=0; i<STAT_RESPSIZE_BUCKETS; i++) {
+		if(!ssl_printf(ssl, "num.respsize.%lu=%lu\n",
+			(unsigned long)1<<(i+STAT_RESPSIZE_SHIFT),
+			(unsigned long)rs->respsize[i]))
+			return;
+	}
+	if(!ssl_printf(ssl, "num.respsize.sum=%lu\n",
+		(unsigned long)rs->respsize_sum))
+		return;
 }
 
 #ifdef USE_ZONE_STATS
@@ -3210,7 +3486,7 @@ zonestat_print(RES *ssl, struct evbuffer *evbuf, xfrd_state_type *xfrd,
 
 static void
 print_stats(RES* ssl, xfrd_state_type* xfrd, struct timeval* now, int clear,
-	struct nsdst* st, struct nsdst** zonestats)
+	struct nsdst* st, struct nsdst_resp* rs, struct nsdst** zonestats)
 {
 	size_t i;
 	stc_type total = 0;
@@ -3241,6 +3517,13 @@ print_stats(RES* ssl, xfrd_state_type* xfrd, struct timeval* now, int clear,
 		return;
 	if(!print_longnum(ssl, "size.db.mem=", st->db_mem))
 		return;
+	if(!print_longnum(ssl, "size.ixfr.mem=", st->ixfr_mem))
+		return;
+	if(!print_longnum(ssl, "size.ixfr.disk=", st->ixfr_disk))
+		return;
+	if(!print_longnum(ssl, "size.ixfr.condensed.mem=",
+		st->ixfr_condensed))
+		return;
 	if(!print_longnum(ssl, "size.xfrd.mem=", region_get_mem(xfrd->region)))
 		return;
 	if(!print_longnum(ssl, "size.config.disk=", 
@@ -3250,6 +3533,7 @@ print_stats(RES* ssl, xfrd_state_type* xfrd, struct timeval* now, int clear,
 		xfrd->nsd->options->region)))
 		return;
 	print_stat_block(ssl, "", "", st);
+	print_resp_block(ssl, rs);
 
 	/* zone statistics */
 	if(!ssl_printf(ssl, "zone.primary=%lu\n",
@@ -3262,6 +3546,50 @@ print_stats(RES* ssl, xfrd_state_type* xfrd, struct timeval* now, int clear,
 		return;
 	if(!ssl_printf(ssl, "zone.slave=%lu\n", (unsigned long)xfrd->zones->count))
 		return;
+
+	/* reloads, and the time from a transfer to serving it, in msec */
+	if(!ssl_printf(ssl, "reload.num=%lu\n",
+		(unsigned long)xfrd->reload_count))
+		return;
+	if(!ssl_printf(ssl, "reload.duration=%lu.%3.3lu\n",
+		(unsigned long)xfrd->reload_duration_avg/1000,
+		(unsigned long)xfrd->reload_duration_avg%1000))
+		return;
+	for(i=0; i<XFRD_STALENESS_BUCKETS-1; i++) {
+		if(!ssl_printf(ssl, "reload.staleness.msec.%lu=%lu\n",
+			(unsigned long)1<<i, (unsigned long)xfrd->staleness[i]))
+			return;
+	}
+	if(!ssl_printf(ssl, "reload.staleness.msec.inf=%lu\n",
+		(unsigned long)xfrd->staleness[XFRD_STALENESS_BUCKETS-1]))
+		return;
+	if(!ssl_printf(ssl, "reload.staleness.sum=%lu\n",
+		(unsigned long)xfrd->staleness_sum))
+		return;
+
+	/* the time from a refresh that is due to sending its query, in sec */
+	for(i=0; i<XFRD_REFRESH_LAG_BUCKETS-1; i++) {
+		if(!ssl_printf(ssl, "refresh.lag.sec.%lu=%lu\n",
+			(unsigned long)1<<i, (unsigned long)xfrd->refresh_lag[i]))
+			return;
+	}
+	if(!ssl_printf(ssl, "refresh.lag.sec.inf=%lu\n",
+		(unsigned long)xfrd->refresh_lag[XFRD_REFRESH_LAG_BUCKETS-1]))
+		return;
+	if(!ssl_printf(ssl, "refresh.lag.sum=%lu\n",
+		(unsigned long)xfrd->refresh_lag_sum))
+		return;
+
+	/* tcp connections to primaries, and their reuse when idle */
+	if(!ssl_printf(ssl, "xfrd.tcp.open=%lu\n",
+		(unsigned long)xfrd->tcp_opened))
+		return;
+	if(!ssl_printf(ssl, "xfrd.tcp.reuse=%lu\n",
+		(unsigned long)xfrd->tcp_reused))
+		return;
+	if(!ssl_printf(ssl, "xfrd.tls.handshake.avoided=%lu\n",
+		(unsigned long)xfrd->tls_reused))
+		return;
 #ifdef USE_ZONE_STATS
 	zonestat_print(ssl, NULL, xfrd, clear, zonestats); /* per-zone statistics */
 #else
@@ -3273,7 +3601,7 @@ void
 process_stats_alloc(struct xfrd_state* xfrd, struct nsdst** stats,
 	struct nsdst** zonestats)
 {
-	*stats = xmallocarray(xfrd->nsd->child_count*2, sizeof(struct nsdst));
+	*stats = xmallocarray(xfrd->nsd->child_count*2+1, sizeof(struct nsdst));
 #ifdef USE_ZONE_STATS
 	zonestats[0] = xmallocarray(xfrd->zonestat_safe, sizeof(struct nsdst));
 	zonestats[1] = xmallocarray(xfrd->zonestat_safe, sizeof(struct nsdst));
@@ -3289,7 +3617,7 @@ process_stats_grab(struct xfrd_state* xfrd, struct timeval* stattime,
 	if(gettimeofday(stattime, NULL) == -1)
 		log_msg(LOG_ERR, "gettimeofday: %s", strerror(errno));
 	memcpy(stats, xfrd->nsd->stat_map,
-		xfrd->nsd->child_count*2*sizeof(struct nsdst));
+		(xfrd->nsd->child_count*2+1)*sizeof(struct nsdst));
 #ifdef USE_ZONE_STATS
 	memcpy(zonestats[0], xfrd->nsd->zonestat[0],
 		xfrd->zonestat_safe*sizeof(struct nsdst));
@@ -3306,6 +3634,9 @@ process_stats_add_old_new(struct xfrd_state* xfrd, struct nsdst* stats)
 	size_t i;
 	uint64_t dbd = stats[0].db_disk;
 	uint64_t dbm = stats[0].db_mem;
+	uint64_t ixm = stats[0].ixfr_mem;
+	uint64_t ixd = stats[0].ixfr_disk;
+	uint64_t ixc = stats[0].ixfr_condensed;
 	stc_type count1, count2;
 
 	/* Pick up the latest database memory use value. */
@@ -3316,6 +3647,9 @@ process_stats_add_old_new(struct xfrd_state* xfrd, struct nsdst* stats)
 	   (count2 < count1 && count1-count2 > 0xffff)) {
 		dbd = stats[xfrd->nsd->child_count+0].db_disk;
 		dbm = stats[xfrd->nsd->child_count+0].db_mem;
+		ixm = stats[xfrd->nsd->child_count+0].ixfr_mem;
+		ixd = stats[xfrd->nsd->child_count+0].ixfr_disk;
+		ixc = stats[xfrd->nsd->child_count+0].ixfr_condensed;
 	}
 
 	/* The old and new server processes have separate stat blocks,
@@ -3325,8 +3659,14 @@ process_stats_add_old_new(struct xfrd_state* xfrd, struct nsdst* stats)
 	for(i=0; i<xfrd->nsd->child_count; i++) {
 		stats_add(&stats[i], &stats[xfrd->nsd->child_count+i]);
 	}
+	/* The dnstap collector has the block after them, its values are
+	 * counted with the first server process. */
+	stats_add(&stats[0], &stats[xfrd->nsd->child_count*2]);
 	stats[0].db_disk = dbd;
 	stats[0].db_mem = dbm;
+	stats[0].ixfr_mem = ixm;
+	stats[0].ixfr_disk = ixd;
+	stats[0].ixfr_condensed = ixc;
 }
 
 void
@@ -3359,6 +3699,30 @@ process_stats_manage_clear(struct xfrd_state* xfrd, struct nsdst* stats,
 	}
 }
 
+void
+process_stats_resp(struct xfrd_state* xfrd, struct nsdst_resp* total,
+	int peek)
+{
+	struct nsdst_resp st;
+	size_t i;
+	/* the answer statistics are only printed as a total, add up the
+	 * blocks of the old and new server processes */
+	memcpy(total, &xfrd->nsd->resp_map[0], sizeof(*total));
+	for(i=1; i<xfrd->nsd->child_count*2+1; i++)
+		resp_stats_add(total, &xfrd->nsd->resp_map[i]);
+	if(peek) {
+		if(xfrd->stat_resp_clear)
+			resp_stats_subtract(total, xfrd->stat_resp_clear);
+		return;
+	}
+	if(!xfrd->stat_resp_clear)
+		xfrd->stat_resp_clear = region_alloc_zero(xfrd->region,
+			sizeof(struct nsdst_resp));
+	memcpy(&st, total, sizeof(st));
+	resp_stats_subtract(total, xfrd->stat_resp_clear);
+	memcpy(xfrd->stat_resp_clear, &st, sizeof(st));
+}
+
 void
 process_stats_add_total(struct xfrd_state* xfrd, struct nsdst* total,
 	struct nsdst* stats)
@@ -3375,6 +3739,13 @@ process_stats_add_total(struct xfrd_state* xfrd, struct nsdst* total,
 			+ stats[i].qudp6 + stats[i].ctcp + stats[i].ctcp6
 			+ stats[i].ctls + stats[i].ctls6;
 	}
+	/* the sizes are set by the main process, in the first block,
+	 * stats_add has copied them from the others */
+	total->db_disk = stats[0].db_disk;
+	total->db_mem = stats[0].db_mem;
+	total->ixfr_mem = stats[0].ixfr_mem;
+	total->ixfr_disk = stats[0].ixfr_disk;
+	total->ixfr_condensed = stats[0].ixfr_condensed;
 }
 
 void
@@ -3382,6 +3753,7 @@ process_stats(RES* ssl, struct evbuffer *evbuf, struct xfrd_state* xfrd, int pee
 {
 	struct timeval stattime;
 	struct nsdst* stats, *zonestats[2], total;
+	struct nsdst_resp resp;
 
 	/* it only really makes sense for one to be used at a time and would
 	 * otherwise cause issues if peek is zero */
@@ -3392,19 +3764,21 @@ process_stats(RES* ssl, struct evbuffer *evbuf, struct xfrd_state* xfrd, int pee
 	process_stats_add_old_new(xfrd, stats);
 	process_stats_manage_clear(xfrd, stats, peek);
 	process_stats_add_total(xfrd, &total, stats);
+	process_stats_resp(xfrd, &resp, peek);
 	if (ssl) {
-		print_stats(ssl, xfrd, &stattime, !peek, &total, zonestats);
+		print_stats(ssl, xfrd, &stattime, !peek, &total, &resp,
+			zonestats);
 	}
 #ifdef USE_METRICS
 	if (evbuf) {
 		if (xfrd->nsd->options->control_enable) {
 			/* only pass in rc->stats_time if remote-conrol is enabled,
 			 * otherwise stats_time is uninitialized */
-			metrics_print_stats(evbuf, xfrd, &stattime, !peek, &total, zonestats,
-			                    &xfrd->nsd->rc->stats_time);
+			metrics_print_stats(evbuf, xfrd, &stattime, !peek, &total, stats,
+			                    &resp, zonestats, &xfrd->nsd->rc->stats_time);
 		} else {
-			metrics_print_stats(evbuf, xfrd, &stattime, !peek, &total, zonestats,
-			                    NULL);
+			metrics_print_stats(evbuf, xfrd, &stattime, !peek, &total, stats,
+			                    &resp, zonestats, NULL);
 		}
 	}
 #else
@@ -3412,6 +3786,10 @@ process_stats(RES* ssl, struct evbuffer *evbuf, struct xfrd_state* xfrd, int pee
 #endif /* USE_METRICS */
 	if(!peek) {
 		xfrd->nsd->rc->stats_time = stattime;
+#ifdef USE_METRICS
+		/* the cached page has the counters from before the reset */
+		daemon_metrics_invalidate(xfrd->nsd->metrics);
+#endif /* USE_METRICS */
 	}
 
 	free(stats);
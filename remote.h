@@ -50,6 +50,7 @@ struct nsd_options;
 
 #ifdef BIND8_STATS
 struct nsdst;
+struct nsdst_resp;
 struct remote_stream;
 struct evbuffer;
 #endif /* BIND8_STATS */
@@ -152,6 +153,17 @@ process_stats_manage_clear(struct xfrd_state* xfrd,
                            struct nsdst* stats,
                            int peek);
 
+/**
+ * Add up the answer statistics of the server processes, and manage the
+ * clearing of them.
+ * @param xfrd: the process that hosts the control connection.
+ * @param total: where to store the total data
+ * @param peek: whether to reset the stats time (0) or not (1)
+ */
+void process_stats_resp(struct xfrd_state* xfrd,
+                        struct nsdst_resp* total,
+                        int peek);
+
 /**
  * Add up the statistics to get the total over the server children.
  * @param xfrd: the process that hosts the control connection.
@@ -8,7 +8,6 @@
 #include <errno.h>
 #include "rrl.h"
 #include "util.h"
-#include "lookup3.h"
 #include "options.h"
 
 #ifdef RATELIMIT
@@ -21,6 +20,16 @@
 #endif /* HAVE_MMAP */
 
 
+int siphash(const uint8_t *in, const size_t inlen,
+                const uint8_t *k, uint8_t *out, const size_t outlen);
+
+/**
+ * The buckets are in sets of RRL_WAYS buckets. The hash selects the set,
+ * and a source can be in any bucket of that set. If the source is not in
+ * the set, the bucket with the lowest rate is taken over by the source.
+ */
+#define RRL_WAYS 4
+
 /**
  * The rate limiting data structure bucket, this represents one rate of
  * packets from a single source.
@@ -32,7 +41,7 @@ struct rrl_bucket {
 	/* rate, in queries per second, which due to rate=r(t)+r(t-1)/2 is
 	 * equal to double the queries per second */
 	uint32_t rate;
-	/* the full hash */
+	/* the upper part of the hash */
 	uint32_t hash;
 	/* counter for queries arrived in this second */
 	uint32_t counter;
@@ -43,6 +52,44 @@ struct rrl_bucket {
 	uint16_t flags;
 };
 
+#ifdef HAVE_ATOMIC_BUILTINS
+/**
+ * The bucket of the shared table, that all server processes update at the
+ * same time. The rate, counter and timestamp are packed in one state word,
+ * that is updated with compare and swap. The tag is part of the hash, the
+ * bucket belongs to a source if the tag, the source and the flags are the
+ * same. Tag 0 is an empty bucket.
+ */
+struct rrl_shared_bucket {
+	/* tag(12) stamp(16) counter(18) rate(18) */
+	uint64_t state;
+	/* the source netmask and flags that started the bucket */
+	uint64_t source;
+	uint16_t flags;
+};
+/* the max of the counter and the rate, they are kept at that value */
+#define RRL_STATE_MAX 0x3ffff
+#define RRL_STATE(tag, stamp, counter, rate) ( ((uint64_t)(tag)<<52) | \
+	((uint64_t)((uint32_t)(stamp)&0xffff)<<36) | \
+	((uint64_t)((counter)>RRL_STATE_MAX?RRL_STATE_MAX:(counter))<<18) | \
+	(uint64_t)((rate)>RRL_STATE_MAX?RRL_STATE_MAX:(rate)) )
+#define RRL_STATE_TAG(s) ((uint16_t)((s)>>52))
+#define RRL_STATE_STAMP(s) ((uint32_t)(((s)>>36)&0xffff))
+#define RRL_STATE_COUNTER(s) ((uint32_t)(((s)>>18)&RRL_STATE_MAX))
+#define RRL_STATE_RATE(s) ((uint32_t)((s)&RRL_STATE_MAX))
+
+/* the shared table, if in use by this process */
+static struct rrl_shared_bucket* rrl_shared_array = NULL;
+/* the mmap with the shared table (saved between reloads) */
+static void* rrl_shared_map = NULL;
+/* statistic counter for retried updates of the shared table */
+static unsigned long* rrl_retry_stat = NULL;
+#endif /* HAVE_ATOMIC_BUILTINS */
+/* statistic counter for buckets taken over from a source with a rate */
+static unsigned long* rrl_evict_stat = NULL;
+/* secret key for the hash, so that the set of a source is not known */
+static uint8_t rrl_hash_key[16];
+
 /* the (global) array of RRL buckets */
 static struct rrl_bucket* rrl_array = NULL;
 static size_t rrl_array_size = RRL_BUCKETS;
@@ -57,14 +104,38 @@ static uint32_t rrl_whitelist_ratelimit = RRL_WLIST_LIMIT; /* 2x qps */
 static void** rrl_maps = NULL;
 static size_t rrl_maps_num = 0;
 
+/**
+ * The buckets with the highest rates that a server process has seen, that
+ * xfrd reads for rrl_top, so it does not have to scan the tables. Every
+ * server process updates its own, when a rate is higher than the lowest
+ * in the list. The rates are halved every second, like the ratelimit.
+ */
+struct rrl_top_keep {
+	/* the rate of the bucket when it was seen */
+	uint32_t rate[RRL_TOP_KEEP];
+	/* the index of the bucket plus one, 0 if the entry is empty */
+	uint32_t bucket[RRL_TOP_KEEP];
+	/* the lowest rate in the list, and the entry that has it */
+	uint32_t min;
+	uint32_t minpos;
+	/* the time of the rates */
+	int32_t stamp;
+};
+/* the top lists of the children, in a mmap made with the tables */
+static struct rrl_top_keep* rrl_top_map = NULL;
+/* the top list of this process, NULL if not kept */
+static struct rrl_top_keep* rrl_top_mine = NULL;
+
 void rrl_mmap_init(int numch, size_t numbuck, size_t lm, size_t wlm, size_t sm,
-	size_t plf, size_t pls)
+	size_t plf, size_t pls, int shared)
 {
 #ifdef HAVE_MMAP
 	size_t i;
 #endif
 	if(numbuck != 0)
 		rrl_array_size = numbuck;
+	/* whole sets of buckets */
+	rrl_array_size = (rrl_array_size+RRL_WAYS-1)/RRL_WAYS*RRL_WAYS;
 	rrl_ratelimit = lm*2;
 	rrl_slip_ratio = sm;
 	rrl_ipv4_prefixlen = plf;
@@ -76,6 +147,42 @@ void rrl_mmap_init(int numch, size_t numbuck, size_t lm, size_t wlm, size_t sm,
 			(((uint64_t)0xffffffff)<<32);
 	}
 	rrl_whitelist_ratelimit = wlm*2;
+#ifdef HAVE_MMAP
+	/* the top lists of the children, also preserved across reforks */
+	if(numch > 0) {
+		rrl_top_map = mmap(NULL, sizeof(struct rrl_top_keep)*numch,
+			PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+		if(rrl_top_map == MAP_FAILED) {
+			log_msg(LOG_ERR, "rrl: mmap failed: %s",
+				strerror(errno));
+			exit(1);
+		}
+		memset(rrl_top_map, 0, sizeof(struct rrl_top_keep)*numch);
+	}
+#endif
+#if defined(HAVE_MMAP) && defined(HAVE_ATOMIC_BUILTINS)
+	if(shared) {
+		/* one table for all the children, also preserved across
+		 * reforks, the children update it with atomic operations */
+		rrl_shared_map = mmap(NULL,
+			sizeof(struct rrl_shared_bucket)*rrl_array_size,
+			PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+		if(rrl_shared_map == MAP_FAILED) {
+			log_msg(LOG_ERR, "rrl: mmap failed: %s",
+				strerror(errno));
+			exit(1);
+		}
+		memset(rrl_shared_map, 0,
+			sizeof(struct rrl_shared_bucket)*rrl_array_size);
+		rrl_maps_num = (size_t)numch;
+		rrl_maps = NULL;
+		return;
+	}
+#else
+	if(shared)
+		log_msg(LOG_WARNING, "rrl: rrl-shared is not available on "
+			"this system, every server process has its own table");
+#endif
 #ifdef HAVE_MMAP
 	/* allocate the ratelimit hashtable in a memory map so it is
 	 * preserved across reforks (every child its own table) */
@@ -104,12 +211,23 @@ void rrl_mmap_deinit(void)
 {
 #ifdef HAVE_MMAP
 	size_t i;
-	for(i=0; i<rrl_maps_num; i++) {
+#ifdef HAVE_ATOMIC_BUILTINS
+	if(rrl_shared_map) {
+		munmap(rrl_shared_map,
+			sizeof(struct rrl_shared_bucket)*rrl_array_size);
+		rrl_shared_map = NULL;
+	}
+#endif
+	for(i=0; rrl_maps && i<rrl_maps_num; i++) {
 		munmap(rrl_maps[i], sizeof(struct rrl_bucket)*rrl_array_size);
 		rrl_maps[i] = NULL;
 	}
 	free(rrl_maps);
 	rrl_maps = NULL;
+	if(rrl_top_map) {
+		munmap(rrl_top_map, sizeof(struct rrl_top_keep)*rrl_maps_num);
+		rrl_top_map = NULL;
+	}
 #endif
 }
 
@@ -121,6 +239,21 @@ void rrl_mmap_deinit_keep_mmap(void)
 #endif
 }
 
+void rrl_set_stats(unsigned long* retry, unsigned long* evict)
+{
+#ifdef HAVE_ATOMIC_BUILTINS
+	rrl_retry_stat = retry;
+#else
+	(void)retry;
+#endif
+	rrl_evict_stat = evict;
+}
+
+void rrl_set_hash_key(const uint8_t* key)
+{
+	memmove(rrl_hash_key, key, sizeof(rrl_hash_key));
+}
+
 void rrl_set_limit(size_t lm, size_t wlm, size_t sm)
 {
 	rrl_ratelimit = lm*2;
@@ -130,6 +263,14 @@ void rrl_set_limit(size_t lm, size_t wlm, size_t sm)
 
 void rrl_init(size_t ch)
 {
+	rrl_top_mine = (rrl_top_map && ch < rrl_maps_num ?
+		&rrl_top_map[ch] : NULL);
+#ifdef HAVE_ATOMIC_BUILTINS
+	if(rrl_shared_map && ch < rrl_maps_num) {
+		rrl_shared_array = (struct rrl_shared_bucket*)rrl_shared_map;
+		return;
+	}
+#endif
 	if(!rrl_maps || ch >= rrl_maps_num)
 	    rrl_array = xalloc_array_zero(sizeof(struct rrl_bucket),
 	    	rrl_array_size);
@@ -140,6 +281,13 @@ void rrl_init(size_t ch)
 
 void rrl_deinit(size_t ch)
 {
+	rrl_top_mine = NULL;
+#ifdef HAVE_ATOMIC_BUILTINS
+	if(rrl_shared_array) {
+		rrl_shared_array = NULL;
+		return;
+	}
+#endif
 	if(!rrl_maps || ch >= rrl_maps_num)
 		free(rrl_array);
 	rrl_array = NULL;
@@ -171,7 +319,7 @@ static uint64_t rrl_get_source(query_type* query, uint16_t* c2)
 }
 
 /** debug source to string */
-static const char* rrlsource2str(uint64_t s, uint16_t c2)
+const char* rrlsource2str(uint64_t s, uint16_t c2)
 {
 	static char buf[64];
 	struct in_addr a4;
@@ -303,7 +451,7 @@ static uint16_t rrl_classify(query_type* query, const uint8_t** d,
 }
 
 /** Examine the query and return hash and source of netblock. */
-static void examine_query(query_type* query, uint32_t* hash, uint64_t* source,
+static void examine_query(query_type* query, uint64_t* hash, uint64_t* source,
 	uint16_t* flags, uint32_t* lm)
 {
 	/* compile a binary string representing the query */
@@ -311,7 +459,7 @@ static void examine_query(query_type* query, uint32_t* hash, uint64_t* source,
 	/* size with 16 bytes to spare */
 	uint8_t buf[MAXDOMAINLEN + sizeof(*source) + sizeof(c) + 16];
 	const uint8_t* dname = NULL; size_t dname_len = 0;
-	uint32_t r = 0x267fcd16;
+	size_t len = sizeof(*source)+sizeof(c);
 
 	*source = rrl_get_source(query, &c2);
 	c = rrl_classify(query, &dname, &dname_len);
@@ -326,12 +474,13 @@ static void examine_query(query_type* query, uint32_t* hash, uint64_t* source,
 
 	DEBUG(DEBUG_QUERY, 1, (LOG_INFO, "rrl_examine type %s name %s", rrltype2str(c), dname?wiredname2str(dname):"NULL"));
 
-	/* and hash it */
+	/* and hash it, with siphash and a secret key, so that sources that
+	 * end up in the same set cannot be made by an attacker */
 	if(dname && dname_len <= MAXDOMAINLEN) {
-		memmove(buf+sizeof(*source)+sizeof(c), dname, dname_len);
-		*hash = hashlittle(buf, sizeof(*source)+sizeof(c)+dname_len, r);
-	} else
-		*hash = hashlittle(buf, sizeof(*source)+sizeof(c), r);
+		memmove(buf+len, dname, dname_len);
+		len += dname_len;
+	}
+	(void)siphash(buf, len, rrl_hash_key, (uint8_t*)hash, sizeof(*hash));
 }
 
 /* age the bucket because elapsed time steps have gone by */
@@ -371,6 +520,25 @@ rrl_msg(query_type* query, const char* str)
 		address, rrtype_to_string(query->qtype));
 }
 
+/** the rate of the bucket at time now, to pick the bucket to take over */
+static uint32_t rrl_bucket_value(struct rrl_bucket* b, int32_t now)
+{
+	int32_t elapsed = now - b->stamp;
+	if(elapsed == 0)
+		return b->counter + b->rate/2;
+	if(elapsed < 0 || elapsed > 16)
+		return 0;
+	/* like rrl_attenuate_bucket, and for elapsed 1 the new rate */
+	return (b->rate>>elapsed) + (b->counter>>(elapsed-1));
+}
+
+/** count that a bucket with a rate is taken over by another source */
+static void rrl_count_evict(uint32_t value)
+{
+	if(value != 0 && rrl_evict_stat)
+		(*rrl_evict_stat)++;
+}
+
 /** true if the query used to be blocked by the ratelimit */
 static int
 used_to_block(uint32_t rate, uint32_t counter, uint32_t lm)
@@ -378,39 +546,18 @@ used_to_block(uint32_t rate, uint32_t counter, uint32_t lm)
 	return rate >= lm || counter+rate/2 >= lm;
 }
 
-/** update the rate in a ratelimit bucket, return actual rate */
-uint32_t rrl_update(query_type* query, uint32_t hash, uint64_t source,
-	uint16_t flags, int32_t now, uint32_t lm)
-{
-	struct rrl_bucket* b = &rrl_array[hash % rrl_array_size];
-
-	DEBUG(DEBUG_QUERY, 1, (LOG_INFO, "source %llx hash %x oldrate %d oldcount %d stamp %d",
-		(long long unsigned)source, hash, b->rate, b->counter, b->stamp));
-
-	/* check if different source */
-	if(b->source != source || b->flags != flags || b->hash != hash) {
-		/* initialise */
-		/* potentially the wrong limit here, used lower nonwhitelim */
-		if(verbosity >= 1 &&
-			used_to_block(b->rate, b->counter, rrl_ratelimit)) {
-			char address[128];
-			addr2str(&query->client_addr, address, sizeof(address));
-			log_msg(LOG_INFO, "ratelimit unblock ~ type %s target %s query %s %s (%s collision)",
-				rrltype2str(b->flags),
-				rrlsource2str(b->source, b->flags),
-				address, rrtype_to_string(query->qtype),
-				(b->hash!=hash?"bucket":"hash"));
-		}
-		b->hash = hash;
-		b->source = source;
-		b->flags = flags;
-		b->counter = 1;
-		b->rate = 0;
-		b->stamp = now;
-		return 1;
-	}
-	/* this is the same source */
+/** what to log after the update of a bucket */
+enum rrl_log {
+	rrl_log_none = 0,
+	rrl_log_block,
+	rrl_log_unblock
+};
 
+/** step the rate in the bucket to the time now and count the query,
+ * for the same source as in the bucket, return actual rate */
+static uint32_t rrl_bucket_step(struct rrl_bucket* b, int32_t now,
+	uint32_t lm, enum rrl_log* log)
+{
 	/* check if old, zero or smooth it */
 	/* circular arith for time */
 	if(now - b->stamp == 1) {
@@ -418,7 +565,7 @@ uint32_t rrl_update(query_type* query, uint32_t hash, uint64_t source,
 		int oldblock = used_to_block(b->rate, b->counter, lm);
 		b->rate = b->rate/2 + b->counter;
 		if(oldblock && b->rate < lm)
-			rrl_msg(query, "unblock");
+			*log = rrl_log_unblock;
 		b->counter = 1;
 		b->stamp = now;
 	} else if(now - b->stamp > 0) {
@@ -426,13 +573,13 @@ uint32_t rrl_update(query_type* query, uint32_t hash, uint64_t source,
 		int olderblock = used_to_block(b->rate, b->counter, lm);
 		rrl_attenuate_bucket(b, now - b->stamp);
 		if(olderblock && b->rate < lm)
-			rrl_msg(query, "unblock");
+			*log = rrl_log_unblock;
 		b->counter = 1;
 		b->stamp = now;
 	} else if(now != b->stamp) {
 		/* robust, timestamp from the future */
 		if(used_to_block(b->rate, b->counter, lm))
-			rrl_msg(query, "unblock");
+			*log = rrl_log_unblock;
 		b->rate = 0;
 		b->counter = 1;
 		b->stamp = now;
@@ -442,7 +589,7 @@ uint32_t rrl_update(query_type* query, uint32_t hash, uint64_t source,
 
 		/* log what is blocked for operational debugging */
 		if(b->counter + b->rate/2 == lm && b->rate < lm)
-			rrl_msg(query, "block");
+			*log = rrl_log_block;
 	}
 
 	/* return max from current rate and projected next-value for rate */
@@ -453,10 +600,321 @@ uint32_t rrl_update(query_type* query, uint32_t hash, uint64_t source,
 	return b->rate;
 }
 
+/** log the block or unblock of the bucket update */
+static void rrl_log_msg(query_type* query, enum rrl_log log)
+{
+	if(log == rrl_log_block)
+		rrl_msg(query, "block");
+	else if(log == rrl_log_unblock)
+		rrl_msg(query, "unblock");
+}
+
+/** log that a bucket that was blocked is taken over by another source */
+static void rrl_log_collision(query_type* query, uint64_t source,
+	uint16_t flags, const char* what)
+{
+	char address[128];
+	addr2str(&query->client_addr, address, sizeof(address));
+	log_msg(LOG_INFO, "ratelimit unblock ~ type %s target %s query %s %s (%s collision)",
+		rrltype2str(flags), rrlsource2str(source, flags),
+		address, rrtype_to_string(query->qtype), what);
+}
+
+/** find the lowest rate in the top list */
+static void rrl_top_keep_min(struct rrl_top_keep* t)
+{
+	uint32_t i;
+	t->min = t->rate[0];
+	t->minpos = 0;
+	for(i=1; i<RRL_TOP_KEEP; i++) {
+		if(t->rate[i] < t->min) {
+			t->min = t->rate[i];
+			t->minpos = i;
+		}
+	}
+}
+
+/** put the bucket in the top list of this process, if its rate is high
+ * enough, in place of the lowest rate */
+static void rrl_top_note(size_t bucket, uint32_t rate, int32_t now)
+{
+	struct rrl_top_keep* t = rrl_top_mine;
+	uint32_t i, d;
+	if(!t)
+		return;
+	if(t->stamp != now) {
+		/* the rates halve every second */
+		d = (uint32_t)(now - t->stamp);
+		for(i=0; i<RRL_TOP_KEEP; i++)
+			t->rate[i] = (d < 32 ? t->rate[i]>>d : 0);
+		t->stamp = now;
+		rrl_top_keep_min(t);
+	}
+	if(rate <= t->min)
+		return;
+	for(i=0; i<RRL_TOP_KEEP; i++) {
+		if(t->bucket[i] == bucket+1)
+			break;
+	}
+	if(i == RRL_TOP_KEEP)
+		i = t->minpos;
+	t->bucket[i] = bucket+1;
+	t->rate[i] = rate;
+	if(i == t->minpos)
+		rrl_top_keep_min(t);
+}
+
+#ifdef HAVE_ATOMIC_BUILTINS
+/** get the bucket contents from the state word of a shared bucket */
+static void rrl_state_get(uint64_t state, int32_t now, struct rrl_bucket* b)
+{
+	/* the stamp is stored modulo 65536, recreate it around now */
+	int32_t d = (int32_t)(((uint32_t)now - RRL_STATE_STAMP(state)) &
+		0xffff);
+	if(d >= 0x8000)
+		d -= 0x10000;
+	b->stamp = now - d;
+	b->rate = RRL_STATE_RATE(state);
+	b->counter = RRL_STATE_COUNTER(state);
+}
+
+/** update the rate in a bucket of the shared table, return actual rate */
+static uint32_t rrl_update_shared(query_type* query, uint64_t hash,
+	uint64_t source, uint16_t flags, int32_t now, uint32_t lm)
+{
+	struct rrl_shared_bucket* set = &rrl_shared_array[
+		(hash % (rrl_array_size/RRL_WAYS))*RRL_WAYS];
+	struct rrl_shared_bucket* b, *victim;
+	/* tag 0 is for empty buckets */
+	uint16_t tag = (uint16_t)(hash>>52) ? (uint16_t)(hash>>52) : 1;
+	uint64_t state, victimstate = 0, newstate;
+	uint32_t value, victimvalue;
+	struct rrl_bucket s;
+	enum rrl_log log;
+	uint32_t rate;
+	int i;
+
+	while(1) {
+		/* find the source in the set */
+		b = NULL;
+		victim = NULL;
+		victimvalue = 0;
+		for(i=0; i<RRL_WAYS; i++) {
+			state = __atomic_load_n(&set[i].state,
+				__ATOMIC_RELAXED);
+			if(RRL_STATE_TAG(state) == tag &&
+				__atomic_load_n(&set[i].source,
+				__ATOMIC_RELAXED) == source &&
+				__atomic_load_n(&set[i].flags,
+				__ATOMIC_RELAXED) == flags) {
+				b = &set[i];
+				break;
+			}
+			rrl_state_get(state, now, &s);
+			value = rrl_bucket_value(&s, now);
+			if(!victim || value < victimvalue) {
+				victim = &set[i];
+				victimstate = state;
+				victimvalue = value;
+			}
+		}
+		if(!b) {
+			/* different source, take over the lowest rate bucket */
+			newstate = RRL_STATE(tag, now, 1, 0);
+			if(!__atomic_compare_exchange_n(&victim->state,
+				&victimstate, newstate, 0, __ATOMIC_RELAXED,
+				__ATOMIC_RELAXED)) {
+				if(rrl_retry_stat)
+					(*rrl_retry_stat)++;
+				continue;
+			}
+			rrl_count_evict(victimvalue);
+			if(verbosity >= 1 && used_to_block(
+				RRL_STATE_RATE(victimstate),
+				RRL_STATE_COUNTER(victimstate), rrl_ratelimit))
+				rrl_log_collision(query,
+					__atomic_load_n(&victim->source,
+					__ATOMIC_RELAXED),
+					__atomic_load_n(&victim->flags,
+					__ATOMIC_RELAXED), "bucket");
+			__atomic_store_n(&victim->source, source,
+				__ATOMIC_RELAXED);
+			__atomic_store_n(&victim->flags, flags,
+				__ATOMIC_RELAXED);
+			return 1;
+		}
+		/* this is the same source */
+		rrl_state_get(state, now, &s);
+		log = rrl_log_none;
+		rate = rrl_bucket_step(&s, now, lm, &log);
+		newstate = RRL_STATE(tag, s.stamp, s.counter, s.rate);
+		if(__atomic_compare_exchange_n(&b->state, &state, newstate, 0,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+		/* changed by another process, look again, the bucket may
+		 * have been taken over by another source */
+		if(rrl_retry_stat)
+			(*rrl_retry_stat)++;
+	}
+	rrl_log_msg(query, log);
+	rrl_top_note((size_t)(b - rrl_shared_array), rate, now);
+	return rate;
+}
+#endif /* HAVE_ATOMIC_BUILTINS */
+
+/** update the rate in a ratelimit bucket, return actual rate */
+uint32_t rrl_update(query_type* query, uint64_t hash, uint64_t source,
+	uint16_t flags, int32_t now, uint32_t lm)
+{
+	struct rrl_bucket* set, *b = NULL, *victim = NULL;
+	uint32_t check = (uint32_t)(hash>>32);
+	uint32_t value, victimvalue = 0;
+	enum rrl_log log = rrl_log_none;
+	uint32_t rate;
+	int i;
+
+#ifdef HAVE_ATOMIC_BUILTINS
+	if(rrl_shared_array)
+		return rrl_update_shared(query, hash, source, flags, now, lm);
+#endif
+	set = &rrl_array[(hash % (rrl_array_size/RRL_WAYS))*RRL_WAYS];
+
+	/* find the source in the set */
+	for(i=0; i<RRL_WAYS; i++) {
+		if(set[i].source == source && set[i].flags == flags &&
+			set[i].hash == check) {
+			b = &set[i];
+			break;
+		}
+		value = rrl_bucket_value(&set[i], now);
+		if(!victim || value < victimvalue) {
+			victim = &set[i];
+			victimvalue = value;
+		}
+	}
+
+	if(!b) {
+		/* different source, take over the lowest rate bucket */
+		/* potentially the wrong limit here, used lower nonwhitelim */
+		b = victim;
+		rrl_count_evict(victimvalue);
+		if(verbosity >= 1 &&
+			used_to_block(b->rate, b->counter, rrl_ratelimit))
+			rrl_log_collision(query, b->source, b->flags,
+				(b->hash!=check?"bucket":"hash"));
+		b->hash = check;
+		b->source = source;
+		b->flags = flags;
+		b->counter = 1;
+		b->rate = 0;
+		b->stamp = now;
+		return 1;
+	}
+
+	DEBUG(DEBUG_QUERY, 1, (LOG_INFO, "source %llx hash %llx oldrate %d oldcount %d stamp %d",
+		(long long unsigned)source, (long long unsigned)hash, b->rate,
+		b->counter, b->stamp));
+
+	/* this is the same source */
+	rate = rrl_bucket_step(b, now, lm, &log);
+	rrl_log_msg(query, log);
+	rrl_top_note((size_t)(b - rrl_array), rate, now);
+	return rate;
+}
+
+#if defined(HAVE_MMAP) && defined(HAVE_ATOMIC_BUILTINS)
+/** see if the bucket of the shared table is in the top list of a server
+ * process before server i entry k, then it is listed already */
+static int rrl_top_seen(size_t i, size_t k, uint32_t bucket)
+{
+	size_t x, y;
+	for(x=0; x<=i; x++) {
+		for(y=0; y<(x==i?k:RRL_TOP_KEEP); y++) {
+			if(rrl_top_map[x].bucket[y] == bucket)
+				return 1;
+		}
+	}
+	return 0;
+}
+#endif
+
+/** put the bucket in the top list, sorted on rate, if it is high enough */
+static void rrl_top_add(struct rrl_top* top, size_t num, size_t* count,
+	uint64_t source, uint16_t flags, uint32_t rate, int server)
+{
+	size_t i;
+	if(rate == 0 || (*count == num && rate <= top[num-1].rate))
+		return;
+	i = (*count < num ? (*count)++ : num-1);
+	while(i > 0 && top[i-1].rate < rate) {
+		top[i] = top[i-1];
+		i--;
+	}
+	top[i].source = source;
+	top[i].flags = flags;
+	top[i].rate = rate;
+	top[i].server = server;
+}
+
+size_t rrl_top_list(struct rrl_top* top, size_t num, int32_t now)
+{
+	size_t count = 0;
+#ifdef HAVE_MMAP
+	size_t i, k, j;
+	if(num == 0 || !rrl_top_map)
+		return 0;
+	/* the buckets in the top lists of the server processes, the tables
+	 * are read while they are changed, this is a snapshot, a bucket may
+	 * be partly updated */
+	for(i=0; i<rrl_maps_num; i++) {
+		for(k=0; k<RRL_TOP_KEEP; k++) {
+			j = rrl_top_map[i].bucket[k];
+			if(j == 0 || j > rrl_array_size)
+				continue;
+			j--;
+#ifdef HAVE_ATOMIC_BUILTINS
+			if(rrl_shared_map) {
+				struct rrl_shared_bucket* a =
+					(struct rrl_shared_bucket*)
+					rrl_shared_map;
+				struct rrl_bucket b;
+				uint64_t state = __atomic_load_n(&a[j].state,
+					__ATOMIC_RELAXED);
+				if(state == 0 || rrl_top_seen(i, k, j+1))
+					continue;
+				rrl_state_get(state, now, &b);
+				rrl_top_add(top, num, &count,
+					__atomic_load_n(&a[j].source,
+					__ATOMIC_RELAXED),
+					__atomic_load_n(&a[j].flags,
+					__ATOMIC_RELAXED),
+					rrl_bucket_value(&b, now), -1);
+				continue;
+			}
+#endif
+			if(rrl_maps) {
+				struct rrl_bucket* a =
+					(struct rrl_bucket*)rrl_maps[i];
+				if(a[j].counter == 0)
+					continue;
+				rrl_top_add(top, num, &count, a[j].source,
+					a[j].flags, rrl_bucket_value(&a[j],
+					now), (int)i);
+			}
+		}
+	}
+#else
+	(void)top;
+	(void)num;
+	(void)now;
+#endif /* HAVE_MMAP */
+	return count;
+}
+
 int rrl_process_query(query_type* query)
 {
 	uint64_t source;
-	uint32_t hash;
+	uint64_t hash;
 	/* we can use circular arithmetic here, so int32 works after 2038 */
 	int32_t now = (int32_t)time(NULL);
 	uint32_t lm = rrl_ratelimit;
@@ -42,9 +42,10 @@ enum rrl_type {
  * Initialize for n children (optional, otherwise no mmaps used)
  * ratelimits lm and wlm are in qps (this routines x2s them for internal use).
  * plf and pls are in prefix lengths.
+ * If shared, the children use one table, with atomic updates, if available.
  */
 void rrl_mmap_init(int numch, size_t numbuck, size_t lm, size_t wlm, size_t sm,
-	size_t plf, size_t pls);
+	size_t plf, size_t pls, int shared);
 
 /**
  * Initialize rate limiting (for this child server process)
@@ -76,10 +77,43 @@ query_state_type rrl_slip(query_type* query);
 const char* rrltype2str(enum rrl_type c);
 /** convert string to classification type */
 enum rrl_type rrlstr2type(const char* s);
+/** convert source netblock to string, c2 is rrl_ip6 for IPv6 */
+const char* rrlsource2str(uint64_t s, uint16_t c2);
+
+/** the number of buckets with the highest rates kept per server process */
+#define RRL_TOP_KEEP 64
+
+/** entry in the list of buckets with the highest rates */
+struct rrl_top {
+	/* source netblock */
+	uint64_t source;
+	/* classification type and rrl_ip6 */
+	uint16_t flags;
+	/* the rate, in 2x qps like the ratelimit */
+	uint32_t rate;
+	/* the server process whose table it is in, -1 for the shared table */
+	int server;
+};
+
+/**
+ * Find the buckets with the highest rates at time now, in the tables of
+ * all server processes, or in the shared table. For a process that has
+ * the tables mapped, but does not update them, like xfrd. It looks at the
+ * RRL_TOP_KEEP buckets with the highest rates that every server process
+ * keeps, not at the whole tables.
+ * top is an array of num entries, it is filled sorted on rate, highest
+ * first. Returns the number of entries filled in.
+ */
+size_t rrl_top_list(struct rrl_top* top, size_t num, int32_t now);
 
 /** for unit test, update rrl bucket; return rate */
-uint32_t rrl_update(query_type* query, uint32_t hash, uint64_t source,
+uint32_t rrl_update(query_type* query, uint64_t hash, uint64_t source,
 	uint16_t flags, int32_t now, uint32_t lm);
+/** set the statistic counters for retried updates of the shared table
+ * and for buckets that are taken over from a source with a rate */
+void rrl_set_stats(unsigned long* retry, unsigned long* evict);
+/** set the secret key for the hash of the buckets, 16 bytes */
+void rrl_set_hash_key(const uint8_t* key);
 /** set the rate limit counters, pass variables in qps */
 void rrl_set_limit(size_t lm, size_t wlm, size_t sm);
 
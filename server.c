@@ -95,6 +95,10 @@
 #endif /* USE_METRICS */
 
 #define RELOAD_SYNC_TIMEOUT 25 /* seconds */
+/* wait for the server processes to apply an incremental reload */
+#define RELOAD_INCREMENTAL_TIMEOUT 5 /* seconds */
+/* after this many times reload-incremental bytes, do a full reload */
+#define RELOAD_INCREMENTAL_TOTAL 64
 
 #ifdef USE_DNSTAP
 /*
@@ -216,6 +220,57 @@ struct mmsghdr {
 static struct mmsghdr msgs[NUM_RECV_PER_SELECT];
 static struct iovec iovecs[NUM_RECV_PER_SELECT];
 static struct query *queries[NUM_RECV_PER_SELECT];
+#ifdef BIND8_STATS
+/* receive times of the UDP queries, for the latency statistics. With
+ * SO_TIMESTAMPNS the kernel stamps every packet, and the time is that of
+ * the query itself, otherwise it is that of the recvmmsg call. */
+static struct timespec recvstamps[NUM_RECV_PER_SELECT];
+#ifdef SO_TIMESTAMPNS
+static union {
+	struct cmsghdr hdr;
+	uint8_t buf[CMSG_SPACE(sizeof(struct timespec))];
+} stampctl[NUM_RECV_PER_SELECT];
+#endif
+#endif /* BIND8_STATS */
+
+/* let the recvmmsg of message i pick up the kernel receive time */
+static void
+udp_stamp_prepare(int i)
+{
+#if defined(BIND8_STATS) && defined(SO_TIMESTAMPNS)
+	msgs[i].msg_hdr.msg_control = stampctl[i].buf;
+	msgs[i].msg_hdr.msg_controllen = sizeof(stampctl[i].buf);
+#else
+	(void)i;
+#endif
+}
+
+#ifdef BIND8_STATS
+/* get the receive time of message i, the kernel stamp or else the time of
+ * the recvmmsg call, and take the stamp off the message, so that it is not
+ * sent along with the answer */
+static void
+udp_stamp_get(int i, struct timespec* recvtime)
+{
+#ifdef SO_TIMESTAMPNS
+	struct cmsghdr* cmsg;
+	recvstamps[i] = *recvtime;
+	for(cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg;
+		cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+		if(cmsg->cmsg_level == SOL_SOCKET &&
+			cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			memmove(&recvstamps[i], CMSG_DATA(cmsg),
+				sizeof(recvstamps[i]));
+			break;
+		}
+	}
+	msgs[i].msg_hdr.msg_control = NULL;
+	msgs[i].msg_hdr.msg_controllen = 0;
+#else
+	recvstamps[i] = *recvtime;
+#endif
+}
+#endif /* BIND8_STATS */
 #ifdef USE_XDP
 static struct query *xdp_queries[XDP_RX_BATCH_SIZE];
 #endif
@@ -295,6 +350,13 @@ struct tcp_handler_data
 	struct nsd_socket *socket;
 #endif /* USE_DNSTAP */
 
+#ifdef BIND8_STATS
+	/* when the query was received, for the latency statistics, and
+	 * if the latency is still to be accounted when the answer is sent */
+	struct timespec query_start;
+	int latency_pending;
+#endif /* BIND8_STATS */
+
 	/* if set, PROXYv2 is expected on this connection */
 	int pp2_enabled;
 
@@ -398,6 +460,8 @@ static uint16_t *compressed_dname_offsets = 0;
 static uint32_t compression_table_capacity = 0;
 static uint32_t compression_table_size = 0;
 static domain_type* compressed_dnames[MAXRRSPP];
+/* bytes of transfers applied with reload-incremental since the last reload */
+static uint64_t reload_incremental_bytes = 0;
 
 #ifdef USE_TCP_FASTOPEN
 /* Checks to see if the kernel value must be manually changed in order for
@@ -725,7 +789,10 @@ void
 server_stat_alloc(struct nsd* nsd)
 {
 	char tmpfile[256];
-	size_t sz = sizeof(struct nsdst) * nsd->child_count * 2;
+	/* the old and new server processes, and the dnstap collector,
+	 * followed by their answer statistics */
+	size_t sz = (sizeof(struct nsdst) + sizeof(struct nsdst_resp)) *
+		(nsd->child_count * 2 + 1);
 	uint8_t z = 0;
 
 	/* file name */
@@ -769,8 +836,11 @@ fail_exit:
 	memset(nsd->stat_map, 0, sz);
 	nsd->stats_per_child[0] = nsd->stat_map;
 	nsd->stats_per_child[1] = &nsd->stat_map[nsd->child_count];
+	nsd->resp_map = (struct nsdst_resp*)&nsd->stat_map[
+		nsd->child_count * 2 + 1];
 	nsd->stat_current = 0;
 	nsd->st = &nsd->stats_per_child[nsd->stat_current][0];
+	nsd->resp = &nsd->resp_map[0];
 #endif /* HAVE_MMAP */
 }
 #endif /* BIND8_STATS */
@@ -795,8 +865,12 @@ static void
 initialize_dname_compression_tables(struct nsd *nsd)
 {
 	size_t needed = domain_table_count(nsd->db->domains) + 1;
+	/* with reload-incremental the server processes add domains to
+	 * their zones, leave room in the table for those */
+	size_t room = (nsd->options->reload_incremental?
+		needed/8 + EXTRA_DOMAIN_NUMBERS : 0);
 	needed += EXTRA_DOMAIN_NUMBERS;
-	if(compression_table_capacity < needed) {
+	if(compression_table_capacity < needed + room) {
 		if(compressed_dname_offsets) {
 			region_remove_cleanup(nsd->db->region,
 				cleanup_dname_compression_tables,
@@ -804,13 +878,15 @@ initialize_dname_compression_tables(struct nsd *nsd)
 			free(compressed_dname_offsets);
 		}
 		compressed_dname_offsets = (uint16_t *) xmallocarray(
-			needed, sizeof(uint16_t));
+			needed + room, sizeof(uint16_t));
 		region_add_cleanup(nsd->db->region, cleanup_dname_compression_tables,
 			compressed_dname_offsets);
-		compression_table_capacity = needed;
-		compression_table_size=domain_table_count(nsd->db->domains)+1;
+		compression_table_capacity = needed + room;
+		compression_table_size=domain_table_count(nsd->db->domains)+1
+			+ room;
 	}
-	memset(compressed_dname_offsets, 0, needed * sizeof(uint16_t));
+	memset(compressed_dname_offsets, 0, compression_table_capacity *
+		sizeof(uint16_t));
 	compressed_dname_offsets[0] = QHEADERSZ; /* The original query name */
 }
 
@@ -863,6 +939,22 @@ set_reuseport(struct nsd_socket *sock)
 	return 0;
 }
 
+/* have the kernel stamp the received packets, for the latency statistics */
+static void
+set_timestamp(struct nsd_socket *sock)
+{
+#if defined(BIND8_STATS) && defined(SO_TIMESTAMPNS)
+	int on = 1;
+	if(setsockopt(sock->s, SOL_SOCKET, SO_TIMESTAMPNS, &on,
+		sizeof(on)) == -1) {
+		VERBOSITY(2, (LOG_INFO, "setsockopt(..., SO_TIMESTAMPNS, "
+			"...) failed: %s", strerror(errno)));
+	}
+#else
+	(void)sock;
+#endif
+}
+
 static int
 set_reuseaddr(struct nsd_socket *sock)
 {
@@ -1334,6 +1426,7 @@ open_udp_socket(struct nsd *nsd, struct nsd_socket *sock, int *reuseport_works)
 	 * after select returns readable.
 	 */
 	set_nonblock(sock);
+	set_timestamp(sock);
 
 	if(nsd->options->ip_freebind)
 		(void)set_ip_freebind(sock);
@@ -1526,12 +1619,24 @@ server_prepare(struct nsd *nsd)
 #  endif
 		hash_set_raninit(random());
 #endif
-	rrl_mmap_init(nsd->child_count, nsd->options->rrl_size,
-		nsd->options->rrl_ratelimit,
-		nsd->options->rrl_whitelist_ratelimit,
-		nsd->options->rrl_slip,
-		nsd->options->rrl_ipv4_prefix_length,
-		nsd->options->rrl_ipv6_prefix_length);
+	/* and the secret key for the ratelimit buckets */
+	{
+		uint8_t key[16];
+#ifdef HAVE_GETRANDOM
+		if(getrandom(key, sizeof(key), 0) == -1) {
+			log_msg(LOG_ERR, "getrandom failed: %s", strerror(errno));
+			exit(1);
+		}
+#else
+		size_t i;
+#  ifdef HAVE_SSL
+		if(!RAND_status() || RAND_bytes(key, sizeof(key)) <= 0)
+#  endif
+		for(i=0; i<sizeof(key); i++)
+			key[i] = (uint8_t)random_generate(256);
+#endif
+		rrl_set_hash_key(key);
+	}
 #endif /* RATELIMIT */
 
 	/* Open the database... */
@@ -2366,12 +2471,13 @@ block_read(struct nsd* nsd, int s, void* p, ssize_t sz, int timeout)
 	return total;
 }
 
-static void
+static size_t
 reload_process_non_xfr_tasks(struct nsd* nsd, udb_ptr* xfrs2process,
 		udb_ptr* last_task)
 {
 	udb_ptr t, next, xfr_tail;
 	udb_base* u = nsd->task[nsd->mytask];
+	size_t non_xfr_processed = 0;
 	udb_ptr_init(&next, u);
 	udb_ptr_init(&xfr_tail, u);
 	udb_ptr_new(&t, u, udb_base_get_userdata(u));
@@ -2386,6 +2492,7 @@ reload_process_non_xfr_tasks(struct nsd* nsd, udb_ptr* xfrs2process,
 			/* process task t */
 			/* append results for task t and update last_task */
 			task_process_in_reload(nsd, u, last_task, &t);
+			non_xfr_processed += 1;
 
 		} else if(udb_ptr_is_null(xfrs2process)) {
 			udb_ptr_set_ptr( xfrs2process, u, &t);
@@ -2399,6 +2506,112 @@ reload_process_non_xfr_tasks(struct nsd* nsd, udb_ptr* xfrs2process,
 	}
 	/* t and next are already unlinked (because they are null) */
 	udb_ptr_unlink(&xfr_tail, u);
+	return non_xfr_processed;
+}
+
+/*
+ * Check the xfr files of the transfers with xfr-check-processes processes,
+ * before they are applied one after the other. The transfers are divided
+ * over the processes by the size of their files. Returns a byte for every
+ * transfer, in a shared mapping of num bytes, that is set if it failed the
+ * check, or NULL if they are not checked.
+ */
+static uint8_t*
+reload_check_xfr_tasks(struct nsd* nsd, udb_ptr* xfrs2process, size_t* num)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_FORK)
+	udb_base* u = nsd->task[nsd->mytask];
+	size_t procs = (size_t)nsd->options->xfr_check_processes;
+	size_t count = 0, i, k;
+	uint64_t *files, *load, sz;
+	size_t* owner;
+	pid_t* pids;
+	uint8_t* bad;
+	udb_ptr t;
+	struct timespec start, end;
+
+	*num = 0;
+	if(procs <= 1 || udb_ptr_is_null(xfrs2process))
+		return NULL;
+	udb_ptr_init(&t, u);
+	udb_ptr_set_ptr(&t, u, xfrs2process);
+	while(!udb_ptr_is_null(&t)) {
+		count++;
+		udb_ptr_set_rptr(&t, u, &TASKLIST(&t)->next);
+	}
+	if(procs > count)
+		procs = count;
+	bad = (uint8_t*)mmap(NULL, count, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(bad == MAP_FAILED) {
+		log_msg(LOG_ERR, "xfr check: mmap failed: %s",
+			strerror(errno));
+		udb_ptr_unlink(&t, u);
+		return NULL;
+	}
+	files = (uint64_t*)xalloc_array_zero(count, sizeof(*files));
+	owner = (size_t*)xalloc_array_zero(count, sizeof(*owner));
+	load = (uint64_t*)xalloc_array_zero(procs, sizeof(*load));
+	pids = (pid_t*)xalloc_array_zero(procs, sizeof(*pids));
+	i = 0;
+	udb_ptr_set_ptr(&t, u, xfrs2process);
+	while(!udb_ptr_is_null(&t)) {
+		files[i] = TASKLIST(&t)->yesno;
+		if(!xfrd_xfrfile_size(nsd, files[i], &sz))
+			sz = 0;
+		/* to the process that has the least bytes to check */
+		for(k=1; k<procs; k++) {
+			if(load[k] < load[owner[i]])
+				owner[i] = k;
+		}
+		load[owner[i]] += sz;
+		i++;
+		udb_ptr_set_rptr(&t, u, &TASKLIST(&t)->next);
+	}
+	udb_ptr_unlink(&t, u);
+
+	get_time(&start);
+	for(k=1; k<procs; k++) {
+		pids[k] = fork();
+		if(pids[k] == -1) {
+			log_msg(LOG_ERR, "xfr check: fork failed: %s",
+				strerror(errno));
+			pids[k] = 0;
+		} else if(pids[k] == 0) {
+			for(i=0; i<count; i++) {
+				if(owner[i] == k)
+					bad[i] = !check_xfrfile(nsd, files[i]);
+			}
+			exit(0);
+		}
+	}
+	/* this process checks its part, and that of failed forks */
+	for(i=0; i<count; i++) {
+		if(owner[i] == 0 || pids[owner[i]] == 0)
+			bad[i] = !check_xfrfile(nsd, files[i]);
+	}
+	for(k=1; k<procs; k++) {
+		if(pids[k] == 0)
+			continue;
+		while(waitpid(pids[k], NULL, 0) == -1 && errno == EINTR)
+			; /* wait for it */
+	}
+	get_time(&end);
+	timespec_subtract(&end, &start);
+	VERBOSITY(2, (LOG_INFO, "reload: %d xfrs checked by %d processes in "
+		"%lld.%6.6d seconds", (int)count, (int)procs,
+		(long long)end.tv_sec, (int)(end.tv_nsec/1000)));
+	free(files);
+	free(owner);
+	free(load);
+	free(pids);
+	*num = count;
+	return bad;
+#else
+	(void)nsd; (void)xfrs2process;
+	*num = 0;
+	return NULL;
+#endif /* HAVE_MMAP && HAVE_FORK */
 }
 
 static size_t
@@ -2407,8 +2620,12 @@ reload_process_xfr_tasks(struct nsd* nsd, int cmdsocket, udb_ptr* xfrs2process)
 	sig_atomic_t cmd = NSD_QUIT_SYNC;
 	udb_ptr next;
 	udb_base* u = nsd->task[nsd->mytask];
-	size_t xfrs_processed = 0;
+	size_t xfrs_processed = 0, num_checked = 0;
+	struct timespec start, end;
+	uint8_t* bad;
 
+	get_time(&start);
+	bad = reload_check_xfr_tasks(nsd, xfrs2process, &num_checked);
 	udb_ptr_init(&next, u);
 	while(!udb_ptr_is_null(xfrs2process)) {
 		/* store next in list so this one can be deleted or reused */
@@ -2417,7 +2634,13 @@ reload_process_xfr_tasks(struct nsd* nsd, int cmdsocket, udb_ptr* xfrs2process)
 		
 		/* process xfr task at xfrs2process */
 		assert(TASKLIST(xfrs2process)->task_type == task_apply_xfr);
-		task_process_apply_xfr(nsd, u, xfrs2process);
+		if(bad && xfrs_processed < num_checked && bad[xfrs_processed]) {
+			/* it would fail part way, the zone keeps its data */
+			task_process_skip_xfr(nsd, u, xfrs2process);
+		} else if(!task_process_apply_xfr(nsd, u, xfrs2process)) {
+			/* the old-main keeps the zones it has */
+			exit(1);
+		}
 		xfrs_processed += 1;
 
 		/* go to next */
@@ -2441,9 +2664,407 @@ reload_process_xfr_tasks(struct nsd* nsd, int cmdsocket, udb_ptr* xfrs2process)
 		}
 	}
 	/* xfrs2process and next are already unlinked (because they are null) */
+#ifdef NSEC3
+	nsec3_hash_pool_stop();
+#endif
+#ifdef HAVE_MMAP
+	if(bad)
+		munmap(bad, num_checked);
+#endif
+	if(xfrs_processed > 1) {
+		get_time(&end);
+		timespec_subtract(&end, &start);
+		VERBOSITY(1, (LOG_INFO, "reload: %d xfrs applied in "
+			"%lld.%6.6d seconds", (int)xfrs_processed,
+			(long long)end.tv_sec, (int)(end.tv_nsec/1000)));
+	}
 	return xfrs_processed;
 }
 
+/* add the soainfo for xfrd of the zones that the transfers updated */
+static void
+reload_new_soainfo(struct nsd* nsd, udb_ptr* last_task)
+{
+	struct radnode* node;
+	zone_type* zone;
+	enum soainfo_hint hint;
+
+	for(node = radix_first(nsd->db->zonetree); node != NULL;
+		node = radix_next(node)) {
+
+		zone = (zone_type *)node->elem;
+		if(zone->is_updated) {
+			if(zone->is_bad) {
+				nsd->mode = NSD_RELOAD_FAILED;
+				hint = soainfo_bad;
+			} else {
+				hint = soainfo_ok;
+			}
+			/* update(s), verified or not, possibly with subsequent
+			   skipped update(s). skipped update(s) are picked up
+			   by failed update check in xfrd */
+			task_new_soainfo(nsd->task[nsd->mytask], last_task,
+			                 zone, hint);
+		} else if(zone->is_skipped) {
+			/* corrupt or inconsistent update without preceding
+			   update(s), communicate soainfo_gone */
+			task_new_soainfo(nsd->task[nsd->mytask], last_task,
+			                 zone, soainfo_gone);
+		}
+		zone->is_updated = 0;
+		zone->is_skipped = 0;
+	}
+}
+
+/*
+ * Apply the transfers in a short lived process. A failed apply exits the
+ * process that does it, so this tells if the main process and the server
+ * processes can apply them. Returns true if they can.
+ */
+static int
+reload_incremental_trial(struct nsd* nsd, udb_ptr* xfrs2process)
+{
+	udb_base* u = nsd->task[nsd->mytask];
+	udb_ptr t;
+	pid_t pid;
+	int status, ret;
+
+	pid = fork();
+	if(pid == -1) {
+		log_msg(LOG_ERR, "reload-incremental: fork failed: %s",
+			strerror(errno));
+		return 0;
+	}
+	if(pid == 0) {
+		/* the main process logs the transfers when it applies them,
+		 * the task list is left as it is for it */
+		verbosity = 0;
+		nsd->db->nsec3_hash_cache = 0;
+		udb_ptr_init(&t, u);
+		udb_ptr_set_ptr(&t, u, xfrs2process);
+		while(!udb_ptr_is_null(&t)) {
+			ret = apply_xfrfile(nsd, TASKLIST(&t)->zname,
+				TASKLIST(&t)->yesno, u);
+			if(ret == 0 || ret == -1)
+				exit(1);
+			udb_ptr_set_rptr(&t, u, &TASKLIST(&t)->next);
+		}
+		/* the new domains must fit in the compression table of
+		 * the server processes */
+		if(domain_table_count(nsd->db->domains) + 1 >
+			compression_table_size)
+			exit(1);
+		exit(0);
+	}
+	while(waitpid(pid, &status, 0) == -1) {
+		if(errno != EINTR) {
+			log_msg(LOG_ERR, "reload-incremental: waitpid(%d): %s",
+				(int)pid, strerror(errno));
+			return 0;
+		}
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* handle a command from a server process while waiting for its reply
+ * to the transfers, returns true if it is the reply */
+static int
+reload_incremental_child_cmd(struct nsd* nsd, sig_atomic_t cmd)
+{
+	switch(cmd) {
+	case NSD_APPLY_XFR:
+		return 1;
+	/* commands sent before the reply, as the ipc handler */
+	case NSD_QUIT:
+		nsd->mode = cmd;
+		break;
+	case NSD_STATS:
+		nsd->signal_hint_stats = 1;
+		break;
+	case NSD_REAP_CHILDREN:
+		nsd->signal_hint_child = 1;
+		break;
+	default:
+		log_msg(LOG_ERR, "reload-incremental: bad mode %d",
+			(int)cmd);
+		break;
+	}
+	return 0;
+}
+
+/*
+ * Wait for the server processes that were sent the transfers to reply
+ * that they applied them. They are waited for together, for at most
+ * RELOAD_INCREMENTAL_TIMEOUT seconds in total, and the ones that have
+ * not replied by then are restarted.
+ */
+static void
+reload_incremental_wait_children(struct nsd* nsd, region_type* region,
+	uint8_t* sent)
+{
+	struct pollfd* fds = (struct pollfd*)region_alloc_array(region,
+		nsd->child_count+1, sizeof(*fds));
+	size_t* idx = (size_t*)region_alloc_array(region, nsd->child_count+1,
+		sizeof(*idx));
+	struct timespec deadline, now;
+	sig_atomic_t cmd;
+	size_t i, n;
+	ssize_t r;
+	int ms;
+
+	get_time(&deadline);
+	deadline.tv_sec += RELOAD_INCREMENTAL_TIMEOUT;
+	for(;;) {
+		n = 0;
+		for(i=0; i < nsd->child_count; i++) {
+			if(!sent[i])
+				continue;
+			fds[n].fd = nsd->children[i].child_fd;
+			fds[n].events = POLLIN;
+			fds[n].revents = 0;
+			idx[n] = i;
+			n++;
+		}
+		if(n == 0)
+			return;
+		get_time(&now);
+		if(timespec_compare(&now, &deadline) >= 0)
+			break;
+		now.tv_sec = deadline.tv_sec - now.tv_sec;
+		now.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+		ms = (int)now.tv_sec*1000 + (int)(now.tv_nsec/1000000);
+		if(poll(fds, (nfds_t)n, ms<1?1:ms) == -1) {
+			if(errno == EINTR || errno == EAGAIN)
+				continue;
+			log_msg(LOG_ERR, "reload-incremental: poll: %s",
+				strerror(errno));
+			break;
+		}
+		for(i=0; i<n; i++) {
+			if(fds[i].revents == 0)
+				continue;
+			r = block_read(nsd, fds[i].fd, &cmd, sizeof(cmd), 0);
+			if(r == sizeof(cmd)) {
+				if(reload_incremental_child_cmd(nsd, cmd))
+					sent[idx[i]] = 0;
+			} else if(r == 0) {
+				/* the server process exited, the ipc
+				 * handler picks it up and restarts it */
+				sent[idx[i]] = 0;
+			}
+		}
+	}
+	for(i=0; i < nsd->child_count; i++) {
+		if(!sent[i])
+			continue;
+		log_msg(LOG_WARNING, "server %d did not apply the transfers, "
+			"restarting it", (int)nsd->children[i].pid);
+		kill(nsd->children[i].pid, SIGTERM);
+	}
+}
+
+/*
+ * A transfer failed to apply in the main process after the trial, and
+ * left the zone partly updated. Wipe it and read it again from the
+ * zonefile, xfrd is told the serial that it then has.
+ */
+static void
+reload_incremental_reread_zone(struct nsd* nsd, zone_type* zone,
+	udb_ptr* last_task)
+{
+	size_t shard;
+	log_msg(LOG_ERR, "reload-incremental: zone %s could not be "
+		"updated, read it again", domain_to_string(zone->apex));
+	shard = namedb_use_zone_shard(nsd->db, zone);
+#ifdef NSEC3
+	nsec3_clear_precompile(nsd->db, zone);
+	zone->nsec3_param = NULL;
+#endif
+	delete_zone_rrs(nsd->db, zone);
+	namedb_zone_free_filenames(nsd->db, zone);
+	namedb_use_shard(nsd->db, shard);
+	zone->mtime.tv_sec = 0;
+	zone->mtime.tv_nsec = 0;
+	zone->is_updated = 0;
+	zone->is_skipped = 0;
+	namedb_read_zonefile(nsd, zone, nsd->task[nsd->mytask], last_task);
+}
+
+/*
+ * Apply the transfers without a reload process and new server processes,
+ * if reload-incremental is enabled and they are small. After a trial, the
+ * main process applies them to its zones, and the server processes apply
+ * them to their copy of the zones. Returns false if the ordinary reload
+ * has to be done, xfrs2process is then unchanged, or empty if one of the
+ * transfers failed in the main process after the trial.
+ */
+static int
+reload_incremental(struct nsd* nsd, udb_ptr* xfrs2process,
+	udb_ptr* last_task)
+{
+	udb_base* u = nsd->task[nsd->mytask];
+	udb_ptr t, next;
+	uint64_t bytes = 0, sz;
+	uint32_t count = 0;
+	size_t msglen = 2*sizeof(uint32_t), i;
+	sig_atomic_t cmd;
+	uint32_t len;
+	pid_t mypid;
+	region_type* region;
+	buffer_type* msg;
+	uint8_t* sent;
+	zone_type** failed;
+	size_t num_failed = 0;
+
+	if(nsd->options->reload_incremental == 0 ||
+		nsd->options->verify_enable ||
+		udb_ptr_is_null(xfrs2process))
+		return 0;
+	udb_ptr_init(&t, u);
+	udb_ptr_set_ptr(&t, u, xfrs2process);
+	while(!udb_ptr_is_null(&t)) {
+		if(!xfrd_xfrfile_size(nsd, TASKLIST(&t)->yesno, &sz)) {
+			udb_ptr_unlink(&t, u);
+			return 0;
+		}
+		bytes += sz;
+		count++;
+		msglen += sizeof(uint64_t) + 1 +
+			TASKLIST(&t)->zname->name_size;
+		udb_ptr_set_rptr(&t, u, &TASKLIST(&t)->next);
+	}
+	if(bytes > nsd->options->reload_incremental ||
+		reload_incremental_bytes + bytes >
+		(uint64_t)nsd->options->reload_incremental *
+		RELOAD_INCREMENTAL_TOTAL)
+		return 0;
+	if(!reload_incremental_trial(nsd, xfrs2process)) {
+		VERBOSITY(2, (LOG_INFO, "reload: the transfers cannot be "
+			"applied incrementally, start a reload process"));
+		return 0;
+	}
+
+	/* the transfers for the server processes, the pid of main names
+	 * the directory of the xfr files */
+	region = region_create(xalloc, free);
+	msg = buffer_create(region, msglen);
+	buffer_write_u32(msg, (uint32_t)nsd->pid);
+	buffer_write_u32(msg, count);
+	udb_ptr_set_ptr(&t, u, xfrs2process);
+	while(!udb_ptr_is_null(&t)) {
+		buffer_write_u64(msg, TASKLIST(&t)->yesno);
+		buffer_write_u8(msg, TASKLIST(&t)->zname->name_size);
+		buffer_write(msg, dname_name(TASKLIST(&t)->zname),
+			TASKLIST(&t)->zname->name_size);
+		udb_ptr_set_rptr(&t, u, &TASKLIST(&t)->next);
+	}
+	buffer_flip(msg);
+	cmd = NSD_APPLY_XFR;
+	len = (uint32_t)buffer_limit(msg);
+	sent = (uint8_t*)region_alloc_zero(region, nsd->child_count+1);
+	for(i=0; i < nsd->child_count; i++) {
+		if(nsd->children[i].pid <= 0 ||
+			nsd->children[i].child_fd == -1 ||
+			nsd->children[i].need_to_exit)
+			continue;
+		if(!write_socket(nsd->children[i].child_fd, &cmd, sizeof(cmd))
+			|| !write_socket(nsd->children[i].child_fd, &len,
+			sizeof(len))
+			|| !write_socket(nsd->children[i].child_fd,
+			buffer_begin(msg), len)) {
+			log_msg(LOG_ERR, "reload-incremental: could not send "
+				"transfers to server %d: %s, restarting it",
+				(int)nsd->children[i].pid, strerror(errno));
+			kill(nsd->children[i].pid, SIGTERM);
+			continue;
+		}
+		sent[i] = 1;
+	}
+
+	/* apply them to the zones of this process, while the server
+	 * processes do the same */
+	failed = (zone_type**)region_alloc_array_zero(region, count,
+		sizeof(*failed));
+	udb_ptr_init(&next, u);
+	while(!udb_ptr_is_null(xfrs2process)) {
+		zone_type* zone = namedb_find_zone(nsd->db,
+			TASKLIST(xfrs2process)->zname);
+		udb_ptr_set_rptr(&next, u, &TASKLIST(xfrs2process)->next);
+		udb_rptr_zero(&TASKLIST(xfrs2process)->next, u);
+		if(!task_process_apply_xfr(nsd, u, xfrs2process))
+			failed[num_failed++] = zone;
+		udb_ptr_set_ptr(xfrs2process, u, &next);
+	}
+#ifdef NSEC3
+	nsec3_hash_pool_stop();
+#endif
+	/* xfrs2process, next and t are unlinked because they are null */
+	reload_new_soainfo(nsd, last_task);
+	for(i=0; i<num_failed; i++)
+		reload_incremental_reread_zone(nsd, failed[i], last_task);
+	namedb_ixfr_condense(nsd->db);
+#ifdef BIND8_STATS
+	nsd->stats_per_child[nsd->stat_current][0].db_mem =
+		region_get_mem(nsd->db->region);
+	namedb_ixfr_sizes(nsd->db,
+		&nsd->stats_per_child[nsd->stat_current][0].ixfr_mem,
+		&nsd->stats_per_child[nsd->stat_current][0].ixfr_disk,
+		&nsd->stats_per_child[nsd->stat_current][0].ixfr_condensed);
+#endif
+
+	/* the xfr files are removed by xfrd after the reload is done,
+	 * the server processes must have read them */
+	reload_incremental_wait_children(nsd, region, sent);
+	region_destroy(region);
+	if(num_failed > 0) {
+		/* the server processes have the zones as the transfers made
+		 * them, do the ordinary reload for new ones, the soainfo is
+		 * in the task list for it */
+		return 0;
+	}
+	reload_incremental_bytes += bytes;
+
+	udb_ptr_set(last_task, u, 0);
+	task_process_sync(u);
+	cmd = NSD_RELOAD_DONE;
+	if(!write_socket(nsd->xfrd_listener->fd, &cmd,  sizeof(cmd))) {
+		log_msg(LOG_ERR, "problems sending reload_done xfrd: %s",
+			strerror(errno));
+	}
+	mypid = getpid();
+	if(!write_socket(nsd->xfrd_listener->fd, &mypid,  sizeof(mypid))) {
+		log_msg(LOG_ERR, "problems sending reloadpid to xfrd: %s",
+			strerror(errno));
+	}
+	VERBOSITY(1, (LOG_INFO, "reload: %d xfrs of %llu bytes applied "
+		"incrementally", (int)count, (unsigned long long)bytes));
+	return 1;
+}
+
+/*
+ * Return the amount of memory, in kB, that this process does not share
+ * with other processes and has written to. For the reload process, right
+ * after the fork, that is the memory copied on write or newly allocated.
+ * Returns -1 if it cannot be determined (only Linux has smaps_rollup).
+ */
+static long
+reload_private_dirty_kb(void)
+{
+	char line[256];
+	long kb = -1;
+	FILE* in = fopen("/proc/self/smaps_rollup", "r");
+	if(!in)
+		return -1;
+	while(fgets(line, (int)sizeof(line), in)) {
+		if(strncmp(line, "Private_Dirty:", 14) == 0) {
+			kb = atol(line+14);
+			break;
+		}
+	}
+	fclose(in);
+	return kb;
+}
+
 static void server_verify(struct nsd *nsd, int cmdsocket,
 	struct sigaction* old_sigchld);
 
@@ -2531,9 +3152,6 @@ server_reload(struct nsd *nsd, region_type* server_region, netio_type* netio,
 	pid_t mypid;
 	sig_atomic_t cmd;
 	struct sigaction old_sigchld, ign_sigchld;
-	struct radnode* node;
-	zone_type* zone;
-	enum soainfo_hint hint;
 	struct quit_sync_event_data cb_data;
 	struct event signal_event, cmd_event;
 	struct timeval reload_sync_timeout;
@@ -2541,6 +3159,15 @@ server_reload(struct nsd *nsd, region_type* server_region, netio_type* netio,
 	/* For swapping filedescriptors from the serve childs to the xfrd
 	 * and/or the dnstap collector */
 	int *swap_fd_send;
+	/* memory no longer shared with the old processes, and db size,
+	 * at the start of the reload, if reload-cow-stats is enabled */
+	long cow_start_kb = -1;
+	size_t cow_start_db_mem = 0;
+
+	if(nsd->options->reload_cow_stats) {
+		cow_start_kb = reload_private_dirty_kb();
+		cow_start_db_mem = region_get_mem(nsd->db->region);
+	}
 
 	/* ignore SIGCHLD from the previous server_main that used this pid */
 	memset(&ign_sigchld, 0, sizeof(ign_sigchld));
@@ -2555,6 +3182,17 @@ server_reload(struct nsd *nsd, region_type* server_region, netio_type* netio,
 
 	/* see what tasks we got from xfrd */
 	xfrs_processed = reload_process_xfr_tasks(nsd, cmdsocket, xfrs2process);
+	/* the new server processes share the memory with this process */
+	reload_incremental_bytes = 0;
+	if(cow_start_kb != -1) {
+		long cow_kb = reload_private_dirty_kb();
+		size_t db_mem = region_get_mem(nsd->db->region);
+		if(cow_kb != -1)
+			log_msg(LOG_INFO, "reload: %d xfrs applied, %ld kB "
+				"private dirty memory, zone data grew by %ld kB",
+				(int)xfrs_processed, cow_kb - cow_start_kb,
+				((long)db_mem - (long)cow_start_db_mem)/1024);
+	}
 
 #ifndef NDEBUG
 	if(nsd_debug_level >= 1)
@@ -2591,40 +3229,24 @@ server_reload(struct nsd *nsd, region_type* server_region, netio_type* netio,
 #endif
 	}
 
-	if(xfrs_processed) for( node = radix_first(nsd->db->zonetree)
-	                      ; node != NULL; node = radix_next(node)) {
-
-		zone = (zone_type *)node->elem;
-		if(zone->is_updated) {
-			if(zone->is_bad) {
-				nsd->mode = NSD_RELOAD_FAILED;
-				hint = soainfo_bad;
-			} else {
-				hint = soainfo_ok;
-			}
-			/* update(s), verified or not, possibly with subsequent
-			   skipped update(s). skipped update(s) are picked up
-			   by failed update check in xfrd */
-			task_new_soainfo(nsd->task[nsd->mytask], last_task,
-			                 zone, hint);
-		} else if(zone->is_skipped) {
-			/* corrupt or inconsistent update without preceding
-			   update(s), communicate soainfo_gone */
-			task_new_soainfo(nsd->task[nsd->mytask], last_task,
-			                 zone, soainfo_gone);
-		}
-		zone->is_updated = 0;
-		zone->is_skipped = 0;
-	}
+	if(xfrs_processed)
+		reload_new_soainfo(nsd, last_task);
 
 	if(nsd->mode == NSD_RELOAD_FAILED) {
 		exit(NSD_RELOAD_FAILED);
 	}
+	/* the condensed IXFRs are made before the fork, the server
+	 * processes share them */
+	namedb_ixfr_condense(nsd->db);
 #ifdef BIND8_STATS
 	nsd->stats_per_child[nsd->stat_current][0].reloadcount =
 		nsd->stats_per_child[(nsd->stat_current==0?1:0)][0].reloadcount+1;
 	nsd->stats_per_child[nsd->stat_current][0].db_mem =
 		region_get_mem(nsd->db->region);
+	namedb_ixfr_sizes(nsd->db,
+		&nsd->stats_per_child[nsd->stat_current][0].ixfr_mem,
+		&nsd->stats_per_child[nsd->stat_current][0].ixfr_disk,
+		&nsd->stats_per_child[nsd->stat_current][0].ixfr_condensed);
 #endif
 
 	/* listen for the signals of failed children again */
@@ -2804,10 +3426,16 @@ server_main(struct nsd *nsd)
 	/* Add listener for the XFRD process */
 	netio_add_handler(netio, nsd->xfrd_listener);
 
+	/* the condensed IXFRs of the zones read at the start */
+	namedb_ixfr_condense(nsd->db);
+
 #ifdef BIND8_STATS
 	nsd->st = &nsd->stat_map[0];
+	nsd->resp = &nsd->resp_map[0];
 	nsd->st->db_disk = 0;
 	nsd->st->db_mem = region_get_mem(nsd->db->region);
+	namedb_ixfr_sizes(nsd->db, &nsd->st->ixfr_mem, &nsd->st->ixfr_disk,
+		&nsd->st->ixfr_condensed);
 #endif
 	memset(&xfrs2process, 0, sizeof(xfrs2process));
 	memset(&last_task, 0, sizeof(last_task));
@@ -3034,8 +3662,20 @@ server_main(struct nsd *nsd)
 			 * reload_process_non_xfr_tasks() may clear (and
 			 * implicitly unlink) xfrs2process.
 			 */
-			reload_process_non_xfr_tasks(nsd, &xfrs2process
-			                                , &last_task);
+			if(reload_process_non_xfr_tasks(nsd, &xfrs2process
+			                                , &last_task) == 0 &&
+			   reload_incremental(nsd, &xfrs2process, &last_task)) {
+				/* applied without a reload process */
+				close(reload_sockets[0]);
+				close(reload_sockets[1]);
+#ifdef HAVE_SETPROCTITLE
+				setproctitle("main");
+#endif
+#ifdef USE_LOG_PROCESS_ROLE
+				log_set_process_role("main");
+#endif
+				break;
+			}
 			/* Do actual reload */
 			reload_pid = fork();
 			switch (reload_pid) {
@@ -3239,9 +3879,11 @@ server_process_query_udp(struct nsd *nsd, struct query *query, uint32_t *now_p)
 	if(query_process(query, nsd, now_p) != QUERY_DISCARDED) {
 		if(query->edns.cookie_status != COOKIE_VALID
 		&& query->edns.cookie_status != COOKIE_VALID_REUSE
-		&& rrl_process_query(query))
+		&& rrl_process_query(query)) {
+			STATUP(nsd, ratelimited);
+			ZTATUP(nsd, query->zone, ratelimited);
 			return rrl_slip(query);
-		else	return QUERY_PROCESSED;
+		} else	return QUERY_PROCESSED;
 	}
 	return QUERY_DISCARDED;
 #else
@@ -3507,6 +4149,7 @@ static void server_verify(struct nsd *nsd, int cmdsocket,
 		msgs[i].msg_hdr.msg_iovlen = 1;
 		msgs[i].msg_hdr.msg_name = &queries[i]->remote_addr;
 		msgs[i].msg_hdr.msg_namelen = queries[i]->remote_addrlen;
+		udp_stamp_prepare(i);
 	}
 
 	for (size_t i = 0; i < nsd->verify_ifs; i++) {
@@ -3585,6 +4228,10 @@ server_child(struct nsd *nsd)
 #ifdef RATELIMIT
 	rrl_init(nsd->this_child->child_num);
 #endif
+	qtrace_init(nsd->this_child->child_num);
+#ifdef NSEC3
+	nsec3_proof_cache_init(nsd->options->nsec3_proof_cache_size);
+#endif
 
 	assert(nsd->server_kind != NSD_SERVER_MAIN);
 
@@ -3606,8 +4253,13 @@ server_child(struct nsd *nsd)
 #ifdef BIND8_STATS
 	nsd->st = &nsd->stats_per_child[nsd->stat_current]
 		[nsd->this_child->child_num];
+	nsd->resp = &nsd->resp_map[nsd->stat_current*nsd->child_count +
+		nsd->this_child->child_num];
 	nsd->st->boot = nsd->stat_map[0].boot;
 	memcpy(&nsd->stat_proc, nsd->st, sizeof(nsd->stat_proc));
+#ifdef RATELIMIT
+	rrl_set_stats(&nsd->st->rrlretry, &nsd->st->rrlevict);
+#endif
 #endif
 
 	if (!(nsd->server_kind & NSD_SERVER_TCP)) {
@@ -3662,6 +4314,7 @@ server_child(struct nsd *nsd)
 			msgs[i].msg_hdr.msg_iovlen  = 1;
 			msgs[i].msg_hdr.msg_name    = &queries[i]->remote_addr;
 			msgs[i].msg_hdr.msg_namelen = queries[i]->remote_addrlen;
+			udp_stamp_prepare(i);
 		}
 
 		for (i = 0; i < nsd->ifs; i++) {
@@ -3842,17 +4495,17 @@ service_remaining_tcp(struct nsd* nsd)
 {
 	struct tcp_handler_data* p;
 	struct event_base* event_base;
-	/* check if it is needed */
-	if(nsd->current_tcp_count == 0 || tcp_active_list == NULL)
-		return;
-	VERBOSITY(5, (LOG_INFO, "service remaining TCP connections"));
 #ifdef USE_DNSTAP
 	/* remove dnstap collector, we cannot write there because the new
 	 * child process is using the file descriptor, or the child
-	 * process after that. */
+	 * process after that. That also releases the ring of this child. */
 	dt_collector_destroy(nsd->dt_collector, nsd);
 	nsd->dt_collector = NULL;
 #endif
+	/* check if it is needed */
+	if(nsd->current_tcp_count == 0 || tcp_active_list == NULL)
+		return;
+	VERBOSITY(5, (LOG_INFO, "service remaining TCP connections"));
 	/* setup event base */
 	event_base = nsd_child_event_base();
 	if(!event_base) {
@@ -4173,6 +4826,61 @@ done:
 	return 1;
 }
 
+#ifdef BIND8_STATS
+/* time for the latency statistics, monotonic if possible */
+static void
+stat_clock(struct timespec* t)
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	if(clock_gettime(CLOCK_MONOTONIC, t) == 0)
+		return;
+#endif
+	get_time(t);
+}
+
+/* time for the UDP latency statistics, on the clock of the kernel stamps
+ * of the received packets */
+static void
+udp_stat_clock(struct timespec* t)
+{
+#ifdef SO_TIMESTAMPNS
+	get_time(t);
+#else
+	stat_clock(t);
+#endif
+}
+
+/* account the time from start to end for a query that has been sent */
+static void
+stat_latency(struct nsd* nsd, struct timespec* start, struct timespec* end)
+{
+	uint64_t usec = 0;
+	int b = 0;
+	if(end->tv_sec > start->tv_sec || (end->tv_sec == start->tv_sec &&
+		end->tv_nsec > start->tv_nsec))
+		usec = (uint64_t)(end->tv_sec - start->tv_sec)*1000000 +
+			((int64_t)end->tv_nsec - (int64_t)start->tv_nsec)/1000;
+	while(b < STAT_LATENCY_BUCKETS-1 && usec >= ((uint64_t)1<<b))
+		b++;
+	nsd->resp->latency[b]++;
+	nsd->resp->latency_sum += usec;
+}
+
+/* account the answer in the per transport and response size counters */
+static void
+stat_response(struct nsd* nsd, struct query* q, int tp, size_t len)
+{
+	int b = 0;
+	while(b < STAT_RESPSIZE_BUCKETS-1 &&
+		len >= ((size_t)1<<(b+STAT_RESPSIZE_SHIFT)))
+		b++;
+	nsd->resp->qtype_tp[tp][q->qtype <= 255 ? q->qtype : 256]++;
+	nsd->resp->rcode_tp[tp][RCODE(q->packet)]++;
+	nsd->resp->respsize[b]++;
+	nsd->resp->respsize_sum += len;
+}
+#endif /* BIND8_STATS */
+
 static void
 handle_udp(int fd, short event, void* arg)
 {
@@ -4180,6 +4888,12 @@ handle_udp(int fd, short event, void* arg)
 	int received, sent, recvcount, i;
 	struct query *q;
 	uint32_t now = 0;
+#ifdef BIND8_STATS
+	struct timespec recvtime, sendtime;
+	int recvnum;
+#endif
+	struct timespec tracetime;
+	int tracing;
 
 	if (!(event & EV_READ)) {
 		return;
@@ -4196,8 +4910,17 @@ handle_udp(int fd, short event, void* arg)
 		/* Simply no data available */
 		return;
 	}
+#ifdef BIND8_STATS
+	udp_stat_clock(&recvtime);
+	recvnum = recvcount;
+#endif
+	if ((tracing = QTRACE_ACTIVE()))
+		qtrace_clock(&tracetime);
 	for (i = 0; i < recvcount; i++) {
 	loopstart:
+#ifdef BIND8_STATS
+		udp_stamp_get(i, &recvtime);
+#endif
 		received = msgs[i].msg_len;
 		queries[i]->remote_addrlen = msgs[i].msg_hdr.msg_namelen;
 		queries[i]->client_addrlen = (socklen_t)sizeof(queries[i]->client_addr);
@@ -4244,20 +4967,26 @@ handle_udp(int fd, short event, void* arg)
 			memmove(&q->client_addr, &q->remote_addr,
 				q->remote_addrlen);
 		}
+		if(tracing)
+			qtrace_begin(q, &tracetime);
 #ifdef USE_DNSTAP
-		/*
-		 * sending UDP-query with server address (local) and client address to dnstap process
-		 */
-		log_addr("query from client", &q->client_addr);
-		log_addr("to server (local)", (void*)&data->socket->addr.ai_addr);
-		if(verbosity >= 6 && q->is_proxied)
-			log_addr("query via proxy", &q->remote_addr);
-		dt_collector_submit_auth_query(data->nsd, (void*)&data->socket->addr.ai_addr, &q->client_addr, q->client_addrlen,
-			q->tcp, q->packet);
+		if(dt_collector_log_query(data->nsd, q, STAT_UDP)) {
+			/*
+			 * sending UDP-query with server address (local) and client address to dnstap process
+			 */
+			log_addr("query from client", &q->client_addr);
+			log_addr("to server (local)", (void*)&data->socket->addr.ai_addr);
+			if(verbosity >= 6 && q->is_proxied)
+				log_addr("query via proxy", &q->remote_addr);
+			dt_collector_submit_auth_query(data->nsd, (void*)&data->socket->addr.ai_addr, &q->client_addr, q->client_addrlen,
+				q->tcp, q->packet);
+		}
 #endif /* USE_DNSTAP */
 
 		/* Process and answer the query... */
 		if (server_process_query_udp(data->nsd, q, &now) != QUERY_DISCARDED) {
+			if (q->trace.on)
+				qtrace_process_done(q);
 			if (RCODE(q->packet) == RCODE_OK && !AA(q->packet)) {
 				STATUP(data->nsd, nona);
 				ZTATUP(data->nsd, q->zone, nona);
@@ -4284,18 +5013,22 @@ handle_udp(int fd, short event, void* arg)
 				STATUP(data->nsd, truncated);
 				ZTATUP(data->nsd, q->zone, truncated);
 			}
+			stat_response(data->nsd, q, STAT_UDP, iovecs[i].iov_len);
 #endif /* BIND8_STATS */
 #ifdef USE_DNSTAP
-			/*
-			 * sending UDP-response with server address (local) and client address to dnstap process
-			 */
-			log_addr("from server (local)", (void*)&data->socket->addr.ai_addr);
-			log_addr("response to client", &q->client_addr);
-			if(verbosity >= 6 && q->is_proxied)
-				log_addr("response via proxy", &q->remote_addr);
-			dt_collector_submit_auth_response(data->nsd, (void*)&data->socket->addr.ai_addr,
-				&q->client_addr, q->client_addrlen, q->tcp, q->packet,
-				q->zone);
+			if(dt_collector_log_response(data->nsd,
+				(void*)&data->socket->addr.ai_addr, q)) {
+				/*
+				 * sending UDP-response with server address (local) and client address to dnstap process
+				 */
+				log_addr("from server (local)", (void*)&data->socket->addr.ai_addr);
+				log_addr("response to client", &q->client_addr);
+				if(verbosity >= 6 && q->is_proxied)
+					log_addr("response via proxy", &q->remote_addr);
+				dt_collector_submit_auth_response(data->nsd, (void*)&data->socket->addr.ai_addr,
+					&q->client_addr, q->client_addrlen, q->tcp, q->packet,
+					q->zone);
+			}
 #endif /* USE_DNSTAP */
 		} else {
 			query_reset(queries[i], UDP_MAX_MESSAGE_LEN, 0);
@@ -4384,11 +5117,32 @@ handle_udp(int fd, short event, void* arg)
 		}
 		i += sent;
 	}
+#ifdef BIND8_STATS
+	if(i > 0) {
+		int j;
+		udp_stat_clock(&sendtime);
+		for(j=0; j<i; j++)
+			stat_latency(data->nsd, &recvstamps[j], &sendtime);
+	}
+#endif /* BIND8_STATS */
+	if(tracing) {
+		int j;
+		for(j=0; j<i; j++) {
+			if(queries[j]->trace.on)
+				qtrace_finish(queries[j], STAT_UDP,
+					iovecs[j].iov_len);
+		}
+	}
 	for(i=0; i<recvcount; i++) {
 		query_reset(queries[i], UDP_MAX_MESSAGE_LEN, 0);
 		iovecs[i].iov_len = buffer_remaining(queries[i]->packet);
 		msgs[i].msg_hdr.msg_namelen = queries[i]->remote_addrlen;
 	}
+#ifdef BIND8_STATS
+	/* also the dropped ones, that have been swapped to the end */
+	for(i=0; i<recvnum; i++)
+		udp_stamp_prepare(i);
+#endif
 }
 
 #ifdef HAVE_SSL
@@ -4458,6 +5212,107 @@ cleanup_tcp_handler(struct tcp_handler_data* data)
 	region_destroy(data->region);
 }
 
+/* stop the zone transfers that are sent out for the zone, they walk the
+ * zone data that is changed */
+static void
+server_stop_zone_transfers(struct zone* zone)
+{
+	struct tcp_handler_data* p, *next;
+	for(p = tcp_active_list; p != NULL; p = next) {
+		next = p->next;
+		if((p->query_state == QUERY_IN_AXFR ||
+			p->query_state == QUERY_IN_IXFR) &&
+			(p->query->axfr_zone == zone ||
+			p->query->zone == zone)) {
+			VERBOSITY(2, (LOG_INFO, "stop zone transfer of %s, "
+				"the zone is updated", zone->opts->name));
+			cleanup_tcp_handler(p);
+		}
+	}
+}
+
+void
+server_child_apply_xfrs(struct nsd* nsd, int fd)
+{
+	sig_atomic_t cmd = NSD_APPLY_XFR;
+	uint32_t len, mainpid, count, i;
+	int verb = verbosity;
+	int hash_cache = nsd->db->nsec3_hash_cache;
+	int hash_procs = nsd->db->nsec3_precompile_processes;
+	region_type* region;
+	buffer_type* msg;
+	struct dname_buffer zname;
+
+	if(block_read(nsd, fd, &len, sizeof(len), RELOAD_INCREMENTAL_TIMEOUT)
+		!= sizeof(len)) {
+		log_msg(LOG_ERR, "server %d: could not read the transfers "
+			"from main, exit", (int)getpid());
+		exit(1);
+	}
+	region = region_create(xalloc, free);
+	msg = buffer_create(region, len);
+	if(block_read(nsd, fd, buffer_begin(msg), len,
+		RELOAD_INCREMENTAL_TIMEOUT) != (ssize_t)len) {
+		log_msg(LOG_ERR, "server %d: could not read the transfers "
+			"from main, exit", (int)getpid());
+		exit(1);
+	}
+	buffer_set_limit(msg, len);
+	mainpid = buffer_read_u32(msg);
+	count = buffer_read_u32(msg);
+
+	/* the main process logs the transfers, and writes the nsec3 hash
+	 * cache. Every server process applies them, they do not each fork
+	 * hash processes */
+	verbosity = 0;
+	nsd->db->nsec3_hash_cache = 0;
+	nsd->db->nsec3_precompile_processes = 1;
+	for(i=0; i<count; i++) {
+		uint64_t filenumber = buffer_read_u64(msg);
+		uint8_t namelen = buffer_read_u8(msg);
+		zone_type* zone;
+		int ret;
+		if(!dname_make_buffered(&zname, buffer_current(msg), 0)) {
+			verbosity = verb;
+			log_msg(LOG_ERR, "server %d: bad zone name for "
+				"transfer, exit", (int)getpid());
+			exit(1);
+		}
+		buffer_skip(msg, namelen);
+		zone = namedb_find_zone(nsd->db, (dname_type*)&zname);
+		if(zone)
+			server_stop_zone_transfers(zone);
+		/* the pid of main names the directory of the xfr files */
+		nsd->pid = (pid_t)mainpid;
+		ret = apply_xfrfile(nsd, (dname_type*)&zname, filenumber, NULL);
+		nsd->pid = 0;
+		if(ret == 0 || ret == -1) {
+			verbosity = verb;
+			log_msg(LOG_ERR, "server %d: could not apply the "
+				"transfer for %s, exit", (int)getpid(),
+				dname_to_string((dname_type*)&zname, NULL));
+			exit(1);
+		}
+		if(zone) {
+			zone->is_updated = 0;
+			zone->is_skipped = 0;
+		}
+	}
+	namedb_ixfr_condense(nsd->db);
+	verbosity = verb;
+	nsd->db->nsec3_hash_cache = hash_cache;
+	nsd->db->nsec3_precompile_processes = hash_procs;
+	region_destroy(region);
+#ifdef NSEC3
+	/* the cached proofs point into the old zone data */
+	nsec3_proof_cache_init(nsd->options->nsec3_proof_cache_size);
+#endif
+	if(!write_socket(fd, &cmd, sizeof(cmd))) {
+		log_msg(LOG_ERR, "server %d: could not reply to main: %s",
+			(int)getpid(), strerror(errno));
+	}
+}
+
 /* Read more data into the buffer for tcp read. Pass the amount of additional
  * data required. Returns false if nothing needs to be done this event, or
  * true if the additional data is in the buffer. */
@@ -4685,7 +5540,14 @@ handle_tcp_reading(int fd, short event, void* arg)
 		STATUP(data->nsd, ctcp6);
 	}
 #endif
+	stat_clock(&data->query_start);
+	data->latency_pending = 1;
 #endif /* BIND8_STATS */
+	if (QTRACE_ACTIVE()) {
+		struct timespec tracetime;
+		qtrace_clock(&tracetime);
+		qtrace_begin(data->query, &tracetime);
+	}
 
 	/* We have a complete query, process it.  */
 
@@ -4694,15 +5556,17 @@ handle_tcp_reading(int fd, short event, void* arg)
 
 	buffer_flip(data->query->packet);
 #ifdef USE_DNSTAP
-	/*
-	 * and send TCP-query with found address (local) and client address to dnstap process
-	 */
-	log_addr("query from client", &data->query->client_addr);
-	log_addr("to server (local)", (void*)&data->socket->addr.ai_addr);
-	if(verbosity >= 6 && data->query->is_proxied)
-		log_addr("query via proxy", &data->query->remote_addr);
-	dt_collector_submit_auth_query(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->client_addr,
-		data->query->client_addrlen, data->query->tcp, data->query->packet);
+	if(dt_collector_log_query(data->nsd, data->query, STAT_TCP)) {
+		/*
+		 * and send TCP-query with found address (local) and client address to dnstap process
+		 */
+		log_addr("query from client", &data->query->client_addr);
+		log_addr("to server (local)", (void*)&data->socket->addr.ai_addr);
+		if(verbosity >= 6 && data->query->is_proxied)
+			log_addr("query via proxy", &data->query->remote_addr);
+		dt_collector_submit_auth_query(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->client_addr,
+			data->query->client_addrlen, data->query->tcp, data->query->packet);
+	}
 #endif /* USE_DNSTAP */
 	data->query_state = server_process_query(data->nsd, data->query, &now);
 	if (data->query_state == QUERY_DISCARDED) {
@@ -4712,6 +5576,8 @@ handle_tcp_reading(int fd, short event, void* arg)
 		cleanup_tcp_handler(data);
 		return;
 	}
+	if (data->query->trace.on)
+		qtrace_process_done(data->query);
 
 #ifdef BIND8_STATS
 	if (RCODE(data->query->packet) == RCODE_OK
@@ -4747,18 +5613,23 @@ handle_tcp_reading(int fd, short event, void* arg)
 		STATUP(data->nsd, truncated);
 		ZTATUP(data->nsd, data->query->zone, truncated);
 	}
+	stat_response(data->nsd, data->query, STAT_TCP,
+		data->query->tcplen);
 #endif /* BIND8_STATS */
 #ifdef USE_DNSTAP
-	/*
-	 * sending TCP-response with found (earlier) address (local) and client address to dnstap process
-	 */
-	log_addr("from server (local)", (void*)&data->socket->addr.ai_addr);
-	log_addr("response to client", &data->query->client_addr);
-	if(verbosity >= 6 && data->query->is_proxied)
-		log_addr("response via proxy", &data->query->remote_addr);
-	dt_collector_submit_auth_response(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->client_addr,
-		data->query->client_addrlen, data->query->tcp, data->query->packet,
-		data->query->zone);
+	if(dt_collector_log_response(data->nsd,
+		(void*)&data->socket->addr.ai_addr, data->query)) {
+		/*
+		 * sending TCP-response with found (earlier) address (local) and client address to dnstap process
+		 */
+		log_addr("from server (local)", (void*)&data->socket->addr.ai_addr);
+		log_addr("response to client", &data->query->client_addr);
+		if(verbosity >= 6 && data->query->is_proxied)
+			log_addr("response via proxy", &data->query->remote_addr);
+		dt_collector_submit_auth_response(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->client_addr,
+			data->query->client_addrlen, data->query->tcp, data->query->packet,
+			data->query->zone);
+	}
 #endif /* USE_DNSTAP */
 	data->bytes_transmitted = 0;
 
@@ -4901,6 +5772,16 @@ handle_tcp_writing(int fd, short event, void* arg)
 	}
 
 	assert(data->bytes_transmitted == q->tcplen + sizeof(q->tcplen));
+#ifdef BIND8_STATS
+	if(data->latency_pending) {
+		struct timespec end;
+		data->latency_pending = 0;
+		stat_clock(&end);
+		stat_latency(data->nsd, &data->query_start, &end);
+	}
+#endif /* BIND8_STATS */
+	if(q->trace.on)
+		qtrace_finish(q, STAT_TCP, q->tcplen);
 
 	if (data->query_state == QUERY_IN_AXFR ||
 		data->query_state == QUERY_IN_IXFR) {
@@ -5301,6 +6182,15 @@ handle_tls_reading(int fd, short event, void* arg)
 		STATUP(data->nsd, ctls6);
 	}
 #endif
+#ifdef BIND8_STATS
+	stat_clock(&data->query_start);
+	data->latency_pending = 1;
+#endif /* BIND8_STATS */
+	if (QTRACE_ACTIVE()) {
+		struct timespec tracetime;
+		qtrace_clock(&tracetime);
+		qtrace_begin(data->query, &tracetime);
+	}
 
 	/* We have a complete query, process it.  */
 
@@ -5309,15 +6199,17 @@ handle_tls_reading(int fd, short event, void* arg)
 
 	buffer_flip(data->query->packet);
 #ifdef USE_DNSTAP
-	/*
-	 * and send TCP-query with found address (local) and client address to dnstap process
-	 */
-	log_addr("query from client", &data->query->client_addr);
-	log_addr("to server (local)", (void*)&data->socket->addr.ai_addr);
-	if(verbosity >= 6 && data->query->is_proxied)
-		log_addr("query via proxy", &data->query->remote_addr);
-	dt_collector_submit_auth_query(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->client_addr,
-		data->query->client_addrlen, data->query->tcp, data->query->packet);
+	if(dt_collector_log_query(data->nsd, data->query, STAT_TLS)) {
+		/*
+		 * and send TCP-query with found address (local) and client address to dnstap process
+		 */
+		log_addr("query from client", &data->query->client_addr);
+		log_addr("to server (local)", (void*)&data->socket->addr.ai_addr);
+		if(verbosity >= 6 && data->query->is_proxied)
+			log_addr("query via proxy", &data->query->remote_addr);
+		dt_collector_submit_auth_query(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->client_addr,
+			data->query->client_addrlen, data->query->tcp, data->query->packet);
+	}
 #endif /* USE_DNSTAP */
 	data->query_state = server_process_query(data->nsd, data->query, &now);
 	if (data->query_state == QUERY_DISCARDED) {
@@ -5327,6 +6219,8 @@ handle_tls_reading(int fd, short event, void* arg)
 		cleanup_tcp_handler(data);
 		return;
 	}
+	if (data->query->trace.on)
+		qtrace_process_done(data->query);
 
 #ifdef BIND8_STATS
 	if (RCODE(data->query->packet) == RCODE_OK
@@ -5362,18 +6256,23 @@ handle_tls_reading(int fd, short event, void* arg)
 		STATUP(data->nsd, truncated);
 		ZTATUP(data->nsd, data->query->zone, truncated);
 	}
+	stat_response(data->nsd, data->query, STAT_TLS,
+		data->query->tcplen);
 #endif /* BIND8_STATS */
 #ifdef USE_DNSTAP
-	/*
-	 * sending TCP-response with found (earlier) address (local) and client address to dnstap process
-	 */
-	log_addr("from server (local)", (void*)&data->socket->addr.ai_addr);
-	log_addr("response to client", &data->query->client_addr);
-	if(verbosity >= 6 && data->query->is_proxied)
-		log_addr("response via proxy", &data->query->remote_addr);
-	dt_collector_submit_auth_response(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->client_addr,
-		data->query->client_addrlen, data->query->tcp, data->query->packet,
-		data->query->zone);
+	if(dt_collector_log_response(data->nsd,
+		(void*)&data->socket->addr.ai_addr, data->query)) {
+		/*
+		 * sending TCP-response with found (earlier) address (local) and client address to dnstap process
+		 */
+		log_addr("from server (local)", (void*)&data->socket->addr.ai_addr);
+		log_addr("response to client", &data->query->client_addr);
+		if(verbosity >= 6 && data->query->is_proxied)
+			log_addr("response via proxy", &data->query->remote_addr);
+		dt_collector_submit_auth_response(data->nsd, (void*)&data->socket->addr.ai_addr, &data->query->client_addr,
+			data->query->client_addrlen, data->query->tcp, data->query->packet,
+			data->query->zone);
+	}
 #endif /* USE_DNSTAP */
 	data->bytes_transmitted = 0;
 
@@ -5494,6 +6393,16 @@ handle_tls_writing(int fd, short event, void* arg)
 	}
 
 	assert(data->bytes_transmitted == q->tcplen + sizeof(q->tcplen));
+#ifdef BIND8_STATS
+	if(data->latency_pending) {
+		struct timespec end;
+		data->latency_pending = 0;
+		stat_clock(&end);
+		stat_latency(data->nsd, &data->query_start, &end);
+	}
+#endif /* BIND8_STATS */
+	if(q->trace.on)
+		qtrace_finish(q, STAT_TLS, q->tcplen);
 
 	if (data->query_state == QUERY_IN_AXFR ||
 		data->query_state == QUERY_IN_IXFR) {
@@ -0,0 +1,138 @@
+/*
+	test the server cookies of edns.h
+*/
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "tpkg/cutest/cutest.h"
+#include "nsd.h"
+#include "query.h"
+#include "edns.h"
+
+static void cookie_1(CuTest *tc);
+static void cookie_2(CuTest *tc);
+
+CuSuite* reg_cutest_cookie(void)
+{
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, cookie_1);
+	SUITE_ADD_TEST(suite, cookie_2);
+	return suite;
+}
+
+int siphash(const uint8_t *in, const size_t inlen,
+	const uint8_t *k, uint8_t *out, const size_t outlen);
+
+/* siphash gives the first test vector of the reference implementation */
+static void cookie_1(CuTest *tc)
+{
+	uint8_t key[16], out[8];
+	size_t i;
+
+	for(i=0; i<sizeof(key); i++)
+		key[i] = (uint8_t)i;
+	siphash(key, 0, key, out, 8);
+	CuAssert(tc, "vector", out[0] == 0x31 && out[1] == 0x0e &&
+		out[7] == 0x72);
+}
+
+/* make a query from a client with the cookie of an earlier answer */
+static void
+cookie_query(struct query* q, const uint8_t* cookie)
+{
+	struct sockaddr_in* sa = (struct sockaddr_in*)&q->client_addr;
+	memset(q, 0, sizeof(*q));
+	sa->sin_family = AF_INET;
+	inet_pton(AF_INET, "192.0.2.1", &sa->sin_addr);
+	q->edns.cookie_status = COOKIE_UNVERIFIED;
+	q->edns.cookie_len = 24;
+	memcpy(q->edns.cookie, cookie, 24);
+}
+
+/* server cookies are made and verified, with the secret history */
+static void cookie_2(CuTest *tc)
+{
+	struct nsd nsd;
+#ifdef BIND8_STATS
+	struct nsdst st;
+#endif
+	struct query q;
+	uint8_t cookie[24];
+	uint32_t now;
+	size_t i;
+
+	memset(&nsd, 0, sizeof(nsd));
+#ifdef BIND8_STATS
+	memset(&st, 0, sizeof(st));
+	nsd.st = &st;
+#endif
+	nsd.cookie_count = 2;
+	for(i=0; i<NSD_COOKIE_SECRET_SIZE; i++) {
+		nsd.cookie_secrets[0].cookie_secret[i] = (uint8_t)i;
+		nsd.cookie_secrets[1].cookie_secret[i] = (uint8_t)(i+100);
+	}
+
+	/* the answer gets a server cookie an hour ago */
+	memset(cookie, 0, sizeof(cookie));
+	memcpy(cookie, "clientck", 8);
+	now = (uint32_t)time(NULL) - 3000;
+	cookie_query(&q, cookie);
+	cookie_create(&q, &nsd, &now);
+	memcpy(cookie, q.edns.cookie, 24);
+
+	now = 0;
+	cookie_query(&q, cookie);
+	cookie_verify(&q, &nsd, &now);
+	CuAssert(tc, "valid", q.edns.cookie_status == COOKIE_VALID);
+
+	/* a new cookie is reused */
+	now = (uint32_t)time(NULL) - 10;
+	cookie_query(&q, cookie);
+	cookie_create(&q, &nsd, &now);
+	memcpy(cookie, q.edns.cookie, 24);
+	now = 0;
+	cookie_query(&q, cookie);
+	cookie_verify(&q, &nsd, &now);
+	CuAssert(tc, "reuse", q.edns.cookie_status == COOKIE_VALID_REUSE);
+
+	/* after a rollover it verifies with the old secret */
+	memcpy(nsd.cookie_secrets[1].cookie_secret,
+		nsd.cookie_secrets[0].cookie_secret, NSD_COOKIE_SECRET_SIZE);
+	for(i=0; i<NSD_COOKIE_SECRET_SIZE; i++)
+		nsd.cookie_secrets[0].cookie_secret[i] = (uint8_t)(i+200);
+	cookie_query(&q, cookie);
+	cookie_verify(&q, &nsd, &now);
+	CuAssert(tc, "old secret", q.edns.cookie_status == COOKIE_VALID);
+
+	/* and not when the old secret is dropped */
+	nsd.cookie_count = 1;
+	cookie_query(&q, cookie);
+	cookie_verify(&q, &nsd, &now);
+	CuAssert(tc, "dropped", q.edns.cookie_status == COOKIE_INVALID);
+
+	/* a changed hash, and a cookie that is too old */
+	nsd.cookie_count = 2;
+	cookie[23] ^= 1;
+	cookie_query(&q, cookie);
+	cookie_verify(&q, &nsd, &now);
+	CuAssert(tc, "bad hash", q.edns.cookie_status == COOKIE_INVALID);
+	cookie[23] ^= 1;
+	now += 7200;
+	cookie_query(&q, cookie);
+	cookie_verify(&q, &nsd, &now);
+	CuAssert(tc, "too old", q.edns.cookie_status == COOKIE_INVALID);
+
+#ifdef BIND8_STATS
+	CuAssert(tc, "counters", st.cookievalid == 2 && st.cookiereuse == 1
+		&& st.cookieinvalid == 3);
+#endif
+}
@@ -0,0 +1,392 @@
+/*
+	test the compression and the condensing of the stored versions in
+	ixfr.h
+*/
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tpkg/cutest/cutest.h"
+#include "util.h"
+#include "nsd.h"
+#include "ixfr.h"
+
+static void ixfr_z_1(CuTest *tc);
+static void ixfr_z_2(CuTest *tc);
+static void ixfr_c_1(CuTest *tc);
+static void ixfr_c_2(CuTest *tc);
+static void ixfr_c_3(CuTest *tc);
+
+CuSuite* reg_cutest_ixfr(void)
+{
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, ixfr_z_1);
+	SUITE_ADD_TEST(suite, ixfr_z_2);
+	SUITE_ADD_TEST(suite, ixfr_c_1);
+	SUITE_ADD_TEST(suite, ixfr_c_2);
+	SUITE_ADD_TEST(suite, ixfr_c_3);
+	return suite;
+}
+
+/* compress and decompress the data, return the compressed length */
+static size_t
+z_roundtrip(CuTest *tc, const uint8_t* in, size_t len)
+{
+	uint8_t* z = xalloc(ixfr_compress_bound(len));
+	uint8_t* out = xalloc(len+1);
+	size_t zlen = ixfr_compress(in, len, z);
+	CuAssert(tc, "bound", zlen <= ixfr_compress_bound(len));
+	CuAssert(tc, "decompress", ixfr_decompress(z, zlen, out, len));
+	CuAssert(tc, "same", len == 0 || memcmp(in, out, len) == 0);
+	/* the length of the output must be the one stored */
+	if(len > 0)
+		CuAssert(tc, "shorter", !ixfr_decompress(z, zlen, out, len-1));
+	CuAssert(tc, "longer", !ixfr_decompress(z, zlen, out, len+1));
+	free(z);
+	free(out);
+	return zlen;
+}
+
+/* make RRs in wireformat like the stored versions have */
+static size_t
+z_make_rrs(uint8_t* buf, size_t num)
+{
+	static const uint8_t rr[] = { 3, 'w', 'w', 'w', 7, 'e', 'x', 'a',
+		'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0, 0, 1, 0, 1,
+		0, 0, 0x0e, 0x10, 0, 4, 192, 0, 2, 0 };
+	size_t i, len = 0;
+	for(i=0; i<num; i++) {
+		memcpy(buf+len, rr, sizeof(rr));
+		buf[len+1] = (uint8_t)('a'+i%26);
+		buf[len+sizeof(rr)-1] = (uint8_t)i;
+		len += sizeof(rr);
+	}
+	return len;
+}
+
+/* the data is the same after compression */
+static void ixfr_z_1(CuTest *tc)
+{
+	uint8_t buf[100000];
+	size_t i, len;
+	unsigned int r = 12345;
+
+	/* empty and short data */
+	memcpy(buf, "abc", 3);
+	z_roundtrip(tc, buf, 0);
+	z_roundtrip(tc, buf, 3);
+	memcpy(buf, "abcdabcd", 8);
+	z_roundtrip(tc, buf, 8);
+
+	/* RRs get smaller */
+	len = z_make_rrs(buf, 1000);
+	CuAssert(tc, "rrs", z_roundtrip(tc, buf, len) < len/2);
+
+	/* a long run, with an overlapping match */
+	memset(buf, 'x', sizeof(buf));
+	CuAssert(tc, "run", z_roundtrip(tc, buf, sizeof(buf)) < 1000);
+
+	/* random data, with long literals */
+	for(i=0; i<sizeof(buf); i++) {
+		r = r*1103515245 + 12345;
+		buf[i] = (uint8_t)(r>>16);
+	}
+	z_roundtrip(tc, buf, sizeof(buf));
+	for(len=1; len<300; len+=7)
+		z_roundtrip(tc, buf, len);
+}
+
+/* bad compressed data is not accepted */
+static void ixfr_z_2(CuTest *tc)
+{
+	uint8_t buf[10000], out[10000];
+	uint8_t* z = xalloc(ixfr_compress_bound(sizeof(buf)));
+	size_t len, zlen, i;
+
+	len = z_make_rrs(buf, 100);
+	zlen = ixfr_compress(buf, len, z);
+	for(i=0; i<zlen; i++)
+		CuAssert(tc, "truncated", !ixfr_decompress(z, i, out, len));
+
+	/* an offset before the start of the data */
+	z[0] = 0x10;
+	z[1] = 'a';
+	z[2] = 2;
+	z[3] = 0;
+	z[4] = 0;
+	CuAssert(tc, "offset", !ixfr_decompress(z, 5, out, sizeof(out)));
+	z[2] = 0;
+	CuAssert(tc, "offset 0", !ixfr_decompress(z, 5, out, sizeof(out)));
+	z[2] = 1;
+	CuAssert(tc, "offset 1", ixfr_decompress(z, 5, out, 5) &&
+		memcmp(out, "aaaaa", 5) == 0);
+	free(z);
+}
+
+/* make an RR in wireformat, owner in text, an A record or with serial
+ * the SOA record. Returns the length. */
+static size_t
+c_make_rr(uint8_t* buf, const char* owner, uint16_t type, uint32_t ttl,
+	uint32_t val)
+{
+	size_t len = 0, rdlen;
+	const char* p = owner;
+	while(*p) {
+		const char* dot = strchr(p, '.');
+		size_t lablen = (dot?(size_t)(dot-p):strlen(p));
+		buf[len++] = (uint8_t)lablen;
+		memcpy(buf+len, p, lablen);
+		len += lablen;
+		p += lablen + (dot?1:0);
+	}
+	buf[len++] = 0;
+	rdlen = (type == TYPE_SOA ? 2+20 : 4);
+	write_uint16(buf+len, type);
+	write_uint16(buf+len+2, CLASS_IN);
+	write_uint32(buf+len+4, ttl);
+	write_uint16(buf+len+8, (uint16_t)rdlen);
+	len += 10;
+	memset(buf+len, 0, rdlen);
+	if(type == TYPE_SOA)
+		write_uint32(buf+len+2, val);
+	else	write_uint32(buf+len, val);
+	return len + rdlen;
+}
+
+/* the length of the RR in wireformat */
+static size_t
+c_rr_len(const uint8_t* rr)
+{
+	size_t len = 0;
+	while(rr[len] != 0)
+		len += rr[len] + 1;
+	len += 1;
+	return len + 10 + read_uint16(rr+len+8);
+}
+
+/* an RR to put in a version, the owner, TTL and address */
+struct c_rr {
+	const char* owner;
+	uint32_t ttl;
+	uint32_t addr;
+};
+
+/* put the RRs and then the SOA record in a new buffer */
+static uint8_t*
+c_make_rrs(const struct c_rr* rrs, size_t num, uint32_t serial,
+	size_t* len)
+{
+	uint8_t* buf = xalloc(num*300 + 300);
+	size_t i;
+	*len = 0;
+	for(i=0; i<num; i++)
+		*len += c_make_rr(buf+*len, rrs[i].owner, TYPE_A, rrs[i].ttl,
+			rrs[i].addr);
+	*len += c_make_rr(buf+*len, "example.com", TYPE_SOA, 3600, serial);
+	return buf;
+}
+
+/* add a version to the ixfr, from serial to serial+1. If compress, the
+ * RRs are stored compressed. */
+static void
+c_add_version(struct zone_ixfr* ixfr, uint32_t serial,
+	const struct c_rr* del, size_t delnum,
+	const struct c_rr* add, size_t addnum, int compress)
+{
+	struct ixfr_data* data = xalloc_zero(sizeof(*data));
+	data->oldserial = serial;
+	data->newserial = serial+1;
+	data->oldsoa = c_make_rrs(NULL, 0, serial, &data->oldsoa_len);
+	data->newsoa = c_make_rrs(NULL, 0, serial+1, &data->newsoa_len);
+	data->del = c_make_rrs(del, delnum, serial+1, &data->del_len);
+	data->add = c_make_rrs(add, addnum, serial+1, &data->add_len);
+	if(compress) {
+		size_t len = data->del_len + data->add_len;
+		uint8_t* buf = xalloc(len);
+		memcpy(buf, data->del, data->del_len);
+		memcpy(buf+data->del_len, data->add, data->add_len);
+		data->zdata = xalloc(ixfr_compress_bound(len));
+		data->zdata_len = ixfr_compress(buf, len, data->zdata);
+		free(buf);
+		free(data->del);
+		free(data->add);
+		data->del = NULL;
+		data->add = NULL;
+	}
+	zone_ixfr_add(ixfr, data, 1, "example.com");
+}
+
+/* check that the RRs, before the SOA record, are the RRs in the list */
+static void
+c_check_rrs(CuTest* tc, const uint8_t* rrs, size_t len, uint32_t serial,
+	const struct c_rr* want, size_t num)
+{
+	uint8_t rr[300], soa[300];
+	size_t soalen = c_make_rr(soa, "example.com", TYPE_SOA, 3600, serial);
+	size_t i, pos, count = 0;
+	/* the RRs end with the SOA record of the newest version */
+	CuAssert(tc, "soa at end", len >= soalen &&
+		memcmp(rrs+len-soalen, soa, soalen) == 0);
+	for(pos = 0; pos < len-soalen; pos += c_rr_len(rrs+pos))
+		count++;
+	CuAssert(tc, "rr count", pos == len-soalen && count == num);
+	for(i=0; i<num; i++) {
+		size_t rrlen = c_make_rr(rr, want[i].owner, TYPE_A,
+			want[i].ttl, want[i].addr);
+		int found = 0;
+		for(pos = 0; pos < len-soalen; pos += c_rr_len(rrs+pos)) {
+			if(c_rr_len(rrs+pos) == rrlen &&
+				memcmp(rrs+pos, rr, rrlen) == 0)
+				found = 1;
+		}
+		CuAssert(tc, "rr in condensed", found);
+	}
+}
+
+/* condense the versions from the serial, and check the result */
+static void
+c_check(CuTest* tc, struct zone_ixfr* ixfr, uint32_t from, uint32_t to,
+	const struct c_rr* del, size_t delnum,
+	const struct c_rr* add, size_t addnum)
+{
+	struct ixfr_data* c = ixfr_data_condense(ixfr,
+		zone_ixfr_find_serial(ixfr, from));
+	uint8_t soa[300];
+	size_t soalen;
+	CuAssert(tc, "condense", c != NULL);
+	CuAssert(tc, "serials", c->oldserial == from && c->newserial == to);
+	/* the SOA records of the first and the last version */
+	soalen = c_make_rr(soa, "example.com", TYPE_SOA, 3600, from);
+	CuAssert(tc, "oldsoa", c->oldsoa_len == soalen &&
+		memcmp(c->oldsoa, soa, soalen) == 0);
+	soalen = c_make_rr(soa, "example.com", TYPE_SOA, 3600, to);
+	CuAssert(tc, "newsoa", c->newsoa_len == soalen &&
+		memcmp(c->newsoa, soa, soalen) == 0);
+	CuAssert(tc, "not compressed", c->zdata == NULL);
+	c_check_rrs(tc, c->del, c->del_len, to, del, delnum);
+	c_check_rrs(tc, c->add, c->add_len, to, add, addnum);
+	free(c->oldsoa);
+	free(c->newsoa);
+	free(c->del);
+	free(c->add);
+	free(c);
+}
+
+/* a zone_ixfr for the tests */
+static struct zone_ixfr*
+c_create(struct nsd* nsd)
+{
+	memset(nsd, 0, sizeof(*nsd));
+	nsd->region = region_create(xalloc, free);
+	return zone_ixfr_create(nsd);
+}
+
+static void
+c_delete(struct nsd* nsd, struct zone_ixfr* ixfr)
+{
+	zone_ixfr_free(ixfr);
+	region_destroy(nsd->region);
+}
+
+/* TTL changes, and changes that undo each other */
+static void ixfr_c_1(CuTest *tc)
+{
+	struct nsd nsd;
+	struct zone_ixfr* ixfr = c_create(&nsd);
+	struct c_rr ttl300[] = {{"www.example.com", 300, 1}};
+	struct c_rr ttl600[] = {{"www.example.com", 600, 1}};
+	struct c_rr other[] = {{"www.example.com", 300, 2}};
+	struct c_rr both[] = {{"www.example.com", 600, 1},
+		{"www.example.com", 300, 2}};
+
+	/* the TTL goes to 600 and back to 300, then the address changes */
+	c_add_version(ixfr, 1, ttl300, 1, ttl600, 1, 0);
+	c_add_version(ixfr, 2, ttl600, 1, ttl300, 1, 0);
+	c_add_version(ixfr, 3, ttl300, 1, other, 1, 0);
+
+	/* the TTL change is sent as delete and add */
+	c_check(tc, ixfr, 2, 4, ttl600, 1, other, 1);
+	/* the change and its undo are not sent */
+	c_check(tc, ixfr, 1, 4, ttl300, 1, other, 1);
+	c_check(tc, ixfr, 3, 4, ttl300, 1, other, 1);
+	c_delete(&nsd, ixfr);
+
+	/* only the TTL changes, it is not folded with the other TTL */
+	ixfr = c_create(&nsd);
+	c_add_version(ixfr, 1, ttl300, 1, ttl600, 1, 0);
+	c_add_version(ixfr, 2, NULL, 0, other, 1, 0);
+	c_check(tc, ixfr, 1, 3, ttl300, 1, both, 2);
+	c_delete(&nsd, ixfr);
+}
+
+/* delete, add and delete again, with compressed and uncompressed
+ * versions mixed */
+static void ixfr_c_2(CuTest *tc)
+{
+	struct c_rr x[] = {{"x.example.com", 3600, 1}};
+	struct c_rr y[] = {{"y.example.com", 3600, 1}};
+	struct c_rr xy[] = {{"x.example.com", 3600, 1},
+		{"y.example.com", 3600, 1}};
+	int compress;
+	for(compress = 0; compress < 8; compress++) {
+		struct nsd nsd;
+		struct zone_ixfr* ixfr = c_create(&nsd);
+		/* x is deleted, added and deleted,
+		 * y is added, deleted and added */
+		c_add_version(ixfr, 10, x, 1, y, 1, compress&1);
+		c_add_version(ixfr, 11, y, 1, x, 1, compress&2);
+		c_add_version(ixfr, 12, x, 1, y, 1, compress&4);
+		c_check(tc, ixfr, 10, 13, x, 1, y, 1);
+		c_check(tc, ixfr, 11, 13, NULL, 0, NULL, 0);
+		c_check(tc, ixfr, 12, 13, x, 1, y, 1);
+		c_delete(&nsd, ixfr);
+
+		/* x and y are deleted, and one by one added again */
+		ixfr = c_create(&nsd);
+		c_add_version(ixfr, 10, xy, 2, NULL, 0, compress&1);
+		c_add_version(ixfr, 11, NULL, 0, x, 1, compress&2);
+		c_add_version(ixfr, 12, NULL, 0, y, 1, compress&4);
+		c_check(tc, ixfr, 10, 13, NULL, 0, NULL, 0);
+		c_check(tc, ixfr, 11, 13, NULL, 0, xy, 2);
+		c_delete(&nsd, ixfr);
+	}
+}
+
+/* the owner names are compared case insensitive, the labels and the
+ * rdata are compared exactly */
+static void ixfr_c_3(CuTest *tc)
+{
+	struct nsd nsd;
+	struct zone_ixfr* ixfr = c_create(&nsd);
+	struct c_rr lower[] = {{"www.example.com", 3600, 1}};
+	struct c_rr upper[] = {{"WWW.Example.COM", 3600, 1}};
+	struct c_rr labels[] = {{"ab.c.example.com", 3600, 1}};
+	struct c_rr labels2[] = {{"a.bc.example.com", 3600, 1}};
+	struct c_rr addr[] = {{"www.example.com", 3600, 2}};
+
+	/* added in lower case, deleted in upper case */
+	c_add_version(ixfr, 1, NULL, 0, lower, 1, 0);
+	c_add_version(ixfr, 2, upper, 1, NULL, 0, 1);
+	c_check(tc, ixfr, 1, 3, NULL, 0, NULL, 0);
+	c_delete(&nsd, ixfr);
+
+	/* the same letters, in other labels, are another owner */
+	ixfr = c_create(&nsd);
+	c_add_version(ixfr, 1, NULL, 0, labels, 1, 0);
+	c_add_version(ixfr, 2, labels2, 1, NULL, 0, 0);
+	c_check(tc, ixfr, 1, 3, labels2, 1, labels, 1);
+	c_delete(&nsd, ixfr);
+
+	/* another address is another RR */
+	ixfr = c_create(&nsd);
+	c_add_version(ixfr, 1, NULL, 0, lower, 1, 0);
+	c_add_version(ixfr, 2, addr, 1, NULL, 0, 0);
+	c_check(tc, ixfr, 1, 3, addr, 1, lower, 1);
+	c_delete(&nsd, ixfr);
+}
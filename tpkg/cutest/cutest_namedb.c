@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/stat.h>
 #include "tpkg/cutest/cutest.h"
 #include "region-allocator.h"
 #include "options.h"
@@ -23,12 +24,15 @@
 #include "nsd.h"
 #include "zone.h"
 #include "rdata.h"
+#include "iterated_hash.h"
 
 static void namedb_1(CuTest *tc);
 static void namedb_2(CuTest *tc);
+static void namedb_5(CuTest *tc);
 #ifdef NSEC3
 static void namedb_3(CuTest *tc);
 static void namedb_4(CuTest *tc);
+static void namedb_6(CuTest *tc);
 #endif /* NSEC3 */
 static int v = 0; /* verbosity */
 
@@ -41,9 +45,11 @@ CuSuite* reg_cutest_namedb(void)
 
 	SUITE_ADD_TEST(suite, namedb_1);
 	SUITE_ADD_TEST(suite, namedb_2);
+	SUITE_ADD_TEST(suite, namedb_5);
 #ifdef NSEC3
 	SUITE_ADD_TEST(suite, namedb_3);
 	SUITE_ADD_TEST(suite, namedb_4);
+	SUITE_ADD_TEST(suite, namedb_6);
 #endif /* NSEC3 */
 	return suite;
 }
@@ -1777,3 +1783,393 @@ static void namedb_4(CuTest *tc)
 	region_destroy(region);
 }
 #endif /* NSEC3 */
+
+/* the body of a snapshot, with a SOA at the apex and an A at www */
+static const uint8_t snapshot_body[] = {
+	13, 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0, 0, 1,
+	0, 6, 0, 1, 0, 1, 0, 0, 0x0e, 0x10, 0, 51,
+	2, 'n', 's', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0,
+	1, 'h', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0,
+	0, 0, 0, 5, 0, 0, 0x0e, 0x10, 0, 0, 0x03, 0x84, 0, 1, 0x51, 0x80,
+	0, 0, 1, 0x2c,
+	17, 3, 'w', 'w', 'w', 7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c',
+	'o', 'm', 0, 0, 1,
+	0, 1, 0, 1, 0, 1, 0, 0, 0x0e, 0x10, 0, 4, 192, 0, 2, 1
+};
+
+/* write a file, return false on failure */
+static int
+write_test_file(const char* fname, const uint8_t* data, size_t len)
+{
+	FILE* out = fopen(fname, "w");
+	if(!out)
+		return 0;
+	if(fwrite(data, 1, len, out) != len) {
+		fclose(out);
+		return 0;
+	}
+	return fclose(out) == 0;
+}
+
+/* make the snapshot file for the zonefile, with the body and rrcount. */
+static int
+write_test_snapshot_body(const char* zfile, const char* snapfile,
+	const uint8_t* body, size_t len, uint32_t rrcount)
+{
+	uint8_t* buf;
+	uint32_t nsec = 0;
+	struct stat zs;
+	int ret;
+	if(stat(zfile, &zs) != 0)
+		return 0;
+#ifdef HAVE_STRUCT_STAT_ST_MTIMENSEC
+	nsec = (uint32_t)zs.st_mtimensec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+	nsec = (uint32_t)zs.st_mtim.tv_nsec;
+#endif
+	buf = (uint8_t*)malloc(ZONE_SNAPSHOT_HEADER_SIZE+len);
+	if(!buf)
+		return 0;
+	write_uint32(buf, ZONE_SNAPSHOT_MAGIC);
+	write_uint32(buf+4, ZONE_SNAPSHOT_VERSION);
+	write_uint64(buf+8, (uint64_t)zs.st_mtime);
+	write_uint32(buf+16, nsec);
+	write_uint64(buf+20, (uint64_t)zs.st_size);
+	write_uint32(buf+28, rrcount);
+	write_uint64(buf+32, len);
+	write_uint32(buf+40, ~compute_crc(0xffffffff, (uint8_t*)body, len));
+	memcpy(buf+ZONE_SNAPSHOT_HEADER_SIZE, body, len);
+	ret = write_test_file(snapfile, buf, ZONE_SNAPSHOT_HEADER_SIZE+len);
+	free(buf);
+	return ret;
+}
+
+/* make the snapshot file for the zonefile, with the test body. */
+static int
+write_test_snapshot(const char* zfile, const char* snapfile)
+{
+	return write_test_snapshot_body(zfile, snapfile, snapshot_body,
+		sizeof(snapshot_body), 2);
+}
+
+/* see if the file has the contents of the snapshot that was made */
+static int
+snapshot_file_same(const char* snapfile)
+{
+	uint8_t buf[ZONE_SNAPSHOT_HEADER_SIZE+sizeof(snapshot_body)+1];
+	size_t len;
+	FILE* in = fopen(snapfile, "r");
+	if(!in)
+		return 0;
+	len = fread(buf, 1, sizeof(buf), in);
+	fclose(in);
+	return len == sizeof(buf)-1 && memcmp(buf+ZONE_SNAPSHOT_HEADER_SIZE,
+		snapshot_body, sizeof(snapshot_body)) == 0;
+}
+
+static void namedb_5(CuTest *tc)
+{
+	/* test _5 : the zone snapshot is read and written */
+	region_type* region = region_create(xalloc, free);
+	char* zfile = udbtest_get_temp_file("snap.zone");
+	char snapfile[1024];
+	struct zone_options* zopt;
+	namedb_type* db;
+	zone_type* zone;
+	domain_type* www;
+	uint8_t bad[ZONE_SNAPSHOT_HEADER_SIZE+sizeof(snapshot_body)];
+	FILE* in;
+
+	if(v) printf("test namedb-snapshot start\n");
+	snprintf(snapfile, sizeof(snapfile), "%s%s", zfile,
+		ZONE_SNAPSHOT_SUFFIX);
+	CuAssert(tc, "zonefile", write_test_file(zfile,
+		(uint8_t*)"; zonefile\n", 11));
+	CuAssert(tc, "snapshot", write_test_snapshot(zfile, snapfile));
+
+	zopt = zone_options_create(region);
+	zopt->name = region_strdup(region, "example.com.");
+	db = namedb_open(NULL);
+	zone = namedb_zone_create(db, dname_parse(region, "example.com."),
+		zopt);
+
+	/* read it */
+	CuAssert(tc, "read", namedb_read_zone_snapshot(db, zone, zfile));
+	CuAssert(tc, "soa", zone->soa_rrset && zone->soa_rrset->rr_count == 1
+		&& zone->soa_rrset->rrs[0]->ttl == 3600);
+	www = domain_table_find(db->domains, dname_parse(region,
+		"www.example.com."));
+	CuAssert(tc, "www", www && domain_find_rrset(www, zone, TYPE_A) &&
+		domain_find_rrset(www, zone, TYPE_A)->rrs[0]->type == TYPE_A);
+
+	/* write it again, it is the same */
+	unlink(snapfile);
+	CuAssert(tc, "write", namedb_write_zone_snapshot(zone, zfile));
+	CuAssert(tc, "same", snapshot_file_same(snapfile));
+
+	/* a corrupt snapshot is not used, and the zone is empty */
+	in = fopen(snapfile, "r");
+	CuAssert(tc, "open", in != NULL);
+	CuAssert(tc, "fread", in && fread(bad, 1, sizeof(bad), in) ==
+		sizeof(bad));
+	if(in)
+		fclose(in);
+	bad[sizeof(bad)-1] ^= 1;
+	CuAssert(tc, "write bad", write_test_file(snapfile, bad,
+		sizeof(bad)));
+	delete_zone_rrs(db, zone);
+	CuAssert(tc, "corrupt", !namedb_read_zone_snapshot(db, zone, zfile));
+	CuAssert(tc, "emptied", domain_find_rrset(zone->apex, zone, TYPE_SOA)
+		== NULL);
+
+	/* a snapshot for another zonefile is not used */
+	CuAssert(tc, "snapshot 2", write_test_snapshot(zfile, snapfile));
+	CuAssert(tc, "zonefile 2", write_test_file(zfile,
+		(uint8_t*)"; changed zonefile\n", 19));
+	CuAssert(tc, "stale", !namedb_read_zone_snapshot(db, zone, zfile));
+
+	unlink(snapfile);
+	unlink(zfile);
+	free(zfile);
+	namedb_close(db);
+	region_destroy(region);
+	if(v) printf("test namedb-snapshot end\n");
+}
+
+#ifdef NSEC3
+/* names in the NSEC3 test zone, the hashes need more than one batch of
+ * the hash processes */
+#define HASHCACHE_NAMES 2100
+static const uint8_t hashcache_apex[] = {7, 'e', 'x', 'a', 'm', 'p', 'l',
+	'e', 3, 'c', 'o', 'm', 0};
+/* NSEC3 parameters: SHA1, no flags, 2 iterations, salt abcd */
+static const uint8_t hashcache_param[] = {1, 0, 0, 2, 2, 0xab, 0xcd};
+
+/* write an RRset with one RR to the snapshot body */
+static void
+hashcache_rr(buffer_type* b, uint16_t type, const uint8_t* rdata,
+	uint16_t rdlen)
+{
+	buffer_write_u16(b, type);
+	buffer_write_u16(b, CLASS_IN);
+	buffer_write_u16(b, 1);
+	buffer_write_u32(b, 3600);
+	buffer_write_u16(b, rdlen);
+	buffer_write(b, rdata, rdlen);
+}
+
+/* write the owner name, www.example.com as prefix www, to the body */
+static void
+hashcache_owner(buffer_type* b, const char* prefix, uint16_t rrsets)
+{
+	size_t len = strlen(prefix);
+	if(len == 0) {
+		buffer_write_u8(b, sizeof(hashcache_apex));
+	} else {
+		buffer_write_u8(b, (uint8_t)(1+len+sizeof(hashcache_apex)));
+		buffer_write_u8(b, (uint8_t)len);
+		buffer_write(b, prefix, len);
+	}
+	buffer_write(b, hashcache_apex, sizeof(hashcache_apex));
+	buffer_write_u16(b, rrsets);
+}
+
+/* write the snapshot of the NSEC3 signed test zone, with the serial */
+static int
+hashcache_snapshot(region_type* region, const char* zfile,
+	const char* snapfile, uint32_t serial)
+{
+	buffer_type* b = buffer_create(region, 65536*2);
+	uint8_t rd[64], h[NSEC3_HASH_LEN];
+	char b32[64];
+	int i;
+	/* apex SOA and NSEC3PARAM, the SOA rdata as in snapshot_body */
+	hashcache_owner(b, "", 2);
+	memcpy(rd, snapshot_body+28, 51);
+	write_uint32(rd+31, serial);
+	hashcache_rr(b, TYPE_SOA, rd, 51);
+	hashcache_rr(b, TYPE_NSEC3PARAM, hashcache_param,
+		sizeof(hashcache_param));
+	/* the NSEC3 for the apex, that makes the chain usable */
+	iterated_hash(h, hashcache_param+5, 2, hashcache_apex,
+		sizeof(hashcache_apex), 2);
+	if(b32_ntop(h, sizeof(h), b32, sizeof(b32)) != 32)
+		return 0;
+	hashcache_owner(b, b32, 1);
+	memcpy(rd, hashcache_param, sizeof(hashcache_param));
+	rd[7] = NSEC3_HASH_LEN;
+	memcpy(rd+8, h, NSEC3_HASH_LEN);
+	rd[28] = 0; /* window 0, SOA */
+	rd[29] = 1;
+	rd[30] = 0x02;
+	hashcache_rr(b, TYPE_NSEC3, rd, 31);
+	/* a delegation, that has a DS hash */
+	hashcache_owner(b, "sub", 1);
+	hashcache_rr(b, TYPE_NS, snapshot_body+28, 16);
+	for(i=0; i<HASHCACHE_NAMES; i++) {
+		char label[16];
+		uint8_t a[4] = {192, 0, 2, 1};
+		snprintf(label, sizeof(label), "h%d", i);
+		hashcache_owner(b, label, 1);
+		hashcache_rr(b, TYPE_A, a, sizeof(a));
+	}
+	buffer_flip(b);
+	return write_test_snapshot_body(zfile, snapfile, buffer_begin(b),
+		buffer_limit(b), 4+HASHCACHE_NAMES);
+}
+
+/* read the NSEC3 test zone with the serial, and compute its NSEC3
+ * information with the number of hash processes and the hash cache */
+static namedb_type*
+hashcache_read(CuTest* tc, region_type* region, const char* zfile,
+	const char* snapfile, uint32_t serial, int procs, int cache)
+{
+	struct zone_options* zopt = zone_options_create(region);
+	namedb_type* db = namedb_open(NULL);
+	zone_type* zone;
+	zopt->name = region_strdup(region, "example.com.");
+	db->nsec3_precompile_processes = procs;
+	db->nsec3_hash_cache = cache;
+	zone = namedb_zone_create(db, dname_parse(region, "example.com."),
+		zopt);
+	CuAssert(tc, "snapshot", hashcache_snapshot(region, zfile, snapfile,
+		serial));
+	CuAssert(tc, "read", namedb_read_zone_snapshot(db, zone, zfile));
+	zone->filename = region_strdup(db->region, zfile);
+	prehash_zone_complete(db, zone);
+	nsec3_hash_pool_stop();
+	CuAssert(tc, "nsec3", zone->nsec3_param != NULL);
+	return db;
+}
+
+/* the precompiled hash of the name */
+static uint8_t*
+hashcache_hash(namedb_type* db, region_type* region, const char* name)
+{
+	domain_type* d = domain_table_find(db->domains, dname_parse(region,
+		name));
+	if(!d || !d->nsec3 || !d->nsec3->hash_wc)
+		return NULL;
+	return d->nsec3->hash_wc->hash.hash;
+}
+
+/* see if the two databases have the same precompiled hashes */
+static int
+hashcache_same(namedb_type* db1, namedb_type* db2)
+{
+	domain_type* d1;
+	size_t n = 0;
+	for(d1 = domain_next(db1->domains->root); d1; d1 = domain_next(d1)) {
+		domain_type* d2 = domain_table_find(db2->domains,
+			domain_dname(d1));
+		struct nsec3_domain_data* n1 = d1->nsec3, *n2;
+		if(!n1 || (!n1->hash_wc && !n1->ds_parent_hash))
+			continue;
+		if(!d2 || !(n2 = d2->nsec3))
+			return 0;
+		if(n1->hash_wc && (!n2->hash_wc ||
+			memcmp(n1->hash_wc->hash.hash, n2->hash_wc->hash.hash,
+			NSEC3_HASH_LEN) != 0 ||
+			memcmp(n1->hash_wc->wc.hash, n2->hash_wc->wc.hash,
+			NSEC3_HASH_LEN) != 0))
+			return 0;
+		if(n1->ds_parent_hash && (!n2->ds_parent_hash ||
+			memcmp(n1->ds_parent_hash->hash,
+			n2->ds_parent_hash->hash, NSEC3_HASH_LEN) != 0))
+			return 0;
+		n++;
+	}
+	return n >= HASHCACHE_NAMES;
+}
+
+/* read the hash cache file, returns malloced data */
+static uint8_t*
+hashcache_file(const char* fname, size_t* len)
+{
+	uint8_t* data = (uint8_t*)malloc(1024*1024);
+	FILE* in = fopen(fname, "r");
+	if(!in || !data) {
+		if(in) fclose(in);
+		free(data);
+		return NULL;
+	}
+	*len = fread(data, 1, 1024*1024, in);
+	fclose(in);
+	return data;
+}
+
+static void namedb_6(CuTest *tc)
+{
+	/* test _6 : the NSEC3 hash processes and the hash cache */
+	region_type* region = region_create(xalloc, free);
+	char* zfile = udbtest_get_temp_file("hash.zone");
+	char snapfile[1024], cachefile[1024];
+	uint8_t h7[NSEC3_HASH_LEN], *data, *h;
+	namedb_type* ref, *db;
+	size_t len = 0, i;
+	const uint8_t h7name[] = {2, 'h', '7', 7, 'e', 'x', 'a', 'm', 'p', 'l',
+		'e', 3, 'c', 'o', 'm', 0};
+
+	if(v) printf("test namedb-nsec3-hash-cache start\n");
+	snprintf(snapfile, sizeof(snapfile), "%s%s", zfile,
+		ZONE_SNAPSHOT_SUFFIX);
+	snprintf(cachefile, sizeof(cachefile), "%s%s", zfile,
+		NSEC3_HASH_CACHE_SUFFIX);
+	CuAssert(tc, "zonefile", write_test_file(zfile,
+		(uint8_t*)"; zonefile\n", 11));
+
+	/* hashed by the precompile itself */
+	ref = hashcache_read(tc, region, zfile, snapfile, 1, 1, 0);
+	CuAssert(tc, "no cache", access(cachefile, F_OK) != 0);
+	h = hashcache_hash(ref, region, "h7.example.com.");
+	CuAssert(tc, "h7", h != NULL);
+	memcpy(h7, h, NSEC3_HASH_LEN);
+
+	/* hashed by the hash processes, the same, and the cache written */
+	db = hashcache_read(tc, region, zfile, snapfile, 1, 3, 1);
+	CuAssert(tc, "processes", hashcache_same(ref, db));
+	CuAssert(tc, "processes all", hashcache_same(db, ref));
+	namedb_close(db);
+	data = hashcache_file(cachefile, &len);
+	CuAssert(tc, "cache", data != NULL && len > 100);
+
+	/* change the hash of h7 in the cache, it is read from there */
+	for(i=0; i+sizeof(h7name)+NSEC3_HASH_LEN < len; i++) {
+		if(memcmp(data+i, h7name, sizeof(h7name)) == 0)
+			break;
+	}
+	CuAssert(tc, "h7 in cache", i+sizeof(h7name)+NSEC3_HASH_LEN < len &&
+		memcmp(data+i+sizeof(h7name), h7, NSEC3_HASH_LEN) == 0);
+	data[i+sizeof(h7name)] ^= 0xff;
+	write_uint32(data+len-4, ~compute_crc(0xffffffff, data, len-4));
+	CuAssert(tc, "write", write_test_file(cachefile, data, len));
+	db = hashcache_read(tc, region, zfile, snapfile, 1, 1, 1);
+	h = hashcache_hash(db, region, "h7.example.com.");
+	CuAssert(tc, "from cache", h && h[0] == (h7[0]^0xff) &&
+		memcmp(h+1, h7+1, NSEC3_HASH_LEN-1) == 0);
+	namedb_close(db);
+
+	/* a corrupt cache is not used */
+	data[len/2] ^= 0x01;
+	CuAssert(tc, "write corrupt", write_test_file(cachefile, data, len));
+	data[len/2] ^= 0x01;
+	db = hashcache_read(tc, region, zfile, snapfile, 1, 1, 1);
+	CuAssert(tc, "corrupt", hashcache_same(ref, db));
+	namedb_close(db);
+
+	/* a cache for another serial is not used */
+	CuAssert(tc, "write stale", write_test_file(cachefile, data, len));
+	db = hashcache_read(tc, region, zfile, snapfile, 2, 1, 1);
+	CuAssert(tc, "stale", hashcache_same(ref, db));
+	namedb_close(db);
+
+	free(data);
+	unlink(cachefile);
+	unlink(snapfile);
+	unlink(zfile);
+	free(zfile);
+	namedb_close(ref);
+	region_destroy(region);
+	if(v) printf("test namedb-nsec3-hash-cache end\n");
+}
+#endif /* NSEC3 */
@@ -0,0 +1,154 @@
+/*
+	test qtrace.h
+*/
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "tpkg/cutest/cutest.h"
+#include "qtrace.h"
+#include "query.h"
+
+#ifdef HAVE_MMAP
+static void qtrace_1(CuTest *tc);
+static void qtrace_2(CuTest *tc);
+
+CuSuite* reg_cutest_qtrace(void)
+{
+	CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, qtrace_1);
+	SUITE_ADD_TEST(suite, qtrace_2);
+	return suite;
+}
+
+/* make a query from a client for a name */
+static void
+qtrace_query(struct query* q, region_type* region, const char* client,
+	const char* name)
+{
+	struct sockaddr_in* sa = (struct sockaddr_in*)&q->client_addr;
+	memset(q, 0, sizeof(*q));
+	q->packet = buffer_create(region, 512);
+	sa->sin_family = AF_INET;
+	inet_pton(AF_INET, client, &sa->sin_addr);
+	q->qname = dname_parse(region, name);
+	q->qtype = TYPE_A;
+}
+
+/* run the query through the stages, as the server does */
+static void
+qtrace_run(struct query* q)
+{
+	struct timespec t;
+	if(!QTRACE_ACTIVE())
+		return;
+	qtrace_clock(&t);
+	qtrace_begin(q, &t);
+	QTRACE_STAMP(q, qtrace_process);
+	QTRACE_STAMP(q, qtrace_encode);
+	if(q->trace.on)
+		qtrace_process_done(q);
+	if(q->trace.on)
+		qtrace_finish(q, STAT_UDP, 100);
+}
+
+/* sample rate and the ring */
+static void qtrace_1(CuTest *tc)
+{
+	region_type* region = region_create(xalloc, free);
+	struct qtrace_entry list[QTRACE_RING_SIZE];
+	int server[QTRACE_RING_SIZE];
+	struct query q;
+	size_t i, n;
+
+	qtrace_mmap_init(2);
+	qtrace_init(1);
+	qtrace_query(&q, region, "192.0.2.1", "www.example.com.");
+	CuAssert(tc, "not active", !QTRACE_ACTIVE());
+	qtrace_run(&q);
+	CuAssert(tc, "empty", qtrace_list(list, server, 10) == 0);
+
+	qtrace_start(4, NULL, 0, NULL, 0);
+	CuAssert(tc, "active", QTRACE_ACTIVE());
+	for(i=0; i<40; i++)
+		qtrace_run(&q);
+	n = qtrace_list(list, server, QTRACE_RING_SIZE);
+	CuAssert(tc, "1 in 4", n == 10);
+	CuAssert(tc, "server", server[0] == 1 && server[9] == 1);
+	CuAssert(tc, "qtype", list[0].qtype == TYPE_A);
+	CuAssert(tc, "size", list[0].size == 100);
+	CuAssert(tc, "family", list[0].family == AF_INET);
+	CuAssert(tc, "qname", list[0].qnamelen == q.qname->name_size &&
+		memcmp(list[0].qname, dname_name(q.qname),
+		q.qname->name_size) == 0);
+	CuAssert(tc, "stages", list[0].ns[qtrace_process] != 0 &&
+		list[0].ns[qtrace_encode] >= list[0].ns[qtrace_process] &&
+		list[0].ns[qtrace_lookup_zone] == 0 &&
+		list[0].ns[qtrace_send] >= list[0].ns[qtrace_encode]);
+
+	/* the ring keeps the last entries */
+	qtrace_start(1, NULL, 0, NULL, 0);
+	for(i=0; i<QTRACE_RING_SIZE+10; i++)
+		qtrace_run(&q);
+	n = qtrace_list(list, server, QTRACE_RING_SIZE);
+	CuAssert(tc, "ring full", n == QTRACE_RING_SIZE);
+	n = qtrace_list(list, server, 5);
+	CuAssert(tc, "last 5", n == 5);
+
+	qtrace_stop();
+	CuAssert(tc, "stopped", !QTRACE_ACTIVE());
+	qtrace_mmap_deinit();
+	region_destroy(region);
+}
+
+/* the name and client filters */
+static void qtrace_2(CuTest *tc)
+{
+	region_type* region = region_create(xalloc, free);
+	struct qtrace_entry list[10];
+	int server[10];
+	struct query q;
+	uint8_t addr[16];
+
+	qtrace_mmap_init(1);
+	qtrace_init(0);
+	memset(addr, 0, sizeof(addr));
+	inet_pton(AF_INET, "192.0.2.0", addr);
+	qtrace_start(1, dname_parse(region, "Example.COM."), AF_INET, addr,
+		25);
+
+	qtrace_query(&q, region, "192.0.2.1", "www.example.com.");
+	qtrace_run(&q);
+	CuAssert(tc, "below name", qtrace_list(list, server, 10) == 1);
+	qtrace_query(&q, region, "192.0.2.1", "example.com.");
+	qtrace_run(&q);
+	CuAssert(tc, "same name", qtrace_list(list, server, 10) == 2);
+	qtrace_query(&q, region, "192.0.2.1", "example.net.");
+	qtrace_run(&q);
+	qtrace_query(&q, region, "192.0.2.1", "wwwexample.com.");
+	qtrace_run(&q);
+	CuAssert(tc, "other name", qtrace_list(list, server, 10) == 2);
+	qtrace_query(&q, region, "192.0.2.127", "www.example.com.");
+	qtrace_run(&q);
+	CuAssert(tc, "in prefix", qtrace_list(list, server, 10) == 3);
+	qtrace_query(&q, region, "192.0.2.128", "www.example.com.");
+	qtrace_run(&q);
+	CuAssert(tc, "out of prefix", qtrace_list(list, server, 10) == 3);
+
+	qtrace_mmap_deinit();
+	region_destroy(region);
+}
+#else
+CuSuite* reg_cutest_qtrace(void)
+{
+	return CuSuiteNew();
+}
+#endif /* HAVE_MMAP */
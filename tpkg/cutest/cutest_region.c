@@ -25,11 +25,13 @@
 #endif /* PACKED_STRUCTS */
 
 static void region_1(CuTest *tc);
+static void region_2(CuTest *tc);
 
 CuSuite* reg_cutest_region(void)
 {
 	CuSuite* suite = CuSuiteNew();
 	SUITE_ADD_TEST(suite, region_1); /* test recycle */
+	SUITE_ADD_TEST(suite, region_2); /* test recycle with arenas */
 	return suite;
 }
 
@@ -317,3 +319,54 @@ region_1(CuTest *tc)
 	region_destroy(region);
 	region_destroy(tree_region);
 }
+
+/* test recycle in a region with arenas, switching between them */
+static void
+region_2(CuTest *tc)
+{
+	region_type* tree_region = region_create(xalloc, free);
+	rbtree_type* tree = rbtree_create(tree_region, comparef);
+	region_type* region = 0;
+	int i;
+	int max = 10000;
+	size_t arenas = 4;
+
+	srand48(8192);
+	region = region_create_custom(xalloc, free, DEFAULT_CHUNK_SIZE,
+		DEFAULT_LARGE_OBJECT_SIZE, DEFAULT_INITIAL_CLEANUP_SIZE, 1);
+	CuAssert(tc, "region_set_arenas", region_set_arenas(region, arenas));
+	CuAssert(tc, "arena 0 in use", region_use_arena(region, 1) == 0);
+	CuAssert(tc, "arena 1 in use", region_use_arena(region, 0) == 1);
+	CuAssert(tc, "no such arena", region_use_arena(region, arenas) == 0);
+
+	/* blocks allocated in one arena are recycled in another */
+	for(i=0; i<max; i++) {
+		if(i%100 == 0)
+			(void)region_use_arena(region,
+				(size_t)GetRandom(0, (int)arenas-1));
+		if(drand48() < 0.5)
+			test_alloc(tc, tree, region);
+		else	test_dealloc(tc, tree, region);
+	}
+
+	/* a block goes back to the arena it was allocated from */
+	{
+		void* p, *q;
+		(void)region_use_arena(region, 1);
+		p = region_alloc(region, 40);
+		(void)region_use_arena(region, 3);
+		region_recycle(region, p, 40);
+		q = region_alloc(region, 40);
+		CuAssert(tc, "recycled in its own arena", q != p);
+		(void)region_use_arena(region, 1);
+		CuAssert(tc, "reused in its own arena",
+			region_alloc(region, 40) == p);
+	}
+
+	region_free_all(region);
+	CuAssert(tc, "arena 0 after free_all",
+		region_use_arena(region, 2) == 0);
+	CuAssert(tc, "alloc after free_all", region_alloc(region, 10) != NULL);
+	region_destroy(region);
+	region_destroy(tree_region);
+}
@@ -10,17 +10,38 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #include "tpkg/cutest/cutest.h"
 #include "rrl.h"
 
 #ifdef RATELIMIT
 static void rrl_1(CuTest *tc);
+static void rrl_3(CuTest *tc);
+#ifdef HAVE_MMAP
+static void rrl_4(CuTest *tc);
+#endif
+#if defined(HAVE_MMAP) && defined(HAVE_ATOMIC_BUILTINS)
+static void rrl_2(CuTest *tc);
+static void rrl_5(CuTest *tc);
+#endif
 
 CuSuite* reg_cutest_rrl(void)
 {
         CuSuite* suite = CuSuiteNew();
 
 	SUITE_ADD_TEST(suite, rrl_1);
+#if defined(HAVE_MMAP) && defined(HAVE_ATOMIC_BUILTINS)
+	SUITE_ADD_TEST(suite, rrl_2);
+#endif
+	SUITE_ADD_TEST(suite, rrl_3);
+#ifdef HAVE_MMAP
+	SUITE_ADD_TEST(suite, rrl_4);
+#endif
+#if defined(HAVE_MMAP) && defined(HAVE_ATOMIC_BUILTINS)
+	SUITE_ADD_TEST(suite, rrl_5);
+#endif
 	return suite;
 }
 
@@ -29,7 +50,7 @@ static void rrl_1(CuTest *tc)
 	query_type q;
 	uint64_t source = 0x100;
 	uint32_t now = 123;
-	uint32_t hash = 0x743;
+	uint64_t hash = 0x743;
 	uint16_t c = rrl_type_nxdomain;
 	uint32_t i;
 	uint32_t rate = 200;
@@ -72,4 +93,188 @@ static void rrl_1(CuTest *tc)
 
 	rrl_deinit(0);
 }
+
+#if defined(HAVE_MMAP) && defined(HAVE_ATOMIC_BUILTINS)
+/* shared table, updated by several children */
+static void rrl_2(CuTest *tc)
+{
+	query_type q;
+	uint64_t source = 0x200;
+	uint32_t now = 123;
+	uint64_t hash = 0x12340743;
+	uint16_t c = rrl_type_nxdomain;
+	uint32_t i;
+	uint32_t rate = 200;
+	uint32_t m = 400; /* ratelimit */
+	unsigned long retry = 0, evict = 0;
+	pid_t pid;
+	int status;
+	memset(&q, 0, sizeof(q));
+
+	rrl_mmap_init(2, 1000, 200, 2000, 2, 24, 64, 1);
+	rrl_init(0);
+	rrl_set_stats(&retry, &evict);
+	CuAssert(tc, "rrl 1st query", 1 == rrl_update(&q, hash, source, c, now, m));
+	for(i=1; i<rate/2; i++) {
+		CuAssert(tc, "rrl rate check", i+1 == rrl_update(&q, hash, source, c, now, m));
+	}
+	rrl_deinit(0);
+
+	/* the other child continues the count */
+	rrl_init(1);
+	for(i=rate/2; i<rate; i++) {
+		CuAssert(tc, "rrl shared check", i+1 == rrl_update(&q, hash, source, c, now, m));
+	}
+	now++;
+	for(i=0; i<rate-1; i++) {
+		rrl_update(&q, hash, source, c, now, m);
+	}
+	CuAssert(tc, "rrl rate(t+1) check", rate+rate/2 == rrl_update(&q, hash, source, c, now, m));
+	now += 3;
+	CuAssert(tc, "rrl rate(t+4) check", rate/4+rate/8 == rrl_update(&q, hash, source, c, now, m));
+
+	/* different source in the bucket, recount */
+	hash ^= ((uint64_t)1)<<50;
+	CuAssert(tc, "rrl source check", 1 == rrl_update(&q, hash, source, c, now, m));
+
+	/* concurrent updates from two processes, none are lost */
+	now++;
+	CuAssert(tc, "rrl step", 1 == rrl_update(&q, hash, source, c, now, m));
+	pid = fork();
+	CuAssert(tc, "fork", pid != -1);
+	for(i=0; i<100000; i++)
+		rrl_update(&q, hash, source, c, now, m);
+	if(pid == 0)
+		_exit(0);
+	CuAssert(tc, "waitpid", waitpid(pid, &status, 0) == pid);
+	CuAssert(tc, "rrl concurrent", 200002 == rrl_update(&q, hash, source, c, now, m));
+
+	/* another source with the same hash and tag has its own bucket */
+	now += 100;
+	CuAssert(tc, "rrl tag other source", 1 == rrl_update(&q, hash, source+1, c, now, m));
+	CuAssert(tc, "rrl tag source", 1 == rrl_update(&q, hash, source, c, now, m));
+	CuAssert(tc, "rrl tag other source", 2 == rrl_update(&q, hash, source+1, c, now, m));
+	CuAssert(tc, "rrl tag source", 2 == rrl_update(&q, hash, source, c, now, m));
+	rrl_set_stats(NULL, NULL);
+	rrl_deinit(1);
+	rrl_mmap_deinit();
+}
+#endif
+
+/* sources in the same set of buckets */
+static void rrl_3(CuTest *tc)
+{
+	query_type q;
+	uint64_t source;
+	uint32_t now = 123;
+	uint64_t hash = 0x4321;
+	uint16_t c = rrl_type_nxdomain;
+	uint32_t i;
+	uint32_t m = 400; /* ratelimit */
+	unsigned long evict = 0;
+	memset(&q, 0, sizeof(q));
+
+	rrl_init(0);
+	rrl_set_stats(NULL, &evict);
+	/* a heavy source and three light sources fill the set */
+	for(i=0; i<300; i++)
+		rrl_update(&q, hash, 1, c, now, m);
+	for(source=2; source<=4; source++)
+		for(i=0; i<source; i++)
+			rrl_update(&q, hash, source, c, now, m);
+	CuAssert(tc, "rrl set full", evict == 0);
+
+	/* a new source takes the bucket of the lowest rate source */
+	CuAssert(tc, "rrl new source", 1 == rrl_update(&q, hash, 5, c, now, m));
+	CuAssert(tc, "rrl evict", evict == 1);
+	CuAssert(tc, "rrl heavy kept", 301 == rrl_update(&q, hash, 1, c, now, m));
+	CuAssert(tc, "rrl light kept", 4 == rrl_update(&q, hash, 3, c, now, m));
+	CuAssert(tc, "rrl light kept", 5 == rrl_update(&q, hash, 4, c, now, m));
+	CuAssert(tc, "rrl new kept", 2 == rrl_update(&q, hash, 5, c, now, m));
+	CuAssert(tc, "rrl evicted", 1 == rrl_update(&q, hash, 2, c, now, m));
+	CuAssert(tc, "rrl evict", evict == 2);
+
+	/* old buckets have no rate, taking them over is not counted */
+	now += 20;
+	CuAssert(tc, "rrl new source", 1 == rrl_update(&q, hash, 6, c, now, m));
+	CuAssert(tc, "rrl no evict", evict == 2);
+	rrl_set_stats(NULL, NULL);
+	rrl_deinit(0);
+}
+
+#ifdef HAVE_MMAP
+/* list of highest rates over the tables of the children */
+static void rrl_4(CuTest *tc)
+{
+	query_type q;
+	uint32_t now = 123;
+	uint16_t c = rrl_type_nxdomain;
+	uint32_t i;
+	uint32_t m = 400; /* ratelimit */
+	struct rrl_top top[2];
+	memset(&q, 0, sizeof(q));
+
+	rrl_mmap_init(2, 1000, 200, 2000, 2, 24, 64, 0);
+	rrl_init(0);
+	for(i=0; i<100; i++)
+		rrl_update(&q, 0x111, 0x10, c, now, m);
+	for(i=0; i<10; i++)
+		rrl_update(&q, 0x222, 0x20, c|rrl_ip6, now, m);
+	rrl_deinit(0);
+	rrl_init(1);
+	for(i=0; i<50; i++)
+		rrl_update(&q, 0x333, 0x30, rrl_type_positive, now, m);
+	rrl_deinit(1);
+
+	CuAssert(tc, "rrl top count", 2 == rrl_top_list(top, 2, now));
+	CuAssert(tc, "rrl top 1", top[0].source == 0x10 && top[0].rate == 100
+		&& top[0].server == 0 && top[0].flags == c);
+	CuAssert(tc, "rrl top 2", top[1].source == 0x30 && top[1].rate == 50
+		&& top[1].server == 1 && top[1].flags == rrl_type_positive);
+	/* the rates decay */
+	CuAssert(tc, "rrl top count", 2 == rrl_top_list(top, 2, now+2));
+	CuAssert(tc, "rrl top decay", top[0].rate == 50 && top[1].rate == 25);
+	CuAssert(tc, "rrl top old", 0 == rrl_top_list(top, 2, now+20));
+	rrl_mmap_deinit();
+}
+#endif
+
+#if defined(HAVE_MMAP) && defined(HAVE_ATOMIC_BUILTINS)
+/* list of highest rates with more sources than are kept, shared table */
+static void rrl_5(CuTest *tc)
+{
+	query_type q;
+	uint32_t now = 123;
+	uint16_t c = rrl_type_nxdomain;
+	uint64_t hash = ((uint64_t)0x1234)<<48; /* tag, 0 is an empty bucket */
+	uint32_t i, j;
+	uint32_t m = 400; /* ratelimit */
+	struct rrl_top top[3];
+	memset(&q, 0, sizeof(q));
+
+	rrl_mmap_init(2, 10000, 200, 2000, 2, 24, 64, 1);
+	rrl_init(0);
+	/* source 0x100+i has i+1 queries, every one in its own set */
+	for(i=0; i<RRL_TOP_KEEP*3; i++) {
+		for(j=0; j<=i; j++)
+			rrl_update(&q, hash+i, 0x100+i, c, now, m);
+	}
+	rrl_deinit(0);
+	/* the highest is also in the top list of the other child */
+	rrl_init(1);
+	i = RRL_TOP_KEEP*3-1;
+	for(j=0; j<50; j++)
+		rrl_update(&q, hash+i, 0x100+i, c, now, m);
+	rrl_deinit(1);
+
+	CuAssert(tc, "rrl top count", 3 == rrl_top_list(top, 3, now));
+	CuAssert(tc, "rrl top 1", top[0].source == 0x100+i &&
+		top[0].rate == i+51 && top[0].server == -1);
+	CuAssert(tc, "rrl top 2", top[1].source == 0x100+i-1 &&
+		top[1].rate == i);
+	CuAssert(tc, "rrl top 3", top[2].source == 0x100+i-2 &&
+		top[2].rate == i-1);
+	rrl_mmap_deinit();
+}
+#endif
 #endif /* RATELIMIT */
@@ -27,11 +27,14 @@ CuSuite * reg_cutest_namedb(void);
 CuSuite * reg_cutest_bitset(void);
 #ifdef RATELIMIT
 CuSuite * reg_cutest_rrl(void);
+CuSuite * reg_cutest_qtrace(void);
 #endif
+CuSuite * reg_cutest_cookie(void);
 CuSuite * reg_cutest_popen3(void);
 CuSuite * reg_cutest_iter(void);
 CuSuite * reg_cutest_event(void);
 CuSuite * reg_cutest_xfrd_tcp(void);
+CuSuite * reg_cutest_ixfr(void);
 
 /* dummy functions to link */
 struct nsd nsd;
@@ -79,12 +82,15 @@ int runalltests(const char *regex)
 	CuSuiteAddSuite(suite, reg_cutest_namedb());
 #ifdef RATELIMIT
 	CuSuiteAddSuite(suite, reg_cutest_rrl());
+	CuSuiteAddSuite(suite, reg_cutest_qtrace());
 #endif
+	CuSuiteAddSuite(suite, reg_cutest_cookie());
 	CuSuiteAddSuite(suite, reg_cutest_bitset());
 	CuSuiteAddSuite(suite, reg_cutest_popen3());
 	CuSuiteAddSuite(suite, reg_cutest_iter());
 	CuSuiteAddSuite(suite, reg_cutest_event());
 	CuSuiteAddSuite(suite, reg_cutest_xfrd_tcp());
+	CuSuiteAddSuite(suite, reg_cutest_ixfr());
 
 	if(CuSuiteRunRegexDisplay(suite, regex, disp_callback) == -1) {
 		fprintf(stderr, "invalid regular expression");
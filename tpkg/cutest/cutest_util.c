@@ -10,6 +10,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include "tpkg/cutest/cutest.h"
 #include "region-allocator.h"
 #include "util.h"
@@ -19,6 +21,7 @@ static void util_2(CuTest *tc);
 static void util_3(CuTest *tc);
 static void util_4(CuTest *tc);
 static void util_5(CuTest *tc);
+static void util_6(CuTest *tc);
 
 CuSuite* reg_cutest_util(void)
 {
@@ -29,6 +32,7 @@ CuSuite* reg_cutest_util(void)
 	SUITE_ADD_TEST(suite, util_3);
 	SUITE_ADD_TEST(suite, util_4);
 	SUITE_ADD_TEST(suite, util_5);
+	SUITE_ADD_TEST(suite, util_6);
 	return suite;
 }
 
@@ -226,3 +230,39 @@ static void util_5(CuTest *tc)
 
 	free(bset);
 }
+
+/* test addr_in_netblock */
+static void util_6(CuTest *tc)
+{
+#ifdef INET6
+	struct sockaddr_storage addr;
+#else
+	struct sockaddr_in addr;
+#endif
+	struct sockaddr_in* sa = (struct sockaddr_in*)&addr;
+	uint8_t net[16];
+
+	memset(&addr, 0, sizeof(addr));
+	sa->sin_family = AF_INET;
+	inet_pton(AF_INET, "192.0.2.77", &sa->sin_addr);
+	inet_pton(AF_INET, "192.0.2.64", net);
+	CuAssert(tc, "in /26", addr_in_netblock(&addr, AF_INET, net, 26));
+	CuAssert(tc, "not in /29", !addr_in_netblock(&addr, AF_INET, net, 29));
+	CuAssert(tc, "in /0", addr_in_netblock(&addr, AF_INET, net, 0));
+	CuAssert(tc, "not the host", !addr_in_netblock(&addr, AF_INET, net,
+		200));
+	inet_pton(AF_INET, "192.0.2.77", net);
+	CuAssert(tc, "the host", addr_in_netblock(&addr, AF_INET, net, 200));
+#ifdef INET6
+	CuAssert(tc, "other family", !addr_in_netblock(&addr, AF_INET6, net,
+		0));
+	memset(&addr, 0, sizeof(addr));
+	((struct sockaddr_in6*)&addr)->sin6_family = AF_INET6;
+	inet_pton(AF_INET6, "2001:db8::1", &((struct sockaddr_in6*)&addr)
+		->sin6_addr);
+	inet_pton(AF_INET6, "2001:db8:1::", net);
+	CuAssert(tc, "in /32", addr_in_netblock(&addr, AF_INET6, net, 32));
+	CuAssert(tc, "not in /48", !addr_in_netblock(&addr, AF_INET6, net,
+		48));
+#endif
+}
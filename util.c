@@ -1050,6 +1050,38 @@ addrport2str(
 		(unsigned)ntohs(((struct sockaddr_in *)addr)->sin_port));
 }
 
+int
+addr_in_netblock(
+#ifdef INET6
+	struct sockaddr_storage *addr
+#else
+	struct sockaddr_in *addr
+#endif
+	, int family, const uint8_t* net, int prefix)
+{
+	const uint8_t* a;
+	int af = ((struct sockaddr*)addr)->sa_family, i;
+	if(af != family)
+		return 0;
+	if(af == AF_INET) {
+		a = (const uint8_t*)&((struct sockaddr_in*)addr)->sin_addr;
+		if(prefix > 32) prefix = 32;
+#ifdef INET6
+	} else if(af == AF_INET6) {
+		a = (const uint8_t*)&((struct sockaddr_in6*)addr)->sin6_addr;
+		if(prefix > 128) prefix = 128;
+#endif
+	} else {
+		return 0;
+	}
+	for(i=0; prefix >= 8; i++, prefix -= 8)
+		if(a[i] != net[i])
+			return 0;
+	if(prefix > 0 && ((a[i]^net[i]) & (uint8_t)(0xff << (8-prefix))) != 0)
+		return 0;
+	return 1;
+}
+
 void
 append_trailing_slash(const char** dirname, region_type* region)
 {
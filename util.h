@@ -415,6 +415,17 @@ void addrport2str(
 #endif
 	, char* str, size_t len);
 
+/* true if the address is in the netblock of family AF_INET or AF_INET6,
+ * with the address bytes in net, and prefix length prefix. A prefix that
+ * is longer than the address matches the whole address. */
+int addr_in_netblock(
+#ifdef INET6
+	struct sockaddr_storage *addr
+#else
+	struct sockaddr_in *addr
+#endif
+	, int family, const uint8_t* net, int prefix);
+
 /** copy dirname string and append slash.  Previous dirname is leaked,
  * but it is to be used once, at startup, for chroot */
 void append_trailing_slash(const char** dirname, struct region* region);
@@ -1159,7 +1159,7 @@ xfr_writer_write_packet(struct xfrd_xfr_writer* xw)
 			 , xw->producer_zone->options->pattern->pname
 			 , xw->old_serial, xw->new_serial, xw->seq_nr
 			 , buffer_begin(&xw->packet), buffer_limit(&xw->packet)
-			 , xfrd->nsd, xw->xfrfilenumber);
+			 , xfrd->nsd, xw->xfrfilenumber, NULL);
 	xw->seq_nr += 1;
 	buffer_clear(&xw->packet);
 	buffer_write(&xw->packet, "\000\000\000\000\000\000"
@@ -1184,7 +1184,7 @@ xfr_writer_commit(struct xfrd_xfr_writer* xw, const char *fmt, ...)
 	diff_write_commit( dname_to_string(producer_name, NULL)
 			 , xw->old_serial, xw->new_serial
 			 , xw->seq_nr /* Number of packets */
-			 , 1, msg, xfrd->nsd, xw->xfrfilenumber);
+			 , 1, msg, xfrd->nsd, xw->xfrfilenumber, NULL);
 	task_new_apply_xfr( xfrd->nsd->task[xfrd->nsd->mytask], xfrd->last_task
 			  , producer_name
 			  , xw->old_serial, xw->new_serial, xw->xfrfilenumber);
@@ -600,16 +600,14 @@ xfrd_unlink_xfrfile(struct nsd* nsd, uint64_t number)
 	}
 }
 
-uint64_t
-xfrd_get_xfrfile_size(struct nsd* nsd, uint64_t number )
+int
+xfrd_xfrfile_size(struct nsd* nsd, uint64_t number, uint64_t* size)
 {
 	char fname[1200];
-	struct stat tempxfr_stat;
+	struct stat s;
 	tempxfrname(fname, sizeof(fname), nsd, number);
-	if( stat( fname, &tempxfr_stat ) < 0 ) {
-	    log_msg(LOG_WARNING, "could not get file size %s: %s", fname,
-		    strerror(errno));
-	    return 0;
-	}
-	return (uint64_t)tempxfr_stat.st_size;
+	if(stat(fname, &s) == -1)
+		return 0;
+	*size = (uint64_t)s.st_size;
+	return 1;
 }
@@ -636,12 +636,12 @@ pipeline_find(struct xfrd_tcp_set* set, xfrd_zone_type* zone)
 	struct xfrd_tcp_pipeline_key k, *key=&k;
 	key->node.key = key;
 	key->ip_len = xfrd_acl_sockaddr_to(zone->master, &key->ip);
-	key->num_unused = set->tcp_pipeline;
+	/* one more than a pipeline can have unused, so the key sorts after
+	 * all the pipelines to the master, also an idle one that has all
+	 * its IDs unused */
+	key->num_unused = set->tcp_pipeline+1;
 	/* lookup existing tcp transfer to the master with highest unused */
-	if(rbtree_find_less_equal(set->pipetree, key, &sme)) {
-		/* exact match, strange, fully unused tcp cannot be open */
-		assert(0);
-	} 
+	(void)rbtree_find_less_equal(set->pipetree, key, &sme);
 	if(!sme)
 		return NULL;
 	r = (struct xfrd_tcp_pipeline*)sme->key;
@@ -743,7 +743,8 @@ tcp_pipe_reset_timeout(struct xfrd_tcp_pipeline* tp)
 {
 	int fd = tp->handler.ev_fd;
 	struct timeval tv;
-	tv.tv_sec = xfrd->tcp_set->tcp_timeout;
+	tv.tv_sec = (tp->idle?xfrd->nsd->options->xfrd_tcp_idle_timeout:
+		xfrd->tcp_set->tcp_timeout);
 	tv.tv_usec = 0;
 	if(tp->handler_added)
 		event_del(&tp->handler);
@@ -765,6 +766,18 @@ tcp_pipe_reset_timeout(struct xfrd_tcp_pipeline* tp)
 	tp->handler_added = 1;
 }
 
+/* the number of the tcp pipe in the set */
+static int
+pipeline_conn(struct xfrd_tcp_set* set, struct xfrd_tcp_pipeline* tp)
+{
+	int i;
+	for(i=0; i<set->tcp_max; i++) {
+		if(set->tcp_state[i] == tp)
+			return i;
+	}
+	return -1;
+}
+
 /* handle event from fd of tcp pipe */
 void
 xfrd_handle_tcp_pipe(int ATTR_UNUSED(fd), short event, void* arg)
@@ -784,6 +797,13 @@ xfrd_handle_tcp_pipe(int ATTR_UNUSED(fd), short event, void* arg)
 		xfrd_tcp_read(tp);
 	}
 	if((event & EV_TIMEOUT) && tp->handler_added) {
+		if(tp->idle) {
+			/* the idle connection is not used again in time */
+			DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: tcp idle timeout"));
+			xfrd_tcp_pipe_release(xfrd->tcp_set, tp,
+				pipeline_conn(xfrd->tcp_set, tp));
+			return;
+		}
 		/* tcp connection timed out */
 		DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: event tcp timeout"));
 		xfrd_tcp_pipe_stop(tp);
@@ -798,6 +818,16 @@ pipeline_setup_new_zone(struct xfrd_tcp_set* set, struct xfrd_tcp_pipeline* tp,
 	/* assign the ID */
 	int idx;
 	assert(tp->key.num_unused > 0);
+	if(tp->idle) {
+		/* the connection was kept open, no connect or handshake */
+		tp->idle = 0;
+		tp->reused = 1;
+		xfrd->tcp_reused++;
+#ifdef HAVE_TLS_1_3
+		if(tp->ssl)
+			xfrd->tls_reused++;
+#endif
+	}
 	/* we pick a random ID, even though it is TCP anyway */
 	idx = random_generate(tp->key.num_unused);
 	zone->query_id = tp->unused[idx];
@@ -825,6 +855,57 @@ pipeline_setup_new_zone(struct xfrd_tcp_set* set, struct xfrd_tcp_pipeline* tp,
 	}
 }
 
+/* use the pipeline, that is open to the master of the zone */
+static void
+pipeline_use(struct xfrd_tcp_set* set, struct xfrd_tcp_pipeline* tp,
+	xfrd_zone_type* zone)
+{
+	if(zone->zone_handler.ev_fd != -1)
+		xfrd_udp_release(zone);
+	zone->tcp_conn = pipeline_conn(set, tp);
+	xfrd_deactivate_zone(zone);
+	xfrd_unset_timer(zone);
+	pipeline_setup_new_zone(set, tp, zone);
+}
+
+/* close an idle pipeline, so that its slot can connect to another
+ * master, returns false if there is no idle pipeline */
+static int
+pipeline_close_idle(struct xfrd_tcp_set* set)
+{
+	int i;
+	assert(!set->tcp_waiting_first);
+	for(i=0; i<set->tcp_max; i++) {
+		if(set->tcp_state[i]->idle) {
+			xfrd_tcp_pipe_release(set, set->tcp_state[i], i);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* see if the pipeline, that has no queries, is kept open */
+static int
+pipeline_keep_idle(struct xfrd_tcp_set* set, struct xfrd_tcp_pipeline* tp)
+{
+	int i, num = 0;
+	if(xfrd->nsd->options->xfrd_tcp_idle_timeout <= 0 ||
+		!tp->connection_established || set->tcp_waiting_first)
+		return 0;
+#ifdef HAVE_TLS_1_3
+	if(tp->ssl && !tp->handshake_done)
+		return 0;
+#endif
+	/* the number of idle connections to the master is limited */
+	for(i=0; i<set->tcp_max; i++) {
+		struct xfrd_tcp_pipeline* t = set->tcp_state[i];
+		if(t != tp && t->idle && t->key.ip_len == tp->key.ip_len &&
+			memcmp(&t->key.ip, &tp->key.ip, tp->key.ip_len) == 0)
+			num++;
+	}
+	return num < xfrd->nsd->options->xfrd_tcp_pool_size;
+}
+
 void
 xfrd_tcp_obtain(struct xfrd_tcp_set* set, xfrd_zone_type* zone)
 {
@@ -832,6 +913,18 @@ xfrd_tcp_obtain(struct xfrd_tcp_set* set, xfrd_zone_type* zone)
 	assert(zone->tcp_conn == -1);
 	assert(zone->tcp_waiting == 0);
 
+	/* an idle connection to the master is used again, it has the most
+	 * unused IDs of the pipelines to the master */
+	tp = (zone->master?pipeline_find(set, zone):NULL);
+	if(tp && tp->idle) {
+		pipeline_use(set, tp, zone);
+		return;
+	}
+	/* with no pipeline to the master, an idle one to another master
+	 * makes room */
+	if(set->tcp_count >= set->tcp_max && !tp && !set->tcp_waiting_first)
+		(void)pipeline_close_idle(set);
+
 	if(set->tcp_count < set->tcp_max) {
 		int i;
 		assert(!set->tcp_waiting_first);
@@ -872,17 +965,8 @@ xfrd_tcp_obtain(struct xfrd_tcp_set* set, xfrd_zone_type* zone)
 		return;
 	}
 	/* check for a pipeline to the same master with unused ID */
-	if((tp = pipeline_find(set, zone))!= NULL) {
-		int i;
-		if(zone->zone_handler.ev_fd != -1)
-			xfrd_udp_release(zone);
-		for(i=0; i<set->tcp_max; i++) {
-			if(set->tcp_state[i] == tp)
-				zone->tcp_conn = i;
-		}
-		xfrd_deactivate_zone(zone);
-		xfrd_unset_timer(zone);
-		pipeline_setup_new_zone(set, tp, zone);
+	if(tp) {
+		pipeline_use(set, tp, zone);
 		return;
 	}
 
@@ -1091,6 +1175,7 @@ xfrd_tcp_open(struct xfrd_tcp_set* set, struct xfrd_tcp_pipeline* tp,
 	if(event_add(&tp->handler, &tv) != 0)
 		log_msg(LOG_ERR, "xfrd tcp: event_add failed");
 	tp->handler_added = 1;
+	xfrd->tcp_opened++;
 	return 1;
 }
 
@@ -1573,12 +1658,43 @@ conn_read(struct xfrd_tcp* tcp)
 	return 1;
 }
 
+/* see if the answer is only the SOA record with the current serial, to
+ * an IXFR, the zone is up to date. The answer is complete, no more
+ * packets with the ID follow, and the connection can be kept open. */
+static int
+tcp_answer_current_soa(xfrd_zone_type* zone, buffer_type* packet)
+{
+	int r = 0, i;
+	if(zone->latest_xfr->query_type != TYPE_IXFR ||
+		!zone->soa_disk_acquired || RCODE(packet) != RCODE_OK ||
+		ANCOUNT(packet) != 1)
+		return 0;
+	buffer_set_position(packet, QHEADERSZ);
+	for(i=0; i<QDCOUNT(packet); i++) {
+		if(!packet_skip_rr(packet, 1)) {
+			buffer_set_position(packet, 0);
+			return 0;
+		}
+	}
+	/* owner, type, class, ttl, rdlength, and the rdata up to serial */
+	if(packet_skip_dname(packet) && buffer_available(packet, 10) &&
+		buffer_read_u16(packet) == TYPE_SOA) {
+		buffer_skip(packet, 8);
+		if(packet_skip_dname(packet) && packet_skip_dname(packet) &&
+			buffer_available(packet, 4))
+			r = (htonl(buffer_read_u32(packet)) ==
+				zone->soa_disk.serial);
+	}
+	buffer_set_position(packet, 0);
+	return r;
+}
+
 void
 xfrd_tcp_read(struct xfrd_tcp_pipeline* tp)
 {
 	xfrd_zone_type* zone;
 	struct xfrd_tcp* tcp = tp->tcp_r;
-	int ret;
+	int ret, soa_only;
 	enum xfrd_packet_result pkt_result;
 #ifdef HAVE_TLS_1_3
 	if(tp->ssl) {
@@ -1606,8 +1722,19 @@ xfrd_tcp_read(struct xfrd_tcp_pipeline* tp)
 	} else 
 #endif
 		ret = conn_read(tcp);
+	if(ret == -1 && tp->idle) {
+		/* the master closed the idle connection */
+		DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: idle tcp closed"));
+		xfrd_tcp_pipe_release(xfrd->tcp_set, tp,
+			pipeline_conn(xfrd->tcp_set, tp));
+		return;
+	}
 	if(ret == -1) {
-		if(errno != 0)
+		if(tp->reused) {
+			/* the zones retry on a new connection */
+			VERBOSITY(2, (LOG_INFO, "xfrd: reused tcp connection "
+				"was closed: %s", errno?strerror(errno):"EOF"));
+		} else if(errno != 0)
 			log_msg(LOG_ERR, "xfrd: failed reading tcp %s", strerror(errno));
 		else
 			log_msg(LOG_ERR, "xfrd: failed reading tcp: closed");
@@ -1616,6 +1743,7 @@ xfrd_tcp_read(struct xfrd_tcp_pipeline* tp)
 	}
 	if(ret == 0)
 		return;
+	tp->reused = 0;
 	/* completed msg */
 	buffer_flip(tcp->packet);
 	/* see which ID number it is, if skip, handle skip, NULL: warn */
@@ -1638,6 +1766,7 @@ xfrd_tcp_read(struct xfrd_tcp_pipeline* tp)
 	assert(zone->tcp_conn != -1);
 
 	/* handle message for zone */
+	soa_only = tcp_answer_current_soa(zone, tcp->packet);
 	pkt_result = xfrd_handle_received_xfr_packet(zone, tcp->packet);
 	/* setup for reading the next packet on this connection */
 	tcp_conn_ready_for_reading(tcp);
@@ -1647,8 +1776,10 @@ xfrd_tcp_read(struct xfrd_tcp_pipeline* tp)
 			break;
 		case xfrd_packet_newlease:
 			/* set to skip if more packets with this ID */
-			xfrd_tcp_pipeline_skip_id(tp, zone->query_id);
-			tp->key.num_skip++;
+			if(!soa_only) {
+				xfrd_tcp_pipeline_skip_id(tp, zone->query_id);
+				tp->key.num_skip++;
+			}
 			/* fall through to remove zone from tp */
 			/* fallthrough */
 		case xfrd_packet_transfer:
@@ -1670,8 +1801,10 @@ xfrd_tcp_read(struct xfrd_tcp_pipeline* tp)
 		case xfrd_packet_tcp:
 		default:
 			/* set to skip if more packets with this ID */
-			xfrd_tcp_pipeline_skip_id(tp, zone->query_id);
-			tp->key.num_skip++;
+			if(!soa_only) {
+				xfrd_tcp_pipeline_skip_id(tp, zone->query_id);
+				tp->key.num_skip++;
+			}
 			xfrd_tcp_release(xfrd->tcp_set, zone);
 			/* query next server */
 			xfrd_make_request(zone);
@@ -1723,6 +1856,13 @@ xfrd_tcp_release(struct xfrd_tcp_set* set, xfrd_zone_type* zone)
 		/* waiting zone did not go to same server */
 	}
 
+	/* if all unused, keep it open for the next transfers, or close it */
+	if(tp->key.num_unused >= tp->pipe_num && pipeline_keep_idle(set, tp)) {
+		DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: tcp pipe is idle"));
+		tp->idle = 1;
+		tcp_pipe_reset_timeout(tp);
+		return;
+	}
 	/* if all unused, or only skipped leftover, close the pipeline */
 	if(tp->key.num_unused >= tp->pipe_num || tp->key.num_skip >= tp->pipe_num - tp->key.num_unused)
 		xfrd_tcp_pipe_release(set, tp, conn);
@@ -1733,6 +1873,8 @@ xfrd_tcp_pipe_release(struct xfrd_tcp_set* set, struct xfrd_tcp_pipeline* tp,
 	int conn)
 {
 	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: tcp pipe released"));
+	tp->idle = 0;
+	tp->reused = 0;
 	/* one handler per tcp pipe */
 	if(tp->handler_added)
 		event_del(&tp->handler);
@@ -140,6 +140,13 @@ struct xfrd_tcp_pipeline {
 	struct xfrd_tcp* tcp_w;
 	/* once a byte has been written, handshake complete */
 	int connection_established;
+	/* the pipeline has no queries, it is kept open, for the idle timeout,
+	 * for the next transfers from the primary */
+	int idle;
+	/* the pipeline was kept open and is used again, but no answer has
+	 * been read since, if it fails, the primary closed it in the mean
+	 * time */
+	int reused;
 #ifdef HAVE_TLS_1_3
 	/* XoT: SSL object */
 	SSL *ssl;
@@ -13,6 +13,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <inttypes.h>
@@ -32,6 +33,7 @@
 #include "ipc.h"
 #include "remote.h"
 #include "rrl.h"
+#include "qtrace.h"
 #ifdef USE_DNSTAP
 #include "dnstap/dnstap_collector.h"
 #endif
@@ -88,15 +90,32 @@ static void xfrd_set_timer_refresh(xfrd_zone_type* zone);
 
 /* set reload timeout */
 static void xfrd_set_reload_timeout(void);
+/* schedule the reload for the waiting updates */
+static void xfrd_schedule_reload(void);
+/* schedule the reload for the transfer that is committed for the zone */
+static void xfrd_reload_for_xfr(xfrd_zone_type* zone, uint64_t size);
+/* account the time from receiving the transfer to serving it */
+static void xfrd_stat_staleness(xfrd_xfr_type* xfr);
 /* handle reload timeout */
 static void xfrd_handle_reload(int fd, short event, void* arg);
 /* handle child timeout */
 static void xfrd_handle_child_timer(int fd, short event, void* arg);
 
-/* send ixfr request, returns fd of connection to read on */
-static int xfrd_send_ixfr_request_udp(xfrd_zone_type* zone);
+/* send ixfr request on the udp socket of the primary, false on failure */
+static int xfrd_send_ixfr_request_udp(xfrd_zone_type* zone,
+	struct xfrd_udp_sock* s);
 /* obtain udp socket slot */
 static void xfrd_udp_obtain(xfrd_zone_type* zone);
+/* send the probes of zones that wait, while sockets are available */
+static void xfrd_udp_start_waiting(void);
+/* remove zone from the udp waiting list of its primary */
+static void xfrd_udp_waiting_remove(xfrd_zone_type* zone);
+/* the udp probe of the zone is done, its socket may close */
+static void xfrd_udp_probe_end(xfrd_zone_type* zone);
+/* account the refresh lag of the request that is sent for the zone */
+static void xfrd_stat_refresh_lag(xfrd_zone_type* zone);
+/* spread the refresh of the zones that are due at the start */
+static void xfrd_spread_activated(void);
 
 /* read data via udp */
 static void xfrd_udp_read(xfrd_zone_type* zone);
@@ -159,8 +178,10 @@ xfrd_init(int socket, struct nsd* nsd, int shortsoa, int reload_active,
 	}
 	xfrd->nsd = nsd;
 	xfrd->packet = buffer_create(xfrd->region, QIOBUFSZ);
-	xfrd->udp_waiting_first = NULL;
-	xfrd->udp_waiting_last = NULL;
+	xfrd->primaries = rbtree_create(xfrd->region,
+		(int (*)(const void *, const void *)) strcmp);
+	xfrd->udp_ready_first = NULL;
+	xfrd->udp_ready_last = NULL;
 	xfrd->udp_use_num = 0;
 	xfrd->got_time = 0;
 	xfrd->xfrfilenumber = 0;
@@ -236,6 +257,7 @@ xfrd_init(int socket, struct nsd* nsd, int shortsoa, int reload_active,
 	xfrd_receive_soa(socket, shortsoa);
 	if(nsd->options->xfrdfile != NULL && nsd->options->xfrdfile[0]!=0)
 		xfrd_read_state(xfrd);
+	xfrd_spread_activated();
 	
 	/* did we get killed before startup was successful? */
 	if(nsd->signal_hint_shutdown) {
@@ -394,12 +416,13 @@ xfrd_shutdown()
 	{
 		if(zone->event_added) {
 			event_del(&zone->zone_handler);
-			if(zone->zone_handler.ev_fd != -1) {
-				close(zone->zone_handler.ev_fd);
-				zone->zone_handler.ev_fd = -1;
-			}
 			zone->event_added = 0;
 		}
+		if(zone->udp_sock) {
+			/* closes the socket with the last probe */
+			xfrd_udp_probe_end(zone);
+			zone->zone_handler.ev_fd = -1;
+		}
 	}
 	close_notify_fds(xfrd->notify_zones);
 
@@ -488,6 +511,7 @@ xfrd_shutdown()
 #ifdef RATELIMIT
 	rrl_mmap_deinit();
 #endif
+	qtrace_mmap_deinit();
 #ifdef USE_DNSTAP
 	dt_collector_destroy(nsd.dt_collector, &nsd);
 #endif
@@ -872,6 +896,7 @@ xfrd_process_soa_info_task(struct task_list_d* task)
 				(soa_ptr && soa_ptr->serial == htonl(xfr->msg_new_serial)))
 				apply_xfrs_to_consumer_zone(
 					consumer_zone, dbzone, xfr);
+			xfrd_stat_staleness(xfr);
 		}
 		DEBUG(DEBUG_IPC, 1,
 			(LOG_INFO, "xfrd: zone %s delete update to serial %u",
@@ -1066,15 +1091,7 @@ xfrd_del_slave_zone(xfrd_state_type* xfrd, const dname_type* dname)
 	}
 	if(z->udp_waiting) {
 		/* delete from udp waiting list */
-		if(z->udp_waiting_prev)
-			z->udp_waiting_prev->udp_waiting_next =
-				z->udp_waiting_next;
-		else	xfrd->udp_waiting_first = z->udp_waiting_next;
-		if(z->udp_waiting_next)
-			z->udp_waiting_next->udp_waiting_prev =
-				z->udp_waiting_prev;
-		else	xfrd->udp_waiting_last = z->udp_waiting_prev;
-		z->udp_waiting = 0;
+		xfrd_udp_waiting_remove(z);
 	}
 	xfrd_deactivate_zone(z);
 	if(z->tcp_conn != -1) {
@@ -1189,13 +1206,6 @@ xfrd_handle_zone(int ATTR_UNUSED(fd), short event, void* arg)
 		event = EV_TIMEOUT;
 	}
 
-	if((event & EV_READ)) {
-		/* busy in udp transaction */
-		DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: zone %s event udp read", zone->apex_str));
-		xfrd_udp_read(zone);
-		return;
-	}
-
 	/* timeout */
 	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: zone %s timeout", zone->apex_str));
 	if(zone->zone_handler.ev_fd != -1 && zone->event_added &&
@@ -1237,8 +1247,15 @@ xfrd_handle_zone(int ATTR_UNUSED(fd), short event, void* arg)
 
 	/* only make a new request if no request is running (UDPorTCP) */
 	if(zone->zone_handler.ev_fd == -1 && zone->tcp_conn == -1) {
+		/* the refresh lag counts from the time the timer was due */
+		zone->request_due = ((event&EV_TIMEOUT) && zone->timer_due)?
+			zone->timer_due:xfrd_time();
 		/* make a new request */
 		xfrd_make_request(zone);
+		/* no request is sent, and none waits for its turn */
+		if(!zone->udp_waiting && !zone->tcp_waiting &&
+			zone->zone_handler.ev_fd == -1 && zone->tcp_conn == -1)
+			zone->request_due = 0;
 	}
 }
 
@@ -1360,49 +1377,402 @@ xfrd_make_request(xfrd_zone_type* zone)
 	}
 }
 
+/* the primary for the probes of the zone, created if it is new */
+static struct xfrd_primary*
+xfrd_primary_find(xfrd_zone_type* zone)
+{
+	struct xfrd_primary* p;
+	struct acl_options* ifc;
+	char name[1024];
+	size_t len;
+	/* the sockets are bound to the outgoing-interface of the zone */
+	snprintf(name, sizeof(name), "%s", zone->master->ip_address_spec);
+	for(ifc = zone->zone_options->pattern->outgoing_interface; ifc;
+		ifc = ifc->next) {
+		len = strlen(name);
+		snprintf(name+len, sizeof(name)-len, " %s",
+			ifc->ip_address_spec);
+	}
+	p = (struct xfrd_primary*)rbtree_search(xfrd->primaries, name);
+	if(p)
+		return p;
+	p = (struct xfrd_primary*)region_alloc_zero(xfrd->region, sizeof(*p));
+	p->name = region_strdup(xfrd->region, name);
+	p->node.key = p->name;
+	rbtree_insert(xfrd->primaries, &p->node);
+	return p;
+}
+
+/* put the primary at the end of the list of primaries that wait for a
+ * udp socket, if it has waiting zones and a turn in its budget */
+static void
+xfrd_udp_ready_add(struct xfrd_primary* p)
+{
+	if(p->udp_ready || !p->udp_waiting_first ||
+		p->udp_num >= xfrd->nsd->options->xfrd_udp_per_primary)
+		return;
+	p->udp_ready = 1;
+	p->udp_ready_next = NULL;
+	if(xfrd->udp_ready_last)
+		xfrd->udp_ready_last->udp_ready_next = p;
+	else	xfrd->udp_ready_first = p;
+	xfrd->udp_ready_last = p;
+}
+
+static void
+xfrd_udp_waiting_remove(xfrd_zone_type* zone)
+{
+	struct xfrd_primary* p = zone->udp_primary;
+	assert(zone->udp_waiting && p);
+	if(zone->udp_waiting_prev)
+		zone->udp_waiting_prev->udp_waiting_next =
+			zone->udp_waiting_next;
+	else	p->udp_waiting_first = zone->udp_waiting_next;
+	if(zone->udp_waiting_next)
+		zone->udp_waiting_next->udp_waiting_prev =
+			zone->udp_waiting_prev;
+	else	p->udp_waiting_last = zone->udp_waiting_prev;
+	zone->udp_waiting = 0;
+	zone->udp_primary = NULL;
+}
+
+static int
+xfrd_udp_probe_compare(const void* x, const void* y)
+{
+	struct xfrd_udp_probe* a = (struct xfrd_udp_probe*)x;
+	struct xfrd_udp_probe* b = (struct xfrd_udp_probe*)y;
+	if(a->id < b->id)
+		return -1;
+	if(a->id > b->id)
+		return 1;
+	return 0;
+}
+
+static struct xfrd_udp_probe*
+xfrd_udp_probe_lookup(struct xfrd_udp_sock* s, uint16_t id)
+{
+	struct xfrd_udp_probe key;
+	rbnode_type* n;
+	memset(&key, 0, sizeof(key));
+	key.node.key = &key;
+	key.id = id;
+	n = rbtree_search(s->probes, &key);
+	if(n && n != RBTREE_NULL)
+		return (struct xfrd_udp_probe*)n;
+	return NULL;
+}
+
+/* a query ID that is not in use by the probes on the socket */
+static uint16_t
+xfrd_udp_probe_new_id(struct xfrd_udp_sock* s)
+{
+	uint16_t id;
+	do {
+		id = qid_generate();
+	} while(xfrd_udp_probe_lookup(s, id));
+	return id;
+}
+
+/* the primary is done with the socket, close it when no probes remain */
+static void
+xfrd_udp_sock_close(struct xfrd_udp_sock* s)
+{
+	if(s->primary->udp_sock == s)
+		s->primary->udp_sock = NULL;
+	if(s->probes->count != 0)
+		return;
+	event_del(&s->handler);
+	close(s->handler.ev_fd);
+	s->handler.ev_fd = -1;
+	s->next = xfrd->udp_sock_free;
+	xfrd->udp_sock_free = s;
+	if(xfrd->udp_use_num > 0)
+		xfrd->udp_use_num--;
+}
+
+/* the answer is for the probe of the zone, if the question is the same */
+static int
+xfrd_udp_answer_match(xfrd_zone_type* zone, buffer_type* packet)
+{
+	uint8_t qname[MAXDOMAINLEN+1];
+	int len;
+	if(QDCOUNT(packet) != 1)
+		return 0;
+	buffer_set_position(packet, QHEADERSZ);
+	len = dname_make_wire_from_packet(qname, packet, 1);
+	if(len == 0 || len != zone->apex->name_size ||
+		!dname_equal_nocase(qname, (uint8_t*)dname_name(zone->apex),
+		len) || !buffer_available(packet, 4) ||
+		buffer_read_u16(packet) != TYPE_IXFR ||
+		buffer_read_u16(packet) != CLASS_IN)
+		return 0;
+	buffer_set_position(packet, 0);
+	return 1;
+}
+
+/* read an answer on the socket of a primary, for one of its probes */
+static void
+xfrd_udp_sock_handle(int fd, short event, void* arg)
+{
+	struct xfrd_udp_sock* s = (struct xfrd_udp_sock*)arg;
+	struct xfrd_udp_probe* probe;
+	ssize_t received;
+	if(!(event & EV_READ))
+		return;
+	buffer_clear(xfrd->packet);
+	received = recv(fd, buffer_begin(xfrd->packet),
+		buffer_remaining(xfrd->packet), 0);
+	if(received == -1) {
+		/* the socket is connected, errors for the probes from
+		 * ICMP are reported here, the probes time out */
+		if(errno != EAGAIN && errno != EINTR &&
+			errno != ECONNREFUSED)
+			log_msg(LOG_ERR, "xfrd: recv from %s failed: %s",
+				s->primary->name, strerror(errno));
+		return;
+	} else if(received < QHEADERSZ) {
+		log_msg(LOG_ERR, "xfrd: UDP packet too small");
+		return;
+	}
+	buffer_set_limit(xfrd->packet, received);
+	probe = xfrd_udp_probe_lookup(s, ID(xfrd->packet));
+	if(!probe || !xfrd_udp_answer_match(probe->zone, xfrd->packet)) {
+		VERBOSITY(2, (LOG_INFO, "xfrd: dropped UDP answer from %s "
+			"that is not for a query in progress", s->primary->name));
+		return;
+	}
+	xfrd_udp_read(probe->zone);
+}
+
+/* open a udp socket to the primary of the zone, for the probes. The
+ * probes share the port, so a spoofed answer only has to guess the query
+ * ID, the port is changed after XFRD_UDP_SOCK_QUERIES queries. The socket
+ * is bound to the outgoing-interface of the zone, and used only for zones
+ * with the same outgoing-interface. */
+static struct xfrd_udp_sock*
+xfrd_udp_sock_open(struct xfrd_primary* p, xfrd_zone_type* zone)
+{
+#ifdef INET6
+	struct sockaddr_storage to;
+#else
+	struct sockaddr_in to;
+#endif /* INET6 */
+	struct acl_options* ifc = zone->zone_options->pattern->
+		outgoing_interface;
+	struct xfrd_udp_sock* s;
+	int fd, family;
+
+	/* this will set the remote port to acl->port or TCP_PORT */
+	socklen_t to_len = xfrd_acl_sockaddr_to(zone->master, &to);
+
+	/* get the address family of the remote host */
+	if(zone->master->is_ipv6) {
+#ifdef INET6
+		family = PF_INET6;
+#else
+		return NULL;
+#endif /* INET6 */
+	} else {
+		family = PF_INET;
+	}
+
+	fd = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+	if(fd == -1) {
+		log_msg(LOG_ERR, "xfrd: cannot create udp socket to %s: %s",
+			zone->master->ip_address_spec, strerror(errno));
+		return NULL;
+	}
+	if (!xfrd_bind_local_interface(fd, ifc, zone->master, 0)) {
+		log_msg(LOG_ERR, "xfrd: cannot bind outgoing interface '%s' to "
+				 "udp socket: No matching ip addresses found",
+			ifc->ip_address_spec);
+		close(fd);
+		return NULL;
+	}
+	/* only the primary can send answers to the connected socket */
+	if(connect(fd, (struct sockaddr*)&to, to_len) == -1) {
+		log_msg(LOG_ERR, "xfrd: cannot connect udp socket to %s: %s",
+			zone->master->ip_address_spec, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	if(fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+		log_msg(LOG_ERR, "xfrd: fcntl udp socket: %s",
+			strerror(errno));
+	}
+
+	if(xfrd->udp_sock_free) {
+		s = xfrd->udp_sock_free;
+		xfrd->udp_sock_free = s->next;
+	} else {
+		s = (struct xfrd_udp_sock*)region_alloc_zero(xfrd->region,
+			sizeof(*s));
+		s->probes = rbtree_create(xfrd->region,
+			&xfrd_udp_probe_compare);
+	}
+	s->primary = p;
+	s->ifc = ifc;
+	s->queries = 0;
+	s->next = NULL;
+	memset(&s->handler, 0, sizeof(s->handler));
+	event_set(&s->handler, fd, EV_PERSIST|EV_READ, xfrd_udp_sock_handle,
+		s);
+	if(event_base_set(xfrd->event_base, &s->handler) != 0)
+		log_msg(LOG_ERR, "xfrd udp: event_base_set failed");
+	if(event_add(&s->handler, NULL) != 0)
+		log_msg(LOG_ERR, "xfrd udp: event_add failed");
+	xfrd->udp_use_num++;
+	return s;
+}
+
+/* if the socket can be used for the probe of the zone, it has room and
+ * is bound to the outgoing-interface of the zone */
+static int
+xfrd_udp_sock_usable(struct xfrd_udp_sock* s, xfrd_zone_type* zone)
+{
+	return s && s->queries < XFRD_UDP_SOCK_QUERIES &&
+		s->ifc == zone->zone_options->pattern->outgoing_interface;
+}
+
+/* if the primary has a socket for the probe of the zone, or one can be
+ * opened */
+static int
+xfrd_udp_sock_available(struct xfrd_primary* p, xfrd_zone_type* zone)
+{
+	return xfrd_udp_sock_usable(p->udp_sock, zone)
+		|| xfrd->udp_use_num < XFRD_MAX_UDP;
+}
+
+/* send the udp probe for the zone to the primary, false on failure */
+static int
+xfrd_udp_send(xfrd_zone_type* zone, struct xfrd_primary* p)
+{
+	struct xfrd_udp_sock* s = p->udp_sock;
+	if(s && !xfrd_udp_sock_usable(s, zone)) {
+		/* the next queries get a new port, this socket is closed
+		 * when its probes are done */
+		xfrd_udp_sock_close(s);
+		s = NULL;
+	}
+	if(!s) {
+		if(!(s = xfrd_udp_sock_open(p, zone)))
+			return 0;
+		p->udp_sock = s;
+	}
+	if(!xfrd_send_ixfr_request_udp(zone, s)) {
+		xfrd_udp_sock_close(s);
+		return 0;
+	}
+	s->queries++;
+	zone->udp_probe.node.key = &zone->udp_probe;
+	zone->udp_probe.id = zone->query_id;
+	zone->udp_probe.zone = zone;
+	rbtree_insert(s->probes, &zone->udp_probe.node);
+	zone->udp_sock = s;
+	zone->udp_primary = p;
+	p->udp_num++;
+
+	/* the answer is read by the socket, the zone has the timeout */
+	if(zone->event_added)
+		event_del(&zone->zone_handler);
+	memset(&zone->zone_handler, 0, sizeof(zone->zone_handler));
+	event_set(&zone->zone_handler, s->handler.ev_fd,
+		EV_PERSIST|EV_TIMEOUT, xfrd_handle_zone, zone);
+	if(event_base_set(xfrd->event_base, &zone->zone_handler) != 0)
+		log_msg(LOG_ERR, "xfrd udp: event_base_set failed");
+	if(event_add(&zone->zone_handler, &zone->timeout) != 0)
+		log_msg(LOG_ERR, "xfrd udp: event_add failed");
+	zone->zone_handler_flags=EV_PERSIST|EV_TIMEOUT;
+	zone->event_added = 1;
+	return 1;
+}
+
+/* the probe of the zone is done, or stopped */
+static void
+xfrd_udp_probe_end(xfrd_zone_type* zone)
+{
+	struct xfrd_udp_sock* s = zone->udp_sock;
+	struct xfrd_primary* p = zone->udp_primary;
+	(void)rbtree_delete(s->probes, &zone->udp_probe);
+	zone->udp_sock = NULL;
+	zone->udp_primary = NULL;
+	if(p->udp_num > 0)
+		p->udp_num--;
+	if(s->probes->count == 0)
+		xfrd_udp_sock_close(s);
+}
+
 static void
 xfrd_udp_obtain(xfrd_zone_type* zone)
 {
+	struct xfrd_primary* p;
 	assert(zone->udp_waiting == 0);
 	if(zone->tcp_conn != -1) {
 		/* no tcp and udp at the same time */
 		xfrd_tcp_release(xfrd->tcp_set, zone);
 	}
-	if(xfrd->udp_use_num < XFRD_MAX_UDP) {
-		int fd;
-		xfrd->udp_use_num++;
-		fd = xfrd_send_ixfr_request_udp(zone);
-		if(fd == -1)
-			xfrd->udp_use_num--;
-		else {
-			if(zone->event_added)
-				event_del(&zone->zone_handler);
-			memset(&zone->zone_handler, 0,
-				sizeof(zone->zone_handler));
-			event_set(&zone->zone_handler, fd,
-				EV_PERSIST|EV_READ|EV_TIMEOUT,
-				xfrd_handle_zone, zone);
-			if(event_base_set(xfrd->event_base, &zone->zone_handler) != 0)
-				log_msg(LOG_ERR, "xfrd udp: event_base_set failed");
-			if(event_add(&zone->zone_handler, &zone->timeout) != 0)
-				log_msg(LOG_ERR, "xfrd udp: event_add failed");
-			zone->zone_handler_flags=EV_PERSIST|EV_READ|EV_TIMEOUT;
-			zone->event_added = 1;
-		}
+	/* every primary has a budget of probes, so that the zones of a
+	 * primary that does not answer do not take all the sockets */
+	p = xfrd_primary_find(zone);
+	if(!p->udp_waiting_first &&
+		p->udp_num < xfrd->nsd->options->xfrd_udp_per_primary &&
+		xfrd_udp_sock_available(p, zone)) {
+		(void)xfrd_udp_send(zone, p);
 		return;
 	}
-	/* queue the zone as last */
+	/* queue the zone as last at the primary */
 	zone->udp_waiting = 1;
+	zone->udp_primary = p;
 	zone->udp_waiting_next = NULL;
-	zone->udp_waiting_prev = xfrd->udp_waiting_last;
-	if(!xfrd->udp_waiting_first)
-		xfrd->udp_waiting_first = zone;
-	if(xfrd->udp_waiting_last)
-		xfrd->udp_waiting_last->udp_waiting_next = zone;
-	xfrd->udp_waiting_last = zone;
+	zone->udp_waiting_prev = p->udp_waiting_last;
+	if(!p->udp_waiting_first)
+		p->udp_waiting_first = zone;
+	if(p->udp_waiting_last)
+		p->udp_waiting_last->udp_waiting_next = zone;
+	p->udp_waiting_last = zone;
+	xfrd_udp_ready_add(p);
 	xfrd_unset_timer(zone);
 }
 
+static void
+xfrd_udp_start_waiting(void)
+{
+	struct xfrd_primary* p, *blocked_first = NULL, *blocked_last = NULL;
+	/* the primaries take turns, one probe at a time */
+	while((p = xfrd->udp_ready_first)) {
+		xfrd_zone_type* wz;
+		xfrd->udp_ready_first = p->udp_ready_next;
+		if(!xfrd->udp_ready_first)
+			xfrd->udp_ready_last = NULL;
+		p->udp_ready = 0;
+		if(!p->udp_waiting_first ||
+			p->udp_num >= xfrd->nsd->options->xfrd_udp_per_primary)
+			continue;
+		if(!xfrd_udp_sock_available(p, p->udp_waiting_first)) {
+			/* it waits for a socket to be closed */
+			p->udp_ready = 1;
+			p->udp_ready_next = NULL;
+			if(blocked_last)
+				blocked_last->udp_ready_next = p;
+			else	blocked_first = p;
+			blocked_last = p;
+			continue;
+		}
+		/* snip off waiting list */
+		wz = p->udp_waiting_first;
+		xfrd_udp_waiting_remove(wz);
+		/* see if this zone needs udp connection */
+		if(wz->tcp_conn == -1 && !xfrd_udp_send(wz, p)) {
+			/* make this zone do something with
+			 * this failure to act */
+			xfrd_set_refresh_now(wz);
+		}
+		xfrd_udp_ready_add(p);
+	}
+	xfrd->udp_ready_first = blocked_first;
+	xfrd->udp_ready_last = blocked_last;
+}
+
 time_t
 xfrd_time()
 {
@@ -1413,6 +1783,15 @@ xfrd_time()
 	return xfrd->current_time;
 }
 
+uint64_t
+xfrd_time_msec(void)
+{
+	struct timeval tv;
+	if(gettimeofday(&tv, NULL) == -1)
+		return (uint64_t)time(0)*1000;
+	return (uint64_t)tv.tv_sec*1000 + (uint64_t)tv.tv_usec/1000;
+}
+
 void
 xfrd_copy_soa(xfrd_soa_type* soa, rr_type* rr)
 {
@@ -1507,6 +1886,7 @@ xfrd_set_timer(xfrd_zone_type* zone, time_t t)
 		time_t base = t*9/10;
 		t = base + random_generate(t-base);
 	}
+	zone->timer_due = xfrd_time() + t;
 
 	/* keep existing flags and fd, but re-add with timeout */
 	if(zone->event_added)
@@ -1677,58 +2057,20 @@ xfrd_udp_read_packet(buffer_type* packet, int fd, struct sockaddr* src,
 void
 xfrd_udp_release(xfrd_zone_type* zone)
 {
+	struct xfrd_primary* p = zone->udp_primary;
 	assert(zone->udp_waiting == 0);
 	if(zone->event_added)
 		event_del(&zone->zone_handler);
-	if(zone->zone_handler.ev_fd != -1) {
-		close(zone->zone_handler.ev_fd);
-	}
+	if(zone->udp_sock)
+		xfrd_udp_probe_end(zone);
 	zone->zone_handler.ev_fd = -1;
 	zone->zone_handler_flags = 0;
 	zone->event_added = 0;
-	/* see if there are waiting zones */
-	if(xfrd->udp_use_num == XFRD_MAX_UDP)
-	{
-		while(xfrd->udp_waiting_first) {
-			/* snip off waiting list */
-			xfrd_zone_type* wz = xfrd->udp_waiting_first;
-			assert(wz->udp_waiting);
-			wz->udp_waiting = 0;
-			xfrd->udp_waiting_first = wz->udp_waiting_next;
-			if(wz->udp_waiting_next)
-				wz->udp_waiting_next->udp_waiting_prev = NULL;
-			if(xfrd->udp_waiting_last == wz)
-				xfrd->udp_waiting_last = NULL;
-			/* see if this zone needs udp connection */
-			if(wz->tcp_conn == -1) {
-				int fd = xfrd_send_ixfr_request_udp(wz);
-				if(fd != -1) {
-					if(wz->event_added)
-						event_del(&wz->zone_handler);
-					memset(&wz->zone_handler, 0,
-						sizeof(wz->zone_handler));
-					event_set(&wz->zone_handler, fd,
-						EV_READ|EV_TIMEOUT|EV_PERSIST,
-						xfrd_handle_zone, wz);
-					if(event_base_set(xfrd->event_base,
-						&wz->zone_handler) != 0)
-						log_msg(LOG_ERR, "cannot set event_base for ixfr");
-					if(event_add(&wz->zone_handler, &wz->timeout) != 0)
-						log_msg(LOG_ERR, "cannot add event for ixfr");
-					wz->zone_handler_flags = EV_READ|EV_TIMEOUT|EV_PERSIST;
-					wz->event_added = 1;
-					return;
-				} else {
-					/* make this zone do something with
-					 * this failure to act */
-					xfrd_set_refresh_now(wz);
-				}
-			}
-		}
-	}
-	/* no waiting zones */
-	if(xfrd->udp_use_num > 0)
-		xfrd->udp_use_num--;
+	zone->udp_primary = NULL;
+	/* the turn goes to the zones that wait */
+	if(p)
+		xfrd_udp_ready_add(p);
+	xfrd_udp_start_waiting();
 }
 
 /** disable ixfr for master */
@@ -1748,19 +2090,7 @@ static void
 xfrd_udp_read(xfrd_zone_type* zone)
 {
 	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: zone %s read udp data", zone->apex_str));
-	if(!xfrd_udp_read_packet(xfrd->packet, zone->zone_handler.ev_fd,
-		NULL, NULL)) {
-		zone->master->bad_xfr_count++;
-		if (zone->master->bad_xfr_count > 2) {
-			xfrd_disable_ixfr(zone);
-			zone->master->bad_xfr_count = 0;
-		}
-		/* drop packet */
-		xfrd_udp_release(zone);
-		/* query next server */
-		xfrd_make_request(zone);
-		return;
-	}
+	/* the packet was read from the socket of the primary */
 	switch(xfrd_handle_received_xfr_packet(zone, xfrd->packet)) {
 		case xfrd_packet_tcp:
 			xfrd_set_timer(zone, xfrd->tcp_set->tcp_timeout);
@@ -1966,9 +2296,9 @@ xfrd_tsig_sign_request(buffer_type* packet, tsig_record_type* tsig,
 }
 
 static int
-xfrd_send_ixfr_request_udp(xfrd_zone_type* zone)
+xfrd_send_ixfr_request_udp(xfrd_zone_type* zone, struct xfrd_udp_sock* s)
 {
-	int fd, apex_compress = 0;
+	int apex_compress = 0;
 
 	/* make sure we have a master to query the ixfr request to */
 	assert(zone->master);
@@ -1977,10 +2307,11 @@ xfrd_send_ixfr_request_udp(xfrd_zone_type* zone)
 		/* tcp is using the zone_handler.fd */
 		log_msg(LOG_ERR, "xfrd: %s tried to send udp whilst tcp engaged",
 			zone->apex_str);
-		return -1;
+		return 0;
 	}
+	/* the ID tells the answers on the socket apart */
 	xfrd_setup_packet(xfrd->packet, TYPE_IXFR, CLASS_IN, zone->apex,
-		qid_generate(), &apex_compress);
+		xfrd_udp_probe_new_id(s), &apex_compress);
 	zone->query_id = ID(xfrd->packet);
 	xfrd_prepare_zone_xfr(zone, TYPE_IXFR);
 	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "sent query with ID %d", zone->query_id));
@@ -1995,15 +2326,23 @@ xfrd_send_ixfr_request_udp(xfrd_zone_type* zone)
 	buffer_flip(xfrd->packet);
 	xfrd_set_timer(zone, XFRD_UDP_TIMEOUT);
 
-	if((fd = xfrd_send_udp(zone->master, xfrd->packet,
-		zone->zone_options->pattern->outgoing_interface)) == -1)
-		return -1;
+	/* an ICMP error for an earlier probe on the connected socket is
+	 * returned once, by the next call, and then the send can succeed */
+	if(send(s->handler.ev_fd, buffer_begin(xfrd->packet),
+		buffer_remaining(xfrd->packet), 0) == -1 &&
+		(errno != ECONNREFUSED ||
+		send(s->handler.ev_fd, buffer_begin(xfrd->packet),
+		buffer_remaining(xfrd->packet), 0) == -1)) {
+		log_msg(LOG_ERR, "xfrd: send to %s failed %s",
+			zone->master->ip_address_spec, strerror(errno));
+		return 0;
+	}
 
 	DEBUG(DEBUG_XFRD,1, (LOG_INFO,
 		"xfrd sent udp request for ixfr=%u for zone %s to %s",
 		(unsigned)ntohl(zone->soa_disk.serial),
 		zone->apex_str, zone->master->ip_address_spec));
-	return fd;
+	return 1;
 }
 
 static int xfrd_parse_soa_info(buffer_type* packet, xfrd_soa_type* soa)
@@ -2460,6 +2799,16 @@ xfrd_parse_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet,
 		return xfrd_packet_tcp;
 	}
 
+	if(zone->tcp_conn == -1 && !zone->master->key_options) {
+		/* the probes share the udp port, so without TSIG only the
+		 * query ID protects the data of an answer. Get the data
+		 * over tcp. */
+		DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: udp reply without TSIG "
+			"has data. Try tcp."));
+		region_destroy(tempregion);
+		return xfrd_packet_tcp;
+	}
+
 	if(!xfrd_xfr_check_rrs(zone, packet, ancount_todo, &done, soa,
 		tempregion))
 	{
@@ -2508,6 +2857,7 @@ xfrd_free_zone_xfr(xfrd_zone_type *zone, xfrd_xfr_type *xfr)
 		if(xfr->prev != NULL)
 			xfr->prev->next = xfr->next;
 	}
+	diff_xfrfile_close(&xfr->xfrfile);
 	tsig_delete_record(&xfr->tsig, xfrd->region);
 	region_recycle(xfrd->region, xfr, sizeof(*xfr));
 }
@@ -2515,6 +2865,7 @@ xfrd_free_zone_xfr(xfrd_zone_type *zone, xfrd_xfr_type *xfr)
 void
 xfrd_delete_zone_xfr(xfrd_zone_type *zone, xfrd_xfr_type *xfr)
 {
+	diff_xfrfile_close(&xfr->xfrfile);
 	if(xfr->acquired != 0 || xfr->msg_seq_nr != 0) {
 		xfrd_unlink_xfrfile(xfrd->nsd, xfr->xfrfilenumber);
 	}
@@ -2538,6 +2889,8 @@ xfrd_prepare_zone_xfr(xfrd_zone_type *zone, uint16_t query_type)
 	tsig_create_record_custom(&xfr->tsig, NULL, 0, 0, 4);
 	zone->latest_xfr = xfr;
 	xfr->query_type = query_type;
+	/* the query is sent now */
+	xfrd_stat_refresh_lag(zone);
 
 	return xfr;
 }
@@ -2570,6 +2923,7 @@ xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 			if(zone->latest_xfr->msg_seq_nr > 0) {
 				/* do not process xfr - if only one part simply ignore it. */
 				/* delete file with previous parts of commit */
+				diff_xfrfile_close(&zone->latest_xfr->xfrfile);
 				xfrd_unlink_xfrfile(xfrd->nsd, zone->latest_xfr->xfrfilenumber);
 				VERBOSITY(1, (LOG_INFO, "xfrd: zone %s "
 					"reverted transfer %u from %s",
@@ -2603,7 +2957,7 @@ xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 		zone->latest_xfr->msg_new_serial,
 		zone->latest_xfr->msg_seq_nr,
 		buffer_begin(packet), buffer_limit(packet), xfrd->nsd,
-		zone->latest_xfr->xfrfilenumber);
+		zone->latest_xfr->xfrfilenumber, &zone->latest_xfr->xfrfile);
 
 	if(verbosity < 4 || zone->latest_xfr->msg_seq_nr == 0)
 		; /* pass */
@@ -2620,8 +2974,9 @@ xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 	}
 	zone->latest_xfr->msg_seq_nr++;
 
-	xfrfile_size = xfrd_get_xfrfile_size(
-		xfrd->nsd, zone->latest_xfr->xfrfilenumber);
+	/* the size that is written so far, part of it may still be in
+	 * the write buffer of the file */
+	xfrfile_size = diff_xfrfile_size(&zone->latest_xfr->xfrfile);
 	if( zone->zone_options->pattern->size_limit_xfr != 0 &&
 	    xfrfile_size > zone->zone_options->pattern->size_limit_xfr ) {
             /*	    xfrd_unlink_xfrfile(xfrd->nsd, zone->xfrfilenumber);
@@ -2697,7 +3052,8 @@ xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 	buffer_flip(packet);
 	diff_write_commit(zone->apex_str, zone->latest_xfr->msg_old_serial,
 		zone->latest_xfr->msg_new_serial, zone->latest_xfr->msg_seq_nr, 1,
-		(char*)buffer_begin(packet), xfrd->nsd, zone->latest_xfr->xfrfilenumber);
+		(char*)buffer_begin(packet), xfrd->nsd, zone->latest_xfr->xfrfilenumber,
+		&zone->latest_xfr->xfrfile);
 	VERBOSITY(1, (LOG_INFO, "xfrd: zone %s committed \"%s\"",
 		zone->apex_str, (char*)buffer_begin(packet)));
 	/* now put apply_xfr task on the tasklist if no reload in progress */
@@ -2716,6 +3072,7 @@ xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 	zone->latest_xfr->msg_seq_nr = 0;
 	/* update the disk serial no. */
 	zone->soa_disk_acquired = zone->latest_xfr->acquired = xfrd_time();
+	zone->latest_xfr->committed = xfrd_time_msec();
 	zone->soa_disk = soa;
 	if(zone->soa_notified_acquired && (
 		zone->soa_notified.serial == 0 ||
@@ -2738,17 +3095,17 @@ xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 			zone->apex_str));
 		if(zone->zone_options->pattern->multi_primary_check) {
 			zone->multi_master_update_check = zone->master_num;
-			xfrd_set_reload_timeout();
+			xfrd_reload_for_xfr(zone, xfrfile_size);
 			return xfrd_packet_transfer;
 		}
 		zone->round_num = -1; /* next try start anew */
 		xfrd_set_timer_refresh(zone);
-		xfrd_set_reload_timeout();
+		xfrd_reload_for_xfr(zone, xfrfile_size);
 		return xfrd_packet_transfer;
 	} else {
 		/* try to get an even newer serial */
 		/* pretend it was bad to continue queries */
-		xfrd_set_reload_timeout();
+		xfrd_reload_for_xfr(zone, xfrfile_size);
 		return xfrd_packet_bad;
 	}
 }
@@ -2756,34 +3113,107 @@ xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 static void
 xfrd_set_reload_timeout()
 {
+	/* reload after the xfrd-reload-timeout wait period */
+	xfrd->reload_untargeted = 1;
+	xfrd_schedule_reload();
+}
+
+/* the estimated duration of the reload of the waiting transfers, msec */
+static uint64_t
+xfrd_reload_estimate(void)
+{
+	uint64_t est = xfrd->reload_duration_avg;
+	/* more transfer data than usual takes longer to apply */
+	if(xfrd->reload_bytes_avg != 0 &&
+		xfrd->reload_pending_bytes > xfrd->reload_bytes_avg)
+		est = est * xfrd->reload_pending_bytes / xfrd->reload_bytes_avg;
+	return est;
+}
+
+static void
+xfrd_reload_for_xfr(xfrd_zone_type* zone, uint64_t size)
+{
+	uint64_t deadline, est;
+	uint32_t staleness = zone->zone_options->pattern->reload_max_staleness;
+	xfrd->reload_pending_bytes += size;
+	if(staleness == 0) {
+		xfrd_set_reload_timeout();
+		return;
+	}
+	/* the reload has to start this long before the transfer must be
+	 * served */
+	deadline = zone->latest_xfr->committed + (uint64_t)staleness*1000;
+	est = xfrd_reload_estimate();
+	deadline = (deadline > est ? deadline - est : 1);
+	if(xfrd->reload_deadline == 0 || deadline < xfrd->reload_deadline)
+		xfrd->reload_deadline = deadline;
+	xfrd_schedule_reload();
+}
+
+/* send the reload now, and start the reload wait period */
+static void
+xfrd_reload_start(void)
+{
+	if(xfrd->reload_added) {
+		event_del(&xfrd->reload_handler);
+		xfrd->reload_added = 0;
+	}
+	xfrd_set_reload_now(xfrd);
+	xfrd->reload_timeout.tv_sec = xfrd_time() +
+		xfrd->nsd->options->xfrd_reload_timeout;
+	xfrd->reload_timeout.tv_usec = 0;
+}
+
+/*
+ * Updates without a target are reloaded when the xfrd-reload-timeout wait
+ * period after the previous reload has passed. Transfers with a
+ * reload-max-staleness are reloaded at their deadline. That is sooner than
+ * the wait period if the deadline is sooner, and later if all of the
+ * waiting updates have a deadline, so that the reload applies more of them.
+ */
+static void
+xfrd_schedule_reload(void)
+{
+	uint64_t now, at;
+	struct timeval tv;
 	if(xfrd->nsd->options->xfrd_reload_timeout == -1)
 		return; /* automatic reload disabled. */
-	if(xfrd->reload_timeout.tv_sec == 0 ||
-		xfrd_time() >= (time_t)xfrd->reload_timeout.tv_sec ) {
+	if(!xfrd->reload_untargeted && xfrd->reload_deadline == 0)
+		xfrd->reload_untargeted = 1;
+	now = xfrd_time_msec();
+	if(!xfrd->reload_untargeted) {
+		at = xfrd->reload_deadline;
+	} else {
+		at = now;
+		if(xfrd->reload_timeout.tv_sec != 0 &&
+			(uint64_t)xfrd->reload_timeout.tv_sec*1000 > at)
+			at = (uint64_t)xfrd->reload_timeout.tv_sec*1000;
+		if(xfrd->reload_deadline != 0 && xfrd->reload_deadline < at)
+			at = xfrd->reload_deadline;
+	}
+	if(at <= now) {
 		/* no reload wait period (or it passed), do it right away */
-		xfrd_set_reload_now(xfrd);
-		/* start reload wait period */
-		xfrd->reload_timeout.tv_sec = xfrd_time() +
-			xfrd->nsd->options->xfrd_reload_timeout;
-		xfrd->reload_timeout.tv_usec = 0;
+		xfrd_reload_start();
 		return;
 	}
-	/* cannot reload now, set that after the timeout a reload has to happen */
-	if(xfrd->reload_added == 0) {
-		struct timeval tv;
-		tv.tv_sec = xfrd->reload_timeout.tv_sec - xfrd_time();
-		tv.tv_usec = 0;
-		if(tv.tv_sec > xfrd->nsd->options->xfrd_reload_timeout)
-			tv.tv_sec = xfrd->nsd->options->xfrd_reload_timeout;
-		memset(&xfrd->reload_handler, 0, sizeof(xfrd->reload_handler));
-		event_set(&xfrd->reload_handler, -1, EV_TIMEOUT,
-			xfrd_handle_reload, xfrd);
-		if(event_base_set(xfrd->event_base, &xfrd->reload_handler) != 0)
-			log_msg(LOG_ERR, "cannot set reload event base");
-		if(event_add(&xfrd->reload_handler, &tv) != 0)
-			log_msg(LOG_ERR, "cannot add reload event");
-		xfrd->reload_added = 1;
+	/* cannot reload now, set that at the time a reload has to happen */
+	if(xfrd->reload_added) {
+		if(xfrd->reload_timer_at <= at)
+			return;
+		event_del(&xfrd->reload_handler);
+		xfrd->reload_added = 0;
 	}
+	tv.tv_sec = (at - now)/1000;
+	tv.tv_usec = ((at - now)%1000)*1000;
+	memset(&xfrd->reload_handler, 0, sizeof(xfrd->reload_handler));
+	event_set(&xfrd->reload_handler, -1, EV_TIMEOUT,
+		xfrd_handle_reload, xfrd);
+	if(event_base_set(xfrd->event_base, &xfrd->reload_handler) != 0)
+		log_msg(LOG_ERR, "cannot set reload event base");
+	if(event_add(&xfrd->reload_handler, &tv) != 0)
+		log_msg(LOG_ERR, "cannot add reload event");
+	xfrd->reload_timer_at = at;
+	xfrd->reload_added = 1;
 }
 
 static void
@@ -2794,9 +3224,108 @@ xfrd_handle_reload(int ATTR_UNUSED(fd), short event, void* ATTR_UNUSED(arg))
 	(void)event;
 	/* timeout wait period after this request is sent */
 	xfrd->reload_added = 0;
-	xfrd->reload_timeout.tv_sec = xfrd_time() +
-		xfrd->nsd->options->xfrd_reload_timeout;
-	xfrd_set_reload_now(xfrd);
+	xfrd_reload_start();
+}
+
+void
+xfrd_reload_sent(xfrd_state_type* xfrd)
+{
+	/* the waiting updates are in this reload */
+	xfrd->reload_deadline = 0;
+	xfrd->reload_untargeted = 0;
+	xfrd->reload_sent_bytes = xfrd->reload_pending_bytes;
+	xfrd->reload_pending_bytes = 0;
+	xfrd->reload_sent_msec = xfrd_time_msec();
+}
+
+void
+xfrd_reload_done(xfrd_state_type* xfrd)
+{
+	uint64_t now = xfrd_time_msec(), duration;
+	if(xfrd->reload_sent_msec == 0)
+		return;
+	duration = (now > xfrd->reload_sent_msec ?
+		now - xfrd->reload_sent_msec : 0);
+	xfrd->reload_sent_msec = 0;
+	xfrd->reload_count++;
+	/* the estimate is for reloads that apply transfers */
+	if(xfrd->reload_sent_bytes == 0)
+		return;
+	if(xfrd->reload_bytes_avg == 0) {
+		xfrd->reload_duration_avg = duration;
+		xfrd->reload_bytes_avg = xfrd->reload_sent_bytes;
+	} else {
+		xfrd->reload_duration_avg = (xfrd->reload_duration_avg*3 +
+			duration)/4;
+		xfrd->reload_bytes_avg = (xfrd->reload_bytes_avg*3 +
+			xfrd->reload_sent_bytes)/4;
+	}
+}
+
+static void
+xfrd_stat_refresh_lag(xfrd_zone_type* zone)
+{
+	time_t lag;
+	int i;
+	if(zone->request_due == 0)
+		return;
+	lag = (xfrd_time() > zone->request_due ?
+		xfrd_time() - zone->request_due : 0);
+	zone->request_due = 0;
+	for(i=0; i<XFRD_REFRESH_LAG_BUCKETS-1; i++) {
+		if(lag < ((time_t)1<<i))
+			break;
+	}
+	xfrd->refresh_lag[i]++;
+	xfrd->refresh_lag_sum += (uint64_t)lag;
+}
+
+/*
+ * A restart, or the first start, with many zones makes all of them due
+ * for a refresh at once. Their probes are spread over a period of time,
+ * with XFRD_REFRESH_SPREAD zones per second, in random order, so that
+ * the primaries do not get a storm of queries. Zones that are notified
+ * are refreshed now.
+ */
+static void
+xfrd_spread_activated(void)
+{
+	xfrd_zone_type* zone, *next;
+	size_t num = 0;
+	time_t period;
+	for(zone = xfrd->activated_first; zone; zone = zone->activated_next) {
+		if(!zone->soa_notified_acquired)
+			num++;
+	}
+	if(num <= XFRD_REFRESH_SPREAD)
+		return;
+	period = (time_t)(num / XFRD_REFRESH_SPREAD) + 1;
+	for(zone = xfrd->activated_first; zone; zone = next) {
+		next = zone->activated_next;
+		if(zone->soa_notified_acquired)
+			continue;
+		xfrd_deactivate_zone(zone);
+		xfrd_set_timer(zone, random_generate(period));
+	}
+	VERBOSITY(1, (LOG_INFO, "xfrd: refresh of %u zones is spread over "
+		"%d seconds", (unsigned)num, (int)period));
+}
+
+static void
+xfrd_stat_staleness(xfrd_xfr_type* xfr)
+{
+	uint64_t now, msec;
+	int i;
+	if(xfr->committed == 0)
+		return;
+	now = xfrd_time_msec();
+	msec = (now > xfr->committed ? now - xfr->committed : 0);
+	for(i=0; i<XFRD_STALENESS_BUCKETS-1; i++) {
+		if(msec < ((uint64_t)1<<i))
+			break;
+	}
+	xfrd->staleness[i]++;
+	xfrd->staleness_sum += msec;
 }
 
 void
@@ -3033,7 +3562,9 @@ xfrd_prepare_zones_for_reload(void)
 					xfr->xfrfilenumber);
 				if(send && !reload) {
 					reload = 1;
-					xfrd_set_reload_timeout();
+					/* at the time scheduled when the
+					 * transfers were committed */
+					xfrd_schedule_reload();
 				}
 			}
 			xfr->sent = send ? 1 + xfrd->nsd->mytask : 0;
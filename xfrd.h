@@ -26,6 +26,7 @@
 #include "options.h"
 #include "dns.h"
 #include "tsig.h"
+#include "difffile.h"
 
 struct nsd;
 struct region;
@@ -38,6 +39,16 @@ typedef struct xfrd_state xfrd_state_type;
 typedef struct xfrd_xfr xfrd_xfr_type;
 typedef struct xfrd_zone xfrd_zone_type;
 typedef struct xfrd_soa xfrd_soa_type;
+
+/* Buckets of the histogram of the time from a transfer to serving it,
+ * bucket i counts the transfers that took less than 2^i msec, the last
+ * bucket the ones that took longer. */
+#define XFRD_STALENESS_BUCKETS 20
+/* Buckets of the histogram of the refresh lag, the time from when a zone
+ * is due for a refresh or retry to when its query is sent, bucket i
+ * counts the queries that waited less than 2^i seconds. */
+#define XFRD_REFRESH_LAG_BUCKETS 18
+
 /*
  * The global state for the xfrd daemon process.
  * The time_t times are epochs in secs since 1970, absolute times.
@@ -52,10 +63,20 @@ struct xfrd_state {
 	struct xfrd_tcp_set* tcp_set;
 	/* packet buffer for udp packets */
 	struct buffer* packet;
-	/* udp waiting list, double linked list */
-	struct xfrd_zone *udp_waiting_first, *udp_waiting_last;
+	/* tree of primaries, by address, contains struct xfrd_primary* */
+	rbtree_type *primaries;
+	/* list of primaries with zones that wait for a udp socket */
+	struct xfrd_primary *udp_ready_first, *udp_ready_last;
 	/* number of udp sockets (for sending queries) in use */
 	size_t udp_use_num;
+	/* list of udp socket structures that are not in use */
+	struct xfrd_udp_sock* udp_sock_free;
+	/* histogram of the refresh lag, in seconds */
+	uint64_t refresh_lag[XFRD_REFRESH_LAG_BUCKETS], refresh_lag_sum;
+	/* number of tcp connections opened to primaries, of transfers that
+	 * used an idle connection that was kept open, and of those the ones
+	 * that avoided a TLS handshake */
+	uint64_t tcp_opened, tcp_reused, tls_reused;
 	/* activated waiting list, double linked list */
 	struct xfrd_zone *activated_first;
 
@@ -74,6 +95,8 @@ struct xfrd_state {
 	struct nsdst** zonestat_clear;
 	/* array of child_count size with cumulative cleared stat values */
 	struct nsdst* stat_clear;
+	/* cumulative cleared answer stat values, of all server processes */
+	struct nsdst_resp* stat_resp_clear;
 
 	/* timer for NSD reload */
 	struct timeval reload_timeout;
@@ -85,6 +108,26 @@ struct xfrd_state {
 	uint8_t reload_failed;
 	uint8_t can_send_reload;
 	pid_t reload_pid;
+	/* the reload scheduler. The time, in msec, that the reload must be
+	 * sent to serve the waiting transfers within their
+	 * reload-max-staleness, 0 if none, and if updates without such a
+	 * target wait, that are reloaded after xfrd-reload-timeout */
+	uint64_t reload_deadline;
+	uint8_t reload_untargeted;
+	/* the time the reload_handler fires, in msec */
+	uint64_t reload_timer_at;
+	/* size of the transfers that wait for a reload, and of the
+	 * transfers in the reload that runs */
+	uint64_t reload_pending_bytes, reload_sent_bytes;
+	/* the time the running reload was sent, in msec */
+	uint64_t reload_sent_msec;
+	/* moving averages of the duration of the reloads, in msec, and
+	 * the size of their transfers */
+	uint64_t reload_duration_avg, reload_bytes_avg;
+	/* number of reloads, and histogram of the time from receiving a
+	 * transfer to serving it, in msec */
+	uint64_t reload_count;
+	uint64_t staleness[XFRD_STALENESS_BUCKETS], staleness_sum;
 	/* timeout for lost sigchild and reaping children */
 	struct event child_timer;
 	int child_timer_added;
@@ -128,6 +171,56 @@ struct xfrd_state {
 	rbtree_type *catalog_producer_zones;
 };
 
+/*
+ * A primary that zones are transferred from, by the address of the
+ * request-xfr and the outgoing-interface, with the zones that wait for
+ * their turn to be probed.
+ */
+struct xfrd_primary {
+	rbnode_type node; /* key is name */
+	/* the ip_address_spec, and the outgoing-interfaces after it */
+	char* name;
+	/* number of udp probes in progress to the primary */
+	int udp_num;
+	/* the socket that new probes are sent on, or NULL */
+	struct xfrd_udp_sock* udp_sock;
+	/* zones waiting to probe the primary, double linked list */
+	xfrd_zone_type *udp_waiting_first, *udp_waiting_last;
+	/* in the list of primaries that wait for a udp socket */
+	uint8_t udp_ready;
+	struct xfrd_primary* udp_ready_next;
+};
+
+/*
+ * A udp probe, the IXFR query of a zone, in progress on a socket.
+ */
+struct xfrd_udp_probe {
+	/* rbtree node as first member, this is the key */
+	rbnode_type node;
+	/* the query ID */
+	uint16_t id;
+	xfrd_zone_type* zone;
+};
+
+/*
+ * A udp socket to a primary, that the probes of many zones share. It is
+ * connected to the primary. The answers are matched to the zones by the
+ * query ID and the question.
+ */
+struct xfrd_udp_sock {
+	struct xfrd_primary* primary;
+	/* the outgoing-interface that the socket is bound to */
+	struct acl_options* ifc;
+	/* the read event for the answers */
+	struct event handler;
+	/* the probes in progress, by query ID, of struct xfrd_udp_probe */
+	rbtree_type* probes;
+	/* number of queries that were sent on the socket */
+	int queries;
+	/* next in the free list */
+	struct xfrd_udp_sock* next;
+};
+
 /*
  * XFR daemon SOA information kept in network format.
  * This is in packet order.
@@ -189,11 +282,16 @@ struct xfrd_zone {
 	struct zone_options* zone_options;
 	int fresh_xfr_timeout;
 
-	/* handler for timeouts */
+	/* handler for timeouts. During a udp probe it has the fd of the
+	 * socket, but only for the timeout, the socket reads the answers */
 	struct timeval timeout;
 	struct event zone_handler;
 	int zone_handler_flags;
 	int event_added;
+	/* the time the timer is due, and the time that the request that is
+	 * made became due, for the refresh lag, or 0 */
+	time_t timer_due;
+	time_t request_due;
 
 	/* tcp connection zone is using, or -1 */
 	int tcp_conn;
@@ -209,9 +307,14 @@ struct xfrd_zone {
 	xfrd_zone_type* tcp_send_prev;
 	/* zone is waiting for a udp connection (tcp is preferred) */
 	uint8_t udp_waiting;
-	/* next zone in waiting list for UDP */
+	/* next zone in waiting list for UDP of the primary */
 	xfrd_zone_type* udp_waiting_next;
 	xfrd_zone_type* udp_waiting_prev;
+	/* the primary that the zone waits for or probes over udp */
+	struct xfrd_primary* udp_primary;
+	/* the socket of the probe in progress, and the probe */
+	struct xfrd_udp_sock* udp_sock;
+	struct xfrd_udp_probe udp_probe;
 	/* zone has been activated to run now (after the other events
 	 * but before blocking in select again) */
 	uint8_t is_activated;
@@ -243,6 +346,8 @@ struct xfrd_xfr {
 	tsig_record_type tsig; /* tsig state for IXFR/AXFR */
 	uint64_t xfrfilenumber; /* identifier for file to store xfr into,
 	                           valid if msg_seq_nr nonzero */
+	struct diff_xfrfile xfrfile; /* the file while the xfr is received */
+	uint64_t committed; /* time the xfr was committed, in msec */
 };
 
 enum xfrd_packet_result {
@@ -267,6 +372,8 @@ enum xfrd_packet_result {
    connections. Each entry has 64Kb buffer preallocated.
 */
 #define XFRD_MAX_UDP 128 /* max number of UDP sockets at a time for IXFR */
+#define XFRD_REFRESH_SPREAD 1000 /* zones per second refreshed at start */
+#define XFRD_UDP_SOCK_QUERIES 32 /* queries per UDP socket, then new port */
 #define XFRD_MAX_UDP_NOTIFY 128 /* max concurrent UDP sockets for NOTIFY */
 
 #define XFRD_TRANSFER_TIMEOUT_START 10 /* empty zone timeout is between x and 2*x seconds */
@@ -376,6 +483,9 @@ void xfrd_disable_ixfr(xfrd_zone_type* zone);
 /* get the current time epoch. Cached for speed. */
 time_t xfrd_time(void);
 
+/* get the current time in msec, not cached */
+uint64_t xfrd_time_msec(void);
+
 /*
  * Handle final received packet from network.
  * returns enum of packet discovery results
@@ -472,6 +582,10 @@ void xfrd_process_task_result(xfrd_state_type* xfrd, struct udb_base* taskudb);
 
 /* set to reload right away (for user controlled reload events) */
 void xfrd_set_reload_now(xfrd_state_type* xfrd);
+/* the reload is sent, with the updates that wait for it */
+void xfrd_reload_sent(xfrd_state_type* xfrd);
+/* the reload is done, for the estimate of the reload duration */
+void xfrd_reload_done(xfrd_state_type* xfrd);
 
 /* send expiry notifications to nsd */
 void xfrd_send_expire_notification(xfrd_zone_type* zone);